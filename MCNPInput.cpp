@@ -101,6 +101,23 @@ static std::vector<double> makeTransformArgs( const token_list_t tokens ){
   return args;
 }
 
+/**
+ * The Transform given by the args of a transform.  Each distinct list of args is parsed
+ * once for the life of the program, so that a batch of decks sharing their transforms
+ * (see mcnp2cad --batch) does not parse them again for every deck.
+ */
+static const Transform& parsedTransform( const std::vector<double>& args, bool degree_format ){
+  typedef std::map< std::pair< std::vector<double>, bool >, Transform > transform_map;
+  static transform_map parsed;
+
+  std::pair< std::vector<double>, bool > key( args, degree_format );
+  transform_map::iterator i = parsed.find( key );
+  if( i == parsed.end() ){
+    i = parsed.insert( std::make_pair( key, Transform( args, degree_format ) ) ).first;
+  }
+  return (*i).second;
+}
+
 /**
  * Attempt to create a Transform object using the given numbers. Bounding parentheses are allowed
  * and will be removed.
@@ -114,7 +131,7 @@ static DataRef<Transform>* parseTransform( InputDeck& deck, const token_list_t t
     return new CardRef<Transform>( deck, DataCard::TR, static_cast<int>(args[0]) );
   }
   else{
-    return new ImmediateRef<Transform>( Transform( args, degree_format ) );
+    return new ImmediateRef<Transform>( parsedTransform( args, degree_format ) );
   }
 }
 
@@ -970,7 +987,7 @@ public:
 };
 
 TransformCard::TransformCard( InputDeck& deck, int ident_p, bool degree_format, const token_list_t& input ):
-  DataCard(deck), ident(ident_p), trans( Transform( makeTransformArgs( input ), degree_format ) )
+  DataCard(deck), ident(ident_p), trans( parsedTransform( makeTransformArgs( input ), degree_format ) )
 {}
 
 void TransformCard::print( std::ostream& str ){
@@ -0,0 +1,435 @@
+#include "analyze.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "MCNPInput.hpp"
+#include "geometry.hpp"
+#include "volumes.hpp"
+#include "options.hpp"
+
+DeckAnalysis::DeckAnalysis( InputDeck& deck_p, double world_size_p ) :
+  deck( deck_p ), world_size( world_size_p ), universe_depth( 0 ), depth( 0 ), bodies( 0 )
+{}
+
+/** The work of GeometryContext::createGeometry(), up to imprinting */
+void DeckAnalysis::analyze(){
+
+  // as in GeometryContext::createGraveyard()
+  BoundBox boundary;
+  if( Gopt.make_graveyard ){
+    double inner_size = 2.0 * world_size;
+    BoundBox inner = kernel.createBrick( inner_size, inner_size, inner_size );
+    boundary = kernel.copyEnt( inner );
+    double outer_size = 2.0 * ( world_size + (world_size / 50.0) );
+    BoundBox outer = kernel.createBrick( outer_size, outer_size, outer_size );
+    kernel.subtractEnts( outer, inner );
+    world_size *= sqrt(3.0);
+  }
+
+  std::vector<BoundBox> built;
+  defineUniverse( 0, built, Gopt.make_graveyard ? &boundary : NULL, NULL );
+  bodies = built.size() + ( Gopt.make_graveyard ? 1 : 0 );
+}
+
+bool DeckAnalysis::intersectIfPossible( const BoundBox& a, const BoundBox& b, BoundBox& result ){
+  if( kernel.intersectEnts( a, b, result ) ){
+    return true;
+  }
+  kernel.deleteEnt( a );
+  kernel.deleteEnt( b );
+  return false;
+}
+
+bool DeckAnalysis::boundBoxesIntersect( const BoundBox& a, const BoundBox& b ){
+  const BoundBox& a_box = kernel.getEntBoundBox( a );
+  const BoundBox& b_box = kernel.getEntBoundBox( b );
+  for( int i = 0; i < 3; ++i ){
+    if( a_box.min[i] > b_box.max[i] || b_box.min[i] > a_box.max[i] ) return false;
+  }
+  return true;
+}
+
+/** The work of GeometryContext::defineLatticeNode() */
+bool DeckAnalysis::defineLatticeNode( const CellCard& cell, const BoundBox& cell_shell, const BoundBox& lattice_shell,
+                                      const LatticeNodeTable& nodes, size_t n, std::vector<BoundBox>& accum ){
+
+  if( !nodes.in_bounds[n] ) return false;
+  if( nodes.universe[n] == 0 ) return true;
+
+  LatticeUse& use = lattices[ cell.getIdent() ];
+  use.built++;
+
+  Transform t = nodes.getTx( n );
+  size_t begin = accum.size();
+  if( nodes.universe[n] == cell.getUniverse() ){
+    BoundBox cell_copy = kernel.copyEnt( cell_shell );
+    applyTransform( t, kernel, cell_copy );
+    accum.push_back( cell_copy );
+  }
+  else{
+    const FillNode* fn = nodes.fill[n];
+    BoundBox cell_copy_unmoved = kernel.copyEnt( cell_shell );
+    defineUniverse( nodes.universe[n], accum, &cell_copy_unmoved, fn->hasTransform() ? &(fn->getTransform()) : NULL );
+    for( size_t i = begin; i < accum.size(); ++i ){
+      applyTransform( t, kernel, accum[i] );
+    }
+  }
+
+  bool success = false;
+  size_t kept = begin;
+  for( size_t i = begin; i < accum.size(); ++i ){
+    BoundBox lattice_shell_copy = kernel.copyEnt( lattice_shell );
+    BoundBox result;
+    if( intersectIfPossible( lattice_shell_copy, accum[i], result ) ){
+      accum[kept++] = result;
+      success = true;
+    }
+  }
+  accum.resize( kept );
+
+  if( success ) use.kept++;
+  return success;
+}
+
+// number of lattice nodes whose table entries are computed at a time
+static const size_t lattice_chunk_size = 4096;
+
+/** The work of GeometryContext::populateCell() */
+void DeckAnalysis::populateCell( const CellCard& cell, std::vector<BoundBox>& out, const BoundBox& cell_shell,
+                                 const BoundBox* lattice_shell ){
+
+  if( !cell.hasFill() && !cell.isLattice() ){
+    out.push_back( cell_shell );
+    return;
+  }
+  else if( cell.hasFill() && !cell.isLattice() ){
+    // the contained universe is transformed by the FillNode's transform, if any, or
+    // else by the cell's TRCL value, if any.
+    const FillNode& n = cell.getFill().getOriginNode();
+    const Transform* t = NULL;
+    if( n.hasTransform() ){
+      t = &(n.getTransform());
+    } else if( cell.getTrcl().hasData() ){
+      t = &(cell.getTrcl().getData() );
+    }
+    defineUniverse( n.getFillingUniverse(), out, &cell_shell, t );
+    return;
+  }
+
+  LatticeUse& use = lattices[ cell.getIdent() ];
+  use.placements++;
+
+  const Lattice& lattice = cell.getLattice();
+  const BoundBox& shell_box = kernel.getEntBoundBox( cell_shell );
+  const BoundBox& lattice_box = kernel.getEntBoundBox( *lattice_shell );
+  Vector3d shell_min( shell_box.min ), shell_max( shell_box.max );
+  Vector3d lattice_min( lattice_box.min ), lattice_max( lattice_box.max );
+
+  LatticeNodeTable nodes;
+  if( lattice.isFixedSize() ){
+    size_t num_nodes = lattice.numNodes();
+    for( size_t begin = 0; begin < num_nodes; begin += lattice_chunk_size ){
+      nodes.clear();
+      lattice.addNodes( nodes, begin, std::min( begin + lattice_chunk_size, num_nodes ) );
+      lattice.computeNodeTable( nodes, shell_min, shell_max, lattice_min, lattice_max );
+      use.nodes += nodes.size();
+      for( size_t n = 0; n < nodes.size(); ++n ){
+        defineLatticeNode( cell, cell_shell, *lattice_shell, nodes, n, out );
+      }
+    }
+  }
+  else{
+    // rings of nodes are added until one ring has no success, and with extra effort,
+    // not before the first success
+    bool done = false, done_one = !Gopt.infinite_lattice_extra_effort;
+    int radius = 0;
+    while( !done ){
+      done = done_one;
+      nodes.clear();
+      lattice.addShellOfRadius( nodes, radius++ );
+      lattice.computeNodeTable( nodes, shell_min, shell_max, lattice_min, lattice_max );
+      use.nodes += nodes.size();
+      for( size_t n = 0; n < nodes.size(); ++n ){
+        if( defineLatticeNode( cell, cell_shell, *lattice_shell, nodes, n, out ) ){
+          done = false;
+          done_one = true;
+        }
+      }
+    }
+  }
+
+  // both shells are discarded once the lattice is built
+  kernel.deleteEnt( cell_shell );
+  kernel.deleteEnt( *lattice_shell );
+}
+
+/** The work of GeometryContext::defineCell() */
+void DeckAnalysis::defineCell( const CellCard& cell, std::vector<BoundBox>& out, bool define_embedded,
+                               const BoundBox* lattice_shell ){
+
+  int ident = cell.getIdent();
+  if( cells_in_progress.count( ident ) ){
+    std::stringstream msg;
+    msg << "Cell " << ident << " complements itself";
+    throw std::runtime_error( msg.str() );
+  }
+  cells_in_progress.insert( ident );
+  used_cells.insert( ident );
+
+  const CellCard::geom_list_t& geom = cell.getGeom();
+  std::vector<BoundBox> stack;
+  for( CellCard::geom_list_t::const_iterator i = geom.begin(); i != geom.end(); ++i ){
+    const CellCard::geom_list_entry_t& token = (*i);
+    switch( token.first ){
+    case CellCard::CELLNUM:
+      defineCell( *(deck.lookup_cell_card( token.second )), stack, false, NULL );
+      break;
+    case CellCard::SURFNUM:
+      {
+        int surface = std::abs( token.second );
+        used_surfaces.insert( surface );
+        try{
+          SurfaceVolume& surf = makeSurface( deck.lookup_surface_card( surface ) );
+          stack.push_back( surf.define( token.second > 0, kernel, world_size ) );
+        }
+        catch( std::runtime_error& e ){
+          std::cerr << e.what() << std::endl;
+          std::stringstream msg;
+          msg << "Cell " << ident << " cannot be defined without surface " << surface;
+          throw std::runtime_error( msg.str() );
+        }
+      }
+      break;
+    case CellCard::MBODYFACET:
+      throw std::runtime_error( "Macrobody facets are not yet supported by mcnp2cad." );
+    case CellCard::INTERSECT:
+      {
+        BoundBox s1 = stack.back(); stack.pop_back();
+        BoundBox s2 = stack.back(); stack.pop_back();
+        BoundBox result;
+        if( !intersectIfPossible( s1, s2, result ) ){
+          std::stringstream msg;
+          msg << "Intersection failed in cell " << ident;
+          throw std::runtime_error( msg.str() );
+        }
+        stack.push_back( result );
+      }
+      break;
+    case CellCard::UNION:
+      {
+        BoundBox s0 = stack.back(); stack.pop_back();
+        BoundBox s1 = stack.back(); stack.pop_back();
+        stack.push_back( kernel.uniteEnts( s0, s1 ) );
+      }
+      break;
+    case CellCard::COMPLEMENT:
+      {
+        BoundBox world_sphere = makeWorldSphere( kernel, world_size );
+        BoundBox s = stack.back(); stack.pop_back();
+        stack.push_back( kernel.subtractEnts( world_sphere, s ) );
+      }
+      break;
+    default:
+      throw std::runtime_error( "Unexpected token while evaluating cell geometry" );
+    }
+  }
+
+  if( cell.getTrcl().hasData() ){
+    applyTransform( cell.getTrcl().getData(), kernel, stack[0] );
+  }
+  cells_in_progress.erase( ident );
+
+  if( define_embedded ){
+    populateCell( cell, out, stack[0], lattice_shell );
+  }
+  else{
+    out.push_back( stack[0] );
+  }
+}
+
+/** The work of GeometryContext::defineUniverse() */
+void DeckAnalysis::defineUniverse( int universe, std::vector<BoundBox>& out, const BoundBox* container,
+                                   const Transform* transform ){
+
+  if( universes_in_progress.count( universe ) ){
+    std::stringstream msg;
+    msg << "Universe " << universe << " is filled with itself";
+    throw std::runtime_error( msg.str() );
+  }
+  universes_in_progress.insert( universe );
+  used_universes.insert( universe );
+  depth = std::max( depth, ++universe_depth );
+
+  InputDeck::cell_card_list u_cells = deck.getCellsOfUniverse( universe );
+  size_t begin = out.size();
+
+  BoundBox lattice_shell;
+  bool lattice = u_cells.size() == 1 && u_cells[0]->isLattice();
+  if( lattice ){
+    if( !container ){
+      std::stringstream msg;
+      msg << "Lattice cell " << u_cells[0]->getIdent() << " has no container";
+      throw std::runtime_error( msg.str() );
+    }
+    // reverse-transform the containing volume before using it as a lattice boundary
+    lattice_shell = *container;
+    if( transform ){
+      applyReverseTransform( *transform, kernel, lattice_shell );
+    }
+  }
+
+  for( InputDeck::cell_card_list::iterator i = u_cells.begin(); i != u_cells.end(); ++i ){
+    if( (*i)->isLattice() && !lattice ){
+      std::stringstream msg;
+      msg << "Lattice cell " << (*i)->getIdent() << " is not alone in universe " << universe;
+      throw std::runtime_error( msg.str() );
+    }
+    defineCell( *(*i), out, true, lattice ? &lattice_shell : NULL );
+  }
+
+  if( transform ){
+    for( size_t i = begin; i < out.size(); ++i ){
+      applyTransform( *transform, kernel, out[i] );
+    }
+  }
+
+  if( container && !lattice ){
+    size_t kept = begin;
+    for( size_t i = begin; i < out.size(); ++i ){
+      if( boundBoxesIntersect( out[i], *container ) ){
+        BoundBox container_copy = kernel.copyEnt( *container );
+        BoundBox bounded;
+        if( intersectIfPossible( container_copy, out[i], bounded ) ){
+          out[kept++] = bounded;
+        }
+      }
+      else{
+        kernel.deleteEnt( out[i] );
+      }
+    }
+    out.resize( kept );
+    kernel.deleteEnt( *container );
+  }
+
+  universe_depth--;
+  universes_in_progress.erase( universe );
+}
+
+namespace {
+
+/** A duration in the largest units that suit it */
+std::string formatDuration( double seconds ){
+  std::stringstream str;
+  long long s = static_cast<long long>( seconds + 0.5 );
+  if( seconds < 60 ){
+    str << std::fixed << std::setprecision(1) << seconds << " s";
+  }
+  else if( s < 3600 ){
+    str << s / 60 << "m " << std::setw(2) << std::setfill('0') << s % 60 << "s";
+  }
+  else if( s < 86400 ){
+    str << s / 3600 << "h " << std::setw(2) << std::setfill('0') << ( s / 60 ) % 60 << "m";
+  }
+  else{
+    str << s / 86400 << "d " << ( s / 3600 ) % 24 << "h";
+  }
+  return str.str();
+}
+
+void reportOps( std::ostream& out, const std::string& label, const std::string& kind, double count,
+                const std::map<std::string,double>& calibration, double& seconds ){
+  std::map<std::string,double>::const_iterator found = calibration.find( kind );
+  double each = ( found == calibration.end() ) ? 0 : (*found).second;
+  out << "  " << std::setw(28) << std::left << label << std::right
+      << std::setw(14) << std::fixed << std::setprecision(0) << count
+      << "  x " << std::setw(8) << std::setprecision(4) << each << " s = "
+      << formatDuration( count * each ) << std::endl;
+  seconds += count * each;
+}
+
+} // namespace
+
+void DeckAnalysis::report( std::ostream& out, const std::map<std::string,double>& calibration ) const {
+
+  out << "Cells: " << deck.getCells().size() << " in the deck, " << used_cells.size() << " in the model" << std::endl;
+  out << "Surfaces: " << deck.getSurfaces().size() << " in the deck, " << used_surfaces.size()
+      << " distinct surfaces used" << std::endl;
+  out << "Universes: " << used_universes.size() << " in the model, nested " << depth << " deep" << std::endl;
+
+  if( lattices.size() ){
+    out << "Lattices, with the nodes that reach their containers and that survive being bounded:" << std::endl;
+    out << "  " << std::setw(8) << "cell" << std::setw(10) << "universe" << std::setw(12) << "placements"
+        << std::setw(14) << "nodes" << std::setw(14) << "built" << std::setw(14) << "kept" << std::endl;
+    for( std::map< int, LatticeUse >::const_iterator i = lattices.begin(); i != lattices.end(); ++i ){
+      const LatticeUse& use = (*i).second;
+      out << "  " << std::setw(8) << (*i).first << std::setw(10) << deck.lookup_cell_card( (*i).first )->getUniverse()
+          << std::fixed << std::setprecision(0) << std::setw(12) << use.placements
+          << std::setw(14) << use.nodes << std::setw(14) << use.built << std::setw(14) << use.kept << std::endl;
+    }
+  }
+
+  double seconds = 0;
+  out << "Predicted CAD kernel operations:" << std::endl;
+  const BoxKernel::call_map_t& calls = kernel.getCalls();
+  for( BoxKernel::call_map_t::const_iterator i = calls.begin(); i != calls.end(); ++i ){
+    reportOps( out, (*i).first, (*i).first, (*i).second, calibration, seconds );
+  }
+  if( Gopt.imprint_geom ){
+    reportOps( out, "imprinted bodies", "imprint", bodies, calibration, seconds );
+  }
+  out << "Bodies in the model: " << std::fixed << std::setprecision(0) << bodies << std::endl;
+  out << "Estimated conversion time: " << formatDuration( seconds ) << std::endl;
+  out << std::setprecision(6);
+  out.unsetf( std::ios::fixed );
+}
+
+bool readCalibration( const std::string& filename, std::map<std::string,double>& calibration ){
+
+  calibration.clear();
+  calibration[ "createBrick" ] = 0.005;
+  calibration[ "createCone" ] = 0.005;
+  calibration[ "createCylinder" ] = 0.005;
+  calibration[ "createSphere" ] = 0.005;
+  calibration[ "createTorus" ] = 0.005;
+  calibration[ "sectionEnt" ] = 0.01;
+  calibration[ "intersectEnts" ] = 0.05;
+  calibration[ "uniteEnts" ] = 0.05;
+  calibration[ "subtractEnts" ] = 0.05;
+  calibration[ "copyEnt" ] = 0.002;
+  calibration[ "deleteEnt" ] = 0.001;
+  calibration[ "getEntBoundBox" ] = 0.0001;
+  calibration[ "moveEnt" ] = 0.001;
+  calibration[ "rotateEnt" ] = 0.001;
+  calibration[ "reflectEnt" ] = 0.001;
+  calibration[ "scaleEnt" ] = 0.001;
+  calibration[ "imprint" ] = 0.05;
+  if( filename.empty() ) return true;
+
+  std::ifstream in( filename.c_str() );
+  if( !in ){
+    std::cerr << "Error: couldn't open calibration file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while( std::getline( in, line ) ){
+    line = line.substr( 0, line.find( '#' ) );
+    std::stringstream fields( line );
+    std::string kind;
+    double seconds;
+    if( !( fields >> kind ) ) continue;
+    if( !( fields >> seconds ) || !calibration.count( kind ) ){
+      std::cerr << "Warning: ignoring calibration line \"" << line << "\"" << std::endl;
+      continue;
+    }
+    calibration[ kind ] = seconds;
+  }
+  return true;
+}
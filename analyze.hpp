@@ -0,0 +1,87 @@
+#ifndef MCNP2CAD_ANALYZE_H
+#define MCNP2CAD_ANALYZE_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "boxkernel.hpp"
+
+class InputDeck;
+class CellCard;
+class Transform;
+class LatticeNodeTable;
+
+/**
+ * A dry run of a conversion: universe 0 is defined as GeometryContext::createGeometry()
+ * defines it, through the same sequence of kernel operations, but on a BoxKernel that
+ * keeps each body as its bounding box.  Lattice nodes are culled, intersections fail and
+ * infinite lattices stop growing just as they do in mcnp2cad-stub, whose call counts the
+ * analysis reproduces exactly (see check_analysis.sh).  A real kernel's bodies are no
+ * larger than their boxes, so it may drop bodies that the boxes keep; the counts are an
+ * upper bound.
+ *
+ * The methods below are named for the GeometryContext methods they replay, and must be
+ * kept in step with them.  The replay is for a conversion without -j, --shards or
+ * --cache-dir.
+ */
+class DeckAnalysis{
+
+public:
+  /// the placements of a lattice cell, and the nodes considered, built and kept over all of them
+  struct LatticeUse{
+    double placements, nodes, built, kept;
+    LatticeUse() : placements(0), nodes(0), built(0), kept(0) {}
+  };
+
+protected:
+  InputDeck& deck;
+  double world_size;
+  BoxKernel kernel;
+
+  std::set< int > cells_in_progress, universes_in_progress;
+  std::set< int > used_cells, used_surfaces, used_universes;
+  std::map< int, LatticeUse > lattices;
+  int universe_depth, depth;
+  double bodies;
+
+  bool intersectIfPossible( const BoundBox& a, const BoundBox& b, BoundBox& result );
+  bool boundBoxesIntersect( const BoundBox& a, const BoundBox& b );
+
+  bool defineLatticeNode( const CellCard& cell, const BoundBox& cell_shell, const BoundBox& lattice_shell,
+                          const LatticeNodeTable& nodes, size_t n, std::vector<BoundBox>& accum );
+  void populateCell( const CellCard& cell, std::vector<BoundBox>& out, const BoundBox& cell_shell,
+                     const BoundBox* lattice_shell );
+  void defineCell( const CellCard& cell, std::vector<BoundBox>& out, bool define_embedded,
+                   const BoundBox* lattice_shell );
+  void defineUniverse( int universe, std::vector<BoundBox>& out, const BoundBox* container,
+                       const Transform* transform );
+
+public:
+  DeckAnalysis( InputDeck& deck_p, double world_size_p );
+
+  /// replay the definition of universe 0; throws std::runtime_error where the conversion would fail
+  void analyze();
+
+  /// the predicted calls to each iGeom function
+  const BoxKernel::call_map_t& getCalls() const { return kernel.getCalls(); }
+
+  /**
+   * Print the deck's size and structure, the predicted kernel operations and the time
+   * they should take, given the seconds per operation of each kind in calibration.
+   */
+  void report( std::ostream& out, const std::map<std::string,double>& calibration ) const;
+
+};
+
+/**
+ * Seconds per kernel operation, by the name of its iGeom function as counted by
+ * DeckAnalysis, and per body of the finished model for "imprint".  The defaults are rough
+ * figures for an ACIS-based CGM; a file of `kind seconds' lines overrides any of them.
+ * Returns false if the file could not be read.
+ */
+bool readCalibration( const std::string& filename, std::map<std::string,double>& calibration );
+
+#endif /* MCNP2CAD_ANALYZE_H */
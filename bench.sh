@@ -0,0 +1,82 @@
+#!/bin/sh
+#
+# Time mcnp2cad on synthetic decks written by mcnpgen, over a sweep of sizes.  Each deck
+# is read with --parse-only, run through the whole front end with mcnp2cad-stub (every
+# step but the CAD kernel), and fully converted if mcnp2cad has been built against CGM.
+#
+# Settings, from the environment:
+#   SIZES      sizes to sweep; a deck's cell count grows with the square of its size
+#              for lattices and linearly for the other kinds.  Default: "4 8 16 32"
+#   DEPTHS     nesting depths of the nested lattice decks, of 3x3 lattices.  Default: "1 2 3"
+#   NODES      node counts of the lattice-nodes decks, square lattices made as nearly
+#              square as each count allows.  Default: "10000 100000 1000000"
+#   KINDS      kinds of deck, as named by mcnpgen, or lattice-nodes.  Default: all of
+#              mcnpgen's kinds
+#   BENCH_OUT  CSV file to append the results to.  Default: bench.csv
+#   MCNP2CAD   full converter.  Default: ./mcnp2cad, skipped if it is not built
+#
+# Each result line is: kind,size,mode,seconds,status  with mode one of parse, frontend
+# or full, and status the converter's exit code; the size of a nested deck is its depth,
+# and that of a lattice-nodes deck its number of nodes.
+# Wall times come from date +%s.%N.
+
+SIZES=${SIZES:-"4 8 16 32"}
+DEPTHS=${DEPTHS:-"1 2 3"}
+NODES=${NODES:-"10000 100000 1000000"}
+KINDS=${KINDS:-"lattice hexlattice nested planes complements transforms data"}
+BENCH_OUT=${BENCH_OUT:-bench.csv}
+MCNP2CAD=${MCNP2CAD:-./mcnp2cad}
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-bench.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+[ -f "$BENCH_OUT" ] || echo "kind,size,mode,seconds,status" > "$BENCH_OUT"
+
+# time_run KIND SIZE MODE COMMAND...
+time_run(){
+  kind=$1; size=$2; mode=$3; shift 3
+  start=$(date +%s.%N)
+  "$@" > "$scratch/log" 2>&1
+  status=$?
+  end=$(date +%s.%N)
+  seconds=$(echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }')
+  echo "$kind,$size,$mode,$seconds,$status" >> "$BENCH_OUT"
+  printf "%-13s %7s %-9s %9s s%s\n" "$kind" "$size" "$mode" "$seconds" \
+         "$( [ $status -eq 0 ] || echo "  (failed, exit code $status)" )"
+}
+
+# bench_deck KIND SIZE MCNPGEN_ARGS...
+bench_deck(){
+  kind=$1; size=$2; shift 2
+  deck="$scratch/$kind-$size.inp"
+  # lattice-nodes decks are mcnpgen's square lattices
+  gen_kind=$kind
+  [ $kind = lattice-nodes ] && gen_kind=lattice
+  ./mcnpgen "$@" -o "$deck" $gen_kind || exit 1
+  time_run "$kind" "$size" parse ./mcnp2cad-stub --parse-only "$deck"
+  time_run "$kind" "$size" frontend ./mcnp2cad-stub -o "$scratch/out" "$deck"
+  if [ -x "$MCNP2CAD" ]; then
+    time_run "$kind" "$size" full "$MCNP2CAD" -o "$scratch/out.sat" "$deck"
+  fi
+}
+
+for kind in $KINDS; do
+  case $kind in
+    nested)
+      for depth in $DEPTHS; do bench_deck $kind $depth -n 3 --depth $depth; done ;;
+    lattice-nodes)
+      for nodes in $NODES; do
+        # the widest side no longer than the other that divides the count exactly
+        width=$(echo $nodes | awk '{ for( w = int( sqrt( $1 ) ); $1 % w; --w ); print w }')
+        bench_deck $kind $nodes -n $width -m $((nodes / width))
+      done ;;
+    planes|complements|transforms)
+      for size in $SIZES; do bench_deck $kind $size -n $((size * 4)) --planes 8; done ;;
+    data)
+      for size in $SIZES; do bench_deck $kind $size -n $((size * 8)) -m 40; done ;;
+    *)
+      for size in $SIZES; do bench_deck $kind $size -n $size; done ;;
+  esac
+done
+
+echo "Results appended to $BENCH_OUT"
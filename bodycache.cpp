@@ -0,0 +1,189 @@
+#include "bodycache.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "MCNPInput.hpp"
+#include "geometry.hpp"
+#include "checkpoint.hpp"
+
+namespace {
+
+/** Copy a file; returns false if it could not be read or written */
+bool copyFile( const std::string& from, const std::string& to ){
+  std::ifstream in( from.c_str(), std::ios::in | std::ios::binary );
+  std::ofstream out( to.c_str(), std::ios::out | std::ios::binary );
+  if( !in || !out ) return false;
+  out << in.rdbuf();
+  return out.good();
+}
+
+} // namespace
+
+BodyCache::BodyCache( InputDeck& deck_p, const std::string& dir_p, double world_size,
+                      const std::string& extension_p ) :
+  deck(deck_p), dir(dir_p), extension(extension_p)
+{
+  std::stringstream str;
+  str.precision( 17 );
+  str << world_size << " " << geometryOptions();
+  context = str.str();
+}
+
+std::string BodyCache::universeKey( int universe ){
+
+  std::map< int, std::string >::iterator known = universe_keys.find( universe );
+  if( known != universe_keys.end() ) return (*known).second;
+
+  // a universe that contains itself is invalid anyway; it is keyed by its number alone
+  if( universes_in_progress.count( universe ) ){
+    std::stringstream str;
+    str << "u" << universe;
+    return str.str();
+  }
+  universes_in_progress.insert( universe );
+
+  std::stringstream str;
+  str << "universe " << universe << " " << context << "\n";
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  for( size_t i = 0; i < cells.size(); ++i ){
+    str << cellKey( cells[i]->getIdent() ) << "\n";
+  }
+
+  universes_in_progress.erase( universe );
+  std::string description = str.str();
+  std::string key = hashString( hashBytes( description.c_str(), description.length() ) );
+  universe_keys[ universe ] = key;
+  return key;
+}
+
+std::string BodyCache::cellKey( int ident ){
+
+  std::map< int, std::string >::iterator known = cell_keys.find( ident );
+  if( known != cell_keys.end() ) return (*known).second;
+
+  if( cells_in_progress.count( ident ) ){
+    std::stringstream str;
+    str << "c" << ident;
+    return str.str();
+  }
+  cells_in_progress.insert( ident );
+
+  std::stringstream str;
+  str.precision( 17 );
+  describeCell( *deck.lookup_cell_card( ident ), str );
+
+  cells_in_progress.erase( ident );
+  std::string description = str.str();
+  std::string key = hashString( hashBytes( description.c_str(), description.length() ) );
+  cell_keys[ ident ] = key;
+  return key;
+}
+
+void BodyCache::describeCell( const CellCard& cell, std::ostream& str ){
+
+  str << "cell " << cell.getIdent() << " u " << cell.getUniverse()
+      << " mat " << cell.getMat() << " " << cell.getRho() << " imp";
+  const std::map<char,double>& imps = cell.getImportances();
+  for( std::map<char,double>::const_iterator i = imps.begin(); i != imps.end(); ++i ){
+    str << " " << (*i).first << "=" << (*i).second;
+  }
+  str << "\n";
+
+  const CellCard::geom_list_t geom = cell.getGeom();
+  for( CellCard::geom_list_t::const_iterator i = geom.begin(); i != geom.end(); ++i ){
+    str << (*i).first << " " << (*i).second;
+    if( (*i).first == CellCard::SURFNUM || (*i).first == CellCard::MBODYFACET ){
+      int ident = std::abs( (*i).second );
+      if( (*i).first == CellCard::MBODYFACET ) ident /= 10;
+      const SurfaceCard& surface = *deck.lookup_surface_card( ident );
+      str << " " << surface.getMnemonic();
+      const std::vector<double>& args = surface.getArgs();
+      for( size_t j = 0; j < args.size(); ++j ){
+        str << " " << args[j];
+      }
+      if( surface.getTransform().hasData() ){
+        str << " " << surface.getTransform().getData();
+      }
+    }
+    else if( (*i).first == CellCard::CELLNUM ){
+      str << " " << cellKey( std::abs( (*i).second ) );
+    }
+    str << "\n";
+  }
+
+  if( cell.getTrcl().hasData() ){
+    str << "trcl " << cell.getTrcl().getData() << "\n";
+  }
+
+  if( cell.isLattice() ){
+    str << "lat " << cell.getLatticeType() << "\n";
+    describeLattice( cell.getLattice(), str );
+  }
+  else if( cell.hasFill() ){
+    str << "fill ";
+    describeFillNode( cell.getFill().getOriginNode(), str );
+  }
+}
+
+void BodyCache::describeFillNode( const FillNode& node, std::ostream& str ){
+  str << node.getFillingUniverse() << " " << universeKey( node.getFillingUniverse() );
+  if( node.hasTransform() ){
+    str << " " << node.getTransform();
+  }
+  str << "\n";
+}
+
+void BodyCache::describeLattice( const Lattice& lattice, std::ostream& str ){
+
+  // the offsets of the unit nodes give the lattice's pitch and orientation
+  str << lattice.numFiniteDirections() << " " << lattice.getTxForNode( 1, 0, 0 ) << " "
+      << lattice.getTxForNode( 0, 1, 0 ) << " " << lattice.getTxForNode( 0, 0, 1 ) << "\n";
+
+  if( !lattice.isFixedSize() ){
+    describeFillNode( lattice.getFillForNode( 0, 0, 0 ), str );
+    return;
+  }
+
+  irange xr = lattice.getXRange(), yr = lattice.getYRange(), zr = lattice.getZRange();
+  str << xr.first << ":" << xr.second << " " << yr.first << ":" << yr.second << " "
+      << zr.first << ":" << zr.second << "\n";
+  for( int x = xr.first; x <= xr.second; ++x ){
+    for( int y = yr.first; y <= yr.second; ++y ){
+      for( int z = zr.first; z <= zr.second; ++z ){
+        describeFillNode( lattice.getFillForNode( x, y, z ), str );
+      }
+    }
+  }
+}
+
+std::string BodyCache::cachedFile( int universe ){
+  std::stringstream str;
+  str << dir << "/u" << universe << "-" << universeKey( universe ) << extension;
+  return str.str();
+}
+
+std::string BodyCache::lookup( int universe ){
+  std::string filename = cachedFile( universe );
+  bool cached = access( filename.c_str(), R_OK ) == 0 && access( ( filename + ".meta" ).c_str(), R_OK ) == 0;
+  return cached ? filename : "";
+}
+
+bool BodyCache::store( int universe, const std::string& filename ){
+
+  // the metadata is moved into place last, so that a half-copied entry is never found
+  std::string cached = cachedFile( universe );
+  std::string temp_meta = cached + ".meta.new";
+  bool copied = copyFile( filename, cached ) && copyFile( filename + ".meta", temp_meta ) &&
+                rename( temp_meta.c_str(), ( cached + ".meta" ).c_str() ) == 0;
+  if( !copied ){
+    std::cerr << "Warning: could not store universe " << universe << " in the body cache " << dir << std::endl;
+    unlink( temp_meta.c_str() );
+  }
+  return copied;
+}
@@ -0,0 +1,59 @@
+#ifndef MCNP2CAD_BODYCACHE_H
+#define MCNP2CAD_BODYCACHE_H
+
+#include <string>
+#include <iosfwd>
+#include <map>
+#include <set>
+
+class InputDeck;
+class CellCard;
+class Transform;
+class Lattice;
+class FillNode;
+
+/**
+ * An on-disk cache of prebuilt universes, so that a deck that changes a few cells at a
+ * time need not rebuild the universes those changes do not touch.
+ *
+ * Each universe is keyed by a hash of everything its bodies and their metadata depend
+ * on: the geometry, transform, material and importances of each of its cells, the
+ * surfaces they refer to, the cells they complement, and recursively the universes that
+ * fill them or the nodes of their lattices, along with the world size and
+ * geometryOptions().  The cached files are those exported by the workers that prebuild
+ * universes, named by universe and key; nothing is ever removed from the cache.
+ */
+class BodyCache{
+
+protected:
+  InputDeck& deck;
+  std::string dir;
+  std::string extension; // of the exported files
+  std::string context;   // the world size and options, common to every key
+
+  std::map< int, std::string > universe_keys;
+  std::map< int, std::string > cell_keys;
+  std::set< int > universes_in_progress, cells_in_progress;
+
+  std::string cellKey( int ident );
+  void describeCell( const CellCard& cell, std::ostream& str );
+  void describeFillNode( const FillNode& node, std::ostream& str );
+  void describeLattice( const Lattice& lattice, std::ostream& str );
+
+  std::string cachedFile( int universe );
+
+public:
+  BodyCache( InputDeck& deck_p, const std::string& dir_p, double world_size, const std::string& extension_p );
+
+  /// the hash of a universe's dependency closure
+  std::string universeKey( int universe );
+
+  /// the cached file of a universe, or an empty string if it has not been cached
+  std::string lookup( int universe );
+
+  /// copy a universe exported to filename, and its metadata, into the cache
+  bool store( int universe, const std::string& filename );
+
+};
+
+#endif /* MCNP2CAD_BODYCACHE_H */
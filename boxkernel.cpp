@@ -0,0 +1,203 @@
+#include "boxkernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+BoundBox emptyBox(){
+  BoundBox b;
+  for( int i = 0; i < 3; ++i ){ b.min[i] = HUGE_VAL; b.max[i] = -HUGE_VAL; }
+  return b;
+}
+
+BoundBox centeredBox( double dx, double dy, double dz ){
+  BoundBox b;
+  double d[3] = { dx, dy, dz };
+  for( int i = 0; i < 3; ++i ){ b.min[i] = -d[i]/2.0; b.max[i] = d[i]/2.0; }
+  return b;
+}
+
+void growBox( BoundBox& b, const BoundBox& other ){
+  for( int i = 0; i < 3; ++i ){
+    b.min[i] = std::min( b.min[i], other.min[i] );
+    b.max[i] = std::max( b.max[i], other.max[i] );
+  }
+}
+
+BoundBox sphereBox( double radius ){
+  return centeredBox( 2*radius, 2*radius, 2*radius );
+}
+
+BoundBox cylinderBox( double height, double major_rad, double minor_rad ){
+  double r = std::max( major_rad, minor_rad );
+  return centeredBox( 2*r, 2*r, height );
+}
+
+BoundBox coneBox( double height, double major_rad_base, double minor_rad_base, double rad_top ){
+  double r = std::max( major_rad_base, std::max( minor_rad_base, rad_top ) );
+  return centeredBox( 2*r, 2*r, height );
+}
+
+BoundBox torusBox( double major_rad, double minor_rad ){
+  double r = major_rad + minor_rad;
+  return centeredBox( 2*r, 2*r, 2*minor_rad );
+}
+
+void mapBox( BoundBox& b, const double m[9], const double offset[3] ){
+  BoundBox mapped = emptyBox();
+  for( int c = 0; c < 8; ++c ){
+    double p[3] = { (c&1) ? b.max[0] : b.min[0],
+                    (c&2) ? b.max[1] : b.min[1],
+                    (c&4) ? b.max[2] : b.min[2] };
+    for( int i = 0; i < 3; ++i ){
+      double q = m[3*i]*p[0] + m[3*i+1]*p[1] + m[3*i+2]*p[2] + offset[i];
+      mapped.min[i] = std::min( mapped.min[i], q );
+      mapped.max[i] = std::max( mapped.max[i], q );
+    }
+  }
+  b = mapped;
+}
+
+void moveBox( BoundBox& b, double x, double y, double z ){
+  double d[3] = { x, y, z };
+  for( int i = 0; i < 3; ++i ){ b.min[i] += d[i]; b.max[i] += d[i]; }
+}
+
+void rotateBox( BoundBox& b, double angle, double ax, double ay, double az ){
+  double len = sqrt( ax*ax + ay*ay + az*az );
+  if( len == 0 ) return;
+  ax /= len; ay /= len; az /= len;
+  double t = angle * M_PI / 180.0, c = cos(t), s = sin(t), k = 1.0 - c;
+  double m[9] = { c + ax*ax*k,    ax*ay*k - az*s, ax*az*k + ay*s,
+                  ay*ax*k + az*s, c + ay*ay*k,    ay*az*k - ax*s,
+                  az*ax*k - ay*s, az*ay*k + ax*s, c + az*az*k };
+  double zero[3] = {0, 0, 0};
+  mapBox( b, m, zero );
+}
+
+void reflectBox( BoundBox& b, double px, double py, double pz, double nx, double ny, double nz ){
+  double len = sqrt( nx*nx + ny*ny + nz*nz );
+  if( len == 0 ) return;
+  double n[3] = { nx/len, ny/len, nz/len }, p[3] = {px, py, pz};
+  double m[9], offset[3];
+  for( int i = 0; i < 3; ++i ){
+    for( int j = 0; j < 3; ++j ){
+      m[3*i+j] = ( i == j ? 1.0 : 0.0 ) - 2.0 * n[i] * n[j];
+    }
+  }
+  double pn = p[0]*n[0] + p[1]*n[1] + p[2]*n[2];
+  for( int i = 0; i < 3; ++i ){ offset[i] = 2.0 * pn * n[i]; }
+  mapBox( b, m, offset );
+}
+
+void scaleBox( BoundBox& b, double px, double py, double pz, double sx, double sy, double sz ){
+  double m[9] = { sx, 0, 0,  0, sy, 0,  0, 0, sz };
+  double offset[3] = { px - sx*px, py - sy*py, pz - sz*pz };
+  mapBox( b, m, offset );
+}
+
+void sectionBox( BoundBox& b, double nx, double ny, double nz, double offset, bool reverse ){
+  double n[3] = { nx, ny, nz };
+  for( int i = 0; i < 3; ++i ){
+    if( n[i] != 0 && n[(i+1)%3] == 0 && n[(i+2)%3] == 0 ){
+      double d = offset / n[i];
+      bool keep_above = ( n[i] > 0 ) != reverse;
+      if( keep_above ) b.min[i] = std::max( b.min[i], d );
+      else             b.max[i] = std::min( b.max[i], d );
+    }
+  }
+}
+
+bool intersectBoxes( const BoundBox& a, const BoundBox& b, BoundBox& result ){
+  BoundBox overlap;
+  for( int i = 0; i < 3; ++i ){
+    overlap.min[i] = std::max( a.min[i], b.min[i] );
+    overlap.max[i] = std::min( a.max[i], b.max[i] );
+    if( overlap.min[i] >= overlap.max[i] ) return false;
+  }
+  result = overlap;
+  return true;
+}
+
+BoundBox BoxKernel::createSphere( double radius ){
+  count( "createSphere" );
+  return sphereBox( radius );
+}
+
+BoundBox BoxKernel::createBrick( double x, double y, double z ){
+  count( "createBrick" );
+  return centeredBox( x, y, z );
+}
+
+BoundBox BoxKernel::createCylinder( double height, double major_rad, double minor_rad ){
+  count( "createCylinder" );
+  return cylinderBox( height, major_rad, minor_rad );
+}
+
+BoundBox BoxKernel::createCone( double height, double major_rad_base, double minor_rad_base, double rad_top ){
+  count( "createCone" );
+  return coneBox( height, major_rad_base, minor_rad_base, rad_top );
+}
+
+BoundBox BoxKernel::createTorus( double major_rad, double minor_rad ){
+  count( "createTorus" );
+  return torusBox( major_rad, minor_rad );
+}
+
+BoundBox BoxKernel::copyEnt( const BoundBox& b ){
+  count( "copyEnt" );
+  return b;
+}
+
+void BoxKernel::deleteEnt( const BoundBox& ){
+  count( "deleteEnt" );
+}
+
+const BoundBox& BoxKernel::getEntBoundBox( const BoundBox& b ){
+  count( "getEntBoundBox" );
+  return b;
+}
+
+void BoxKernel::moveEnt( BoundBox& b, double x, double y, double z ){
+  count( "moveEnt" );
+  moveBox( b, x, y, z );
+}
+
+void BoxKernel::rotateEnt( BoundBox& b, double angle, double ax, double ay, double az ){
+  count( "rotateEnt" );
+  rotateBox( b, angle, ax, ay, az );
+}
+
+void BoxKernel::reflectEnt( BoundBox& b, double px, double py, double pz, double nx, double ny, double nz ){
+  count( "reflectEnt" );
+  reflectBox( b, px, py, pz, nx, ny, nz );
+}
+
+void BoxKernel::scaleEnt( BoundBox& b, double px, double py, double pz, double sx, double sy, double sz ){
+  count( "scaleEnt" );
+  scaleBox( b, px, py, pz, sx, sy, sz );
+}
+
+BoundBox BoxKernel::sectionEnt( const BoundBox& b, double nx, double ny, double nz, double offset, bool reverse ){
+  count( "sectionEnt" );
+  BoundBox kept = b;
+  sectionBox( kept, nx, ny, nz, offset, reverse );
+  return kept;
+}
+
+BoundBox BoxKernel::uniteEnts( const BoundBox& a, const BoundBox& b ){
+  count( "uniteEnts" );
+  BoundBox united = emptyBox();
+  growBox( united, a );
+  growBox( united, b );
+  return united;
+}
+
+BoundBox BoxKernel::subtractEnts( const BoundBox& blank, const BoundBox& ){
+  count( "subtractEnts" );
+  return blank;
+}
+
+bool BoxKernel::intersectEnts( const BoundBox& a, const BoundBox& b, BoundBox& result ){
+  count( "intersectEnts" );
+  return intersectBoxes( a, b, result );
+}
@@ -0,0 +1,94 @@
+#ifndef MCNP2CAD_BOXKERNEL_H
+#define MCNP2CAD_BOXKERNEL_H
+
+#include <string>
+#include <map>
+
+/**
+ * Bodies known only by their axis-aligned bounding boxes.  The functions below give the
+ * box of the body that each iGeom operation makes: the stub iGeom in stub/ keeps its
+ * bodies with them, and BoxKernel applies them for --analyze, so the two always agree.
+ * Every box holds the body a real kernel would make, so an intersection of boxes that
+ * is empty means the real intersection fails too, but not the other way around.
+ */
+struct BoundBox{
+  double min[3], max[3];
+};
+
+/// an empty box, ready to be grown with growBox()
+BoundBox emptyBox();
+/// a box of the given size, centered on the origin
+BoundBox centeredBox( double dx, double dy, double dz );
+/// grow a box to hold another
+void growBox( BoundBox& b, const BoundBox& other );
+
+/// the boxes of the primitives, with the arguments of iGeom_createSphere() and its kin
+BoundBox sphereBox( double radius );
+BoundBox cylinderBox( double height, double major_rad, double minor_rad );
+BoundBox coneBox( double height, double major_rad_base, double minor_rad_base, double rad_top );
+BoundBox torusBox( double major_rad, double minor_rad );
+
+/// apply an affine map (3x3 matrix m, then offset) to the corners of a box and re-box it
+void mapBox( BoundBox& b, const double m[9], const double offset[3] );
+
+/// the transforms, with the arguments of iGeom_moveEnt() and its kin
+void moveBox( BoundBox& b, double x, double y, double z );
+void rotateBox( BoundBox& b, double angle, double ax, double ay, double az );
+void reflectBox( BoundBox& b, double px, double py, double pz, double nx, double ny, double nz );
+void scaleBox( BoundBox& b, double px, double py, double pz, double sx, double sy, double sz );
+
+/**
+ * Keep the half-space n.x > offset of a box, or n.x < offset if reversed, as
+ * iGeom_sectionEnt() does; only planes normal to an axis can tighten the box.
+ */
+void sectionBox( BoundBox& b, double nx, double ny, double nz, double offset, bool reverse );
+
+/**
+ * The intersection of two boxes; returns false, as a kernel fails an empty
+ * intersection, if they do not overlap with a positive volume.
+ */
+bool intersectBoxes( const BoundBox& a, const BoundBox& b, BoundBox& result );
+
+/**
+ * A kernel that makes nothing but boxes, counting each operation by the name of its iGeom
+ * function.  Its methods take the arguments of those functions, so code that replays a
+ * sequence of iGeom calls on it reads like the original.
+ */
+class BoxKernel{
+
+public:
+  typedef std::map< std::string, double > call_map_t;
+
+protected:
+  call_map_t calls;
+
+  void count( const char* op ){ calls[op] += 1; }
+
+public:
+  BoundBox createSphere( double radius );
+  BoundBox createBrick( double x, double y, double z );
+  BoundBox createCylinder( double height, double major_rad, double minor_rad );
+  BoundBox createCone( double height, double major_rad_base, double minor_rad_base, double rad_top );
+  BoundBox createTorus( double major_rad, double minor_rad );
+
+  BoundBox copyEnt( const BoundBox& b );
+  void deleteEnt( const BoundBox& b );
+  const BoundBox& getEntBoundBox( const BoundBox& b );
+
+  void moveEnt( BoundBox& b, double x, double y, double z );
+  void rotateEnt( BoundBox& b, double angle, double ax, double ay, double az );
+  void reflectEnt( BoundBox& b, double px, double py, double pz, double nx, double ny, double nz );
+  void scaleEnt( BoundBox& b, double px, double py, double pz, double sx, double sy, double sz );
+
+  BoundBox sectionEnt( const BoundBox& b, double nx, double ny, double nz, double offset, bool reverse );
+  BoundBox uniteEnts( const BoundBox& a, const BoundBox& b );
+  BoundBox subtractEnts( const BoundBox& blank, const BoundBox& tool );
+  /// returns false if the intersection is empty, leaving result alone
+  bool intersectEnts( const BoundBox& a, const BoundBox& b, BoundBox& result );
+
+  /// the number of calls made to each function
+  const call_map_t& getCalls() const { return calls; }
+
+};
+
+#endif /* MCNP2CAD_BOXKERNEL_H */
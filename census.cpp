@@ -0,0 +1,197 @@
+#include "census.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace {
+
+/** An open cell */
+struct Frame{
+  int ident;
+  std::string path;
+  int live_at_entry;
+  int consumed;
+  int nested_excess; // bodies left behind by the cells nested in this one
+};
+
+/** The bodies left behind by every occurrence of one cell */
+struct Leak{
+  int bodies;
+  long occurrences;
+  std::string first_path;
+
+  Leak() : bodies(0), occurrences(0) {}
+};
+
+struct Census{
+  bool enabled;
+  iGeom_Instance igm;
+  std::ofstream samples;
+
+  std::vector< Frame > stack;
+  std::map< int, Leak > leaks;
+  long num_samples;
+  int peak_live;
+  long peak_rss;
+  std::string peak_live_path, peak_rss_path;
+
+  Census() : enabled(false), igm(NULL), num_samples(0), peak_live(0), peak_rss(0) {}
+
+  void sample( const Frame& f, int live ){
+    long rss = residentSetSize();
+    num_samples++;
+    if( live > peak_live ){
+      peak_live = live;
+      peak_live_path = f.path;
+    }
+    if( rss > peak_rss ){
+      peak_rss = rss;
+      peak_rss_path = f.path;
+    }
+    if( samples.is_open() ){
+      samples << f.ident << "," << f.path << "," << live << "," << rss / 1024 << "\n";
+    }
+  }
+};
+
+Census census;
+
+} // namespace
+
+bool startCensus( iGeom_Instance igm, const std::string& sample_file ){
+  if( census.samples.is_open() ){
+    census.samples.close();
+  }
+  census.samples.clear();
+  census.stack.clear();
+  census.leaks.clear();
+  census.num_samples = 0;
+  census.peak_live = 0;
+  census.peak_rss = 0;
+  census.peak_live_path = census.peak_rss_path = "";
+
+  census.enabled = true;
+  census.igm = igm;
+  if( sample_file.length() ){
+    census.samples.open( sample_file.c_str() );
+    if( !census.samples.is_open() ){
+      std::cerr << "Error: couldn't open file \"" << sample_file << "\"" << std::endl;
+      return false;
+    }
+    census.samples << "cell,path,live_bodies,rss_kb\n";
+  }
+  return true;
+}
+
+bool censusEnabled(){
+  return census.enabled;
+}
+
+int countLiveBodies( iGeom_Instance igm ){
+  int igm_result;
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  if( igm_result != iBase_SUCCESS ) return -1;
+
+  int num_regions;
+  iGeom_getNumOfType( igm, rootset, iBase_REGION, &num_regions, &igm_result );
+  if( igm_result != iBase_SUCCESS ) return -1;
+  return num_regions;
+}
+
+long residentSetSize(){
+  // the second field of statm is the number of resident pages
+  std::ifstream statm( "/proc/self/statm" );
+  long pages_total = 0, pages_resident = 0;
+  if( !( statm >> pages_total >> pages_resident ) ) return 0;
+  return pages_resident * sysconf( _SC_PAGESIZE );
+}
+
+CensusScope::CensusScope( int ident, const std::string& parent_path, int consumed ) :
+  active( census.enabled )
+{
+  if( !active ) return;
+
+  Frame f;
+  f.ident = ident;
+  std::stringstream path;
+  path << parent_path << "/" << ident;
+  f.path = path.str();
+  f.live_at_entry = countLiveBodies( census.igm );
+  f.consumed = consumed;
+  f.nested_excess = 0;
+  census.stack.push_back( f );
+}
+
+CensusScope::~CensusScope(){
+  if( active ){
+    census.stack.pop_back();
+  }
+}
+
+void CensusScope::close( size_t returned ){
+  if( !active ) return;
+  active = false;
+
+  Frame f = census.stack.back();
+  census.stack.pop_back();
+
+  int live = countLiveBodies( census.igm );
+  if( live < 0 || f.live_at_entry < 0 ) return;
+  census.sample( f, live );
+
+  int excess = live - ( f.live_at_entry - f.consumed + static_cast<int>(returned) );
+  int own_excess = excess - f.nested_excess;
+  if( own_excess > 0 ){
+    Leak& leak = census.leaks[ f.ident ];
+    if( leak.occurrences == 0 ) leak.first_path = f.path;
+    leak.bodies += own_excess;
+    leak.occurrences++;
+  }
+  if( census.stack.size() ){
+    census.stack.back().nested_excess += excess;
+  }
+}
+
+bool reportCensus( iGeom_Instance igm, const std::vector<iBase_EntityHandle>& model ){
+  int live = countLiveBodies( igm );
+  if( census.samples.is_open() ){
+    census.samples.close();
+  }
+
+  // cells defined in worker processes are sampled there, and not counted here
+  std::cout << "Census: " << live << " live bodies, " << model.size() << " in the model";
+  if( census.num_samples ){
+    std::cout << "; peak of " << census.peak_live << " after cell " << census.peak_live_path;
+    if( census.peak_rss ){
+      std::cout << ", peak memory " << census.peak_rss / ( 1024 * 1024 ) << " MB after cell "
+                << census.peak_rss_path;
+    }
+    std::cout << " (" << census.num_samples << " samples)";
+  }
+  std::cout << std::endl;
+
+  // the cells that left the most bodies behind come first
+  std::vector< std::pair<int,int> > worst;
+  for( std::map<int,Leak>::iterator i = census.leaks.begin(); i != census.leaks.end(); ++i ){
+    worst.push_back( std::make_pair( -(*i).second.bodies, (*i).first ) );
+  }
+  std::sort( worst.begin(), worst.end() );
+  for( size_t i = 0; i < worst.size(); ++i ){
+    const Leak& leak = census.leaks[ worst[i].second ];
+    std::cerr << "Warning: cell " << worst[i].second << " left " << leak.bodies << " bodies behind in "
+              << leak.occurrences << " of its occurrences, the first at " << leak.first_path << std::endl;
+  }
+
+  bool leaked = live > static_cast<int>( model.size() );
+  if( leaked ){
+    std::cerr << "Warning: " << live - model.size() << " live bodies are not part of the model" << std::endl;
+  }
+  return !leaked && worst.empty();
+}
@@ -0,0 +1,59 @@
+#ifndef MCNP2CAD_CENSUS_H
+#define MCNP2CAD_CENSUS_H
+
+#include <string>
+#include <vector>
+
+#include "iGeom.h"
+
+/**
+ * Optional census of the bodies alive in the CAD kernel.  When it is on, the live
+ * bodies and the process's resident memory are counted as each cell is entered and
+ * left.  A cell whose count grew by more than the bodies it returned, less those it
+ * took ownership of, has left bodies behind; the growth of the cells nested in it is
+ * counted against them rather than against it.
+ *
+ * Each sample may also be written to a CSV file, and reportCensus() compares the bodies
+ * still alive against those of the finished model.
+ */
+
+/**
+ * Turn the census on, forgetting anything counted by an earlier call, as for the previous
+ * deck of a batch; samples are written to sample_file unless it is empty.
+ */
+bool startCensus( iGeom_Instance igm, const std::string& sample_file );
+
+bool censusEnabled();
+
+/// number of bodies (regions) alive in the kernel, or -1 if they could not be counted
+int countLiveBodies( iGeom_Instance igm );
+
+/// resident memory of this process in bytes, or 0 if it is not known
+long residentSetSize();
+
+/**
+ * Counts the bodies left behind by one cell, from construction to close().  A scope
+ * destroyed without being closed, as when an exception is thrown through it, is dropped
+ * without being counted.
+ */
+class CensusScope{
+  bool active;
+public:
+  /**
+   * @param consumed The number of existing bodies that the cell will delete or take
+   *                 over, such as the lattice shell that bounds a lattice
+   */
+  CensusScope( int ident, const std::string& parent_path, int consumed );
+  ~CensusScope();
+
+  /// finish the count, the cell having returned this many bodies
+  void close( size_t returned );
+};
+
+/**
+ * Print the peak body count and memory use, and warn of cells that left bodies behind
+ * and of live bodies that are not part of the model.  Returns false if bodies leaked.
+ */
+bool reportCensus( iGeom_Instance igm, const std::vector<iBase_EntityHandle>& model );
+
+#endif /* MCNP2CAD_CENSUS_H */
@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# For every tests/INP-* deck, compare the calls to each iGeom function that --analyze
+# predicts with the calls that mcnp2cad-stub makes to convert the deck.  The analysis
+# replays the conversion on bounding boxes, as the stub does, so the counts of the
+# functions that build geometry must match exactly; any difference fails the check.
+# Imprinting, tagging and saving are not part of the replay and are not compared.
+# The decks of option_runs below are also converted and analyzed with their options.
+#
+# Settings, from the environment:
+#   STUB       converter to run.  Default: ./mcnp2cad-stub
+
+STUB=${STUB:-./mcnp2cad-stub}
+ops="createBrick createCone createCylinder createSphere createTorus copyEnt deleteEnt getEntBoundBox
+     moveEnt rotateEnt reflectEnt scaleEnt sectionEnt intersectEnts uniteEnts subtractEnts"
+
+# one run per line: deck, label, options
+option_runs="INP-lat-extra e -e"
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-analysis.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+failed=0
+
+# check_run NAME DECK OPTIONS...
+check_run(){
+  name=$1; deck=$2; shift 2
+  counts="$scratch/$name.counts"
+  if ! IGEOM_STUB_COUNTS="$counts" "$STUB" "$@" -o "$scratch/out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+    echo "FAIL $name: conversion failed"
+    failed=1
+    return
+  fi
+  if ! "$STUB" --analyze "$@" "$deck" > "$scratch/analysis" 2>&1 < /dev/null; then
+    echo "FAIL $name: analysis failed"
+    failed=1
+    return
+  fi
+
+  # the operations table of the report has lines of "  function  count  x seconds s = time"
+  awk '/^Predicted CAD kernel operations:/ { table = 1; next }
+       table && /^  / { print $1, $2; next }
+       { table = 0 }' "$scratch/analysis" > "$scratch/predicted"
+
+  changes=$(awk -v name="$name" -v ops="$ops" '
+    FNR == NR { predicted[$1] = $2; next }
+    { actual[$1] = $2 }
+    END { n = split( ops, list, " " )
+          for( i = 1; i <= n; ++i ){
+            op = list[i]
+            if( predicted[op] + 0 != actual[op] + 0 )
+              printf "FAIL %s: %s predicted %d, made %d\n", name, op, predicted[op], actual[op]
+          } }
+  ' "$scratch/predicted" "$counts")
+
+  if [ -n "$changes" ]; then
+    echo "$changes"
+    failed=1
+  fi
+}
+
+for deck in tests/INP-*; do
+  check_run "$(basename "$deck")" "$deck"
+done
+while read deck label options; do
+  check_run "$deck,$label" "tests/$deck" $options
+done <<EOF
+$option_runs
+EOF
+
+if [ $failed -ne 0 ]; then
+  echo "Predicted kernel operations differ from those made"
+else
+  echo "Predicted kernel operations match those made for every deck"
+fi
+exit $failed
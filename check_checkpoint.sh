@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# Check that a conversion killed after writing a checkpoint resumes to the same model.  A
+# planes deck from mcnpgen is converted once without checkpoints, then again with
+# --checkpoint-dir and the stub's booleans slowed down, and that run is killed as soon as
+# its first checkpoint is written.  Running the same command again must resume from the
+# checkpoint, remove it once the output is saved, and build the same bodies in the same
+# groups as the first conversion, as summarized by stub_summary.sh.
+#
+# Settings, from the environment:
+#   STUB       converter to run.  Default: ./mcnp2cad-stub
+#   MCNPGEN    deck generator to run.  Default: ./mcnpgen
+#   CELLS      cells of the deck.  Default: 200
+
+STUB=${STUB:-./mcnp2cad-stub}
+MCNPGEN=${MCNPGEN:-./mcnpgen}
+CELLS=${CELLS:-200}
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-checkpoint.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+deck="$scratch/planes.inp"
+checkpoints="$scratch/checkpoints"
+mkdir "$checkpoints"
+
+failed=0
+fail(){
+  echo "FAIL $1"
+  failed=1
+}
+
+if ! "$MCNPGEN" -n "$CELLS" -o "$deck" planes > "$scratch/log" 2>&1; then
+  fail "could not generate the deck"
+elif ! "$STUB" -o "$scratch/serial.out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+  fail "conversion without checkpoints failed"
+else
+  # each boolean of the interrupted run takes 20 ms, so it is far from done when killed
+  IGEOM_STUB_BOOL_USEC=20000 "$STUB" --checkpoint-dir "$checkpoints" --checkpoint-interval 0 \
+    -o "$scratch/resumed.out" "$deck" > "$scratch/log" 2>&1 < /dev/null &
+  pid=$!
+  waited=0
+  while [ ! -f "$checkpoints/checkpoint" ] && [ ! -f "$scratch/resumed.out" ] && [ $waited -lt 60 ]; do
+    sleep 1
+    waited=$((waited + 1))
+  done
+  kill -KILL $pid 2> /dev/null
+  wait $pid 2> /dev/null
+
+  if [ -f "$scratch/resumed.out" ]; then
+    fail "the conversion finished before writing a checkpoint; raise CELLS"
+  elif [ ! -f "$checkpoints/checkpoint" ]; then
+    fail "no checkpoint was written in $waited seconds"
+  else
+    if ! "$STUB" --checkpoint-dir "$checkpoints" --checkpoint-interval 0 \
+           -o "$scratch/resumed.out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+      fail "resumed conversion failed"
+    elif ! grep -q "^Resuming from checkpoint" "$scratch/log"; then
+      fail "the conversion did not resume from the checkpoint"
+    else
+      [ -f "$checkpoints/checkpoint" ] && fail "the checkpoint was not removed after the output was saved"
+      sh stub_summary.sh "$scratch/serial.out" > "$scratch/serial"
+      sh stub_summary.sh "$scratch/resumed.out" > "$scratch/resumed"
+      if ! diff "$scratch/serial" "$scratch/resumed" > "$scratch/diff"; then
+        fail "the resumed conversion built other bodies or groups:"
+        head -20 "$scratch/diff"
+      fi
+    fi
+  fi
+fi
+
+if [ $failed -ne 0 ]; then
+  echo "A conversion resumed from a checkpoint differs from one run straight through"
+else
+  echo "A conversion resumed from a checkpoint matches one run straight through"
+fi
+exit $failed
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Convert every tests/INP-* deck with mcnp2cad-stub and compare the number of calls to
+# each iGeom function against the golden counts in tests/golden.  Any count higher than
+# its golden value fails the check; lower counts are reported so that the golden files
+# can be brought down with them.  The counts do not depend on timing or on CGM.
+# Some decks are also converted with options that change the geometry, as listed in
+# option_runs below; their counts are kept as tests/golden/<deck>,<label>.counts, and must
+# match exactly, so that an option that stops taking effect fails the check too.
+#
+# Settings, from the environment:
+#   UPDATE=1   rewrite the golden files from this run instead of checking them
+#   STUB       converter to run.  Default: ./mcnp2cad-stub
+
+STUB=${STUB:-./mcnp2cad-stub}
+golden_dir=tests/golden
+
+# one run per line: deck, label, options
+option_runs="INP-lat-extra e -e"
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-counts.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+[ "$UPDATE" = 1 ] && mkdir -p "$golden_dir"
+
+failed=0
+
+# check_run EXACT NAME DECK OPTIONS...
+check_run(){
+  exact=$1; name=$2; deck=$3; shift 3
+  counts="$scratch/$name.counts"
+  if ! IGEOM_STUB_COUNTS="$counts" "$STUB" "$@" -o "$scratch/out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+    echo "FAIL $name: conversion failed"
+    failed=1
+    return
+  fi
+
+  golden="$golden_dir/$name.counts"
+  if [ "$UPDATE" = 1 ]; then
+    cp "$counts" "$golden"
+    return
+  fi
+  if [ ! -f "$golden" ]; then
+    echo "FAIL $name: no golden counts; run with UPDATE=1 to create them"
+    failed=1
+    return
+  fi
+
+  # print one line per operation whose count changed, starting with FAIL for increases,
+  # and for any change of an exact run
+  changes=$(awk -v name="$name" -v exact=$exact '
+    FNR == NR { golden[$1] = $2; next }
+    { seen[$1] = 1
+      if( $2 > golden[$1] ) printf "FAIL %s: %s %d, was %d\n", name, $1, $2, golden[$1]
+      else if( $2 < golden[$1] ) printf "%s %s: %s %d, was %d\n", exact ? "FAIL" : "    ", name, $1, $2, golden[$1] }
+    END { for( op in golden ) if( !( op in seen ) ) printf "%s %s: %s 0, was %d\n", exact ? "FAIL" : "    ", name, op, golden[op] }
+  ' "$golden" "$counts")
+
+  if [ -n "$changes" ]; then
+    echo "$changes"
+    echo "$changes" | grep -q "^FAIL" && failed=1
+  fi
+}
+
+for deck in tests/INP-*; do
+  check_run 0 "$(basename "$deck")" "$deck"
+done
+while read deck label options; do
+  check_run 1 "$deck,$label" "tests/$deck" $options
+done <<EOF
+$option_runs
+EOF
+
+if [ "$UPDATE" = 1 ]; then
+  echo "Golden counts written to $golden_dir"
+elif [ $failed -ne 0 ]; then
+  echo "Kernel operation counts increased or conversions failed"
+else
+  echo "Kernel operation counts are no higher than the golden counts"
+fi
+exit $failed
@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# Mesh every tests/INP-* deck with mcnp2mesh and check that every object of the OBJ file
+# it writes is closed: each edge must be used by exactly two of the object's triangles,
+# which traverse it in opposite directions.  The OBJ files are read back on their own, so
+# this also checks what mcnp2mesh writes, not only its own count of open meshes.
+#
+# Settings, from the environment:
+#   MESHER     mesher to run.  Default: ./mcnp2mesh
+#   JOBS       worker processes for each deck.  Default: 1
+
+MESHER=${MESHER:-./mcnp2mesh}
+JOBS=${JOBS:-1}
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-meshes.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+failed=0
+for deck in tests/INP-*; do
+  name=$(basename "$deck")
+  obj="$scratch/$name.obj"
+  if ! "$MESHER" -j "$JOBS" -o "$obj" "$deck" > "$scratch/log" 2>&1; then
+    echo "FAIL $name: meshing failed"
+    grep "Warning: the mesh" "$scratch/log"
+    failed=1
+    continue
+  fi
+
+  # face indices are relative to the end of each object's own vertex list
+  changes=$(awk -v name="$name" '
+    function check(){
+      if( object == "" ) return
+      for( e in uses ){
+        split( e, v, SUBSEP )
+        if( uses[e] != 1 || !( ( v[2], v[1] ) in uses ) ){
+          printf "FAIL %s: object %s%s is not closed\n", name, object, ( label == "" ? "" : " of cell " label )
+          break
+        }
+      }
+      delete uses
+    }
+    /^# cell / { cell = $3 }
+    /^o / { check(); object = $2; label = cell; cell = ""; nv = 0 }
+    /^v / { ++nv }
+    /^f / { for( i = 2; i <= 4; ++i ) f[i] = nv + $i
+            uses[f[2], f[3]]++; uses[f[3], f[4]]++; uses[f[4], f[2]]++ }
+    END { check() }
+  ' "$obj")
+
+  if [ -n "$changes" ]; then
+    echo "$changes"
+    failed=1
+  fi
+done
+
+if [ $failed -ne 0 ]; then
+  echo "Meshing failed or left objects open"
+else
+  echo "Every object of every deck's mesh is closed"
+fi
+exit $failed
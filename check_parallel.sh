@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Check that the options which split a conversion up, or reuse earlier work, build the
+# same model as a serial conversion.  Each deck is converted with mcnp2cad-stub serially,
+# with and without -e, and then with each of the options of option_runs below, with
+# --cache-dir into an empty cache and again from the cache it filled, and with --retag of
+# its serial output; finally all the decks are converted together with --batch.  Every
+# output must have the same bodies, with the same names and in the same groups, as the
+# serial one, as summarized by stub_summary.sh; --shards implies -e, so its output is
+# compared with the serial one made with -e.
+#
+# Settings, from the environment:
+#   STUB       converter to run.  Default: ./mcnp2cad-stub
+#   DECKS      decks to convert.  Default: a few tests/INP-* decks with universes,
+#              lattices and transforms.  Decks with rotated fills, such as INP-lat3, are
+#              left out: the stub keeps a rotated body as its bounding box, which depends
+#              on whether a shard cut the body before or after it was rotated.
+
+STUB=${STUB:-./mcnp2cad-stub}
+DECKS=${DECKS:-"tests/INP-simple2 tests/INP-fill1 tests/INP-fill3 tests/INP-lat5 tests/INP-lat-extra
+                tests/INP-hexlat2 tests/INP-transform3"}
+
+# one run per line: label, serial run to match (plain or e), options
+option_runs="j plain -j 3
+shards e --shards 3
+imprint-shards plain --imprint-shards 3"
+
+scratch=$(mktemp -d "${TMPDIR:-/tmp}/mcnp2cad-parallel.XXXXXX") || exit 1
+trap 'rm -rf "$scratch"' EXIT
+
+failed=0
+
+# compare NAME LABEL SERIAL: compare the output of run LABEL of deck NAME with its serial
+# output, plain or made with -e
+compare(){
+  sh stub_summary.sh "$scratch/$1,$2.out" > "$scratch/summary"
+  if ! diff "$scratch/$1,$3.serial" "$scratch/summary" > "$scratch/diff"; then
+    echo "FAIL $1 with $2: other bodies or groups than the serial conversion:"
+    head -10 "$scratch/diff"
+    failed=1
+  fi
+}
+
+# check_run NAME DECK LABEL SERIAL OPTIONS...
+check_run(){
+  name=$1; deck=$2; label=$3; serial=$4; shift 4
+  if ! "$STUB" "$@" -o "$scratch/$name,$label.out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+    echo "FAIL $name with $label: conversion failed"
+    failed=1
+    return
+  fi
+  compare "$name" "$label" "$serial"
+}
+
+: > "$scratch/batch"
+for deck in $DECKS; do
+  name=$(basename "$deck")
+  if ! "$STUB" -o "$scratch/$name.out" "$deck" > "$scratch/log" 2>&1 < /dev/null ||
+     ! "$STUB" -e -o "$scratch/$name,e.out" "$deck" > "$scratch/log" 2>&1 < /dev/null; then
+    echo "FAIL $name: serial conversion failed"
+    failed=1
+    continue
+  fi
+  sh stub_summary.sh "$scratch/$name.out" > "$scratch/$name,plain.serial"
+  sh stub_summary.sh "$scratch/$name,e.out" > "$scratch/$name,e.serial"
+
+  while read label serial options; do
+    check_run "$name" "$deck" "$label" "$serial" $options
+  done <<EOF
+$option_runs
+EOF
+  check_run "$name" "$deck" cache-dir plain --cache-dir "$scratch/$name.cache"
+  check_run "$name" "$deck" cached plain --cache-dir "$scratch/$name.cache"
+  check_run "$name" "$deck" retag plain --retag "$scratch/$name.out"
+  echo "$deck $scratch/$name,batch.out" >> "$scratch/batch"
+done
+
+if ! "$STUB" --batch "$scratch/batch" > "$scratch/log" 2>&1 < /dev/null; then
+  echo "FAIL batch conversion failed"
+  failed=1
+else
+  while read deck output; do
+    compare "$(basename "$deck")" batch plain
+  done < "$scratch/batch"
+fi
+
+if [ $failed -ne 0 ]; then
+  echo "Conversions split up or reusing earlier work differ from the serial ones"
+else
+  echo "Conversions split up or reusing earlier work match the serial ones"
+fi
+exit $failed
@@ -0,0 +1,125 @@
+#include "checkpoint.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "options.hpp"
+#include "version.hpp"
+
+namespace {
+
+const char* state_name = "checkpoint";
+
+std::string statePath( const std::string& dir ){
+  return dir + "/" + state_name;
+}
+
+/** Read a state file; the bodies file it names is returned relative to dir */
+bool readState( const std::string& dir, std::string& key, size_t& cells_done, std::string& bodies_name ){
+  std::ifstream state( statePath( dir ).c_str() );
+  std::string magic;
+  return ( state >> magic >> key >> cells_done >> bodies_name ) && magic == "mcnp2cad-checkpoint";
+}
+
+void removeBodiesFile( const std::string& path ){
+  unlink( path.c_str() );
+  unlink( ( path + ".meta" ).c_str() );
+}
+
+} // namespace
+
+unsigned long long hashBytes( const char* data, size_t length, unsigned long long hash ){
+  for( size_t i = 0; i < length; ++i ){
+    hash ^= static_cast<unsigned char>( data[i] );
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string hashString( unsigned long long hash ){
+  std::stringstream str;
+  str << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return str.str();
+}
+
+std::string geometryOptions( ){
+  size_t dot = Gopt.output_file.find_last_of( '.' );
+  std::stringstream options;
+  options << MCNP2CAD_VERSION_MAJOR << "." << MCNP2CAD_VERSION_MINOR << "." << MCNP2CAD_VERSION_REV
+          << " " << ( dot == std::string::npos ? "" : Gopt.output_file.substr( dot ) )
+          << " " << Gopt.infinite_lattice_extra_effort << Gopt.make_graveyard
+          << Gopt.tag_materials << Gopt.tag_importances << Gopt.uwuw_names;
+  return options.str();
+}
+
+std::string checkpointKey( const std::string& input_file ){
+
+  unsigned long long hash = hashBytes( "", 0 );
+
+  std::ifstream input( input_file.c_str(), std::ios::in | std::ios::binary );
+  char buffer[ 65536 ];
+  while( input.read( buffer, sizeof(buffer) ) || input.gcount() ){
+    hash = hashBytes( buffer, input.gcount(), hash );
+  }
+
+  std::string options = geometryOptions();
+  return hashString( hashBytes( options.c_str(), options.length(), hash ) );
+}
+
+bool readCheckpoint( const std::string& dir, const std::string& key,
+                     size_t& cells_done, std::string& bodies_file ){
+
+  std::string state_key, bodies_name;
+  if( !readState( dir, state_key, cells_done, bodies_name ) ) return false;
+
+  if( state_key != key ){
+    std::cerr << "Warning: the checkpoint in " << dir << " belongs to another deck or other options;"
+              << " it will be replaced." << std::endl;
+    return false;
+  }
+  bodies_file = dir + "/" + bodies_name;
+  return true;
+}
+
+bool writeCheckpoint( const std::string& dir, const std::string& key,
+                      size_t cells_done, const std::string& bodies_file ){
+
+  std::string old_key, old_bodies;
+  size_t old_cells;
+  bool had_state = readState( dir, old_key, old_cells, old_bodies );
+
+  std::string bodies_name = bodies_file.substr( bodies_file.find_last_of( '/' ) + 1 );
+  std::string temp_path = statePath( dir ) + ".new";
+  {
+    std::ofstream state( temp_path.c_str() );
+    state << "mcnp2cad-checkpoint " << key << " " << cells_done << " " << bodies_name << std::endl;
+    if( !state.good() ){
+      std::cerr << "Warning: could not write checkpoint state " << temp_path << std::endl;
+      return false;
+    }
+  }
+  if( rename( temp_path.c_str(), statePath( dir ).c_str() ) != 0 ){
+    std::cerr << "Warning: could not replace checkpoint state in " << dir << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  if( had_state && old_bodies != bodies_name ){
+    removeBodiesFile( dir + "/" + old_bodies );
+  }
+  return true;
+}
+
+void removeCheckpoint( const std::string& dir, const std::string& key ){
+  std::string state_key, bodies_name;
+  size_t cells_done;
+  if( !readState( dir, state_key, cells_done, bodies_name ) || state_key != key ) return;
+  removeBodiesFile( dir + "/" + bodies_name );
+  unlink( statePath( dir ).c_str() );
+}
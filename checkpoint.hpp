@@ -0,0 +1,56 @@
+#ifndef MCNP2CAD_CHECKPOINT_H
+#define MCNP2CAD_CHECKPOINT_H
+
+#include <string>
+
+/**
+ * Checkpoints of a conversion in progress.  While universe 0 is being defined, the
+ * bodies of the cells finished so far are exported to a file in the checkpoint
+ * directory from time to time, and a small state file records how many cells that
+ * file covers.  A later run of the same deck with the same options reloads those
+ * bodies and carries on from the next cell.
+ *
+ * The state file is replaced atomically, after the bodies it names have been written,
+ * so a run that dies while writing a checkpoint still leaves the previous one usable.
+ */
+
+/// 64-bit FNV-1a hash of some bytes, continued from the given hash
+unsigned long long hashBytes( const char* data, size_t length,
+                              unsigned long long hash = 14695981039346656037ULL );
+
+/// a hash as 16 hexadecimal digits
+std::string hashString( unsigned long long hash );
+
+/**
+ * The version, the output format and the options that change the bodies built or their
+ * metadata, as a string to be hashed into the keys of saved bodies.
+ */
+std::string geometryOptions( );
+
+/**
+ * Identify a conversion by a hash of its input file and of geometryOptions(); a
+ * checkpoint is only resumed by a run with the same key.
+ */
+std::string checkpointKey( const std::string& input_file );
+
+/**
+ * Read the checkpoint in dir.  Returns false if there is none, or if it was written by
+ * a conversion with another key, in which case a warning is printed.
+ */
+bool readCheckpoint( const std::string& dir, const std::string& key,
+                     size_t& cells_done, std::string& bodies_file );
+
+/**
+ * Record that bodies_file, in dir, holds the first cells_done cells of universe 0, and
+ * remove the bodies file of the previous checkpoint, if any.
+ */
+bool writeCheckpoint( const std::string& dir, const std::string& key,
+                      size_t cells_done, const std::string& bodies_file );
+
+/**
+ * Remove the checkpoint in dir, once the conversion with the given key is finished.  A
+ * checkpoint written by a conversion with another key is left alone.
+ */
+void removeCheckpoint( const std::string& dir, const std::string& key );
+
+#endif /* MCNP2CAD_CHECKPOINT_H */
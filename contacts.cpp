@@ -0,0 +1,109 @@
+#include "contacts.hpp"
+
+#include <algorithm>
+
+/** Ordering of bodies by the low x coordinate of their boxes */
+class LowXOrder{
+  const std::vector<Vector3d>& mins;
+public:
+  LowXOrder( const std::vector<Vector3d>& mins_p ) : mins(mins_p) {}
+  bool operator()( size_t a, size_t b ) const {
+    return mins[a].v[0] < mins[b].v[0];
+  }
+};
+
+/** True if box a encloses box b */
+static bool encloses( const Vector3d& a_min, const Vector3d& a_max, const Vector3d& b_min, const Vector3d& b_max ){
+  bool ret = true;
+  for( int k = 0; k < 3 && ret; ++k ){
+    ret = a_min.v[k] <= b_min.v[k] && b_max.v[k] <= a_max.v[k];
+  }
+  return ret;
+}
+
+ContactGraph::ContactGraph( const std::vector<Vector3d>& mins, const std::vector<Vector3d>& maxs, double tolerance,
+                            ContactTest* test ) :
+  adjacent( mins.size() ), num_contacts( 0 )
+{
+
+  std::vector<size_t> order( mins.size() );
+  for( size_t i = 0; i < order.size(); ++i ){
+    order[i] = i;
+  }
+  std::sort( order.begin(), order.end(), LowXOrder( mins ) );
+
+  // each body need only be tested against the bodies that start, along x, before it ends
+  for( size_t i = 0; i < order.size(); ++i ){
+    size_t a = order[i];
+    for( size_t j = i+1; j < order.size(); ++j ){
+      size_t b = order[j];
+      if( mins[b].v[0] > maxs[a].v[0] + tolerance ) break;
+
+      bool apart = false;
+      for( int k = 1; k < 3 && !apart; ++k ){
+        apart = mins[b].v[k] > maxs[a].v[k] + tolerance ||
+                mins[a].v[k] > maxs[b].v[k] + tolerance;
+      }
+      if( !apart && test ){
+        if( encloses( mins[a], maxs[a], mins[b], maxs[b] ) ){
+          apart = !test->mightTouch( a, b );
+        }
+        else if( encloses( mins[b], maxs[b], mins[a], maxs[a] ) ){
+          apart = !test->mightTouch( b, a );
+        }
+      }
+      if( !apart ){
+        adjacent[a].push_back( b );
+        adjacent[b].push_back( a );
+        num_contacts++;
+      }
+    }
+  }
+
+}
+
+void ContactGraph::makeBatches( size_t max_size, std::vector< std::vector<size_t> >& batches ) const {
+
+  if( max_size < 1 ) max_size = 1;
+
+  const size_t unassigned = static_cast<size_t>(-1);
+  std::vector<size_t> batch_of( size(), unassigned );
+
+  for( size_t seed = 0; seed < size(); ++seed ){
+    if( batch_of[seed] != unassigned ) continue;
+
+    size_t b = batches.size();
+    batches.push_back( std::vector<size_t>() );
+    std::vector<size_t>& batch = batches.back();
+
+    // grow the neighbourhood breadth first from the seed; batch doubles as the queue
+    batch.push_back( seed );
+    batch_of[seed] = b;
+    for( size_t i = 0; i < batch.size() && batch.size() < max_size; ++i ){
+      const std::vector<size_t>& next = adjacent[ batch[i] ];
+      for( size_t j = 0; j < next.size() && batch.size() < max_size; ++j ){
+        if( batch_of[ next[j] ] == unassigned ){
+          batch_of[ next[j] ] = b;
+          batch.push_back( next[j] );
+        }
+      }
+    }
+  }
+
+  // add the bodies touching each neighbourhood from outside it
+  for( size_t b = 0; b < batches.size(); ++b ){
+    std::vector<size_t>& batch = batches[b];
+    size_t own = batch.size();
+    std::vector<size_t> halo;
+    for( size_t i = 0; i < own; ++i ){
+      const std::vector<size_t>& next = adjacent[ batch[i] ];
+      for( size_t j = 0; j < next.size(); ++j ){
+        if( batch_of[ next[j] ] != b ) halo.push_back( next[j] );
+      }
+    }
+    std::sort( halo.begin(), halo.end() );
+    halo.erase( std::unique( halo.begin(), halo.end() ), halo.end() );
+    batch.insert( batch.end(), halo.begin(), halo.end() );
+  }
+
+}
@@ -0,0 +1,57 @@
+#ifndef MCNP2CAD_CONTACTS_H
+#define MCNP2CAD_CONTACTS_H
+
+#include <vector>
+#include <cstddef>
+
+#include "geometry.hpp"
+
+/**
+ * A closer test of whether two bodies might touch, for pairs where the bounding box of
+ * one encloses the other's.  Boxes say little about such pairs: the box of a body that
+ * surrounds the rest of a model, such as the void outside it, encloses everything.
+ */
+class ContactTest{
+public:
+  virtual ~ContactTest(){}
+  /// false only if the enclosed body certainly does not touch the enclosing one
+  virtual bool mightTouch( size_t enclosing, size_t enclosed ) = 0;
+};
+
+/**
+ * Which bodies of a model might touch one another, judged by their bounding boxes.
+ *
+ * Imprinting and merging only change bodies that touch, so the model can be imprinted
+ * and merged in batches of neighbouring bodies rather than all at once, so long as
+ * every pair of bodies in contact appears together in some batch.
+ */
+class ContactGraph{
+
+protected:
+  std::vector< std::vector<size_t> > adjacent;
+  size_t num_contacts;
+
+public:
+  /**
+   * Build the graph from the bodies' bounding boxes, using sweep and prune along x.
+   * Boxes within tolerance of each other count as touching, unless one box encloses
+   * the other and the given test, if any, rules the contact out.
+   */
+  ContactGraph( const std::vector<Vector3d>& mins, const std::vector<Vector3d>& maxs, double tolerance,
+                ContactTest* test = NULL );
+
+  size_t size() const { return adjacent.size(); }
+  size_t numContacts() const { return num_contacts; }
+  const std::vector<size_t>& getNeighbors( size_t body ) const { return adjacent[body]; }
+
+  /**
+   * Partition the bodies into connected neighbourhoods of at most max_size bodies,
+   * grown breadth first through the graph.  Each batch lists the bodies of one
+   * neighbourhood, followed by any bodies outside it that touch them, so that every
+   * contact is covered by at least one batch.
+   */
+  void makeBatches( size_t max_size, std::vector< std::vector<size_t> >& batches ) const;
+
+};
+
+#endif /* MCNP2CAD_CONTACTS_H */
@@ -2,6 +2,7 @@
 #include <cfloat>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 
 #include "options.hpp"
 
@@ -203,6 +204,20 @@ Transform Transform::reverse() const {
   return t;
 }
 
+// Vector3d::rotate_about() turns points clockwise about its axis, opposite to iGeom_rotateEnt(),
+// so rotations are applied here with negated angles.
+Vector3d Transform::apply( const Vector3d& p ) const {
+  Vector3d q = has_rot ? p.rotate_about( axis, -theta ) : p;
+  if( invert ){ q = -q; }
+  return q + translation;
+}
+
+Vector3d Transform::applyInverse( const Vector3d& p ) const {
+  Vector3d q = p.add( -translation );
+  if( invert ){ q = -q; }
+  return has_rot ? q.rotate_about( axis, theta ) : q;
+}
+
 void Transform::print( std::ostream& str ) const{
   str << "[trans " << translation;
   if(has_rot){
@@ -306,4 +321,232 @@ const FillNode& Lattice::getFillForNode( int x, int y, int z ) const {
   }
 }
 
+void Lattice::getCoordinatesOfPoint( const Vector3d& p, double& i, double& j, double& k ) const {
+
+  // solve p = i*v1 + j*v2 + k*v3 for the finite directions; with fewer than three, this is
+  // the least-squares solution, i.e. the coordinates of p's projection into the lattice.
+  i = j = k = 0;
+  switch( num_finite_dims ){
+  case 3:
+    {
+      double det = v1.dot( v2.cross( v3 ) );
+      i = p.dot( v2.cross( v3 ) ) / det;
+      j = v1.dot( p.cross( v3 ) ) / det;
+      k = v1.dot( v2.cross( p ) ) / det;
+    }
+    break;
+  case 2:
+    {
+      double a = v1.dot( v1 ), b = v1.dot( v2 ), c = v2.dot( v2 );
+      double det = a*c - b*b;
+      i = ( c * p.dot( v1 ) - b * p.dot( v2 ) ) / det;
+      j = ( a * p.dot( v2 ) - b * p.dot( v1 ) ) / det;
+    }
+    break;
+  case 1:
+    i = p.dot( v1 ) / v1.dot( v1 );
+    break;
+  default:
+    break;
+  }
+}
+
+int Lattice::getRadiusOfPoint( const Vector3d& p ) const {
+
+  double i, j, k;
+  getCoordinatesOfPoint( p, i, j, k );
+  double r = std::max( std::fabs( i ), std::max( std::fabs( j ), std::fabs( k ) ) );
+  return static_cast<int>( std::ceil( r ) );
+
+}
+
+void Lattice::getNearestNode( const Vector3d& p, int& x, int& y, int& z ) const {
+  double i, j, k;
+  getCoordinatesOfPoint( p, i, j, k );
+  x = static_cast<int>( std::floor( i + 0.5 ) );
+  y = static_cast<int>( std::floor( j + 0.5 ) );
+  z = static_cast<int>( std::floor( k + 0.5 ) );
+
+  // as in addNodes(), the unused directions of a fixed-size lattice take the first index of their ranges
+  if( isFixedSize() ){
+    if( num_finite_dims < 3 ) z = getZRange().first;
+    if( num_finite_dims < 2 ) y = getYRange().first;
+  }
+}
+
+void LatticeNodeTable::clear(){
+  x.clear(); y.clear(); z.clear();
+  dx.clear(); dy.clear(); dz.clear();
+  fill.clear(); universe.clear();
+  min_x.clear(); min_y.clear(); min_z.clear();
+  max_x.clear(); max_y.clear(); max_z.clear();
+  in_bounds.clear();
+}
+
+/** Index ranges of a fixed-size lattice, restricted to the lattice's finite dimensions */
+static void getNodeRanges( const Lattice& l, irange ranges[3] ){
+  ranges[0] = l.getXRange(); ranges[1] = l.getYRange(); ranges[2] = l.getZRange();
+
+  // lattices with fewer than three finite dimensions use only the first index
+  // of their unused ranges
+  if( l.numFiniteDirections() < 3 ) ranges[2].second = ranges[2].first;
+  if( l.numFiniteDirections() < 2 ) ranges[1].second = ranges[1].first;
+}
+
+bool Lattice::hasNode( int x, int y, int z ) const {
+  if( !isFixedSize() ) return true;
+  irange r[3];
+  getNodeRanges( *this, r );
+  return r[0].first <= x && x <= r[0].second && r[1].first <= y && y <= r[1].second &&
+         r[2].first <= z && z <= r[2].second;
+}
+
+size_t Lattice::numNodes() const {
+  irange r[3];
+  getNodeRanges( *this, r );
+  return static_cast<size_t>( r[0].second - r[0].first + 1 ) *
+         static_cast<size_t>( r[1].second - r[1].first + 1 ) *
+         static_cast<size_t>( r[2].second - r[2].first + 1 );
+}
+
+void Lattice::addNodes( LatticeNodeTable& table, size_t begin, size_t end ) const {
+
+  irange r[3];
+  getNodeRanges( *this, r );
+  size_t ny = r[1].second - r[1].first + 1;
+  size_t nz = r[2].second - r[2].first + 1;
+
+  int i = r[0].first + static_cast<int>( begin / (ny*nz) );
+  int j = r[1].first + static_cast<int>( (begin / nz) % ny );
+  int k = r[2].first + static_cast<int>( begin % nz );
+
+  size_t first = table.size();
+  table.x.resize( first + end - begin );
+  table.y.resize( first + end - begin );
+  table.z.resize( first + end - begin );
+  int* x = &(table.x[first]);
+  int* y = &(table.y[first]);
+  int* z = &(table.z[first]);
+
+  for( size_t n = 0; n < end - begin; ++n ){
+    x[n] = i; y[n] = j; z[n] = k;
+    if( ++k > r[2].second ){
+      k = r[2].first;
+      if( ++j > r[1].second ){
+        j = r[1].first;
+        ++i;
+      }
+    }
+  }
+}
+
+void Lattice::addShellOfRadius( LatticeNodeTable& table, int r ) const {
+  if( r == 0 ){ 
+    table.addNode( 0, 0, 0 );
+  }
+  else{
+    int jmin = num_finite_dims > 1 ? -r : 0;
+    int jmax = num_finite_dims > 1 ?  r : 0;
+    int kmin = num_finite_dims > 2 ? -r : 0;
+    int kmax = num_finite_dims > 2 ?  r : 0;
+    for( int i = -r; i <= r; ++i ){
+      for( int j = jmin;j <= jmax; ++j ){
+        for( int k = kmin; k <= kmax; ++k ){
+          if( i == -r || i == r ||
+              j == -r || j == r ||
+              k == -r || k == r ){
+            table.addNode( i, j, k );
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Compute the offsets, fills, and bounding boxes of every node in the table.
+ * shell_min/shell_max bound the origin element of the lattice, and bound_min/bound_max
+ * bound the volume the lattice is clipped to; nodes whose boxes fall outside the
+ * latter are marked as out of bounds.
+ *
+ * The arithmetic loops work on plain arrays with no calls or branches, so the
+ * compiler is free to vectorize them.
+ */
+void Lattice::computeNodeTable( LatticeNodeTable& table, const Vector3d& shell_min, const Vector3d& shell_max,
+                                const Vector3d& bound_min, const Vector3d& bound_max ) const {
+
+  const size_t count = table.size();
+
+  // directions beyond the lattice's finite dimensions contribute nothing to a node's offset,
+  // as in getTxForNode()
+  Vector3d a1 = ( num_finite_dims >= 1 ) ? v1 : Vector3d();
+  Vector3d a2 = ( num_finite_dims >= 2 ) ? v2 : Vector3d();
+  Vector3d a3 = ( num_finite_dims >= 3 ) ? v3 : Vector3d();
+
+  table.dx.resize( count ); table.dy.resize( count ); table.dz.resize( count );
+  table.min_x.resize( count ); table.min_y.resize( count ); table.min_z.resize( count );
+  table.max_x.resize( count ); table.max_y.resize( count ); table.max_z.resize( count );
+  table.in_bounds.resize( count );
+  table.fill.resize( count );
+  table.universe.resize( count );
+
+  if( count == 0 ) return;
+
+  const int* x = &(table.x[0]);
+  const int* y = &(table.y[0]);
+  const int* z = &(table.z[0]);
+  double* off[3]  = { &(table.dx[0]), &(table.dy[0]), &(table.dz[0]) };
+  double* bmin[3] = { &(table.min_x[0]), &(table.min_y[0]), &(table.min_z[0]) };
+  double* bmax[3] = { &(table.max_x[0]), &(table.max_y[0]), &(table.max_z[0]) };
+
+  for( int d = 0; d < 3; ++d ){
+    const double c1 = a1.v[d], c2 = a2.v[d], c3 = a3.v[d];
+    const double lo = shell_min.v[d], hi = shell_max.v[d];
+    double* o = off[d];
+    double* mn = bmin[d];
+    double* mx = bmax[d];
+    for( size_t n = 0; n < count; ++n ){
+      o[n] = c1 * x[n] + c2 * y[n] + c3 * z[n];
+      mn[n] = lo + o[n];
+      mx[n] = hi + o[n];
+    }
+  }
+
+  char* in_bounds = &(table.in_bounds[0]);
+  for( size_t n = 0; n < count; ++n ){
+    // bitwise rather than logical operators, so that there are no branches in this loop
+    in_bounds[n] = !( (bmin[0][n] > bound_max.v[0]) | (bound_min.v[0] > bmax[0][n]) |
+                      (bmin[1][n] > bound_max.v[1]) | (bound_min.v[1] > bmax[1][n]) |
+                      (bmin[2][n] > bound_max.v[2]) | (bound_min.v[2] > bmax[2][n]) );
+  }
+
+  // fills are looked up only for nodes that are in bounds; the others are never built.
+  const Fill& f = fill->getData();
+  if( f.has_grid ){
+    const FillNode* grid = &(f.nodes[0]);
+    const int x0 = f.xrange.first, y0 = f.yrange.first, z0 = f.zrange.first;
+    const int sx = f.xrange.second - x0 + 1;
+    const int sy = f.yrange.second - y0 + 1;
+    for( size_t n = 0; n < count; ++n ){
+      if( in_bounds[n] ){
+        // as in Fill::indicesToSerialIndex()
+        int index = (z[n]-z0) * (sy*sx) + (y[n]-y0) * sx + (x[n]-x0);
+        assert( index >= 0 && static_cast<size_t>(index) < f.nodes.size() );
+        table.fill[n] = grid + index;
+        table.universe[n] = grid[index].getFillingUniverse();
+      }
+      else{
+        table.fill[n] = NULL;
+        table.universe[n] = 0;
+      }
+    }
+  }
+  else{
+    const FillNode* origin = &(f.getOriginNode());
+    std::fill( table.fill.begin(), table.fill.end(), origin );
+    std::fill( table.universe.begin(), table.universe.end(), origin->getFillingUniverse() );
+  }
+
+}
+
   
@@ -136,6 +136,12 @@ public:
 
   Transform reverse() const;
 
+  /// the image of a point under this transform, as applyTransform() would move it
+  Vector3d apply( const Vector3d& p ) const;
+
+  /// the point that this transform would move to p
+  Vector3d applyInverse( const Vector3d& p ) const;
+
 };
 
 std::ostream& operator<<(std::ostream& str, const Transform& t );
@@ -220,6 +226,42 @@ public:
 };
 
 
+/**
+ * A precomputed table of lattice nodes, stored as parallel arrays with one entry per node.
+ * Node indices are added first; Lattice::computeNodeTable() then fills in the offsets,
+ * filling universes and bounding boxes of every node in a few tight loops, so that the
+ * per-node work of building a lattice does not need to recompute them.  Large lattices
+ * should be processed a chunk of nodes at a time, reusing one table, to keep it in cache.
+ */
+class LatticeNodeTable{
+
+public:
+  // node indices
+  std::vector<int> x, y, z;
+
+  // translation of each node relative to the lattice's origin element
+  std::vector<double> dx, dy, dz;
+
+  // the fill of each node, and the universe number it is filled with
+  std::vector<const FillNode*> fill;
+  std::vector<int> universe;
+
+  // bounding box of each node, and whether that box meets the bounding box of the lattice
+  std::vector<double> min_x, min_y, min_z, max_x, max_y, max_z;
+  std::vector<char> in_bounds;
+
+  size_t size() const { return x.size(); }
+
+  void addNode( int x_p, int y_p, int z_p ){
+    x.push_back( x_p ); y.push_back( y_p ); z.push_back( z_p );
+  }
+
+  void clear();
+
+  Transform getTx( size_t n ) const { return Transform( Vector3d( dx[n], dy[n], dz[n] ) ); }
+
+};
+
 class Lattice{
 
 protected:
@@ -228,6 +270,8 @@ protected:
 
   DataRef<Fill> *fill;
 
+  void getCoordinatesOfPoint( const Vector3d& p, double& i, double& j, double& k ) const ;
+
 public:
   Lattice() : fill(new NullRef<Fill>()){}
   Lattice( int dims, const Vector3d& v1_p, const Vector3d& v2_p, const Vector3d& v3_p, const FillNode& singleton_fill );
@@ -243,6 +287,30 @@ public:
 
   const FillNode& getFillForNode( int x, int y, int z ) const ;
 
+  /// the smallest shell radius (as counted in node indices) at which a node contains, or is
+  /// next to, the given point, or its projection onto the lattice's finite directions
+  int getRadiusOfPoint( const Vector3d& p ) const ;
+
+  /// the node whose offset is nearest to p in lattice coordinates; for lattices whose
+  /// elements are not parallelepipeds, p may lie in one of that node's neighbors instead
+  void getNearestNode( const Vector3d& p, int& x, int& y, int& z ) const ;
+
+  /// whether the lattice has a node with the given indices; infinite lattices have them all
+  bool hasNode( int x, int y, int z ) const ;
+
+  /// number of nodes in a fixed-size lattice
+  size_t numNodes() const ;
+
+  /// add nodes [begin,end) of a fixed-size lattice to the table, counting with x outermost and z innermost
+  void addNodes( LatticeNodeTable& table, size_t begin, size_t end ) const ;
+
+  /// add the nodes at distance r from the origin, counted in node indices, to the table
+  void addShellOfRadius( LatticeNodeTable& table, int r ) const ;
+
+  /// fill in the per-node data of a table whose node indices have been set
+  void computeNodeTable( LatticeNodeTable& table, const Vector3d& shell_min, const Vector3d& shell_max,
+                         const Vector3d& bound_min, const Vector3d& bound_max ) const ;
+
   bool isFixedSize() const { return fill->getData().has_grid; }  
   irange getXRange() const { return fill->getData().xrange; }
   irange getYRange() const { return fill->getData().yrange; }
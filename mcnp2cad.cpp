@@ -7,9 +7,11 @@
 #include <set>
 #include <map>
 #include <sstream>
+#include <iomanip>
 #include <algorithm>
 
 #include <cassert>
+#include <unistd.h>
 
 #include "iGeom.h"
 #include "geometry.hpp"
@@ -18,6 +20,17 @@
 #include "volumes.hpp"
 #include "ProgOptions.hpp"
 #include "version.hpp"
+#include "universes.hpp"
+#include "workers.hpp"
+#include "contacts.hpp"
+#include "mesher.hpp"
+#include "voxels.hpp"
+#include "montecarlo.hpp"
+#include "profile.hpp"
+#include "census.hpp"
+#include "checkpoint.hpp"
+#include "bodycache.hpp"
+#include "analyze.hpp"
 
 
 /* mcnp2cad should be compatible with any implementation of the iGeom library.
@@ -87,11 +100,11 @@ static bool intersectIfPossible( iGeom_Instance igm,
 #ifdef USING_CGMA
   if( CGMA_opt_inhibit_intersect_errs ){
     CubitSilence s;
-    iGeom_intersectEnts( igm, h1, h2, result, &igm_result); 
+    PROFILE_IGEOM( "intersectEnts", iGeom_intersectEnts( igm, h1, h2, result, &igm_result) );
   }  else
 #endif
   {
-    iGeom_intersectEnts( igm, h1, h2, result, &igm_result);
+    PROFILE_IGEOM( "intersectEnts", iGeom_intersectEnts( igm, h1, h2, result, &igm_result) );
   }
   
   if( igm_result == iBase_SUCCESS ){
@@ -99,26 +112,29 @@ static bool intersectIfPossible( iGeom_Instance igm,
   }
   else{
     if( delete_on_failure ){
-      iGeom_deleteEnt( igm, h1, &igm_result);
+      PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, h1, &igm_result) );
       CHECK_IGEOM(igm_result, "deleting an intersection candidate");
-      iGeom_deleteEnt( igm, h2, &igm_result);
+      PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, h2, &igm_result) );
       CHECK_IGEOM(igm_result, "deleting an intersection candidate");
     }
     return false;
   }
 }
 
+static void getBoundBox( iGeom_Instance igm, iBase_EntityHandle h, Vector3d& min, Vector3d& max ){
+  int igm_result;
+  iGeom_getEntBoundBox( igm, h, min.v, min.v+1, min.v+2, max.v, max.v+1, max.v+2, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting bounding box" );
+}
+
 // determine whether the bounding boxes of two volumes overlap.
 // this can save an expensive call to intersectIfPossible()
 static bool boundBoxesIntersect( iGeom_Instance igm, iBase_EntityHandle h1, iBase_EntityHandle h2 ){
 
   Vector3d h1_min, h1_max, h2_min, h2_max;
-  int igm_result;
-  
-  iGeom_getEntBoundBox( igm, h1, h1_min.v, h1_min.v+1, h1_min.v+2, h1_max.v, h1_max.v+1, h1_max.v+2, &igm_result );
-  CHECK_IGEOM( igm_result, "Getting bounding box h1" );
-  iGeom_getEntBoundBox( igm, h2, h2_min.v, h2_min.v+1, h2_min.v+2, h2_max.v, h2_max.v+1, h2_max.v+2, &igm_result );
-  CHECK_IGEOM( igm_result, "Getting bounding box h2" );
+
+  getBoundBox( igm, h1, h1_min, h1_max );
+  getBoundBox( igm, h2, h2_min, h2_max );
 
   bool ret = false;
 
@@ -134,22 +150,24 @@ static bool boundBoxesIntersect( iGeom_Instance igm, iBase_EntityHandle h1, iBas
 /**
  * Contains geometry functions and the shared data members they all reference.
  */
+class OwnedBodies;
+
 class GeometryContext {
 
   /** 
    * Metadata and naming: 
-   * The NamedGroup and NamedEntity mappings are used to keep track of metadata
-   * on particular entity handles that map to MCNP cells.  
+   * Metadata on the entity handles that map to MCNP cells is kept in an index keyed
+   * by handle, so that it can be found without searching.
    * EntityHandles change frequently as CSG operations are performed on volumes,
-   * so these mappings must be updated, by calling updateMaps(), whenever an 
-   * EntityHandle changes.
+   * so the index must be updated, by calling updateMaps(), whenever an 
+   * EntityHandle changes.  Once every cell has its final handle, collectMetadata()
+   * rebuilds the NamedGroup and NamedEntity lists from the index for tagging.
    */
 
 protected:
 
-  // note: this appears slow, since it's called for all cells and constructs a string
-  // for each.  A lookup table would probably be faster, but there are never more than
-  // a few thousand cells.
+  // group names are only built the first time a (material, density) or importance
+  // value is seen; setMaterial() and setImportances() look up the group IDs afterwards.
   std::string materialName( int mat, double rho ){
     std::string ret;
     std::stringstream formatter;
@@ -198,43 +216,31 @@ protected:
       entities.push_back(new_handle);
     }
 
-    void update( iBase_EntityHandle old_h, iBase_EntityHandle new_h ){
-      entity_collection_t::iterator i = std::find( entities.begin(), entities.end(), old_h );
-      if( i != entities.end() ){
-        if( new_h ){
-          *i = new_h;
-        }
-        else {
-          entities.erase( i );
-        }
-      }
-    }
-
-    bool contains( iBase_EntityHandle handle ) const {
-      return std::find( entities.begin(), entities.end(), handle ) != entities.end(); 
-    }
-
   };
 
   class NamedEntity { 
   protected:
     iBase_EntityHandle handle;
     std::string name;
+    std::string origin;
   public:
-    NamedEntity( iBase_EntityHandle handle_p, std::string name_p = "" ):
-      handle(handle_p), name(name_p)
+    NamedEntity( iBase_EntityHandle handle_p, std::string name_p = "", std::string origin_p = "" ):
+      handle(handle_p), name(name_p), origin(origin_p)
     {}
     virtual ~NamedEntity(){}
 
     const std::string& getName() const { return name; }
     iBase_EntityHandle getHandle() const{ return handle; }
 
+    /// the chain of cells and lattice nodes that led to this entity's creation; see origin_path
+    const std::string& getOrigin() const { return origin; }
+
     void setHandle( iBase_EntityHandle new_h ) {
       handle = new_h;
     }
 
-    static NamedEntity* makeCellIDName( iBase_EntityHandle h, int ident ){
-      NamedEntity* e = new NamedEntity(h);
+    static NamedEntity* makeCellIDName( iBase_EntityHandle h, int ident, const std::string& origin ){
+      NamedEntity* e = new NamedEntity( h, "", origin );
       std::stringstream formatter;
       formatter << "MCNP_ID_" << ident;
       formatter >> e->name;
@@ -243,45 +249,158 @@ protected:
 
   };
 
+  /**
+   * The metadata recorded for one entity handle: its cell ID names, and the groups it
+   * belongs to, as indices into group_names.  Each entry carries the sequence number at
+   * which it was recorded, so the original order can be restored by collectMetadata().
+   */
+  class EntityMetadata {
+  public:
+    std::vector< std::pair<long, NamedEntity*> > names;
+    std::vector< std::pair<long, int> > groups;
+
+    bool empty() const { return names.empty() && groups.empty(); }
+  };
+
+  /**
+   * A set of bodies that was built by another process and exported to a file, such as
+   * a prebuilt universe or one shard of universe 0.  Each body is kept with its cell ID
+   * names (and their origins) and the groups it belongs to, so that its metadata can be
+   * restored here.
+   */
+  class ExportedBodies {
+  public:
+    entity_collection_t bodies;
+    std::vector< std::vector<std::string> > cell_names;
+    std::vector< std::vector<std::string> > cell_origins;
+    std::vector< std::vector<std::string> > group_names;
+  };
+
 protected:
   iGeom_Instance& igm;
   InputDeck& deck;
   double world_size;
   int universe_depth;
+  double graveyard_inner_size; // edge length of the graveyard's cavity, centered on the origin
 
+  // handle -> metadata, and the interned names of all groups
+  std::map< iBase_EntityHandle, EntityMetadata > metadata;
+  std::vector< std::string > group_names;
+  std::map< std::string, int > group_ids;
+  long metadata_order;
+
+  // group IDs of each material and density, and of each importance value
+  std::map< std::pair<int,double>, int > material_groups;
+  std::map< std::pair<char,double>, int > importance_groups;
+
+  // the NAME tag, looked up when first needed
+  iBase_TagHandle name_tag;
+  int name_tag_maxlength;
+  iBase_TagHandle getNameTag( );
+
+  // filled in from the index by collectMetadata()
   std::map< std::string, NamedGroup* > named_groups;
   std::vector< NamedEntity* > named_cells;
 
-  NamedGroup* getNamedGroup( const std::string& name ){
-    if( named_groups.find( name ) == named_groups.end() ){
-      named_groups[ name ] = new NamedGroup( name );
+  std::map< int, std::string > prebuilt_files;   // universe -> file exported by a worker
+  BodyCache* body_cache;                         // prebuilt universes kept between runs, if any
+  std::map< int, ExportedBodies > prebuilt;      // universes loaded into this instance
+
+  // The cells and lattice nodes enclosing whatever is being defined, e.g. "/2/4[1,0,-1]/7"
+  // for cell 7 within node (1,0,-1) of lattice cell 4 within cell 2.  This identifies every
+  // leaf body uniquely, which lets the pieces of a body built in separate shards be rejoined.
+  std::string origin_path;
+
+  // when building one shard of universe 0, the region of space it covers
+  iBase_EntityHandle shard_region;
+
+  // when checkpointing universe 0, the key of this conversion and the time of the last checkpoint
+  std::string checkpoint_key;
+  double last_checkpoint;
+
+  // cells of universe 0 that ran out of time under --cell-timeout, with the time spent on
+  // them and whether their shell could be kept in their place
+  struct OverBudgetCell{
+    int ident;
+    double seconds;
+    bool kept_shell;
+  };
+  std::vector< OverBudgetCell > over_budget;
+
+  // directory for files exchanged with worker processes, created when first needed
+  std::string scratch_dir;
+  std::string scratchFile( const std::string& label );
+  bool newWorkerInstance( iGeom_Instance& worker_igm );
+
+  int getGroupID( const std::string& name ){
+    std::map< std::string, int >::iterator i = group_ids.find( name );
+    if( i == group_ids.end() ){
+      i = group_ids.insert( std::make_pair( name, (int)group_names.size() ) ).first;
+      group_names.push_back( name );
       if( OPT_DEBUG ) std::cout << "New named group: " << name 
-                                << "num groups now " << named_groups.size() << std::endl;
+                                << "num groups now " << group_names.size() << std::endl;
     }
-    return named_groups[ name ];
+    return (*i).second;
   }
 
 public:
   GeometryContext( iGeom_Instance& igm_p, InputDeck& deck_p ) :
-    igm(igm_p), deck(deck_p), world_size(0.0), universe_depth(0)
+    igm(igm_p), deck(deck_p), world_size(0.0), universe_depth(0), graveyard_inner_size(0.0), metadata_order(0),
+    name_tag(NULL), name_tag_maxlength(64), body_cache(NULL), shard_region(NULL), last_checkpoint(0.0)
   {}
 
   bool defineLatticeNode( CellCard& cell, iBase_EntityHandle cell_shell, iBase_EntityHandle lattice_shell,
-                          int x, int y, int z, entity_collection_t& accum );
+                          const LatticeNodeTable& nodes, size_t n, OwnedBodies& accum );
   
 
-  entity_collection_t defineCell( CellCard& cell, bool defineEmbedded, iBase_EntityHandle lattice_shell );
-  entity_collection_t populateCell( CellCard& cell, iBase_EntityHandle cell_shell, iBase_EntityHandle lattice_shell );
+  // these append the bodies they define to out, and return how many they appended
+  size_t defineCell( CellCard& cell, OwnedBodies& out, bool defineEmbedded, iBase_EntityHandle lattice_shell );
+  size_t populateCell( CellCard& cell, OwnedBodies& out, iBase_EntityHandle cell_shell, iBase_EntityHandle lattice_shell );
  
 
-  entity_collection_t defineUniverse( int universe, iBase_EntityHandle container, const Transform* transform );
+  size_t defineUniverse( int universe, OwnedBodies& out, iBase_EntityHandle container, const Transform* transform );
+
+  size_t resumeCheckpoint( OwnedBodies& out, size_t num_cells );
+  void saveCheckpoint( OwnedBodies& out, size_t begin, size_t cells_done );
+
+  void defineCellsInWorkers( const InputDeck::cell_card_list& cells, size_t first,
+                             std::map< int, ExportedBodies >& timed );
+  size_t placeTimedCell( CellCard& cell, std::map< int, ExportedBodies >& timed, OwnedBodies& out );
+  bool buildCellInWorker( int ident, bool shell_only, const std::string& filename );
+  void reportOverBudgetCells( );
+
+  void prebuildUniverses( );
+  bool buildUniverseInWorker( int universe, const std::set<int>& dependencies, const std::string& filename );
+  void importPrebuiltUniverses( );
+  entity_collection_t copyPrebuiltUniverse( const ExportedBodies& pre );
+  void releasePrebuiltUniverses( );
+
+  entity_collection_t defineShardedUniverse( iBase_EntityHandle boundary );
+  bool buildShardInWorker( int shard, const Vector3d& min, const Vector3d& max, const std::string& filename );
+  entity_collection_t defineShard( const Vector3d& min, const Vector3d& max );
+
+  void getMetadata( const EntityMetadata& data, std::vector<std::string>& cell_names,
+                    std::vector<std::string>& cell_origins, std::vector<std::string>& groups );
+  void takeMetadata( iBase_EntityHandle h, std::vector<std::string>& cell_names,
+                     std::vector<std::string>& cell_origins, std::vector<std::string>& groups );
+  bool exportBodies( const std::string& label, const entity_collection_t& bodies, const std::string& filename );
+  bool importBodies( const std::string& label, const std::string& filename, ExportedBodies& imported );
+  void importBodies( const std::vector<std::string>& labels, const std::vector<std::string>& filenames,
+                     std::vector<ExportedBodies>& imported, std::vector<bool>& complete );
   
 
   void addToVolumeGroup( iBase_EntityHandle cell, const std::string& groupname );
+  void addToVolumeGroup( iBase_EntityHandle cell, int group );
+  void addCellName( iBase_EntityHandle cell, const std::string& name, const std::string& origin );
   void setVolumeCellID( iBase_EntityHandle cell, int ident);
   void setMaterial( iBase_EntityHandle cell, int material, double density ){
     if( Gopt.tag_materials ){
-        addToVolumeGroup( cell, materialName(material,density) );
+      std::pair<int,double> key( material, density );
+      std::map< std::pair<int,double>, int >::iterator i = material_groups.find( key );
+      if( i == material_groups.end() ){
+        i = material_groups.insert( std::make_pair( key, getGroupID( materialName(material,density) ) ) ).first;
+      }
+      addToVolumeGroup( cell, (*i).second );
     }
   }
 
@@ -290,9 +409,13 @@ public:
       for( std::map<char, double>::const_iterator i = imps.begin();
            i != imps.end(); ++i )
       {
-          char impchar = (*i).first;
-          double imp = (*i).second;
-          addToVolumeGroup( cell, importanceName( impchar, imp ) );
+          std::map< std::pair<char,double>, int >::iterator j = importance_groups.find( *i );
+          if( j == importance_groups.end() ){
+            char impchar = (*i).first;
+            double imp = (*i).second;
+            j = importance_groups.insert( std::make_pair( *i, getGroupID( importanceName( impchar, imp ) ) ) ).first;
+          }
+          addToVolumeGroup( cell, (*j).second );
       }
     }
   }
@@ -300,6 +423,11 @@ public:
 
   void updateMaps ( iBase_EntityHandle old_cell, iBase_EntityHandle new_cell );
 
+  // delete a body that will not be part of the model, and forget its metadata
+  void discardBody( iBase_EntityHandle body );
+  friend class OwnedBodies;
+
+  void collectMetadata( );
   bool mapSanityCheck( iBase_EntityHandle* cells, size_t count );
 
   void tagGroups( );
@@ -310,61 +438,188 @@ public:
   }
 
   iBase_EntityHandle createGraveyard( iBase_EntityHandle& boundary );
+  void imprintInBatches( iBase_EntityHandle* cells, size_t count, iBase_EntityHandle graveyard, double tolerance );
+  void imprintAndMerge( iBase_EntityHandle* cells, size_t count, iBase_EntityHandle graveyard, double tolerance );
+  void imprintInShards( entity_collection_t& defined_cells, iBase_EntityHandle graveyard, double tolerance );
+  bool imprintShardInWorker( int shard, const entity_collection_t& bodies, double tolerance,
+                             const std::string& filename );
   void createGeometry( );
+  void retagGeometry( const std::string& filename );
+
+};
+
+/**
+ * The bodies that one step of defining the geometry is responsible for.  Any still held
+ * when the owner goes out of scope, as when an exception is thrown through it, are
+ * discarded.  A body leaves its owner when a kernel operation consumes it (pop()), or
+ * when it is handed on to the caller or to the function that will own it next
+ * (release()).  Owners cannot be copied, so every transfer of ownership is explicit.
+ */
+class OwnedBodies {
+  GeometryContext& context;
+  entity_collection_t bodies;
+
+  OwnedBodies( const OwnedBodies& );
+  OwnedBodies& operator=( const OwnedBodies& );
+
+public:
+  explicit OwnedBodies( GeometryContext& context_p ) : context(context_p) {}
+
+  /// own one body, if it is not NULL
+  OwnedBodies( GeometryContext& context_p, iBase_EntityHandle body ) : context(context_p) {
+    if( body ) bodies.push_back( body );
+  }
+
+  ~OwnedBodies(){ clear(); }
+
+  size_t size() const { return bodies.size(); }
+  iBase_EntityHandle& operator[]( size_t i ){ return bodies[i]; }
 
+  void push_back( iBase_EntityHandle body ){ bodies.push_back( body ); }
+  void append( const entity_collection_t& more ){ bodies.insert( bodies.end(), more.begin(), more.end() ); }
+
+  /// stop owning the last body, e.g. because a kernel operation is about to consume it
+  iBase_EntityHandle pop(){
+    iBase_EntityHandle body = bodies.back();
+    bodies.pop_back();
+    return body;
+  }
+
+  /// stop owning the bodies from position n on, which have been deleted or consumed elsewhere
+  void truncate( size_t n ){ bodies.resize( n ); }
+
+  /// hand every body over to the caller
+  entity_collection_t release(){
+    entity_collection_t ret;
+    ret.swap( bodies );
+    return ret;
+  }
+
+  /// discard every body now
+  void clear(){
+    for( size_t i = 0; i < bodies.size(); ++i ){
+      context.discardBody( bodies[i] );
+    }
+    bodies.clear();
+  }
 };
 
 void GeometryContext::addToVolumeGroup( iBase_EntityHandle cell, const std::string& name ){
+  addToVolumeGroup( cell, getGroupID( name ) );
+}
 
-  NamedGroup* group = getNamedGroup( name );
-  group->add( cell );
+void GeometryContext::addToVolumeGroup( iBase_EntityHandle cell, int group ){
+
+  metadata[cell].groups.push_back( std::make_pair( metadata_order++, group ) );
 
   if( OPT_DEBUG ){ std::cout << uprefix() 
-                             << "Added cell to volgroup " << group->getName() << std::endl; }
+                             << "Added cell to volgroup " << group_names[group] << std::endl; }
+}
+
+iBase_TagHandle GeometryContext::getNameTag( ){
+
+  if( name_tag == NULL ){
+    int igm_result;
+    std::string name_tag_id = "NAME";
+
+    iGeom_getTagHandle( igm, name_tag_id.c_str(), &name_tag, &igm_result, name_tag_id.length() );
+    CHECK_IGEOM( igm_result, "Looking up NAME tag" );
+  
+    iGeom_getTagSizeBytes( igm, name_tag, &name_tag_maxlength, &igm_result );
+    CHECK_IGEOM( igm_result, "Querying NAME tag length" );
+    if( OPT_DEBUG ) std::cout << "Name tag length: " << name_tag_maxlength << " actual id " << name_tag << std::endl;
+  }
+  return name_tag;
 }
 
+void GeometryContext::addCellName( iBase_EntityHandle cell, const std::string& name, const std::string& origin ){
+
+  metadata[cell].names.push_back( std::make_pair( metadata_order++, new NamedEntity( cell, name, origin ) ) );
+
+}
 
 void GeometryContext::setVolumeCellID( iBase_EntityHandle cell, int ident ){
 
-  named_cells.push_back( NamedEntity::makeCellIDName(cell, ident) );
+  NamedEntity* e = NamedEntity::makeCellIDName( cell, ident, origin_path );
+  metadata[cell].names.push_back( std::make_pair( metadata_order++, e ) );
+
+}
 
+/** Delete a body owned by the caller, and drop any metadata attached to it */
+void GeometryContext::discardBody( iBase_EntityHandle body ){
+  int igm_result;
+  PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, body, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Deleting an unused body" );
+  updateMaps( body, NULL );
 }
 
 /** Inform metadata system that a cell has changed handled, as from a CSG operation */
 void GeometryContext::updateMaps( iBase_EntityHandle old_cell, iBase_EntityHandle new_cell ){
 
-  /* update named_groups.  handling of new_cell == NULL case is performed within NamedGroup class */
-  for( std::map<std::string,NamedGroup*>::iterator i = named_groups.begin();
-       i != named_groups.end(); ++i )
-  {
-    NamedGroup* group = (*i).second;
-    group->update( old_cell, new_cell );
-  }
+  std::map< iBase_EntityHandle, EntityMetadata >::iterator i = metadata.find( old_cell );
+  if( i == metadata.end() || old_cell == new_cell ) return;
 
-  /* update named entities.*/
+  EntityMetadata& old_data = (*i).second;
   if( new_cell != NULL ){
-    for( std::vector< NamedEntity* >::iterator i = named_cells.begin(); 
-         i != named_cells.end(); ++i )
-      {
-        NamedEntity* ne = *i;
-        if( ne->getHandle() == old_cell ){
-          ne->setHandle( new_cell );
-        }
-      }
+    /* move the metadata to the new handle, keeping its sequence numbers */
+    EntityMetadata& new_data = metadata[new_cell];
+    for( size_t j = 0; j < old_data.names.size(); ++j ){
+      old_data.names[j].second->setHandle( new_cell );
+    }
+    if( new_data.empty() ){
+      std::swap( new_data, old_data );
+    }
+    else{
+      new_data.names.insert( new_data.names.end(), old_data.names.begin(), old_data.names.end() );
+      new_data.groups.insert( new_data.groups.end(), old_data.groups.begin(), old_data.groups.end() );
+    }
   }
   else{ /* new_cell == NULL (i.e. cell has disappeared) */
+    for( size_t j = 0; j < old_data.names.size(); ++j ){
+      delete old_data.names[j].second;
+    }
+  }
 
-    // this case is expected to be uncommon in most geometries, so the fact that erasing
-    // from a std::vector is slow should not be a problem.
-    std::vector< NamedEntity* >::iterator i = named_cells.begin();
-    while( i != named_cells.end() ){
-      if( (*i)->getHandle() == old_cell ){
-        delete (*i);
-        named_cells.erase(i);
-      }
-      else{
-        ++i;
-      }
+  metadata.erase( i );
+
+}
+
+/** Ordering for metadata entries: by the sequence number at which they were recorded */
+template < typename T >
+static bool recordedBefore( const std::pair<long,T>& a, const std::pair<long,T>& b ){
+  return a.first < b.first;
+}
+
+/**
+ * Rebuild named_groups and named_cells from the metadata index, in the order the
+ * metadata was originally recorded.  Only called after all cells have their final handles.
+ */
+void GeometryContext::collectMetadata( ){
+
+  std::vector< std::vector< std::pair<long, iBase_EntityHandle> > > members( group_names.size() );
+  std::vector< std::pair<long, NamedEntity*> > names;
+
+  for( std::map< iBase_EntityHandle, EntityMetadata >::iterator i = metadata.begin(); i != metadata.end(); ++i ){
+    const EntityMetadata& data = (*i).second;
+    names.insert( names.end(), data.names.begin(), data.names.end() );
+    for( size_t j = 0; j < data.groups.size(); ++j ){
+      members[ data.groups[j].second ].push_back( std::make_pair( data.groups[j].first, (*i).first ) );
+    }
+  }
+
+  std::sort( names.begin(), names.end(), recordedBefore<NamedEntity*> );
+  named_cells.clear();
+  for( size_t j = 0; j < names.size(); ++j ){
+    named_cells.push_back( names[j].second );
+  }
+
+  for( size_t g = 0; g < group_names.size(); ++g ){
+    NamedGroup*& group = named_groups[ group_names[g] ];
+    if( !group ) group = new NamedGroup( group_names[g] );
+
+    std::sort( members[g].begin(), members[g].end(), recordedBefore<iBase_EntityHandle> );
+    for( size_t j = 0; j < members[g].size(); ++j ){
+      group->add( members[g][j].second );
     }
   }
 
@@ -378,16 +633,7 @@ void GeometryContext::tagGroups( ){
   // talk about material groups could be confusing.
   int igm_result;
   
-  std::string name_tag_id = "NAME";
-  int name_tag_maxlength = 64;
-  iBase_TagHandle name_tag;
-
-  iGeom_getTagHandle( igm, name_tag_id.c_str(), &name_tag, &igm_result, name_tag_id.length() );
-  CHECK_IGEOM( igm_result, "Looking up NAME tag" );
-  
-  iGeom_getTagSizeBytes( igm, name_tag, &name_tag_maxlength, &igm_result );
-  CHECK_IGEOM( igm_result, "Querying NAME tag length" );
-  if( OPT_DEBUG ) std::cout << "Name tag length: " << name_tag_maxlength << " actual id " << name_tag << std::endl;
+  getNameTag();
 
   for( std::map<std::string,NamedGroup*>::iterator i = named_groups.begin(); i != named_groups.end(); ++i ){
 
@@ -401,9 +647,9 @@ void GeometryContext::tagGroups( ){
     CHECK_IGEOM( igm_result, "Creating a new entity set " );
     
     const entity_collection_t& group_list = group->getEntities();
-    for( entity_collection_t::const_iterator j = group_list.begin(); j != group_list.end(); ++j ){
-      iGeom_addEntToSet( igm, *j, set, &igm_result );
-      CHECK_IGEOM( igm_result, "Adding entity to material set" );
+    if( group_list.size() ){
+      iGeom_addEntArrToSet( igm, &(group_list[0]), group_list.size(), set, &igm_result );
+      CHECK_IGEOM( igm_result, "Adding entities to material set" );
     }
 
     std::string name = group->getName();
@@ -425,20 +671,13 @@ void GeometryContext::tagCellIDsAsEntNames(){
   
   int igm_result;
 
-  std::string name_tag_id = "NAME";
-  int name_tag_maxlength = 64;
-  iBase_TagHandle name_tag;
-
-  iGeom_getTagHandle( igm, name_tag_id.c_str(), &name_tag, &igm_result, name_tag_id.length() );
-  CHECK_IGEOM( igm_result, "Looking up NAME tag" );
-  
-  iGeom_getTagSizeBytes( igm, name_tag, &name_tag_maxlength, &igm_result );
-  CHECK_IGEOM( igm_result, "Querying NAME tag length" );
-  if( OPT_DEBUG ) std::cout << "Name tag length: " << name_tag_maxlength << " actual id " << name_tag << std::endl;
-
+  getNameTag();
 
   if( OPT_VERBOSE ){ std::cout << "Naming " << named_cells.size() << " volumes." <<  std::endl; }
 
+  // all the names are set in one call, each padded with nulls to the size of the tag
+  entity_collection_t entities;
+  std::vector<char> values;
   for( std::vector< NamedEntity* >::iterator i = named_cells.begin(); i!=named_cells.end(); ++i){
     std::string name = (*i)->getName();
     iBase_EntityHandle entity = (*i)->getHandle();
@@ -450,9 +689,16 @@ void GeometryContext::tagCellIDsAsEntNames(){
     }
 
     if( entity == NULL ){ std::cerr << "Error: NULL in named_cells" << std::endl; continue; }
-    
-    iGeom_setData( igm, entity, name_tag, name.c_str(), name.length(), &igm_result );
-    CHECK_IGEOM( igm_result, "Naming an NamedEntity" );
+
+    entities.push_back( entity );
+    size_t offset = values.size();
+    values.resize( offset + name_tag_maxlength, '\0' );
+    std::copy( name.begin(), name.end(), values.begin() + offset );
+  }
+
+  if( entities.size() ){
+    iGeom_setArrData( igm, &(entities[0]), entities.size(), name_tag, &(values[0]), values.size(), &igm_result );
+    CHECK_IGEOM( igm_result, "Naming NamedEntities" );
   }
 
 }
@@ -514,124 +760,103 @@ bool GeometryContext::mapSanityCheck( iBase_EntityHandle* cells, size_t count){
   return good;
 }
 
-/** Define node x,y,z in a lattice.
+/** Define node n of a lattice node table.
  *
  * cell_shell is a volume representing lattice node (0,0,0)
  * lattice_shell is the volume into which the node must be intersected
  */
 bool GeometryContext::defineLatticeNode(  CellCard& cell, iBase_EntityHandle cell_shell, iBase_EntityHandle lattice_shell,
-                                          int x, int y, int z, entity_collection_t& accum )
+                                          const LatticeNodeTable& nodes, size_t n, OwnedBodies& accum )
 {
-  const Lattice& lattice = cell.getLattice();
   int lattice_universe =   cell.getUniverse();
 
-  const FillNode* fn = &(lattice.getFillForNode( x, y, z ));                            
-  Transform t = lattice.getTxForNode( x, y, z );        
-  int igm_result;
-  
-  iBase_EntityHandle cell_copy;
-  iGeom_copyEnt( igm, cell_shell, &cell_copy, &igm_result );
-  CHECK_IGEOM( igm_result, "Copying a lattice cell shell" );
-  cell_copy = applyTransform( t, igm, cell_copy );
-  
-  if( !boundBoxesIntersect( igm, cell_copy, lattice_shell ) ){
-    iGeom_deleteEnt( igm, cell_copy, &igm_result);
-    CHECK_IGEOM( igm_result, "Deleting a lattice cell shell" );
+  // the node's bounding box is its shell's box, translated; nodes that fall outside
+  // the lattice's bounding box are rejected without creating anything.
+  if( !nodes.in_bounds[n] ){
     if( OPT_DEBUG ) std::cout << uprefix() << " node failed bbox check" << std::endl;
     return false;
   }
 
-  entity_collection_t node_subcells;
-  if( fn->getFillingUniverse() == 0 ){
+  const FillNode* fn = nodes.fill[n];
+  if( nodes.universe[n] == 0 ){
     // this node of the lattice was assigned universe zero, meaning it's
-    // defined to be emtpy. Delete the shell and return true.
-    iGeom_deleteEnt( igm, cell_copy, &igm_result );
-    CHECK_IGEOM( igm_result, "Deleting a universe-0 lattice cell" );
+    // defined to be emtpy.
     return true;
   }
-  else if( fn->getFillingUniverse() == lattice_universe ){
+
+  Transform t = nodes.getTx( n );
+  int igm_result;
+
+  size_t path_length = origin_path.length();
+  std::stringstream node_name;
+  node_name << "[" << nodes.x[n] << "," << nodes.y[n] << "," << nodes.z[n] << "]";
+  origin_path += node_name.str();
+  ProfileScope profile_scope( "lattice", cell.getIdent(), profilingEnabled() ? origin_path : std::string() );
+
+  // the node's bodies are appended to accum, and bounded there
+  size_t begin = accum.size();
+  if( nodes.universe[n] == lattice_universe ){
     // this node is just a translated copy of the origin element in the lattice
+    iBase_EntityHandle cell_copy;
+    PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, cell_shell, &cell_copy, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Copying a lattice cell shell" );
+    cell_copy = applyTransform( t, igm, cell_copy );
+
     setVolumeCellID(cell_copy, cell.getIdent());
     if( cell.getMat() != 0 ){ setMaterial( cell_copy, cell.getMat(), cell.getRho() ); }
     if( cell.getImportances().size() ){ setImportances( cell_copy, cell.getImportances()); }
-    node_subcells.push_back( cell_copy );
+    accum.push_back( cell_copy );
   }
   else{
-    // this node has an embedded universe
+    // this node has an embedded universe, which is built inside an untranslated
+    // copy of the shell and then moved into place.
 
     iBase_EntityHandle cell_copy_unmoved;
-    iGeom_copyEnt( igm, cell_shell, &cell_copy_unmoved, &igm_result );
-    CHECK_IGEOM( igm_result, "Re-copying a lattice cell shell" );
-    node_subcells = defineUniverse(  fn->getFillingUniverse(), cell_copy_unmoved, (fn->hasTransform() ? &(fn->getTransform()) : NULL ) );
-    for( size_t i = 0; i < node_subcells.size(); ++i ){
-      node_subcells[i] = applyTransform( t, igm, node_subcells[i] );
+    PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, cell_shell, &cell_copy_unmoved, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Copying a lattice cell shell" );
+    defineUniverse(  nodes.universe[n], accum, cell_copy_unmoved, (fn->hasTransform() ? &(fn->getTransform()) : NULL ) );
+    for( size_t i = begin; i < accum.size(); ++i ){
+      accum[i] = applyTransform( t, igm, accum[i] );
     }
 
-    iGeom_deleteEnt( igm, cell_copy, &igm_result );
-    CHECK_IGEOM( igm_result, "Deleting lattice cell copy" );
-
   }
+  origin_path.resize( path_length );
 
-  // bound the node with the enclosing lattice shell
+  // bound the node with the enclosing lattice shell, which consumes each of its bodies;
+  // the results that survive are packed down in place
   bool success = false;
-  for( size_t i = 0; i < node_subcells.size(); ++i ){
+  size_t kept = begin;
+  for( size_t i = begin; i < accum.size(); ++i ){
     iBase_EntityHandle lattice_shell_copy;
-    iGeom_copyEnt( igm, lattice_shell, &lattice_shell_copy, &igm_result );
+    PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, lattice_shell, &lattice_shell_copy, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Copying a lattice shell" );
 
     iBase_EntityHandle result;
-    if( intersectIfPossible( igm, lattice_shell_copy, node_subcells[i], &result, true ) ){
-      updateMaps( node_subcells[i], result );
+    if( intersectIfPossible( igm, lattice_shell_copy, accum[i], &result, true ) ){
+      updateMaps( accum[i], result );
       if( OPT_DEBUG ) std::cout << " node defined successfully" << std::endl;
-      accum.push_back( result );
+      accum[kept++] = result;
+      profile_scope.addBodies( 1 );
       success = true;
     }
     else{ 
-      // lattice_shell_copy and node_subcells[i] were deleted by intersectIfPossible(),
+      // lattice_shell_copy and accum[i] were deleted by intersectIfPossible(),
       // so there's no need to delete them explicitly
-      updateMaps( node_subcells[i], NULL );
+      updateMaps( accum[i], NULL );
       if( OPT_DEBUG ) std::cout << " node failed intersection" << std::endl;
     }
   }
+  accum.truncate( kept );
 
   return success;
 }
 
-typedef struct{ int v[3]; } int_triple;
-
-static std::vector<int_triple> makeGridShellOfRadius( int r, int dimensions ){
-  if( r == 0 ){ 
-    int_triple v; v.v[0] = v.v[1] = v.v[2] = 0;
-    return std::vector<int_triple>(1,v);
-  }
-  else{
-    std::vector<int_triple> ret;
-    
-    int jmin = dimensions > 1 ? -r : 0;
-    int jmax = dimensions > 1 ?  r : 0;
-    int kmin = dimensions > 2 ? -r : 0;
-    int kmax = dimensions > 2 ?  r : 0;
-    for( int i = -r; i <= r; ++i ){
-      for( int j = jmin;j <= jmax; ++j ){
-        for( int k = kmin; k <= kmax; ++k ){
-          if( i == -r || i == r ||
-              j == -r || j == r ||
-              k == -r || k == r ){
-            int_triple v;
-            v.v[0] = i; 
-            v.v[1] = j;
-            v.v[2] = k;
-            ret.push_back(v);
-          }
-        }
-      }
-    }
-    return ret;
-  }
-}
+// number of lattice nodes whose table entries are computed at a time
+static const size_t lattice_chunk_size = 4096;
 
 /** fill a cell with its contents.  The cell's boundary is already defined in cell_shell. */
-entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_EntityHandle cell_shell, 
-                                                   iBase_EntityHandle lattice_shell = NULL )
+size_t GeometryContext::populateCell( CellCard& cell, OwnedBodies& out, iBase_EntityHandle cell_shell,
+                                     iBase_EntityHandle lattice_shell = NULL )
 {
   
   if( OPT_DEBUG ) std::cout << uprefix() << "Populating cell " << cell.getIdent() << std::endl;
@@ -642,7 +867,8 @@ entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_Entity
     setVolumeCellID(cell_shell, cell.getIdent());
     if( cell.getMat() != 0 ){ setMaterial( cell_shell, cell.getMat(), cell.getRho() ); }
     if( cell.getImportances().size() ){ setImportances( cell_shell, cell.getImportances()); }
-    return entity_collection_t(1, cell_shell );
+    out.push_back( cell_shell );
+    return 1;
   }
   else if(cell.hasFill() && !cell.isLattice()){
     // define a simple (non-lattice) fill
@@ -668,9 +894,7 @@ entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_Entity
 
     if( OPT_DEBUG && t ) std::cout << uprefix() << " ... and has transform: " << *t << std::endl;
 
-    entity_collection_t subcells = defineUniverse(  filling_universe, cell_shell, t );
- 
-    return subcells;
+    return defineUniverse(  filling_universe, out, cell_shell, t );
      
   }
   else {
@@ -681,30 +905,42 @@ entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_Entity
     
     if( OPT_VERBOSE ) std::cout << uprefix() << "Creating cell " << cell.getIdent() << "'s lattice" << std::endl;
 
-    entity_collection_t subcells;
+    // both shells are only templates for the nodes, and are discarded once the lattice is built
+    OwnedBodies shells( *this, cell_shell );
+    shells.push_back( lattice_shell );
+    size_t begin = out.size();
         
     const Lattice& lattice = cell.getLattice();
     int num_dims = lattice.numFiniteDirections();
     
     if( OPT_DEBUG ) std::cout << uprefix() << "  lattice num dims: " << num_dims << std::endl;
 
+    // bounding boxes of the lattice's origin element and of its container; every node's
+    // box is derived from these in the node table rather than queried from the kernel.
+    Vector3d shell_min, shell_max, lattice_min, lattice_max;
+    getBoundBox( igm, cell_shell, shell_min, shell_max );
+    getBoundBox( igm, lattice_shell, lattice_min, lattice_max );
+
+    LatticeNodeTable nodes;
+
     if( lattice.isFixedSize() ){
 
       if( OPT_DEBUG ) std::cout << uprefix() << "Defining fixed lattice" << std::endl;
 
-      irange xrange = lattice.getXRange(), yrange = lattice.getYRange(), zrange = lattice.getZRange();
+      size_t num_nodes = lattice.numNodes();
+      for( size_t begin = 0; begin < num_nodes; begin += lattice_chunk_size ){
 
-      for( int i = xrange.first; i <= xrange.second; ++i){
-        for( int j = yrange.first; j <= yrange.second; ++j ){
-          for( int k = zrange.first; k <= zrange.second; ++k ){
+        nodes.clear();
+        lattice.addNodes( nodes, begin, std::min( begin + lattice_chunk_size, num_nodes ) );
+        lattice.computeNodeTable( nodes, shell_min, shell_max, lattice_min, lattice_max );
 
-            if( OPT_DEBUG ) std::cout << uprefix() << "Defining lattice node " << i << ", " << j << ", " << k << std::endl;
+        for( size_t n = 0; n < nodes.size(); ++n ){
 
-            /* bool success = */ defineLatticeNode( cell, cell_shell, lattice_shell, i, j, k, subcells );
+          if( OPT_DEBUG ) std::cout << uprefix() << "Defining lattice node " 
+                                    << nodes.x[n] << ", " << nodes.y[n] << ", " << nodes.z[n] << std::endl;
+
+          /* bool success = */ defineLatticeNode( cell, cell_shell, lattice_shell, nodes, n, out );
 
-            if( num_dims < 3 ) break; // from z loop
-          }
-          if( num_dims < 2 ) break; // from y loop
         }
       }
 
@@ -721,35 +957,42 @@ entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_Entity
       bool done = false, done_one = !Gopt.infinite_lattice_extra_effort;
       int radius = 0;
 
+      bool reached_container = false;
+      int reach_radius = lattice.getRadiusOfPoint( (lattice_min + lattice_max) * 0.5 );
+
       while( !done ){
         
         done = done_one;
-        std::vector<int_triple> shell = makeGridShellOfRadius(radius++, num_dims);
+        nodes.clear();
+        lattice.addShellOfRadius( nodes, radius++ );
+        lattice.computeNodeTable( nodes, shell_min, shell_max, lattice_min, lattice_max );
 
-        for( std::vector<int_triple>::iterator i = shell.begin(); i!=shell.end(); ++i){
-          int x = (*i).v[0];
-          int y = (*i).v[1];
-          int z = (*i).v[2];
+        for( size_t n = 0; n < nodes.size(); ++n ){
           
-          if( OPT_DEBUG ) std::cout << uprefix() << "Defining lattice node " << x << ", " << y << ", " << z << std::endl;
+          if( OPT_DEBUG ) std::cout << uprefix() << "Defining lattice node " 
+                                    << nodes.x[n] << ", " << nodes.y[n] << ", " << nodes.z[n] << std::endl;
 
-          bool success = defineLatticeNode( cell, cell_shell, lattice_shell, x, y, z, subcells );
+          bool success = defineLatticeNode( cell, cell_shell, lattice_shell, nodes, n, out );
           if( success ){
             done = false;
             done_one = true;
+            reached_container = true;
           }
 
         }       
+
+        // within a shard, the lattice's container may be nowhere near the lattice's origin,
+        // so empty shells are expected until the first node lands inside the container.
+        // If the container is out of the lattice's reach, give up a shell after the one
+        // that should have reached its center.
+        if( shard_region && !reached_container && radius <= reach_radius + 1 ){
+          done = false;
+        }
       }
     }
 
-    int igm_result;
-    iGeom_deleteEnt( igm, cell_shell, &igm_result );
-    CHECK_IGEOM( igm_result, "Deleting cell shell after building lattice" );
-    iGeom_deleteEnt( igm, lattice_shell, &igm_result );
-    CHECK_IGEOM( igm_result, "Deleting lattice shell after building lattice" );
-
-    return subcells;
+    shells.clear();
+    return out.size() - begin;
   }
 }
 
@@ -758,29 +1001,29 @@ entity_collection_t GeometryContext::populateCell( CellCard& cell,  iBase_Entity
  * @param defineEmbedded If true, also define the contents of the cell, not just its boundary surfaces.
  * @param lattice_shell
  */
-entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEmbedded = true, 
-                                                  iBase_EntityHandle lattice_shell = NULL )
+size_t GeometryContext::defineCell( CellCard& cell, OwnedBodies& out, bool defineEmbedded = true,
+                                    iBase_EntityHandle lattice_shell = NULL )
 {
   int ident = cell.getIdent();
   const CellCard::geom_list_t& geom = cell.getGeom();
+  ProfileScope profile_scope( "cell", ident );
+  // a lattice's cell takes over the shell that bounds it
+  OwnedBodies owned_shell( *this, lattice_shell );
+  CensusScope census_scope( ident, origin_path, lattice_shell ? 1 : 0 );
  
   if( OPT_VERBOSE ) std::cout << uprefix() << "Defining cell " << ident << std::endl;
 
   int igm_result;
 
-  entity_collection_t tmp;
-
-  std::vector<iBase_EntityHandle> stack;
+  OwnedBodies stack( *this );
   for(CellCard::geom_list_t::const_iterator i = geom.begin(); i!=geom.end(); ++i){
     
     const CellCard::geom_list_entry_t& token = (*i);
     switch(token.first){
     case CellCard::CELLNUM:
       // a cell number appears in a geometry list only because it is being complemented with the # operator
-      // thus, when defineCell is called on it, set defineEmbedded to false
-      tmp = defineCell( *(deck.lookup_cell_card(token.second)), false);
-      assert(tmp.size() == 1);
-      stack.push_back( tmp.at(0) );
+      // thus, when defineCell is called on it, set defineEmbedded to false, and it adds just its shell
+      defineCell( *(deck.lookup_cell_card(token.second)), stack, false );
       break;
     case CellCard::SURFNUM:
       {      
@@ -794,7 +1037,12 @@ entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEm
           iBase_EntityHandle surf_handle = surf.define( pos, igm, world_size );
           stack.push_back(surf_handle);
         }
-        catch(std::runtime_error& e) { std::cerr << e.what() << std::endl; }
+        catch(std::runtime_error& e) {
+          std::cerr << e.what() << std::endl;
+          std::stringstream msg;
+          msg << "Cell " << ident << " cannot be defined without surface " << surface;
+          throw std::runtime_error( msg.str() );
+        }
       }
       break;
     case CellCard::MBODYFACET:
@@ -808,13 +1056,14 @@ entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEm
     case CellCard::INTERSECT:
       {
         assert( stack.size() >= 2 );
-        iBase_EntityHandle s1 = stack.back(); stack.pop_back();
-        iBase_EntityHandle s2 = stack.back(); stack.pop_back();
+        iBase_EntityHandle s1 = stack.pop();
+        iBase_EntityHandle s2 = stack.pop();
         iBase_EntityHandle result;
         if( intersectIfPossible( igm, s1, s2, &result ) ){
           stack.push_back(result);
         }
         else{
+          // s1 and s2 were deleted by intersectIfPossible(); the stack discards the rest
           std::cout << "FAILED INTERSECTION CELL #" << cell.getIdent() << std::endl;
           throw std::runtime_error("Intersection failed");
         }
@@ -824,10 +1073,10 @@ entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEm
       { 
         assert( stack.size() >= 2 );
         iBase_EntityHandle s[2];
-        s[0] = stack.back(); stack.pop_back();
-        s[1] = stack.back(); stack.pop_back();
+        s[0] = stack.pop();
+        s[1] = stack.pop();
         iBase_EntityHandle result;
-        iGeom_uniteEnts( igm, s, 2, &result, &igm_result);
+        PROFILE_IGEOM( "uniteEnts", iGeom_uniteEnts( igm, s, 2, &result, &igm_result) );
         CHECK_IGEOM( igm_result, "Uniting two entities" );
         stack.push_back(result);
       }
@@ -836,10 +1085,10 @@ entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEm
       {
         assert (stack.size() >= 1 );
         iBase_EntityHandle world_sphere = makeWorldSphere(igm, world_size);
-        iBase_EntityHandle s = stack.back(); stack.pop_back();
+        iBase_EntityHandle s = stack.pop();
         iBase_EntityHandle result;
 
-        iGeom_subtractEnts( igm, world_sphere, s, &result, &igm_result);
+        PROFILE_IGEOM( "subtractEnts", iGeom_subtractEnts( igm, world_sphere, s, &result, &igm_result) );
         CHECK_IGEOM( igm_result, "Complementing an entity" );
         stack.push_back(result);
       }
@@ -852,38 +1101,77 @@ entity_collection_t GeometryContext::defineCell(  CellCard& cell,  bool defineEm
 
   assert( stack.size() == 1);
 
-  iBase_EntityHandle cellHandle = stack[0];
-
   if( cell.getTrcl().hasData() ){
-    cellHandle = applyTransform( cell.getTrcl().getData(), igm, cellHandle );
+    stack[0] = applyTransform( cell.getTrcl().getData(), igm, stack[0] );
   }
 
   if( defineEmbedded ){
-    return populateCell( cell, cellHandle, lattice_shell );
+
+    if( shard_region && cell.getUniverse() == 0 ){
+      // building one shard of universe 0: only the part of the cell within the shard is needed,
+      // and cutting it down now keeps whatever fills the cell from being built everywhere else
+      if( !boundBoxesIntersect( igm, stack[0], shard_region ) ){
+        stack.clear();
+        owned_shell.clear();
+        census_scope.close( 0 );
+        return 0;
+      }
+
+      iBase_EntityHandle region_copy, clipped;
+      PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, shard_region, &region_copy, &igm_result ) );
+      CHECK_IGEOM( igm_result, "Copying the shard region" );
+      if( !intersectIfPossible( igm, region_copy, stack.pop(), &clipped, true ) ){
+        owned_shell.clear();
+        census_scope.close( 0 );
+        return 0;
+      }
+      stack.push_back( clipped );
+    }
+
+    size_t path_length = origin_path.length();
+    std::stringstream cell_name;
+    cell_name << "/" << ident;
+    origin_path += cell_name.str();
+
+    // populateCell() takes over the cell's shell and the lattice shell
+    iBase_EntityHandle cell_shell = stack.pop();
+    owned_shell.release();
+    size_t count = populateCell( cell, out, cell_shell, lattice_shell );
+    origin_path.resize( path_length );
+    profile_scope.addBodies( count );
+    census_scope.close( count );
+    return count;
   }
   else{
-    return entity_collection_t( 1, cellHandle );
+    census_scope.close( 1 );
+    out.push_back( stack.pop() );
+    return 1;
   }
   
 }
 
-/** Define all the cells in a universe.
+/** Define all the cells in a universe, appending them to out.
  *
  * @param container If non-null, intersect the universe with this boundary volume
  * @param transform If non-null, transform the universe thus.
+ * @return The number of bodies appended
  */
-entity_collection_t GeometryContext::defineUniverse( int universe, iBase_EntityHandle container = NULL, 
-                                                     const Transform* transform = NULL )
+size_t GeometryContext::defineUniverse( int universe, OwnedBodies& out, iBase_EntityHandle container = NULL,
+                                        const Transform* transform = NULL )
 {
 
   if( OPT_VERBOSE ) std::cout << uprefix() << "Defining universe " << universe << std::endl;
   universe_depth++;
+  ProfileScope profile_scope( "universe", universe );
 
   InputDeck::cell_card_list u_cells = deck.getCellsOfUniverse( universe );
-  entity_collection_t subcells;
+  size_t begin = out.size();
 
+  // the container is this universe's to discard, unless it becomes the shell of a lattice
+  OwnedBodies owned_container( *this, container );
   iBase_EntityHandle lattice_shell = NULL;
   if( u_cells.size() == 1 && u_cells[0]->isLattice() ){
+    owned_container.release();
     lattice_shell = container;
     // reverse-transform the containing volume before using it as a lattice boundary
     if(transform){
@@ -891,39 +1179,62 @@ entity_collection_t GeometryContext::defineUniverse( int universe, iBase_EntityH
     }
   }
 
-  // define all the cells of this universe
-  for( InputDeck::cell_card_list::iterator i = u_cells.begin(); i!=u_cells.end(); ++i){
-    entity_collection_t tmp = defineCell( *(*i), true, lattice_shell );
-    for( size_t i = 0; i < tmp.size(); ++i){
-      subcells.push_back( tmp[i] );
+  std::map< int, ExportedBodies >::iterator pre = prebuilt.find( universe );
+  if( pre != prebuilt.end() ){
+    // this universe was built ahead of time; place copies of its bodies
+    if( OPT_DEBUG ) std::cout << uprefix() << "Copying prebuilt universe " << universe << std::endl;
+    out.append( copyPrebuiltUniverse( (*pre).second ) );
+  }
+  else{
+    // define all the cells of this universe, less any that a checkpointed run already defined
+    bool checkpointing = universe == 0 && checkpoint_key.length();
+    size_t first_cell = checkpointing ? resumeCheckpoint( out, u_cells.size() ) : 0;
+    bool budgeted = universe == 0 && Gopt.cell_timeout > 0 && !shard_region;
+    std::map< int, ExportedBodies > timed_cells;
+    if( budgeted ){
+      defineCellsInWorkers( u_cells, first_cell, timed_cells );
+    }
+    for( size_t c = first_cell; c < u_cells.size(); ++c ){
+      if( budgeted ){
+        placeTimedCell( *(u_cells[c]), timed_cells, out );
+      }
+      else{
+        defineCell( *(u_cells[c]), out, true, lattice_shell );
+      }
+      if( checkpointing && wallTime() - last_checkpoint >= Gopt.checkpoint_interval ){
+        saveCheckpoint( out, begin, c + 1 );
+      }
     }
   }
   
   if( transform ){
-    for( size_t i = 0; i < subcells.size(); ++i){
-      subcells[i] = applyTransform( *transform, igm, subcells[i] );      
+    for( size_t i = begin; i < out.size(); ++i){
+      out[i] = applyTransform( *transform, igm, out[i] );
     }
   }
 
   if( container && !lattice_shell ){
     
     int igm_result;
-    
-    for( size_t i = 0; i < subcells.size(); ++i ){
+
+    // the subcells that survive are packed down in place, keeping their order
+    size_t kept = begin;
+    for( size_t i = begin; i < out.size(); ++i ){
       
       if( OPT_DEBUG ) std::cout << uprefix() << "Bounding a universe cell..." << std::flush;    
+      iBase_EntityHandle subcell = out[i];
       bool subcell_removed = false;
 
-      if( boundBoxesIntersect( igm, subcells[i], container )){
+      if( boundBoxesIntersect( igm, subcell, container )){
         iBase_EntityHandle container_copy;
-        iGeom_copyEnt( igm, container, &container_copy, &igm_result);
+        PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, container, &container_copy, &igm_result) );
         CHECK_IGEOM( igm_result, "Copying a universe-bounding cell" );
         
         iBase_EntityHandle subcell_bounded;
-        bool valid_result = intersectIfPossible( igm, container_copy, subcells[i], &subcell_bounded );
+        bool valid_result = intersectIfPossible( igm, container_copy, subcell, &subcell_bounded );
         if( valid_result ){
-          updateMaps( subcells[i], subcell_bounded );
-          subcells[i] = subcell_bounded;
+          updateMaps( subcell, subcell_bounded );
+          subcell = subcell_bounded;
           if( OPT_DEBUG ) std::cout << " ok." <<  std::endl;
         }
         else{
@@ -932,172 +1243,1728 @@ entity_collection_t GeometryContext::defineUniverse( int universe, iBase_EntityH
 
       }
       else{
-        // bounding boxes didn't intersect, delete subcells[i].
+        // bounding boxes didn't intersect, delete the subcell.
         // this suggests invalid geometry, but we can continue anyway.
-        iGeom_deleteEnt( igm, subcells[i], &igm_result );
+        PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, subcell, &igm_result ) );
         CHECK_IGEOM( igm_result, "Deleting a subcell that didn't intersect a parent's bounding box (strange!)" );
         subcell_removed = true;
       }
       
       if( subcell_removed ){
-        updateMaps( subcells[i], NULL );
-        subcells.erase( subcells.begin()+i );
-        i--;
+        updateMaps( subcell, NULL );
         if( OPT_DEBUG ) std::cout << " removed." << std::endl;
       }
+      else{
+        out[kept++] = subcell;
+      }
       
     }
+    out.truncate( kept );
         
-    iGeom_deleteEnt( igm, container, &igm_result );
-    CHECK_IGEOM( igm_result, "Deleting a bounding cell" );
+    owned_container.clear();
   }
 
   universe_depth--;
   if( OPT_VERBOSE ) std::cout << uprefix() << "Done defining universe " << universe << std::endl;
 
-  return subcells;
+  profile_scope.addBodies( out.size() - begin );
+  return out.size() - begin;
  
 }
 
-/**
- * Create the graveyard bounding cell.  The actual graveyard entity is returned.
- * A copy of the inner surface of the graveyard cell
- * is returned in the argument, to be used as the boundary of all further geometry.
- */
-iBase_EntityHandle GeometryContext::createGraveyard( iBase_EntityHandle& inner_copy ) {
-  iBase_EntityHandle inner, outer, graveyard;
-  int igm_result;
-
-  double inner_size = 2.0 * world_size;
-  iGeom_createBrick( igm, inner_size, inner_size, inner_size, &inner, &igm_result );
-  CHECK_IGEOM( igm_result, "Making graveyard" );
-  
-  iGeom_copyEnt( igm, inner, &inner_copy, &igm_result );
-  CHECK_IGEOM( igm_result, "Copying graveyard" );
-  
-  double outer_size = 2.0 * ( world_size + (world_size / 50.0) );
-  iGeom_createBrick( igm, outer_size, outer_size, outer_size, &outer, &igm_result );
-  CHECK_IGEOM( igm_result, "Making outer graveyard" );
+/** A worker job that builds one universe and exports it to a file */
+class UniverseBuildJob : public WorkerJob {
+protected:
+  GeometryContext& context;
+  int universe;
+  const std::set<int>& dependencies;
+  std::string filename;
+public:
+  UniverseBuildJob( GeometryContext& context_p, int universe_p, const std::set<int>& deps_p,
+                    const std::string& filename_p ) :
+    context(context_p), universe(universe_p), dependencies(deps_p), filename(filename_p)
+  {}
 
-  iGeom_subtractEnts( igm, outer, inner, &graveyard, &igm_result );
-  CHECK_IGEOM( igm_result, "subtracting graveyard" );
-  
-  addToVolumeGroup( graveyard, "graveyard" );
-  
-  // reset world size to a sphere that bounds the inner shell of this graveyard
-  world_size *= sqrt(3.0);
-  if( OPT_DEBUG ) std::cout << "Spherical world size for graveyard: " << world_size << std::endl;
-  
-  return graveyard;
+  virtual bool run(){
+    return context.buildUniverseInWorker( universe, dependencies, filename );
+  }
+};
 
-}
+/** A worker job that builds one shard of universe 0 and exports it to a file */
+class ShardBuildJob : public WorkerJob {
+protected:
+  GeometryContext& context;
+  int shard;
+  Vector3d min, max;
+  std::string filename;
+public:
+  ShardBuildJob( GeometryContext& context_p, int shard_p, const Vector3d& min_p, const Vector3d& max_p,
+                 const std::string& filename_p ) :
+    context(context_p), shard(shard_p), min(min_p), max(max_p), filename(filename_p)
+  {}
 
-void GeometryContext::createGeometry( ){
+  virtual bool run(){
+    return context.buildShardInWorker( shard, min, max, filename );
+  }
+};
 
-  int igm_result;
- 
-  InputDeck::cell_card_list    cells     = deck.getCells();
-  InputDeck::surface_card_list surfaces  = deck.getSurfaces();
-  InputDeck::data_card_list    datacards = deck.getDataCards();
+/** A worker job that defines one cell of universe 0, or only its shell, and exports it to a file */
+class CellBuildJob : public WorkerJob {
+protected:
+  GeometryContext& context;
+  int ident;
+  bool shell_only;
+  std::string filename;
+public:
+  CellBuildJob( GeometryContext& context_p, int ident_p, bool shell_only_p, const std::string& filename_p ) :
+    context(context_p), ident(ident_p), shell_only(shell_only_p), filename(filename_p)
+  {}
 
-  // estimate how large the geometry will need to be to accomodate all the surfaces
-  for( InputDeck::surface_card_list::iterator i = surfaces.begin(); i!=surfaces.end(); ++i){
-    // catch all exceptions from makeSurface at this time; if they exist, they will
-    // more properly be displayed to the user at a later time.  Right now we just want
-    // to estimate a size and failures can be ignored.
-    try{
-      world_size = std::max( world_size, makeSurface( *i ).getFarthestExtentFromOrigin() );
-    } catch(std::runtime_error& e){}
+  virtual bool run(){
+    return context.buildCellInWorker( ident, shell_only, filename );
   }
+};
 
-  // translations can extend the size of the world
-  double translation_addition = 0;
-  for( InputDeck::data_card_list::iterator i = datacards.begin(); i!=datacards.end(); ++i){
-    DataCard* c = *i;
-    if( c->getKind() == DataCard::TR ){
-      double tform_len = dynamic_cast<DataRef<Transform>*>(c)->getData().getTranslation().length();
-      translation_addition = std::max (translation_addition, tform_len );
-    }
-  }
+/** A worker job that imprints and merges one spatial shard of the finished cells, and exports them */
+class ImprintShardJob : public WorkerJob {
+protected:
+  GeometryContext& context;
+  int shard;
+  const entity_collection_t& bodies;
+  double tolerance;
+  std::string filename;
+public:
+  ImprintShardJob( GeometryContext& context_p, int shard_p, const entity_collection_t& bodies_p,
+                   double tolerance_p, const std::string& filename_p ) :
+    context(context_p), shard(shard_p), bodies(bodies_p), tolerance(tolerance_p), filename(filename_p)
+  {}
 
-  for( InputDeck::cell_card_list::iterator i = cells.begin(); i!=cells.end(); ++i){
-    CellCard* c = *i;
-      // translations can come from TRCL data
-    if( c->getTrcl().hasData() ){
-      double tform_len = c->getTrcl().getData().getTranslation().length();
-      translation_addition = std::max( translation_addition, tform_len );
-    }
-    // translations can also come from fill nodes.  This implementation does *not* take
-    // lattices into account, as they are assumed to be contained within other volumes.
-    if( c->hasFill() && c->getFill().getOriginNode().hasTransform() ){
-      double tform_len = c->getFill().getOriginNode().getTransform().getTranslation().length();
-      translation_addition = std::max( translation_addition, tform_len );
-    }
+  virtual bool run(){
+    return context.imprintShardInWorker( shard, bodies, tolerance, filename );
   }
+};
 
-  world_size += translation_addition;
-  world_size *= 1.2;
+/** Name given to body k of a set of exported bodies, so that it can be identified after import */
+static std::string exportedBodyName( const std::string& label, size_t k ){
+  std::stringstream formatter;
+  formatter << "mcnp2cad_" << label << "_" << k;
+  return formatter.str();
+}
 
-  std::cout << "World size: " << world_size << " (trs added " << translation_addition << ")" << std::endl;
+static std::string universeLabel( int universe ){
+  std::stringstream formatter;
+  formatter << "u" << universe;
+  return formatter.str();
+}
 
-  iBase_EntityHandle graveyard = NULL, graveyard_boundary = NULL;
-  if( Gopt.make_graveyard ){
-    graveyard = createGraveyard ( graveyard_boundary ); 
-  }
+static std::string shardLabel( int shard ){
+  std::stringstream formatter;
+  formatter << "s" << shard;
+  return formatter.str();
+}
 
-  std::cout << "Defining geometry..." << std::endl;
+static std::string imprintLabel( int shard ){
+  std::stringstream formatter;
+  formatter << "i" << shard;
+  return formatter.str();
+}
 
-  entity_collection_t defined_cells = defineUniverse( 0, graveyard_boundary );
-  if( graveyard ){ defined_cells.push_back(graveyard); }
+static std::string cellLabel( int ident ){
+  std::stringstream formatter;
+  formatter << "c" << ident;
+  return formatter.str();
+}
 
-  size_t count = defined_cells.size();
-  iBase_EntityHandle *cell_array = new iBase_EntityHandle[ count ];
-  for( unsigned int i = 0; i < count; ++i ){
-    cell_array[i] = defined_cells[i];
-  }
+/** File name extension of exported bodies, which use the output file's format */
+static std::string exportExtension( ){
+  size_t dot = Gopt.output_file.find_last_of( '.' );
+  return ( dot == std::string::npos ) ? ".sat" : Gopt.output_file.substr( dot );
+}
 
-#ifdef USING_CGMA
-  {
-    // in CGM's default implementation, each new volume and surface created
-    // through CSG operations gets a new unique ID number, so those IDs can
-    // be large and widely-spaced.  We want them to start from 1.
-    RefEntityFactory::instance()->compress_ref_ids("surface", false );
-    RefEntityFactory::instance()->compress_ref_ids("volume", false );
+static const char* checkpoint_label = "checkpoint";
+
+/** Return the path of a new file in the scratch directory, creating the directory if needed */
+std::string GeometryContext::scratchFile( const std::string& label ){
+  if( scratch_dir.empty() ){
+    scratch_dir = makeScratchDirectory( "mcnp2cad." );
   }
-#endif
+  return scratch_dir + "/" + label + exportExtension();
+}
 
+/**
+ * Create the iGeom instance of a worker process.  Under some implementations, all the
+ * instances of a process share one model, and the worker would start with a copy of
+ * everything its parent had built; those entities are deleted, so that the worker's
+ * exported file contains only its own bodies.
+ */
+bool GeometryContext::newWorkerInstance( iGeom_Instance& worker_igm ){
+  int igm_result;
+  iGeom_newGeom( Gopt.igeom_init_options.c_str(), &worker_igm, &igm_result, Gopt.igeom_init_options.length() );
+  CHECK_IGEOM( igm_result, "Initializing iGeom in a worker process" );
+  if( igm_result != iBase_SUCCESS ) return false;
 
-  if( OPT_DEBUG ){ mapSanityCheck(cell_array, count); }
-  tagGroups();
+  PROFILE_IGEOM( "deleteAll", iGeom_deleteAll( worker_igm, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Clearing a worker's iGeom instance" );
+  return igm_result == iBase_SUCCESS;
+}
 
-  if( Gopt.tag_cell_IDs ){
-    tagCellIDsAsEntNames();
+/**
+ * Build every universe that can be built independently of its container in a pool of
+ * worker processes.  The exported files are recorded in prebuilt_files.
+ *
+ * Universes are started as soon as all the universes they contain have been built, most
+ * expensive first; each worker imports the universes it depends on.  A universe whose
+ * worker fails is simply not prebuilt, and will be built in place as usual.  With a body
+ * cache, universes found in it are not built at all, and those built are added to it.
+ */
+void GeometryContext::prebuildUniverses( ){
+
+  UniverseGraph graph( deck );
+  std::vector<int> pending = graph.getBuildableUniverses();
+  if( pending.empty() ) return;
+
+  std::set<int> finished; // includes universes whose workers failed
+  std::map< int, std::string > job_files;
+
+  if( body_cache ){
+    size_t num_buildable = pending.size();
+    for( size_t i = 0; i < pending.size(); ){
+      std::string cached = body_cache->lookup( pending[i] );
+      if( cached.empty() ){ ++i; continue; }
+      if( OPT_VERBOSE ) std::cout << "Universe " << pending[i] << " is in the body cache" << std::endl;
+      prebuilt_files[ pending[i] ] = cached;
+      finished.insert( pending[i] );
+      pending.erase( pending.begin() + i );
+    }
+    std::cout << "Found " << num_buildable - pending.size() << " of " << num_buildable
+              << " universes in the body cache." << std::endl;
+    if( pending.empty() ) return;
   }
-  
 
-  if ( Gopt.imprint_geom ) {
-    std::cout << "Imprinting all...\t\t\t" << std::flush;
-    iGeom_imprintEnts( igm, cell_array, count, &igm_result );
-    CHECK_IGEOM( igm_result, "Imprinting all cells" );
-    std::cout << " done." << std::endl;
+  std::cout << "Prebuilding " << pending.size() << " universes with "
+            << Gopt.worker_processes << " worker processes..." << std::endl;
+
+  WorkerPool pool( Gopt.worker_processes );
+
+  while( !pending.empty() || pool.numRunning() > 0 ){
+
+    // start every universe whose dependencies are all finished, in order of decreasing cost
+    for( size_t i = 0; i < pending.size() && pool.hasFreeSlot(); ){
+      int u = pending[i];
+      const std::set<int>& deps = graph.getDependencies( u );
+      bool ready = true;
+      for( std::set<int>::const_iterator j = deps.begin(); j != deps.end() && ready; ++j ){
+        ready = finished.count( *j ) > 0;
+      }
+
+      if( !ready ){ ++i; continue; }
+
+      job_files[u] = scratchFile( universeLabel( u ) );
+
+      if( OPT_VERBOSE ) std::cout << "Prebuilding universe " << u << " (estimated cost "
+                                  << graph.getCost( u ) << ")" << std::endl;
+      UniverseBuildJob job( *this, u, deps, job_files[u] );
+      if( !pool.start( u, job ) ){
+        finished.insert( u );
+      }
+      pending.erase( pending.begin() + i );
+    }
+
+    if( pool.numRunning() == 0 ){
+      // nothing is running and nothing more could be started
+      if( !pending.empty() ){
+        std::cerr << "Warning: " << pending.size() << " universes could not be scheduled;"
+                  << " they will be built in place." << std::endl;
+      }
+      break;
+    }
+
+    bool success;
+    int u = pool.waitAny( success );
+    finished.insert( u );
+    if( success ){
+      prebuilt_files[u] = job_files[u];
+      if( body_cache ) body_cache->store( u, job_files[u] );
+    }
+    else{
+      std::cerr << "Warning: prebuilding universe " << u << " failed; it will be built in place." << std::endl;
+    }
+  }
+
+  std::cout << "Prebuilt " << prebuilt_files.size() << " universes." << std::endl;
+
+}
+
+/** Load all the universes in prebuilt_files into this instance, for defineUniverse() to copy */
+void GeometryContext::importPrebuiltUniverses( ){
+
+  for( std::map<int,std::string>::iterator i = prebuilt_files.begin(); i != prebuilt_files.end(); ++i ){
+    int u = (*i).first;
+    if( !importBodies( universeLabel( u ), (*i).second, prebuilt[u] ) ){
+      prebuilt.erase( u );
+      std::cerr << "Warning: could not import prebuilt universe " << u
+                << "; it will be built in place." << std::endl;
+    }
+  }
+
+}
+
+/** Called in a worker process: build a universe in a new iGeom instance and export it */
+bool GeometryContext::buildUniverseInWorker( int universe, const std::set<int>& dependencies,
+                                             const std::string& filename ){
+
+  iGeom_Instance worker_igm;
+  if( !newWorkerInstance( worker_igm ) ) return false;
+
+  GeometryContext worker( worker_igm, deck );
+  worker.world_size = world_size;
+
+  for( std::set<int>::const_iterator i = dependencies.begin(); i != dependencies.end(); ++i ){
+    std::map< int, std::string >::iterator file = prebuilt_files.find( *i );
+    if( file != prebuilt_files.end() ){
+      worker.prebuilt_files[*i] = (*file).second;
+    }
+  }
+  worker.importPrebuiltUniverses();
+
+  OwnedBodies built( worker );
+  worker.defineUniverse( universe, built );
+  entity_collection_t bodies = built.release();
+  worker.releasePrebuiltUniverses();
+
+  return worker.exportBodies( universeLabel( universe ), bodies, filename );
+
+}
+
+/** Split a box into count regions by repeated bisection; eight regions are the octants of the box. */
+static void splitRegion( const Vector3d& min, const Vector3d& max, int count, int axis,
+                         std::vector< std::pair<Vector3d,Vector3d> >& regions ){
+  if( count <= 1 ){
+    regions.push_back( std::make_pair( min, max ) );
+    return;
+  }
+
+  int low_count = count / 2;
+  double split = min.v[axis] + (max.v[axis] - min.v[axis]) * low_count / count;
+
+  Vector3d low_max = max, high_min = min;
+  low_max.v[axis] = split;
+  high_min.v[axis] = split;
+
+  splitRegion( min, low_max, low_count, (axis+1) % 3, regions );
+  splitRegion( high_min, max, count - low_count, (axis+1) % 3, regions );
+}
+
+/**
+ * Define universe 0 in Gopt.shards pieces, each covering one region of the world, in a pool of
+ * worker processes.  The pieces of cells that were split between shards are united again.
+ * boundary is the volume that bounds universe 0 (if any); it is deleted.
+ */
+entity_collection_t GeometryContext::defineShardedUniverse( iBase_EntityHandle boundary ){
+
+  int igm_result;
+
+  // the shards tile the graveyard's inner box, or else the cube around the world sphere
+  Vector3d world_min( -world_size, -world_size, -world_size ), world_max( world_size, world_size, world_size );
+  if( boundary ){
+    getBoundBox( igm, boundary, world_min, world_max );
+    PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, boundary, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Deleting the boundary of universe 0" );
+  }
+
+  std::vector< std::pair<Vector3d,Vector3d> > regions;
+  splitRegion( world_min, world_max, Gopt.shards, 0, regions );
+
+  int num_workers = Gopt.worker_processes > 1 ? Gopt.worker_processes : Gopt.shards;
+  std::cout << "Defining universe 0 in " << regions.size() << " shards with "
+            << num_workers << " worker processes..." << std::endl;
+
+  WorkerPool pool( num_workers );
+  std::vector<std::string> files( regions.size() );
+  std::vector<bool> built( regions.size(), false );
+
+  size_t next = 0;
+  while( next < regions.size() || pool.numRunning() > 0 ){
+    while( next < regions.size() && pool.hasFreeSlot() ){
+      files[next] = scratchFile( shardLabel( next ) );
+      ShardBuildJob job( *this, next, regions[next].first, regions[next].second, files[next] );
+      pool.start( next, job );
+      ++next;
+    }
+    if( pool.numRunning() == 0 ) continue;
+
+    bool success;
+    int shard = pool.waitAny( success );
+    built[shard] = success;
+    if( !success ){
+      std::cerr << "Warning: shard " << shard << " failed; it will be built in place." << std::endl;
+    }
+  }
+
+  // gather every shard's bodies, grouped by origin
+  importPrebuiltUniverses();
+
+  std::vector< std::string > origins;
+  std::map< std::string, ExportedBodies > pieces;
+
+  for( size_t s = 0; s < regions.size(); ++s ){
+
+    ExportedBodies shard;
+    if( !built[s] || !importBodies( shardLabel( s ), files[s], shard ) ){
+      // build the shard here instead, and record its bodies in the same form
+      entity_collection_t bodies = defineShard( regions[s].first, regions[s].second );
+      for( size_t k = 0; k < bodies.size(); ++k ){
+        shard.bodies.push_back( bodies[k] );
+        shard.cell_names.push_back( std::vector<std::string>() );
+        shard.cell_origins.push_back( std::vector<std::string>() );
+        shard.group_names.push_back( std::vector<std::string>() );
+        takeMetadata( bodies[k], shard.cell_names.back(), shard.cell_origins.back(), shard.group_names.back() );
+      }
+    }
+
+    for( size_t k = 0; k < shard.bodies.size(); ++k ){
+      // bodies are keyed by the origin of their first cell ID; bodies with no ID are never joined
+      std::string key;
+      if( shard.cell_origins[k].size() ){
+        key = shard.cell_origins[k][0];
+      }
+      else{
+        key = exportedBodyName( shardLabel( s ), k );
+      }
+
+      ExportedBodies& p = pieces[key];
+      if( p.bodies.empty() ){
+        origins.push_back( key );
+        p.cell_names.push_back( shard.cell_names[k] );
+        p.cell_origins.push_back( shard.cell_origins[k] );
+        p.group_names.push_back( shard.group_names[k] );
+      }
+      p.bodies.push_back( shard.bodies[k] );
+    }
+  }
+
+  // unite the pieces of each body, and give it back its metadata
+  entity_collection_t defined_cells;
+  int num_joined = 0;
+  for( size_t i = 0; i < origins.size(); ++i ){
+    ExportedBodies& p = pieces[ origins[i] ];
+
+    iBase_EntityHandle body = p.bodies[0];
+    if( p.bodies.size() > 1 ){
+      PROFILE_IGEOM( "uniteEnts", iGeom_uniteEnts( igm, &(p.bodies[0]), p.bodies.size(), &body, &igm_result ) );
+      CHECK_IGEOM( igm_result, "Uniting the pieces of a sharded cell" );
+      num_joined++;
+    }
+
+    for( size_t j = 0; j < p.cell_names[0].size(); ++j ){
+      addCellName( body, p.cell_names[0][j], p.cell_origins[0][j] );
+    }
+    for( size_t j = 0; j < p.group_names[0].size(); ++j ){
+      addToVolumeGroup( body, p.group_names[0][j] );
+    }
+    defined_cells.push_back( body );
+  }
+
+  if( OPT_VERBOSE ) std::cout << "Rejoined " << num_joined << " cells that were split between shards" << std::endl;
+
+  return defined_cells;
+}
+
+/** Define the part of universe 0 within the given box */
+entity_collection_t GeometryContext::defineShard( const Vector3d& min, const Vector3d& max ){
+
+  int igm_result;
+  Vector3d size = max + (-min);
+  Vector3d center = (min + max) * 0.5;
+
+  PROFILE_IGEOM( "createBrick", iGeom_createBrick( igm, size.v[0], size.v[1], size.v[2], &shard_region, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Creating a shard region" );
+  PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, shard_region, center.v[0], center.v[1], center.v[2], &igm_result ) );
+  CHECK_IGEOM( igm_result, "Moving a shard region" );
+
+  // cells of universe 0 are clipped to the shard in defineCell()
+  OwnedBodies built( *this );
+  defineUniverse( 0, built );
+  entity_collection_t bodies = built.release();
+
+  PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, shard_region, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Deleting a shard region" );
+  shard_region = NULL;
+
+  return bodies;
+}
+
+/** Called in a worker process: build one shard of universe 0 in a new iGeom instance and export it */
+bool GeometryContext::buildShardInWorker( int shard, const Vector3d& min, const Vector3d& max,
+                                          const std::string& filename ){
+
+  iGeom_Instance worker_igm;
+  if( !newWorkerInstance( worker_igm ) ) return false;
+
+  GeometryContext worker( worker_igm, deck );
+  worker.world_size = world_size;
+  worker.prebuilt_files = prebuilt_files;
+  worker.importPrebuiltUniverses();
+
+  entity_collection_t bodies = worker.defineShard( min, max );
+  worker.releasePrebuiltUniverses();
+
+  return worker.exportBodies( shardLabel( shard ), bodies, filename );
+
+}
+
+/** List an entity's cell ID names and their origins in the order they were recorded, and its groups by name */
+void GeometryContext::getMetadata( const EntityMetadata& data, std::vector<std::string>& cell_names,
+                                   std::vector<std::string>& cell_origins, std::vector<std::string>& groups ){
+
+  std::vector< std::pair<long, NamedEntity*> > names( data.names );
+  std::sort( names.begin(), names.end(), recordedBefore<NamedEntity*> );
+  for( size_t j = 0; j < names.size(); ++j ){
+    cell_names.push_back( names[j].second->getName() );
+    cell_origins.push_back( names[j].second->getOrigin() );
+  }
+
+  std::vector< std::string > entity_groups;
+  for( size_t j = 0; j < data.groups.size(); ++j ){
+    entity_groups.push_back( group_names[ data.groups[j].second ] );
+  }
+  std::sort( entity_groups.begin(), entity_groups.end() );
+  groups.insert( groups.end(), entity_groups.begin(), entity_groups.end() );
+
+}
+
+/** Remove and return the metadata recorded for an entity */
+void GeometryContext::takeMetadata( iBase_EntityHandle h, std::vector<std::string>& cell_names,
+                                    std::vector<std::string>& cell_origins, std::vector<std::string>& groups ){
+
+  std::map< iBase_EntityHandle, EntityMetadata >::iterator i = metadata.find( h );
+  if( i == metadata.end() ) return;
+
+  getMetadata( (*i).second, cell_names, cell_origins, groups );
+  updateMaps( h, NULL );
+
+}
+
+/**
+ * Save the given bodies, which must be the only entities in this instance, to a file.
+ * The cell IDs and groups of each body are written to a companion .meta file.
+ */
+bool GeometryContext::exportBodies( const std::string& label, const entity_collection_t& bodies,
+                                    const std::string& filename ){
+
+  int igm_result;
+
+  getNameTag();
+
+  std::string meta_filename = filename + ".meta";
+  std::ofstream meta( meta_filename.c_str() );
+  if( !meta ){
+    std::cerr << "Error: could not write " << meta_filename << std::endl;
+    return false;
+  }
+  meta << "mcnp2cad-bodies " << label << " " << bodies.size() << std::endl;
+
+  for( size_t k = 0; k < bodies.size(); ++k ){
+    std::map< iBase_EntityHandle, EntityMetadata >::iterator i = metadata.find( bodies[k] );
+    if( i != metadata.end() ){
+      std::vector<std::string> cell_names, cell_origins, groups;
+      getMetadata( (*i).second, cell_names, cell_origins, groups );
+      for( size_t j = 0; j < cell_names.size(); ++j ){
+        meta << k << " cell " << cell_names[j] << " " << cell_origins[j] << std::endl;
+      }
+      for( size_t j = 0; j < groups.size(); ++j ){
+        meta << k << " group " << groups[j] << std::endl;
+      }
+    }
+
+    std::string name = exportedBodyName( label, k );
+    iGeom_setData( igm, bodies[k], name_tag, name.c_str(), name.length(), &igm_result );
+    CHECK_IGEOM( igm_result, "Naming an exported body" );
+  }
+
+  PROFILE_IGEOM( "save", iGeom_save( igm, filename.c_str(), "", &igm_result, filename.length(), 0 ) );
+  CHECK_IGEOM( igm_result, "Saving exported bodies to "+filename );
+
+  return igm_result == iBase_SUCCESS && meta.good();
+}
+
+/** Load bodies saved by exportBodies() into this instance */
+bool GeometryContext::importBodies( const std::string& label, const std::string& filename, ExportedBodies& imported ){
+  std::vector<std::string> labels( 1, label ), filenames( 1, filename );
+  std::vector<ExportedBodies> loaded;
+  std::vector<bool> complete;
+  importBodies( labels, filenames, loaded, complete );
+  if( complete[0] ){
+    imported = loaded[0];
+  }
+  return complete[0];
+}
+
+/**
+ * Load several files saved by exportBodies() into this instance, finding the bodies of
+ * all of them in a single pass over the model's regions.  complete[i] is false, and
+ * imported[i] holds no bodies, if file i could not be loaded or its bodies identified.
+ */
+void GeometryContext::importBodies( const std::vector<std::string>& labels, const std::vector<std::string>& filenames,
+                                    std::vector<ExportedBodies>& imported, std::vector<bool>& complete ){
+
+  int igm_result;
+
+  imported.assign( labels.size(), ExportedBodies() );
+  complete.assign( labels.size(), false );
+  std::map< std::string, size_t > label_index;
+
+  for( size_t f = 0; f < labels.size(); ++f ){
+    std::string meta_filename = filenames[f] + ".meta";
+    std::ifstream meta( meta_filename.c_str() );
+    std::string magic, meta_label;
+    size_t count;
+    if( !(meta >> magic >> meta_label >> count) || magic != "mcnp2cad-bodies" || meta_label != labels[f] ){
+      std::cerr << "Error: bad metadata in " << meta_filename << std::endl;
+      continue;
+    }
+
+    ExportedBodies& pre = imported[f];
+    pre.bodies.assign( count, NULL );
+    pre.cell_names.resize( count );
+    pre.cell_origins.resize( count );
+    pre.group_names.resize( count );
+
+    std::string line;
+    while( std::getline( meta, line ) ){
+      std::stringstream tokens( line );
+      size_t k;
+      std::string kind, name, origin;
+      if( !(tokens >> k >> kind >> name) || k >= count ) continue;
+      if( kind == "cell" ){
+        tokens >> origin;
+        pre.cell_names[k].push_back( name );
+        pre.cell_origins[k].push_back( origin );
+      }
+      else if( kind == "group" ){
+        pre.group_names[k].push_back( name );
+      }
+    }
+
+    const std::string& filename = filenames[f];
+    PROFILE_IGEOM( "load", iGeom_load( igm, filename.c_str(), "", &igm_result, filename.length(), 0 ) );
+    CHECK_IGEOM( igm_result, "Loading exported bodies from "+filename );
+    if( igm_result != iBase_SUCCESS ){
+      imported[f] = ExportedBodies();
+      continue;
+    }
+    label_index[ labels[f] ] = f;
+  }
+
+  if( label_index.empty() ) return;
+
+  // find the loaded bodies by name, and remove the names again
+  getNameTag();
+
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting root set" );
+
+  int num_regions;
+  iGeom_getNumOfType( igm, rootset, iBase_REGION, &num_regions, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting number of regions" );
+
+  iBase_EntityHandle* regions = new iBase_EntityHandle[ num_regions ];
+  int size = 0;
+  iGeom_getEntities( igm, rootset, iBase_REGION, &regions, &num_regions, &size, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting regions" );
+
+  // names are "<prefix><label>_<k>"
+  std::string prefix = exportedBodyName( "", 0 );
+  prefix.resize( prefix.length() - 2 );
+
+  std::vector<char> buffer( name_tag_maxlength + 1 );
+  for( int i = 0; i < size; ++i ){
+    char* value = &(buffer[0]);
+    int value_allocated = name_tag_maxlength, value_size = 0;
+    iGeom_getData( igm, regions[i], name_tag, &value, &value_allocated, &value_size, &igm_result );
+    if( igm_result != iBase_SUCCESS ) continue; // unnamed
+
+    std::string body_name( value, value_size );
+    body_name = body_name.c_str(); // strip any padding
+    size_t separator = body_name.rfind( '_' );
+    if( body_name.compare( 0, prefix.length(), prefix ) != 0 || separator == std::string::npos ||
+        separator < prefix.length() ) continue;
+
+    std::map< std::string, size_t >::iterator f =
+      label_index.find( body_name.substr( prefix.length(), separator - prefix.length() ) );
+    if( f == label_index.end() ) continue;
+
+    ExportedBodies& pre = imported[ (*f).second ];
+    size_t body = atol( body_name.c_str() + separator + 1 );
+    if( body < pre.bodies.size() && pre.bodies[body] == NULL ){
+      pre.bodies[body] = regions[i];
+      iGeom_rmvTag( igm, regions[i], name_tag, &igm_result );
+      CHECK_IGEOM( igm_result, "Removing an exported body's name" );
+    }
+  }
+  delete[] regions;
+
+  for( std::map< std::string, size_t >::iterator f = label_index.begin(); f != label_index.end(); ++f ){
+    ExportedBodies& pre = imported[ (*f).second ];
+    complete[ (*f).second ] = std::find( pre.bodies.begin(), pre.bodies.end(), (iBase_EntityHandle)NULL ) == pre.bodies.end();
+    if( !complete[ (*f).second ] ){
+      std::cerr << "Error: could not identify all the bodies loaded from " << filenames[ (*f).second ] << std::endl;
+      for( size_t k = 0; k < pre.bodies.size(); ++k ){
+        if( pre.bodies[k] ){
+          PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, pre.bodies[k], &igm_result ) );
+          CHECK_IGEOM( igm_result, "Deleting incompletely imported bodies" );
+        }
+      }
+      pre = ExportedBodies();
+      continue;
+    }
+    if( OPT_DEBUG ) std::cout << "Imported " << (*f).first << ": " << pre.bodies.size() << " bodies" << std::endl;
+  }
+}
+
+/** Make copies of the bodies of a prebuilt universe, carrying over their metadata */
+entity_collection_t GeometryContext::copyPrebuiltUniverse( const ExportedBodies& pre ){
+
+  int igm_result;
+  entity_collection_t copies;
+
+  for( size_t k = 0; k < pre.bodies.size(); ++k ){
+    iBase_EntityHandle copy;
+    PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, pre.bodies[k], &copy, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Copying a prebuilt body" );
+
+    for( size_t i = 0; i < pre.cell_names[k].size(); ++i ){
+      // the prebuilt origins are relative to the universe
+      addCellName( copy, pre.cell_names[k][i], origin_path + pre.cell_origins[k][i] );
+    }
+    for( size_t i = 0; i < pre.group_names[k].size(); ++i ){
+      addToVolumeGroup( copy, pre.group_names[k][i] );
+    }
+    copies.push_back( copy );
+  }
+
+  return copies;
+}
+
+/** Delete the original bodies of all prebuilt universes; only copies of them remain in use */
+void GeometryContext::releasePrebuiltUniverses( ){
+
+  int igm_result;
+  for( std::map<int,ExportedBodies>::iterator i = prebuilt.begin(); i != prebuilt.end(); ++i ){
+    entity_collection_t& bodies = (*i).second.bodies;
+    for( size_t k = 0; k < bodies.size(); ++k ){
+      PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, bodies[k], &igm_result ) );
+      CHECK_IGEOM( igm_result, "Deleting a prebuilt body" );
+    }
+  }
+  prebuilt.clear();
+
+}
+
+/** Every region in an iGeom instance */
+static entity_collection_t allRegions( iGeom_Instance igm ){
+
+  int igm_result;
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting root set" );
+
+  int num_regions;
+  iGeom_getNumOfType( igm, rootset, iBase_REGION, &num_regions, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting number of regions" );
+
+  entity_collection_t regions( num_regions );
+  if( num_regions == 0 ) return regions;
+
+  iBase_EntityHandle* handles = &(regions[0]);
+  int size = 0;
+  iGeom_getEntities( igm, rootset, iBase_REGION, &handles, &num_regions, &size, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting regions" );
+  regions.resize( size );
+  return regions;
+}
+
+/**
+ * Load the bodies of the checkpoint in the checkpoint directory into out, with their
+ * metadata.  Returns the number of cells of universe 0 that they cover, or 0 if there
+ * is no checkpoint of this conversion or it cannot be loaded.
+ */
+size_t GeometryContext::resumeCheckpoint( OwnedBodies& out, size_t num_cells ){
+
+  size_t cells_done;
+  std::string filename;
+  if( !readCheckpoint( Gopt.checkpoint_dir, checkpoint_key, cells_done, filename ) ) return 0;
+  if( cells_done > num_cells ){
+    std::cerr << "Warning: the checkpoint in " << Gopt.checkpoint_dir << " covers more cells than"
+              << " universe 0 has; it will be replaced." << std::endl;
+    return 0;
+  }
+
+  int igm_result;
+  entity_collection_t before = allRegions( igm );
+
+  ExportedBodies resumed;
+  bool loaded = importBodies( checkpoint_label, filename, resumed );
+
+  // the file also holds whatever else was in the model when it was saved, such as the
+  // graveyard; only the checkpointed bodies are kept
+  std::set< iBase_EntityHandle > keep( before.begin(), before.end() );
+  keep.insert( resumed.bodies.begin(), resumed.bodies.end() );
+  entity_collection_t after = allRegions( igm );
+  for( size_t i = 0; i < after.size(); ++i ){
+    if( keep.count( after[i] ) ) continue;
+    PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, after[i], &igm_result ) );
+    CHECK_IGEOM( igm_result, "Deleting a body loaded with a checkpoint" );
+  }
+
+  if( !loaded ){
+    std::cerr << "Warning: could not load the checkpoint in " << Gopt.checkpoint_dir
+              << "; starting from the first cell." << std::endl;
+    return 0;
+  }
+
+  for( size_t k = 0; k < resumed.bodies.size(); ++k ){
+    iBase_EntityHandle body = resumed.bodies[k];
+    for( size_t i = 0; i < resumed.cell_names[k].size(); ++i ){
+      addCellName( body, resumed.cell_names[k][i], resumed.cell_origins[k][i] );
+    }
+    for( size_t i = 0; i < resumed.group_names[k].size(); ++i ){
+      addToVolumeGroup( body, resumed.group_names[k][i] );
+    }
+    out.push_back( body );
+  }
+
+  std::cout << "Resuming from checkpoint: " << cells_done << " of " << num_cells
+            << " cells of universe 0 are already defined." << std::endl;
+  return cells_done;
+}
+
+/**
+ * Save the bodies of out from position begin on, which are those of the first cells_done
+ * cells of universe 0, as a new checkpoint.  iGeom can only save a whole model, so the
+ * file holds everything else in this instance too; resumeCheckpoint() discards it again.
+ */
+void GeometryContext::saveCheckpoint( OwnedBodies& out, size_t begin, size_t cells_done ){
+
+  ProfileScope profile_scope( "phase", "checkpoint" );
+  int igm_result;
+
+  std::stringstream filename;
+  filename << Gopt.checkpoint_dir << "/cells-" << cells_done << exportExtension();
+
+  entity_collection_t bodies;
+  for( size_t i = begin; i < out.size(); ++i ){
+    bodies.push_back( out[i] );
+  }
+  bool saved = exportBodies( checkpoint_label, bodies, filename.str() );
+
+  // remove the names that identify the bodies in the file, lest they reach the output
+  for( size_t k = 0; k < bodies.size(); ++k ){
+    iGeom_rmvTag( igm, bodies[k], name_tag, &igm_result );
+    CHECK_IGEOM( igm_result, "Removing a checkpointed body's name" );
+  }
+
+  if( saved && writeCheckpoint( Gopt.checkpoint_dir, checkpoint_key, cells_done, filename.str() ) ){
+    if( OPT_VERBOSE ) std::cout << "Checkpoint: " << cells_done << " cells of universe 0 saved to "
+                                << filename.str() << std::endl;
+  }
+  else{
+    std::cerr << "Warning: could not save a checkpoint after " << cells_done << " cells" << std::endl;
+  }
+  last_checkpoint = wallTime();
+}
+
+/** Add the prebuilt universes that a universe is built from, directly or through its fills, to uses */
+static void findPrebuiltUses( InputDeck& deck, int universe, const std::map<int,std::string>& prebuilt_files,
+                              std::set<int>& uses, std::set<int>& seen ){
+
+  if( !seen.insert( universe ).second ) return;
+  if( prebuilt_files.count( universe ) ){
+    uses.insert( universe );
+    return;
+  }
+
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  for( size_t i = 0; i < cells.size(); ++i ){
+    const CellCard& cell = *cells[i];
+    if( cell.isLattice() ){
+      const Lattice& lattice = cell.getLattice();
+      if( !lattice.isFixedSize() ){
+        findPrebuiltUses( deck, lattice.getFillForNode( 0, 0, 0 ).getFillingUniverse(), prebuilt_files, uses, seen );
+        continue;
+      }
+      irange xr = lattice.getXRange(), yr = lattice.getYRange(), zr = lattice.getZRange();
+      for( int x = xr.first; x <= xr.second; ++x ){
+        for( int y = yr.first; y <= yr.second; ++y ){
+          for( int z = zr.first; z <= zr.second; ++z ){
+            findPrebuiltUses( deck, lattice.getFillForNode( x, y, z ).getFillingUniverse(), prebuilt_files, uses, seen );
+          }
+        }
+      }
+    }
+    else if( cell.hasFill() ){
+      findPrebuiltUses( deck, cell.getFill().getOriginNode().getFillingUniverse(), prebuilt_files, uses, seen );
+    }
+  }
+}
+
+/**
+ * Define cells [first,end) of universe 0 in worker processes, up to Gopt.worker_processes
+ * at a time, each given Gopt.cell_timeout seconds, and load the bodies of all of them in
+ * one pass.  A filled cell that runs out of time is tried again without its contents, as
+ * an empty shell; a cell whose shell also runs out of time is left out, and is given no
+ * bodies in timed.  Either way it is reported by reportOverBudgetCells().  A worker that
+ * fails for any other reason is not trusted to have timed its cell fairly, and its cell
+ * is missing from timed, to be defined in place as usual.
+ */
+void GeometryContext::defineCellsInWorkers( const InputDeck::cell_card_list& cells, size_t first,
+                                            std::map< int, ExportedBodies >& timed ){
+
+  size_t count = cells.size() - first;
+  if( count == 0 ) return;
+
+  // the state of each cell, by its index less first
+  std::vector<std::string> files( count );
+  std::vector<double> started( count ), seconds( count );
+  std::vector<bool> shell_only( count, false ), built( count, false ), out_of_time( count, false );
+
+  WorkerPool pool( Gopt.worker_processes );
+  size_t next = 0;
+  while( next < count || pool.numRunning() > 0 ){
+    while( next < count && pool.hasFreeSlot() ){
+      files[next] = scratchFile( cellLabel( cells[first+next]->getIdent() ) );
+      CellBuildJob job( *this, cells[first+next]->getIdent(), false, files[next] );
+      started[next] = wallTime();
+      pool.start( next, job, Gopt.cell_timeout );
+      ++next;
+    }
+    if( pool.numRunning() == 0 ) continue;
+
+    bool success, timed_out;
+    int c = pool.waitAny( success, timed_out );
+    CellCard& cell = *(cells[first+c]);
+    seconds[c] = wallTime() - started[c];
+    built[c] = success;
+    if( success || ( !timed_out && !shell_only[c] ) ){
+      continue;
+    }
+
+    out_of_time[c] = true;
+    if( timed_out && cell.hasFill() && !shell_only[c] ){
+      std::cerr << "Warning: cell " << cell.getIdent() << " ran out of time after " << Gopt.cell_timeout
+                << " s; trying its shell alone." << std::endl;
+      shell_only[c] = true;
+      files[c] = scratchFile( cellLabel( cell.getIdent() ) + "-shell" );
+      CellBuildJob job( *this, cell.getIdent(), true, files[c] );
+      if( pool.start( c, job, Gopt.cell_timeout ) ) continue;
+    }
+    std::cerr << "Warning: cell " << cell.getIdent() << " ran out of time after " << Gopt.cell_timeout
+              << " s; it is left out of the model." << std::endl;
+  }
+
+  std::vector<std::string> labels, filenames;
+  std::vector<size_t> loaded_cells;
+  for( size_t c = 0; c < count; ++c ){
+    if( built[c] ){
+      labels.push_back( cellLabel( cells[first+c]->getIdent() ) );
+      filenames.push_back( files[c] );
+      loaded_cells.push_back( c );
+    }
+  }
+  std::vector<ExportedBodies> imported;
+  std::vector<bool> complete;
+  importBodies( labels, filenames, imported, complete );
+  for( size_t f = 0; f < filenames.size(); ++f ){
+    unlink( filenames[f].c_str() );
+    unlink( ( filenames[f] + ".meta" ).c_str() );
+    built[ loaded_cells[f] ] = complete[f];
+    if( complete[f] ){
+      timed[ cells[first + loaded_cells[f]]->getIdent() ] = imported[f];
+    }
+  }
+
+  for( size_t c = 0; c < count; ++c ){
+    int ident = cells[first+c]->getIdent();
+    if( out_of_time[c] ){
+      OverBudgetCell over;
+      over.ident = ident;
+      over.seconds = seconds[c];
+      over.kept_shell = built[c];
+      over_budget.push_back( over );
+      if( !built[c] ){
+        timed[ident] = ExportedBodies();
+      }
+    }
+    else if( !built[c] ){
+      std::cerr << "Warning: defining cell " << ident << " in a worker failed; "
+                << "it will be defined in place." << std::endl;
+    }
+  }
+}
+
+/**
+ * Append the bodies that defineCellsInWorkers() loaded for a cell to out, with their
+ * metadata, or define the cell here if its worker failed.  Returns the number appended.
+ */
+size_t GeometryContext::placeTimedCell( CellCard& cell, std::map< int, ExportedBodies >& timed, OwnedBodies& out ){
+
+  std::map< int, ExportedBodies >::iterator t = timed.find( cell.getIdent() );
+  if( t == timed.end() ){
+    return defineCell( cell, out, true, NULL );
+  }
+
+  const ExportedBodies& cell_bodies = (*t).second;
+  for( size_t k = 0; k < cell_bodies.bodies.size(); ++k ){
+    iBase_EntityHandle body = cell_bodies.bodies[k];
+    for( size_t i = 0; i < cell_bodies.cell_names[k].size(); ++i ){
+      addCellName( body, cell_bodies.cell_names[k][i], origin_path + cell_bodies.cell_origins[k][i] );
+    }
+    for( size_t i = 0; i < cell_bodies.group_names[k].size(); ++i ){
+      addToVolumeGroup( body, cell_bodies.group_names[k][i] );
+    }
+    out.push_back( body );
+  }
+  size_t appended = cell_bodies.bodies.size();
+  timed.erase( t );
+  return appended;
+}
+
+/**
+ * Called in a worker process: define a cell of universe 0 in a new iGeom instance, loading
+ * only the prebuilt universes it uses, and export it.  A shell defined without its
+ * contents is given the cell's number and importances, but no material.
+ */
+bool GeometryContext::buildCellInWorker( int ident, bool shell_only, const std::string& filename ){
+
+  iGeom_Instance worker_igm;
+  if( !newWorkerInstance( worker_igm ) ) return false;
+
+  GeometryContext worker( worker_igm, deck );
+  worker.world_size = world_size;
+
+  CellCard& cell = *deck.lookup_cell_card( ident );
+  if( !shell_only && cell.hasFill() ){
+    std::set<int> uses, seen;
+    findPrebuiltUses( deck, cell.getFill().getOriginNode().getFillingUniverse(), prebuilt_files, uses, seen );
+    for( std::set<int>::iterator i = uses.begin(); i != uses.end(); ++i ){
+      worker.prebuilt_files[*i] = prebuilt_files[*i];
+    }
+    worker.importPrebuiltUniverses();
+  }
+
+  OwnedBodies built( worker );
+  worker.defineCell( cell, built, !shell_only, NULL );
+  if( shell_only ){
+    worker.setVolumeCellID( built[0], ident );
+    if( cell.getImportances().size() ){ worker.setImportances( built[0], cell.getImportances() ); }
+  }
+  entity_collection_t bodies = built.release();
+  worker.releasePrebuiltUniverses();
+
+  return worker.exportBodies( cellLabel( ident ), bodies, filename );
+}
+
+/** Print the cells that ran out of time under --cell-timeout */
+void GeometryContext::reportOverBudgetCells( ){
+
+  if( over_budget.empty() ) return;
+
+  std::cout << over_budget.size() << " cells of universe 0 ran out of their " << Gopt.cell_timeout
+            << " s budget:" << std::endl;
+  for( size_t i = 0; i < over_budget.size(); ++i ){
+    const OverBudgetCell& over = over_budget[i];
+    std::cout << "  cell " << std::setw(8) << std::left << over.ident << std::right
+              << std::setw(10) << std::fixed << std::setprecision(1) << over.seconds << " s  "
+              << ( over.kept_shell ? "replaced by its empty shell" : "left out" ) << std::endl;
+  }
+  std::cout << std::setprecision(6);
+  std::cout.unsetf( std::ios::fixed );
+}
+
+/**
+ * Create the graveyard bounding cell.  The actual graveyard entity is returned.
+ * A copy of the inner surface of the graveyard cell
+ * is returned in the argument, to be used as the boundary of all further geometry.
+ */
+iBase_EntityHandle GeometryContext::createGraveyard( iBase_EntityHandle& inner_copy ) {
+  iBase_EntityHandle inner, outer, graveyard;
+  int igm_result;
+
+  double inner_size = 2.0 * world_size;
+  graveyard_inner_size = inner_size;
+  PROFILE_IGEOM( "createBrick", iGeom_createBrick( igm, inner_size, inner_size, inner_size, &inner, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Making graveyard" );
+  
+  PROFILE_IGEOM( "copyEnt", iGeom_copyEnt( igm, inner, &inner_copy, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Copying graveyard" );
+  
+  double outer_size = 2.0 * ( world_size + (world_size / 50.0) );
+  PROFILE_IGEOM( "createBrick", iGeom_createBrick( igm, outer_size, outer_size, outer_size, &outer, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Making outer graveyard" );
+
+  PROFILE_IGEOM( "subtractEnts", iGeom_subtractEnts( igm, outer, inner, &graveyard, &igm_result ) );
+  CHECK_IGEOM( igm_result, "subtracting graveyard" );
+  
+  addToVolumeGroup( graveyard, "graveyard" );
+  
+  // reset world size to a sphere that bounds the inner shell of this graveyard
+  world_size *= sqrt(3.0);
+  if( OPT_DEBUG ) std::cout << "Spherical world size for graveyard: " << world_size << std::endl;
+  
+  return graveyard;
+
+}
+
+/** Ordering of cells by one coordinate of their box centers */
+class CenterOrder{
+  const std::vector<Vector3d>& centers;
+  int axis;
+public:
+  CenterOrder( const std::vector<Vector3d>& centers_p, int axis_p ) : centers(centers_p), axis(axis_p) {}
+  bool operator()( size_t a, size_t b ) const {
+    return centers[a].v[axis] < centers[b].v[axis];
+  }
+};
+
+/**
+ * Split cells [begin,end) into count groups of similar size, by recursively splitting
+ * at the median of their box centers along the axis where the centers are most spread out.
+ */
+static void splitCells( std::vector<size_t>& cells, size_t begin, size_t end, const std::vector<Vector3d>& centers,
+                        int count, std::vector< std::vector<size_t> >& groups ){
+  if( count <= 1 || end - begin <= 1 ){
+    groups.push_back( std::vector<size_t>( cells.begin() + begin, cells.begin() + end ) );
+    return;
+  }
+
+  Vector3d min = centers[ cells[begin] ], max = min;
+  for( size_t i = begin; i < end; ++i ){
+    for( int k = 0; k < 3; ++k ){
+      min.v[k] = std::min( min.v[k], centers[ cells[i] ].v[k] );
+      max.v[k] = std::max( max.v[k], centers[ cells[i] ].v[k] );
+    }
+  }
+  int axis = 0;
+  for( int k = 1; k < 3; ++k ){
+    if( max.v[k] - min.v[k] > max.v[axis] - min.v[axis] ) axis = k;
+  }
+
+  int low_count = count / 2;
+  size_t mid = begin + ( end - begin ) * low_count / count;
+  std::nth_element( cells.begin() + begin, cells.begin() + mid, cells.begin() + end, CenterOrder( centers, axis ) );
+
+  splitCells( cells, begin, mid, centers, low_count, groups );
+  splitCells( cells, mid, end, centers, count - low_count, groups );
+}
+
+/**
+ * Rules out contact between a body and another whose bounding box encloses its own,
+ * when no face of the enclosing body comes within reach of the enclosed body's box.
+ */
+class FaceProximityTest : public ContactTest {
+protected:
+  class Face {
+  public:
+    iBase_EntityHandle handle;
+    Vector3d min, max;
+  };
+
+  iGeom_Instance& igm;
+  const entity_collection_t& bodies;
+  const std::vector<Vector3d>& mins;
+  const std::vector<Vector3d>& maxs;
+  double tolerance;
+
+  std::map< size_t, std::vector<Face> > faces; // faces of each enclosing body, when first needed
+  std::set< size_t > unknown;                  // bodies whose faces could not be found
+
+  const std::vector<Face>& getFaces( size_t body ){
+    std::map< size_t, std::vector<Face> >::iterator i = faces.find( body );
+    if( i != faces.end() ) return (*i).second;
+
+    std::vector<Face>& body_faces = faces[body];
+    int igm_result;
+    iBase_EntityHandle* adj = NULL;
+    int adj_allocated = 0, adj_size = 0;
+    iGeom_getEntAdj( igm, bodies[body], iBase_FACE, &adj, &adj_allocated, &adj_size, &igm_result );
+    if( igm_result != iBase_SUCCESS ){
+      unknown.insert( body );
+      return body_faces;
+    }
+    for( int j = 0; j < adj_size; ++j ){
+      Face f;
+      f.handle = adj[j];
+      getBoundBox( igm, f.handle, f.min, f.max );
+      body_faces.push_back( f );
+    }
+    free( adj );
+    return body_faces;
+  }
+
+public:
+  FaceProximityTest( iGeom_Instance& igm_p, const entity_collection_t& bodies_p,
+                     const std::vector<Vector3d>& mins_p, const std::vector<Vector3d>& maxs_p, double tolerance_p ) :
+    igm(igm_p), bodies(bodies_p), mins(mins_p), maxs(maxs_p), tolerance(tolerance_p)
+  {}
+
+  virtual bool mightTouch( size_t enclosing, size_t enclosed ){
+
+    const std::vector<Face>& f = getFaces( enclosing );
+    if( unknown.find( enclosing ) != unknown.end() ) return true;
+
+    // any point of contact is within this distance of the enclosed box's center
+    Vector3d center = ( mins[enclosed] + maxs[enclosed] ) * 0.5;
+    double reach = ( maxs[enclosed] + -mins[enclosed] ).length() / 2.0 + tolerance;
+
+    for( size_t j = 0; j < f.size(); ++j ){
+      bool apart = false;
+      for( int k = 0; k < 3 && !apart; ++k ){
+        apart = f[j].min.v[k] > maxs[enclosed].v[k] + tolerance || mins[enclosed].v[k] > f[j].max.v[k] + tolerance;
+      }
+      if( apart ) continue;
+
+      int igm_result;
+      Vector3d on;
+      iGeom_getEntClosestPt( igm, f[j].handle, center.v[0], center.v[1], center.v[2],
+                             &on.v[0], &on.v[1], &on.v[2], &igm_result );
+      if( igm_result != iBase_SUCCESS || ( on + -center ).length() <= reach ) return true;
+    }
+    return false;
+  }
+};
+
+/**
+ * Imprint, and merge if requested, the given cells a neighbourhood at a time, rather than
+ * all at once.  Neighbourhoods are found from the cells' bounding boxes (see ContactGraph).
+ * The graveyard's box encloses everything, so it is instead batched with only those
+ * cells that reach its inner boundary.
+ */
+void GeometryContext::imprintInBatches( iBase_EntityHandle* cells, size_t count, iBase_EntityHandle graveyard,
+                                        double tolerance ){
+
+  int igm_result;
+
+  std::vector<iBase_EntityHandle> bodies;
+  std::vector<Vector3d> mins, maxs;
+  std::vector<size_t> boundary;
+  double inner = graveyard_inner_size / 2.0 - tolerance;
+
+  for( size_t i = 0; i < count; ++i ){
+    if( cells[i] == graveyard ) continue;
+
+    Vector3d min, max;
+    getBoundBox( igm, cells[i], min, max );
+    bodies.push_back( cells[i] );
+    mins.push_back( min );
+    maxs.push_back( max );
+
+    if( graveyard ){
+      bool reaches = false;
+      for( int k = 0; k < 3; ++k ){
+        reaches = reaches || min.v[k] <= -inner || max.v[k] >= inner;
+      }
+      if( reaches ) boundary.push_back( bodies.size() - 1 );
+    }
+  }
+
+  FaceProximityTest test( igm, bodies, mins, maxs, tolerance );
+  ContactGraph contacts( mins, maxs, tolerance, &test );
+  std::vector< std::vector<size_t> > batches;
+  contacts.makeBatches( Gopt.imprint_batch_size, batches );
+
+  // the graveyard, with each group of the cells at its boundary
+  size_t first_graveyard_batch = batches.size();
+  for( size_t i = 0; i < boundary.size(); i += Gopt.imprint_batch_size ){
+    size_t end = std::min( boundary.size(), i + Gopt.imprint_batch_size );
+    batches.push_back( std::vector<size_t>( boundary.begin() + i, boundary.begin() + end ) );
+  }
+
+  // cells that touch nothing need no imprinting
+  std::vector< std::vector<iBase_EntityHandle> > batch_cells;
+  for( size_t b = 0; b < batches.size(); ++b ){
+    std::vector<iBase_EntityHandle> batch;
+    for( size_t i = 0; i < batches[b].size(); ++i ){
+      batch.push_back( bodies[ batches[b][i] ] );
+    }
+    if( b >= first_graveyard_batch ) batch.push_back( graveyard );
+    if( batch.size() > 1 ) batch_cells.push_back( batch );
+  }
+
+  if( OPT_VERBOSE ){
+    std::cout << "Imprint batches: " << bodies.size() << " cells with " << contacts.numContacts()
+              << " possible contacts, " << boundary.size() << " at the graveyard" << std::endl;
+  }
+
+  std::cout << "Imprinting in " << batch_cells.size() << " batches...\t\t" << std::flush;
+  {
+    ProfileScope phase( "phase", "imprint" );
+    for( size_t b = 0; b < batch_cells.size(); ++b ){
+      PROFILE_IGEOM( "imprintEnts", iGeom_imprintEnts( igm, &(batch_cells[b][0]), batch_cells[b].size(), &igm_result ) );
+      CHECK_IGEOM( igm_result, "Imprinting a batch of cells" );
+    }
+  }
+  std::cout << " done." << std::endl;
+
+  if ( Gopt.merge_geom ) {
+    std::cout << "Merging, tolerance=" << tolerance << "...\t\t" << std::flush;
+    ProfileScope phase( "phase", "merge" );
+    for( size_t b = 0; b < batch_cells.size(); ++b ){
+      PROFILE_IGEOM( "mergeEnts", iGeom_mergeEnts( igm, &(batch_cells[b][0]), batch_cells[b].size(), tolerance, &igm_result ) );
+      CHECK_IGEOM( igm_result, "Merging a batch of cells" );
+    }
+    std::cout << " done." << std::endl;
+  }
+
+}
+
+/** Imprint, and merge if requested, the given cells, in batches if Gopt.imprint_batch_size is set */
+void GeometryContext::imprintAndMerge( iBase_EntityHandle* cells, size_t count, iBase_EntityHandle graveyard,
+                                       double tolerance ){
+
+  int igm_result;
+
+  if ( Gopt.imprint_batch_size > 0 && count > (size_t)Gopt.imprint_batch_size ) {
+    imprintInBatches( cells, count, graveyard, tolerance );
+    return;
+  }
+
+  std::cout << "Imprinting all...\t\t\t" << std::flush;
+  {
+    ProfileScope phase( "phase", "imprint" );
+    PROFILE_IGEOM( "imprintEnts", iGeom_imprintEnts( igm, cells, count, &igm_result ) );
+  }
+  CHECK_IGEOM( igm_result, "Imprinting all cells" );
+  std::cout << " done." << std::endl;
     
-    double tolerance = world_size / 1.0e7;
-    if( Gopt.override_tolerance ){
-      tolerance = Gopt.specific_tolerance;
+  if ( Gopt.merge_geom ) {
+    std::cout << "Merging, tolerance=" << tolerance << "...\t\t" << std::flush;
+    ProfileScope phase( "phase", "merge" );
+    PROFILE_IGEOM( "mergeEnts", iGeom_mergeEnts( igm, cells, count,  tolerance, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Merging all cells" );
+    std::cout << " done." << std::endl;
+  }
+
+}
+
+/**
+ * Imprint and merge the given cells in Gopt.imprint_shards spatial shards, each in its own
+ * worker process, then imprint and merge here only the cells that might touch a cell of
+ * another shard, or the graveyard, and finally merge all the cells once more.  The workers
+ * return their cells through files, so the cells' handles change: defined_cells is
+ * updated, along with the metadata index.
+ */
+void GeometryContext::imprintInShards( entity_collection_t& defined_cells, iBase_EntityHandle graveyard,
+                                       double tolerance ){
+
+  int igm_result;
+  ProfileScope phase( "phase", "imprint shards" );
+
+  std::vector<size_t> cells; // indices into defined_cells, skipping the graveyard
+  entity_collection_t bodies;
+  std::vector<Vector3d> mins, maxs, centers;
+  for( size_t i = 0; i < defined_cells.size(); ++i ){
+    if( defined_cells[i] == graveyard ) continue;
+
+    Vector3d min, max;
+    getBoundBox( igm, defined_cells[i], min, max );
+    cells.push_back( i );
+    bodies.push_back( defined_cells[i] );
+    mins.push_back( min );
+    maxs.push_back( max );
+    centers.push_back( ( min + max ) * 0.5 );
+  }
+
+  // shards of similar size, split at the median of the cells' box centers
+  std::vector<size_t> order( cells.size() );
+  for( size_t c = 0; c < order.size(); ++c ){
+    order[c] = c;
+  }
+  std::vector< std::vector<size_t> > shard_cells;
+  splitCells( order, 0, order.size(), centers, Gopt.imprint_shards, shard_cells );
+
+  std::vector<size_t> shard_of( cells.size() );
+  for( size_t s = 0; s < shard_cells.size(); ++s ){
+    std::sort( shard_cells[s].begin(), shard_cells[s].end() );
+    for( size_t i = 0; i < shard_cells[s].size(); ++i ){
+      shard_of[ shard_cells[s][i] ] = s;
+    }
+  }
+
+  // cells that might touch a cell of another shard, or the graveyard, are imprinted again here
+  FaceProximityTest test( igm, bodies, mins, maxs, tolerance );
+  ContactGraph contacts( mins, maxs, tolerance, &test );
+  double inner = graveyard_inner_size / 2.0 - tolerance;
+  std::vector<bool> on_boundary( cells.size(), false );
+  for( size_t c = 0; c < cells.size(); ++c ){
+    const std::vector<size_t>& next = contacts.getNeighbors( c );
+    for( size_t j = 0; j < next.size() && !on_boundary[c]; ++j ){
+      on_boundary[c] = shard_of[ next[j] ] != shard_of[c];
+    }
+    for( int k = 0; k < 3 && graveyard && !on_boundary[c]; ++k ){
+      on_boundary[c] = mins[c].v[k] <= -inner || maxs[c].v[k] >= inner;
+    }
+  }
+
+  size_t num_shards = shard_cells.size();
+  int num_workers = Gopt.worker_processes > 1 ? Gopt.worker_processes : Gopt.imprint_shards;
+  std::cout << "Imprinting in " << num_shards << " shards with "
+            << num_workers << " worker processes..." << std::endl;
+
+  std::vector< entity_collection_t > shard_bodies( num_shards );
+  for( size_t s = 0; s < num_shards; ++s ){
+    for( size_t i = 0; i < shard_cells[s].size(); ++i ){
+      shard_bodies[s].push_back( defined_cells[ cells[ shard_cells[s][i] ] ] );
+    }
+  }
+
+  WorkerPool pool( num_workers );
+  std::vector<std::string> files( num_shards );
+  std::vector<bool> built( num_shards, false );
+
+  size_t next = 0;
+  while( next < num_shards || pool.numRunning() > 0 ){
+    while( next < num_shards && pool.hasFreeSlot() ){
+      if( shard_bodies[next].size() ){
+        files[next] = scratchFile( imprintLabel( next ) );
+        ImprintShardJob job( *this, next, shard_bodies[next], tolerance, files[next] );
+        pool.start( next, job );
+      }
+      ++next;
+    }
+    if( pool.numRunning() == 0 ) continue;
+
+    bool success;
+    int shard = pool.waitAny( success );
+    built[shard] = success;
+    if( !success ){
+      std::cerr << "Warning: imprint shard " << shard << " failed; it will be imprinted in place." << std::endl;
+    }
+  }
+
+  // replace each shard's cells with the imprinted ones
+  for( size_t s = 0; s < num_shards; ++s ){
+    if( shard_bodies[s].empty() ) continue;
+
+    ExportedBodies imprinted;
+    if( !built[s] || !importBodies( imprintLabel( s ), files[s], imprinted ) ){
+      imprintAndMerge( &(shard_bodies[s][0]), shard_bodies[s].size(), NULL, tolerance );
+      continue;
+    }
+
+    for( size_t i = 0; i < shard_cells[s].size(); ++i ){
+      iBase_EntityHandle& cell = defined_cells[ cells[ shard_cells[s][i] ] ];
+      updateMaps( cell, imprinted.bodies[i] );
+      PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, cell, &igm_result ) );
+      CHECK_IGEOM( igm_result, "Deleting a cell replaced by its imprinted copy" );
+      cell = imprinted.bodies[i];
+    }
+  }
+
+  if( !scratch_dir.empty() ){
+    removeScratchDirectory( scratch_dir );
+    scratch_dir.clear();
+  }
+
+  entity_collection_t boundary_cells;
+  for( size_t c = 0; c < cells.size(); ++c ){
+    if( on_boundary[c] ) boundary_cells.push_back( defined_cells[ cells[c] ] );
+  }
+  if( graveyard ) boundary_cells.push_back( graveyard );
+
+  if( OPT_VERBOSE ) std::cout << "Imprinting " << boundary_cells.size() << " cells at shard boundaries" << std::endl;
+  if( boundary_cells.size() > 1 ){
+    imprintAndMerge( &(boundary_cells[0]), boundary_cells.size(), graveyard, tolerance );
+  }
+
+  // the merges made within each shard survive here only if the exported files record them,
+  // which depends on the kernel; merging every cell again, which is cheap next to imprinting,
+  // makes sure of them either way
+  if( Gopt.merge_geom && defined_cells.size() > 1 ){
+    std::cout << "Merging all shards, tolerance=" << tolerance << "...\t" << std::flush;
+    ProfileScope merge_phase( "phase", "merge" );
+    PROFILE_IGEOM( "mergeEnts", iGeom_mergeEnts( igm, &(defined_cells[0]), defined_cells.size(), tolerance, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Merging the cells of all shards" );
+    std::cout << " done." << std::endl;
+  }
+
+}
+
+/**
+ * Called in a worker process: imprint and merge the cells of one shard, and export them.
+ * This process's iGeom instance is a copy of the parent's, so everything else is deleted first.
+ */
+bool GeometryContext::imprintShardInWorker( int shard, const entity_collection_t& bodies, double tolerance,
+                                            const std::string& filename ){
+
+  int igm_result;
+
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting root set" );
+
+  int num_regions;
+  iGeom_getNumOfType( igm, rootset, iBase_REGION, &num_regions, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting number of regions" );
+
+  iBase_EntityHandle* regions = new iBase_EntityHandle[ num_regions ];
+  int size = 0;
+  iGeom_getEntities( igm, rootset, iBase_REGION, &regions, &num_regions, &size, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting the regions of a worker's instance" );
+
+  std::set<iBase_EntityHandle> keep( bodies.begin(), bodies.end() );
+  for( int i = 0; i < size; ++i ){
+    if( keep.find( regions[i] ) == keep.end() ){
+      PROFILE_IGEOM( "deleteEnt", iGeom_deleteEnt( igm, regions[i], &igm_result ) );
+      CHECK_IGEOM( igm_result, "Deleting a region outside a worker's imprint shard" );
+    }
+  }
+  delete[] regions;
+
+  entity_collection_t cells( bodies );
+  {
+    ProfileScope phase( "phase", "imprint" );
+    PROFILE_IGEOM( "imprintEnts", iGeom_imprintEnts( igm, &(cells[0]), cells.size(), &igm_result ) );
+  }
+  CHECK_IGEOM( igm_result, "Imprinting a shard" );
+  if( igm_result != iBase_SUCCESS ) return false;
+
+  if( Gopt.merge_geom ){
+    ProfileScope phase( "phase", "merge" );
+    PROFILE_IGEOM( "mergeEnts", iGeom_mergeEnts( igm, &(cells[0]), cells.size(), tolerance, &igm_result ) );
+    CHECK_IGEOM( igm_result, "Merging a shard" );
+    if( igm_result != iBase_SUCCESS ) return false;
+  }
+
+  return exportBodies( imprintLabel( shard ), cells, filename );
+
+}
+
+void GeometryContext::createGeometry( ){
+
+  int igm_result;
+ 
+  {
+    ProfileScope phase( "phase", "world size" );
+    world_size = estimateWorldSize( deck );
+  }
+
+  ProfileScope* define_phase = new ProfileScope( "phase", "define" );
+
+  // prebuilt universes are exported to scratch files, or found in the body cache, and
+  // loaded when universe 0 is defined
+  if( Gopt.cache_dir.length() ){
+    body_cache = new BodyCache( deck, Gopt.cache_dir, world_size, exportExtension() );
+  }
+  if( Gopt.worker_processes > 1 || body_cache ){
+    prebuildUniverses();
+  }
+
+  iBase_EntityHandle graveyard = NULL, graveyard_boundary = NULL;
+  if( Gopt.make_graveyard ){
+    graveyard = createGraveyard ( graveyard_boundary ); 
+  }
+
+  std::cout << "Defining geometry..." << std::endl;
+
+  if( Gopt.checkpoint_dir.length() ){
+    if( Gopt.shards > 1 ){
+      std::cerr << "Warning: checkpoints are not written when universe 0 is split into shards." << std::endl;
+    }
+    else{
+      checkpoint_key = checkpointKey( Gopt.input_file );
+      last_checkpoint = wallTime();
+    }
+  }
+
+  entity_collection_t defined_cells;
+  if( Gopt.shards > 1 ){
+    defined_cells = defineShardedUniverse( graveyard_boundary );
+  }
+  else{
+    importPrebuiltUniverses();
+    OwnedBodies built( *this );
+    defineUniverse( 0, built, graveyard_boundary );
+    defined_cells = built.release();
+  }
+  reportOverBudgetCells();
+  if( graveyard ){ defined_cells.push_back(graveyard); }
+
+  releasePrebuiltUniverses();
+  delete body_cache;
+  body_cache = NULL;
+  if( !scratch_dir.empty() ){
+    removeScratchDirectory( scratch_dir );
+    scratch_dir.clear();
+  }
+  delete define_phase;
+
+  if( censusEnabled() ){
+    reportCensus( igm, defined_cells );
+  }
+
+  double tolerance = world_size / 1.0e7;
+  if( Gopt.override_tolerance ){
+    tolerance = Gopt.specific_tolerance;
+  }
+
+  // imprinting in shards passes the cells through worker processes, which changes their
+  // handles, so it must be done before any tags are set
+  bool imprint_in_shards = Gopt.imprint_geom && Gopt.imprint_shards > 1;
+  if( imprint_in_shards ){
+    imprintInShards( defined_cells, graveyard, tolerance );
+  }
+
+  size_t count = defined_cells.size();
+  iBase_EntityHandle *cell_array = new iBase_EntityHandle[ count ];
+  for( unsigned int i = 0; i < count; ++i ){
+    cell_array[i] = defined_cells[i];
+  }
+
+#ifdef USING_CGMA
+  {
+    // in CGM's default implementation, each new volume and surface created
+    // through CSG operations gets a new unique ID number, so those IDs can
+    // be large and widely-spaced.  We want them to start from 1.
+    RefEntityFactory::instance()->compress_ref_ids("surface", false );
+    RefEntityFactory::instance()->compress_ref_ids("volume", false );
+  }
+#endif
+
+
+  {
+    ProfileScope phase( "phase", "tag" );
+    collectMetadata();
+    if( OPT_DEBUG ){ mapSanityCheck(cell_array, count); }
+    tagGroups();
+
+    if( Gopt.tag_cell_IDs ){
+      tagCellIDsAsEntNames();
+    }
+  }
+  
+
+  if ( Gopt.imprint_geom && !imprint_in_shards ) {
+    imprintAndMerge( cell_array, count, graveyard, tolerance );
+  }
+
+
+  std::string outName = Gopt.output_file;
+  std::cout << "Saving file \"" << outName << "\"...\t\t\t" << std::flush;
+  ProfileScope phase( "phase", "save" );
+  PROFILE_IGEOM( "save", iGeom_save( igm, outName.c_str(), "", &igm_result, outName.length(), 0 ) );
+  CHECK_IGEOM( igm_result, "saving the output file "+outName );
+  std::cout << " done." << std::endl;
+
+  if( checkpoint_key.length() && igm_result == iBase_SUCCESS ){
+    removeCheckpoint( Gopt.checkpoint_dir, checkpoint_key );
+  }
+
+}
+
+/** Whether a group is one that retagGeometry() rebuilds from the deck */
+static bool isRetaggedGroup( const std::string& name ){
+  if( Gopt.tag_materials && ( name.compare( 0, 4, "mat_" ) == 0 || name.compare( 0, 4, "mat:" ) == 0 ) ){
+    return true;
+  }
+  return Gopt.tag_importances && name.compare( 0, 4, "imp." ) == 0;
+}
+
+/**
+ * Load a previous output of this program, and replace its material and importance groups
+ * with those of the deck, without building any geometry.  Each volume is matched to its
+ * cell by the MCNP_ID_n name it was given.  The volumes, their names and any other
+ * groups, such as the graveyard, are saved to the output file unchanged.
+ */
+void GeometryContext::retagGeometry( const std::string& filename ){
+
+  int igm_result;
+
+  {
+    ProfileScope phase( "phase", "load" );
+    std::cout << "Loading \"" << filename << "\" to retag..." << std::endl;
+    PROFILE_IGEOM( "load", iGeom_load( igm, filename.c_str(), "", &igm_result, filename.length(), 0 ) );
+    CHECK_IGEOM( igm_result, "Loading "+filename );
+    if( igm_result != iBase_SUCCESS ){
+      throw std::runtime_error( "Could not load " + filename );
     }
+  }
+
+  ProfileScope* tag_phase = new ProfileScope( "phase", "tag" );
+  getNameTag();
+  std::vector<char> buffer( name_tag_maxlength + 1 );
+
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting root set" );
+
+  // remove the groups that are about to be rebuilt
+  iBase_EntitySetHandle* sets = NULL;
+  int sets_allocated = 0, num_sets = 0, num_removed = 0;
+  iGeom_getEntSets( igm, rootset, 0, &sets, &sets_allocated, &num_sets, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting entity sets" );
+  for( int i = 0; i < num_sets; ++i ){
+    char* value = &(buffer[0]);
+    int value_allocated = name_tag_maxlength, value_size = 0;
+    iGeom_getEntSetData( igm, sets[i], name_tag, &value, &value_allocated, &value_size, &igm_result );
+    if( igm_result != iBase_SUCCESS ) continue; // unnamed
+
+    std::string name( value, value_size );
+    if( !isRetaggedGroup( name.c_str() ) ) continue;
+    iGeom_destroyEntSet( igm, sets[i], &igm_result );
+    CHECK_IGEOM( igm_result, "Removing the old group " + name );
+    num_removed++;
+  }
+  free( sets );
 
-    if ( Gopt.merge_geom ) {
-      std::cout << "Merging, tolerance=" << tolerance << "...\t\t" << std::flush;
-      iGeom_mergeEnts( igm, cell_array, count,  tolerance, &igm_result );
-      CHECK_IGEOM( igm_result, "Merging all cells" );
-      std::cout << " done." << std::endl;
+  std::map< int, CellCard* > cells;
+  InputDeck::cell_card_list& all_cells = deck.getCells();
+  for( InputDeck::cell_card_list::iterator i = all_cells.begin(); i != all_cells.end(); ++i ){
+    cells[ (*i)->getIdent() ] = *i;
+  }
+
+  // match each volume to its cell, and record the cell's groups
+  entity_collection_t regions = allRegions( igm );
+  std::string prefix = "MCNP_ID_";
+  size_t num_retagged = 0;
+  std::set<int> unknown;
+  for( size_t i = 0; i < regions.size(); ++i ){
+    char* value = &(buffer[0]);
+    int value_allocated = name_tag_maxlength, value_size = 0;
+    iGeom_getData( igm, regions[i], name_tag, &value, &value_allocated, &value_size, &igm_result );
+    if( igm_result != iBase_SUCCESS ) continue; // unnamed, such as the graveyard
+
+    std::string name( value, value_size );
+    name = name.c_str(); // strip any padding
+    if( name.compare( 0, prefix.length(), prefix ) != 0 ) continue;
+
+    int ident = atoi( name.c_str() + prefix.length() );
+    std::map< int, CellCard* >::iterator c = cells.find( ident );
+    if( c == cells.end() ){
+      unknown.insert( ident );
+      continue;
     }
+    CellCard& cell = *((*c).second);
+    if( cell.getMat() != 0 ){ setMaterial( regions[i], cell.getMat(), cell.getRho() ); }
+    if( cell.getImportances().size() ){ setImportances( regions[i], cell.getImportances() ); }
+    num_retagged++;
+  }
+
+  if( unknown.size() ){
+    std::cerr << "Warning: " << unknown.size() << " cells of " << filename << " are not in the deck, "
+              << "the first being cell " << *(unknown.begin()) << "; their volumes are left ungrouped." << std::endl;
   }
+  std::cout << "Retagging " << num_retagged << " of " << regions.size() << " volumes, replacing "
+            << num_removed << " groups." << std::endl;
 
+  collectMetadata();
+  tagGroups();
+  delete tag_phase;
 
   std::string outName = Gopt.output_file;
   std::cout << "Saving file \"" << outName << "\"...\t\t\t" << std::flush;
-  iGeom_save( igm, outName.c_str(), "", &igm_result, outName.length(), 0 );
+  ProfileScope phase( "phase", "save" );
+  PROFILE_IGEOM( "save", iGeom_save( igm, outName.c_str(), "", &igm_result, outName.length(), 0 ) );
   CHECK_IGEOM( igm_result, "saving the output file "+outName );
   std::cout << " done." << std::endl;
 
@@ -1119,6 +2986,236 @@ void debugSurfaceDistances( InputDeck& deck, std::ostream& out = std::cout ){
   
 }
 
+/**
+ * Create the iGeom instance for a conversion and set up what every deck converted with it
+ * shares: the checkpoint and cache directories.  Returns false if either could not be
+ * set up.
+ */
+static bool startKernel( iGeom_Instance& igm ){
+
+  int igm_result; 
+
+  iGeom_newGeom( Gopt.igeom_init_options.c_str(), &igm, &igm_result, Gopt.igeom_init_options.length() );
+  CHECK_IGEOM( igm_result, "Initializing iGeom");
+
+  if( Gopt.checkpoint_dir.length() && !prepareDirectory( Gopt.checkpoint_dir, "checkpoint" ) ){
+    return false;
+  }
+  if( Gopt.cache_dir.length() && !prepareDirectory( Gopt.cache_dir, "body cache" ) ){
+    return false;
+  }
+
+  return true;
+}
+
+#ifdef USING_CGMA
+static void setExportVersion( ProgOptions& po ){
+  int export_vers;
+  if( po.getOpt( "geomver", &export_vers) ){
+    if( CUBIT_SUCCESS == GeometryQueryTool::instance()->set_export_allint_version( export_vers ) ){
+      std::cout << "Set export engine version to " << export_vers << std::endl; 
+    }
+    // on failure, an error message will be printed by CGM
+  }
+}
+#endif
+
+/**
+ * Delete every entity and set of an iGeom instance, so that the next deck of a batch
+ * starts from an empty model, as it would in an instance of its own.
+ */
+static bool clearInstance( iGeom_Instance igm ){
+  int igm_result;
+  PROFILE_IGEOM( "deleteAll", iGeom_deleteAll( igm, &igm_result ) );
+  CHECK_IGEOM( igm_result, "Clearing the iGeom instance" );
+  if( igm_result != iBase_SUCCESS ) return false;
+
+  iBase_EntitySetHandle rootset;
+  iGeom_getRootSet( igm, &rootset, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting root set" );
+  if( igm_result != iBase_SUCCESS ) return false;
+
+  iBase_EntitySetHandle* sets = NULL;
+  int sets_allocated = 0, num_sets = 0;
+  iGeom_getEntSets( igm, rootset, 0, &sets, &sets_allocated, &num_sets, &igm_result );
+  CHECK_IGEOM( igm_result, "Getting entity sets" );
+  bool success = ( igm_result == iBase_SUCCESS );
+  for( int i = 0; i < num_sets; ++i ){
+    iGeom_destroyEntSet( igm, sets[i], &igm_result );
+    CHECK_IGEOM( igm_result, "Removing an entity set" );
+    success = success && ( igm_result == iBase_SUCCESS );
+  }
+  free( sets );
+  return success;
+}
+
+/** A deck of a batch, and the file its geometry is saved to */
+struct BatchJob{
+  std::string input, output;
+};
+
+/// the extension of a path, from its last dot, or "" if its file name has none
+static std::string fileExtension( const std::string& path ){
+  size_t dot = path.find_last_of( '.' ), slash = path.find_last_of( '/' );
+  if( dot == path.npos || ( slash != path.npos && dot < slash ) ) return "";
+  return path.substr( dot );
+}
+
+/**
+ * Read the decks of a batch from a list file: one per line, the path of the deck followed
+ * optionally by the path of its output file.  Blank lines and lines starting with # are
+ * skipped.  A deck without an output file is saved beside itself, under its own name with
+ * the extension of output_file in place of its own.  Returns false if the list could not
+ * be read.
+ */
+static bool readBatchList( const std::string& filename, const std::string& output_file,
+                           std::vector<BatchJob>& jobs ){
+  std::ifstream list( filename.c_str(), std::ios::in );
+  if( !list.is_open() ){
+    std::cerr << "Error: couldn't open batch list \"" << filename << "\"" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while( std::getline( list, line ) ){
+    line_number++;
+    std::stringstream str( line );
+    BatchJob job;
+    if( !(str >> job.input) || job.input[0] == '#' ) continue;
+    if( !(str >> job.output) ){
+      std::string extension = fileExtension( job.input );
+      job.output = job.input.substr( 0, job.input.length() - extension.length() ) + fileExtension( output_file );
+    }
+    if( job.output == job.input ){
+      std::cerr << "Error: line " << line_number << " of " << filename << ": the output file of "
+                << job.input << " would replace it; give an output file after it" << std::endl;
+      return false;
+    }
+    jobs.push_back( job );
+  }
+
+  if( jobs.empty() ){
+    std::cerr << "Error: no decks in batch list \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/// a file name of the user's with the number of a deck of the batch appended, or "" for none
+static std::string batchFileName( const std::string& name, size_t job ){
+  if( name.empty() ) return name;
+  std::stringstream str;
+  str << name << "." << job;
+  return str.str();
+}
+
+static void writeBatchReport( const BatchJob& job, const std::string& status, double seconds ){
+  std::string filename = job.output + ".report";
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open report file \"" << filename << "\"" << std::endl;
+    return;
+  }
+  out << "deck: " << job.input << std::endl;
+  out << "output: " << job.output << std::endl;
+  out << "status: " << status << std::endl;
+  out << "seconds: " << seconds << std::endl;
+  printCostReport( out, 10 );
+}
+
+/**
+ * Convert each deck of a batch in turn with one iGeom instance, which is cleared between
+ * decks.  What the decks have in common is kept from one to the next: the kernel, which
+ * is started only once, the analytic surfaces, which are cached by their content, and the
+ * parsed transforms.  Each output file gets a report beside it, with ".report" appended
+ * to its name, giving the status and time of the conversion and, if it was profiled, its
+ * most expensive parts.  The profile and the census are started afresh for each deck,
+ * and their files are named with the number of the deck appended.  Each deck has its
+ * own checkpoint directory within the one given, named by its checkpointKey(), so that a
+ * batch run again after it was killed resumes every unfinished deck.  A deck that fails is
+ * reported and the batch carries on.  Returns the number of decks that failed.
+ */
+static int convertBatch( iGeom_Instance igm, const std::vector<BatchJob>& jobs,
+                         bool parse_debug, bool output_debug ){
+
+  std::string profile_file = Gopt.profile_file, trace_file = Gopt.trace_file, cost_file = Gopt.cost_file;
+  std::string census_file = Gopt.census_file;
+  std::string checkpoint_dir = Gopt.checkpoint_dir;
+  bool debug = Gopt.debug;
+  double batch_start = wallTime();
+  int failed = 0;
+
+  for( size_t n = 0; n < jobs.size(); ++n ){
+    const BatchJob& job = jobs[n];
+    std::cout << "Converting deck " << n+1 << " of " << jobs.size() << ", " << job.input << std::endl;
+    Gopt.input_file = job.input;
+    Gopt.output_file = job.output;
+    if( profile_file.length() || trace_file.length() || cost_file.length() || OPT_VERBOSE ){
+      startProfiling( batchFileName( profile_file, n+1 ), batchFileName( trace_file, n+1 ),
+                      batchFileName( cost_file, n+1 ) );
+    }
+    double start = wallTime();
+
+    // each deck is checkpointed in a directory of its own, named by its key
+    if( checkpoint_dir.length() ){
+      Gopt.checkpoint_dir = checkpoint_dir + "/" + checkpointKey( job.input );
+    }
+
+    std::string status = "converted";
+    std::ifstream input( job.input.c_str(), std::ios::in );
+    if( ( Gopt.census || census_file.length() ) && !startCensus( igm, batchFileName( census_file, n+1 ) ) ){
+      status = "failed: couldn't start the census";
+    }
+    else if( !input.is_open() ){
+      std::cerr << "Error: couldn't open file \"" << job.input << "\"" << std::endl;
+      status = "failed: couldn't open the deck";
+    }
+    else if( checkpoint_dir.length() && !prepareDirectory( Gopt.checkpoint_dir, "checkpoint" ) ){
+      status = "failed: couldn't create its checkpoint directory";
+    }
+    else{
+      InputDeck* deck = NULL;
+      try{
+        Gopt.debug = debug || parse_debug;
+        {
+          ProfileScope parse_phase( "phase", "parse" );
+          deck = &InputDeck::build( input );
+        }
+        Gopt.debug = debug || output_debug;
+
+        GeometryContext context( igm, *deck );
+        context.createGeometry();
+      }
+      catch( std::runtime_error& e ){
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = std::string( "failed: " ) + e.what();
+      }
+      Gopt.debug = debug;
+      forgetSurfaceCards();
+      delete deck;
+    }
+    if( checkpoint_dir.length() ){
+      // empty once the deck is converted and its checkpoint removed
+      rmdir( Gopt.checkpoint_dir.c_str() );
+    }
+
+    double seconds = wallTime() - start;
+    writeProfile();
+    writeBatchReport( job, status, seconds );
+    if( !clearInstance( igm ) ){
+      std::cerr << "Warning: the model of " << job.input << " could not be cleared, and may be saved "
+                << "with the decks after it." << std::endl;
+    }
+    if( status != "converted" ) failed++;
+  }
+
+  double seconds = wallTime() - batch_start;
+  std::cout << "Converted " << jobs.size() - failed << " of " << jobs.size() << " decks in " << seconds
+            << " seconds, " << seconds / jobs.size() << " per deck." << std::endl;
+  return failed;
+}
+
 std::string mcnp2cad_version(bool full = true);
 
 
@@ -1140,8 +3237,28 @@ int main(int argc, char* argv[]){
   Gopt.igeom_init_options = "";
   Gopt.override_tolerance = false;
   Gopt.uwuw_names = false;
-
-  bool DiFlag = false, DoFlag = false;
+  Gopt.worker_processes = 1;
+  Gopt.shards = 1;
+  Gopt.imprint_batch_size = 0;
+  Gopt.imprint_shards = 1;
+  Gopt.native_mesh = false;
+  Gopt.mesh_size = 0.0;
+  Gopt.volume_samples = 0;
+  Gopt.check_rays = 0;
+  Gopt.locate_point = "";
+  Gopt.profile_file = "";
+  Gopt.trace_file = "";
+  Gopt.cost_file = "";
+  Gopt.census = false;
+  Gopt.census_file = "";
+  Gopt.checkpoint_dir = "";
+  Gopt.checkpoint_interval = 600.0;
+  Gopt.cache_dir = "";
+  Gopt.cell_timeout = 0.0;
+  Gopt.retag_file = "";
+
+  bool DiFlag = false, DoFlag = false, parse_only = false, analyze_only = false, batch = false;
+  std::string calibration_file;
 
   ProgOptions po("mcnp2cad " + mcnp2cad_version(false) +  ": An MCNP geometry to CAD file converter");
   po.setVersion( mcnp2cad_version() );
@@ -1152,10 +3269,37 @@ int main(int argc, char* argv[]){
   po.addOpt<void>("debug,D", "Debugging (very verbose) output", &Gopt.debug );
   po.addOpt<void>("Di", "Debug output for MCNP parsing phase only", &DiFlag);
   po.addOpt<void>("Do","Debug output for iGeom output phase only", &DoFlag);
+  po.addOpt<void>("parse-only", "Read the input file and stop, e.g. to time the parser", &parse_only, po.store_true );
+  po.addOpt<void>("analyze", "Read the input file, report its size and structure and estimate the work and time "
+                  "of converting it, without building any geometry", &analyze_only, po.store_true );
+  po.addOpt<std::string>("calibration", "Seconds per kernel operation for --analyze, as `kind seconds' lines",
+                         &calibration_file );
+  po.addOpt<int>("jobs,j", "Prebuild universes in this many parallel worker processes", 
+                 &Gopt.worker_processes );
+  po.addOpt<int>("shards", "Split universe 0 into this many regions, each defined in its own worker process; "
+                 "implies extra-effort", &Gopt.shards );
+  po.addOpt<std::string>("checkpoint-dir", "Save the cells of universe 0 defined so far to this directory from "
+                         "time to time, and resume from there if a checkpoint of the same deck is found",
+                         &Gopt.checkpoint_dir );
+  po.addOpt<double>("checkpoint-interval", "Seconds between checkpoints. Default: 600",
+                    &Gopt.checkpoint_interval );
+  po.addOpt<std::string>("cache-dir", "Keep prebuilt universes in this directory, and reuse those whose cells, "
+                         "surfaces and fills have not changed", &Gopt.cache_dir );
+  po.addOpt<double>("cell-timeout", "Define each cell of universe 0 in a worker process that is killed after this "
+                    "many seconds; a cell that runs out of time is replaced by its shell, or skipped",
+                    &Gopt.cell_timeout );
 
   po.addOptionHelpHeading( "Options controlling CAD output:" );
   po.addOpt<std::string>(",o", "Give name of output file. Default: " + Gopt.output_file, &Gopt.output_file );
+  po.addOpt<void>("batch", "The input file is a list of decks, one per line with an optional output file "
+                  "after each, to be converted one after another with one CAD kernel", &batch, po.store_true );
+  po.addOpt<std::string>("retag", "Instead of building the geometry, load this earlier output and replace its "
+                         "material and importance groups with those of the input file", &Gopt.retag_file );
   po.addOpt<double>("tol,t", "Specify a tolerance for merging surfaces", &Gopt.specific_tolerance );
+  po.addOpt<int>("imprint-shards", "Imprint and merge this many regions of the model in parallel worker "
+                 "processes, then the cells at their boundaries", &Gopt.imprint_shards );
+  po.addOpt<int>("imprint-batch", "Imprint and merge neighbouring cells in batches of about this many, "
+                 "instead of the whole model at once", &Gopt.imprint_batch_size );
   po.addOpt<void>("skip-mats,M", "Do not tag materials using group names", 
                   &Gopt.tag_materials, po.store_false );
   po.addOpt<void>("skip-imps,P", "Do not tag cell importances using group names",
@@ -1172,6 +3316,31 @@ int main(int argc, char* argv[]){
                                    "i.e. 'mat:mX/rho:Y' where X is material number is Y is density",
                   &Gopt.uwuw_names, po.store_true );
 
+  po.addOptionHelpHeading( "Options for profiling:" );
+  po.addOpt<std::string>("profile", "Time every CAD kernel operation and write a JSON summary to this file",
+                         &Gopt.profile_file );
+  po.addOpt<std::string>("profile-trace", "Write every CAD kernel operation to this file as a Chrome trace "
+                         "event, for viewing as a flame graph", &Gopt.trace_file );
+  po.addOpt<std::string>("cost-report", "Write the time, kernel operations and bodies of each cell, universe "
+                         "and phase to this CSV file", &Gopt.cost_file );
+  po.addOpt<void>("census", "Count the live CAD bodies and memory use after each cell, and warn of cells "
+                  "that leave bodies behind", &Gopt.census, po.store_true );
+  po.addOpt<std::string>("census-samples", "Write each census sample to this CSV file (implies --census)",
+                         &Gopt.census_file );
+
+  po.addOptionHelpHeading( "Options for faceted or voxelized output without CGM:" );
+  po.addOpt<void>("mesh", "Mesh each cell directly from its surfaces and write the facets to an OBJ file, "
+                  "instead of building CAD geometry", &Gopt.native_mesh, po.store_true );
+  po.addOpt<double>("mesh-size", "Largest facet size for --mesh. Default: 1/32 of each cell's extent, up to 1/8 in decks of many cells",
+                    &Gopt.mesh_size );
+  po.addOpt<std::vector<int> >("voxelize", "Write the cell and material at the center of each voxel of an NX,NY,NZ "
+                               "grid to a binary file, instead of building CAD geometry", &Gopt.voxel_dims );
+  po.addOpt<int>("volumes", "Estimate the volume of each cell from this many random points and write them "
+                 "to a CSV file, instead of building CAD geometry", &Gopt.volume_samples );
+  po.addOpt<int>("check-geometry", "Cast this many random rays through the cells and report where no cell or "
+                 "several cells claim the same point, instead of building CAD geometry", &Gopt.check_rays );
+  po.addOpt<std::string>("locate", "Print the cell containing the point X,Y,Z and stop", &Gopt.locate_point );
+
 #ifdef USING_CGMA
   po.addOptionHelpHeading ("Options controlling CGM library:");
   po.addOpt<int>("geomver","Override geometry export engine version");
@@ -1182,7 +3351,8 @@ int main(int argc, char* argv[]){
   po.addOptionHelpHeading( "         (May be useful for infinite lattices, but use cautiously)" );
 #endif
 
-  po.addRequiredArg( "input_file", "Path to MCNP geometry input file", &Gopt.input_file );
+  po.addRequiredArg( "input_file", "Path to MCNP geometry input file (or, with --batch, to a list of them)",
+                     &Gopt.input_file );
 
   po.parseCommandLine( argc, argv );
 
@@ -1220,12 +3390,43 @@ int main(int argc, char* argv[]){
     std::cerr << "Warning: cannot merge geometry without imprinting, will skip merge too." << std::endl;
   }
 
+  if( Gopt.shards > 1 ){
+    // a shard cannot tell where the search for an infinite lattice's nodes would have stopped
+    // in the whole container, so every shard searches until it finds the lattice's nodes
+    Gopt.infinite_lattice_extra_effort = true;
+  }
+
+  if( batch ){
+    if( parse_only || analyze_only || Gopt.retag_file.length() || Gopt.locate_point.length() || Gopt.check_rays ||
+        Gopt.volume_samples || Gopt.voxel_dims.size() || Gopt.native_mesh ){
+      std::cerr << "Error: --batch only converts decks to CAD geometry, and cannot be combined with --parse-only, "
+                << "--analyze, --retag, --locate, --check-geometry, --volumes, --voxelize or --mesh" << std::endl;
+      return 1;
+    }
+    std::vector<BatchJob> jobs;
+    if( !readBatchList( Gopt.input_file, Gopt.output_file, jobs ) ){
+      return 1;
+    }
+    iGeom_Instance igm;
+    if( !startKernel( igm ) ){
+      return 1;
+    }
+#ifdef USING_CGMA
+    setExportVersion( po );
+#endif
+    return convertBatch( igm, jobs, DiFlag || OPT_DEBUG, DoFlag || OPT_DEBUG ) ? 1 : 0;
+  }
+
   std::ifstream input(Gopt.input_file.c_str(), std::ios::in );
   if( !input.is_open() ){
     std::cerr << "Error: couldn't open file \"" << Gopt.input_file << "\"" << std::endl;
     return 1;
   }
   
+  if( Gopt.profile_file.length() || Gopt.trace_file.length() || Gopt.cost_file.length() || OPT_VERBOSE ){
+    startProfiling( Gopt.profile_file, Gopt.trace_file, Gopt.cost_file );
+  }
+
   std::cout << "Reading input file..." << std::endl;
 
   // if --Di and not -D, set debugging to be true for InputDeck::build() call only
@@ -1234,9 +3435,32 @@ int main(int argc, char* argv[]){
   }
   else{ DiFlag = false; }
 
+  ProfileScope* parse_phase = new ProfileScope( "phase", "parse" );
   InputDeck& deck = InputDeck::build(input);
+  delete parse_phase;
   std::cout << "Done reading input." << std::endl;
 
+  if( parse_only ){
+    return writeProfile() ? 0 : 1;
+  }
+
+  if( analyze_only ){
+    std::map<std::string,double> calibration;
+    if( !readCalibration( calibration_file, calibration ) ){
+      return 1;
+    }
+    DeckAnalysis analysis( deck, estimateWorldSize( deck ) );
+    try{
+      analysis.analyze();
+    }
+    catch( std::runtime_error& e ){
+      std::cerr << "Error: the conversion would fail: " << e.what() << std::endl;
+      return 1;
+    }
+    analysis.report( std::cout, calibration );
+    return 0;
+  }
+
   // turn off debug if it was set by --Di only
   if( DiFlag ){ Gopt.debug = false; }
   
@@ -1246,25 +3470,71 @@ int main(int argc, char* argv[]){
     debugSurfaceDistances( deck );
   }
 
-  iGeom_Instance igm;
-  int igm_result; 
+  if( Gopt.locate_point.length() ){
+    return printPointLocation( deck, Gopt.locate_point ) ? 0 : 1;
+  }
 
-  iGeom_newGeom( Gopt.igeom_init_options.c_str(), &igm, &igm_result, Gopt.igeom_init_options.length() );
-  CHECK_IGEOM( igm_result, "Initializing iGeom");
+  if( Gopt.check_rays ){
+    if( Gopt.output_file == OPT_DEFAULT_OUTPUT_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_CONFLICT_FILENAME;
+    }
+    return writeGeometryConflicts( deck, Gopt.check_rays, Gopt.output_file ) ? 0 : 1;
+  }
 
-#ifdef USING_CGMA
-  int export_vers;
-  if( po.getOpt( "geomver", &export_vers) ){
-    if( CUBIT_SUCCESS == GeometryQueryTool::instance()->set_export_allint_version( export_vers ) ){
-      std::cout << "Set export engine version to " << export_vers << std::endl; 
+  if( Gopt.volume_samples ){
+    if( Gopt.output_file == OPT_DEFAULT_OUTPUT_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_VOLUME_FILENAME;
     }
-    // on failure, an error message will be printed by CGM
+    return writeCellVolumes( deck, Gopt.volume_samples, Gopt.output_file ) ? 0 : 1;
+  }
+
+  if( Gopt.voxel_dims.size() ){
+    if( Gopt.output_file == OPT_DEFAULT_OUTPUT_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_VOXEL_FILENAME;
+    }
+    return writeVoxelMap( deck, Gopt.voxel_dims, Gopt.output_file ) ? 0 : 1;
+  }
+
+  if( Gopt.native_mesh ){
+    if( Gopt.output_file == OPT_DEFAULT_OUTPUT_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_MESH_FILENAME;
+    }
+    return writeMeshedGeometry( deck, Gopt.output_file ) ? 0 : 1;
   }
 
+  iGeom_Instance igm;
+  if( !startKernel( igm ) ){
+    return 1;
+  }
+  if( Gopt.census || Gopt.census_file.length() ){
+    if( !startCensus( igm, Gopt.census_file ) ){
+      return 1;
+    }
+  }
+#ifdef USING_CGMA
+  setExportVersion( po );
 #endif
 
   GeometryContext context( igm, deck );
-  context.createGeometry();
+  try{
+    if( Gopt.retag_file.length() ){
+      context.retagGeometry( Gopt.retag_file );
+    }
+    else{
+      context.createGeometry();
+    }
+  }
+  catch( std::runtime_error& e ){
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if( OPT_VERBOSE ){
+    printCostReport( std::cout, 10 );
+  }
+  if( !writeProfile() ){
+    return 1;
+  }
   
 #ifdef USING_CGMA
   if( CGMA_opt_inhibit_intersect_errs && SilentCubitMessageHandler::num_dropped_errors > 0){
@@ -0,0 +1,122 @@
+/**
+ * mcnp2mesh: the faceted output of mcnp2cad --mesh, or the voxelized output of
+ * mcnp2cad --voxelize, built without CGM.
+ *
+ * Every cell is meshed directly from the analytic definitions of its surfaces, so this
+ * program needs neither iGeom nor a CAD kernel to build or run.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "MCNPInput.hpp"
+#include "options.hpp"
+#include "ProgOptions.hpp"
+#include "version.hpp"
+#include "mesher.hpp"
+#include "voxels.hpp"
+#include "montecarlo.hpp"
+
+struct program_option_struct Gopt;
+
+static std::string mcnp2mesh_version( bool full = true ){
+  std::stringstream str;
+  str << (full ? "mcnp2mesh version " : "")
+      << MCNP2CAD_VERSION_MAJOR << "."
+      << MCNP2CAD_VERSION_MINOR << "."
+      << MCNP2CAD_VERSION_REV;
+  if(full)
+      str << "\nCompiled on " << __DATE__ << " at " << __TIME__ ;
+  return str.str();
+}
+
+int main(int argc, char* argv[]){
+
+  // set default options; those that only concern CAD output are left as mcnp2cad sets them
+  Gopt.verbose = Gopt.debug = false;
+  Gopt.infinite_lattice_extra_effort = false;
+  Gopt.tag_materials = true;
+  Gopt.tag_importances = true;
+  Gopt.tag_cell_IDs = true;
+  Gopt.make_graveyard = true;
+  Gopt.imprint_geom = false;
+  Gopt.merge_geom = false;
+  Gopt.input_file = "";
+  Gopt.output_file = OPT_DEFAULT_MESH_FILENAME;
+  Gopt.igeom_init_options = "";
+  Gopt.override_tolerance = false;
+  Gopt.uwuw_names = false;
+  Gopt.worker_processes = 1;
+  Gopt.shards = 1;
+  Gopt.imprint_batch_size = 0;
+  Gopt.imprint_shards = 1;
+  Gopt.native_mesh = true;
+  Gopt.mesh_size = 0.0;
+  Gopt.volume_samples = 0;
+  Gopt.check_rays = 0;
+  Gopt.locate_point = "";
+
+  ProgOptions po("mcnp2mesh " + mcnp2mesh_version(false) +  ": An MCNP geometry to faceted surface converter");
+  po.setVersion( mcnp2mesh_version() );
+
+  po.addOpt<void>("verbose,v", "Verbose output", &Gopt.verbose, po.store_true );
+  po.addOpt<void>("debug,D", "Debugging (very verbose) output", &Gopt.debug, po.store_true );
+  po.addOpt<int>("jobs,j", "Mesh cells in this many parallel worker processes", &Gopt.worker_processes );
+
+  po.addOptionHelpHeading( "Options controlling faceted output:" );
+  po.addOpt<std::string>(",o", "Give name of output file. Default: " + Gopt.output_file, &Gopt.output_file );
+  po.addOpt<double>("mesh-size", "Largest facet size. Default: 1/32 of each cell's extent, up to 1/8 in decks of many cells", &Gopt.mesh_size );
+  po.addOpt<std::vector<int> >("voxelize", "Instead of facets, write the cell and material at the center of "
+                               "each voxel of an NX,NY,NZ grid to a binary file", &Gopt.voxel_dims );
+  po.addOpt<int>("volumes", "Instead of facets, estimate the volume of each cell from this many random "
+                 "points and write them to a CSV file", &Gopt.volume_samples );
+  po.addOpt<int>("check-geometry", "Cast this many random rays through the cells and report where no cell or "
+                 "several cells claim the same point, instead of building facets", &Gopt.check_rays );
+  po.addOpt<std::string>("locate", "Print the cell containing the point X,Y,Z and stop", &Gopt.locate_point );
+  po.addOpt<void>("skip-graveyard,G", "Do not bound the geometry with a `graveyard' bounding box",
+                  &Gopt.make_graveyard, po.store_false );
+
+  po.addRequiredArg( "input_file", "Path to MCNP geometry input file", &Gopt.input_file );
+
+  po.parseCommandLine( argc, argv );
+
+  std::ifstream input(Gopt.input_file.c_str(), std::ios::in );
+  if( !input.is_open() ){
+    std::cerr << "Error: couldn't open file \"" << Gopt.input_file << "\"" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Reading input file..." << std::endl;
+  InputDeck& deck = InputDeck::build(input);
+  std::cout << "Done reading input." << std::endl;
+
+  if( Gopt.locate_point.length() ){
+    return printPointLocation( deck, Gopt.locate_point ) ? 0 : 1;
+  }
+
+  if( Gopt.check_rays ){
+    if( Gopt.output_file == OPT_DEFAULT_MESH_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_CONFLICT_FILENAME;
+    }
+    return writeGeometryConflicts( deck, Gopt.check_rays, Gopt.output_file ) ? 0 : 1;
+  }
+
+  if( Gopt.volume_samples ){
+    if( Gopt.output_file == OPT_DEFAULT_MESH_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_VOLUME_FILENAME;
+    }
+    return writeCellVolumes( deck, Gopt.volume_samples, Gopt.output_file ) ? 0 : 1;
+  }
+
+  if( Gopt.voxel_dims.size() ){
+    if( Gopt.output_file == OPT_DEFAULT_MESH_FILENAME ){
+      Gopt.output_file = OPT_DEFAULT_VOXEL_FILENAME;
+    }
+    return writeVoxelMap( deck, Gopt.voxel_dims, Gopt.output_file ) ? 0 : 1;
+  }
+
+  return writeMeshedGeometry( deck, Gopt.output_file ) ? 0 : 1;
+
+}
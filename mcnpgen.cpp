@@ -0,0 +1,357 @@
+/**
+ * mcnpgen: write synthetic MCNP decks of a chosen shape and size, for timing how
+ * mcnp2cad scales.  Each kind of deck stresses one part of the converter:
+ *
+ *   lattice      an N x M square lattice of pin universes
+ *   hexlattice   an N x M hexagonal lattice of pin universes
+ *   nested       square lattices of N x N elements nested to depth D, with pins innermost;
+ *                N is rounded up to an odd number, so each lattice is centered in the
+ *                element that it fills
+ *   planes       N cells, each a prism bounded by P planes
+ *   complements  N spheres in a box, the box cell excluding each with #n
+ *   transforms   N rotated and translated cylinders, each surface with its own TR card
+ *   data         a few cells followed by N material cards of M nuclides each
+ *
+ * Every deck is closed by a zero-importance outside cell, so it can be converted as is.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include "ProgOptions.hpp"
+#include "version.hpp"
+
+static std::string mcnpgen_version( bool full = true ){
+  std::stringstream str;
+  str << (full ? "mcnpgen version " : "")
+      << MCNP2CAD_VERSION_MAJOR << "."
+      << MCNP2CAD_VERSION_MINOR << "."
+      << MCNP2CAD_VERSION_REV;
+  if(full)
+      str << "\nCompiled on " << __DATE__ << " at " << __TIME__ ;
+  return str.str();
+}
+
+struct deck_params{
+  int n, m;       // main size of the deck, and its second dimension where there is one
+  int depth;      // lattice nesting depth
+  int planes;     // planes bounding each cell
+  double pitch;   // lattice pitch, or spacing of the repeated cells
+};
+
+/** Round the last bits of trigonometric results away, so that zero is written as 0 */
+static double tidy( double x ){
+  return std::fabs( x ) < 1e-12 ? 0.0 : x;
+}
+
+/** Write a card, continuing it on lines of at most 78 characters */
+static void writeCard( std::ostream& out, const std::string& card ){
+  std::stringstream words( card );
+  std::string word, line;
+  while( words >> word ){
+    if( line.length() && line.length() + 1 + word.length() > 78 ){
+      out << line << "\n";
+      line = "     ";
+    }
+    if( line.length() && line != "     " ) line += " ";
+    line += word;
+  }
+  out << line << "\n";
+}
+
+/** The fill array of an n x m x 1 lattice, every element holding the same universe */
+static std::string uniformFill( int lo_i, int n, int lo_j, int m, int universe ){
+  std::stringstream card;
+  card << "fill=" << lo_i << ":" << lo_i + n - 1 << " " << lo_j << ":" << lo_j + m - 1 << " 0:0";
+  for( int k = 0; k < n * m; ++k ){
+    card << " " << universe;
+  }
+  return card.str();
+}
+
+/** A two-cell pin universe: a fuel cylinder of material 1 in a moderator of material 2 */
+static void writePinCells( std::ostream& cells, int universe, int first_cell, int surface ){
+  cells << first_cell << " 1 -10.5 -" << surface << " u=" << universe << " imp:n=1\n";
+  cells << first_cell + 1 << " 2 -1.0 " << surface << " u=" << universe << " imp:n=1\n";
+}
+
+static const char* pin_materials =
+  "m1 92235.70c 0.04 92238.70c 0.96 8016.70c 2.0\n"
+  "m2 1001.70c 2 8016.70c 1\n";
+
+static void writeSquareLattice( std::ostream& out, const deck_params& p ){
+  double h = p.pitch / 2.0;
+  int lo_i = -(p.n / 2), lo_j = -(p.m / 2);
+  std::stringstream cells, surfaces;
+
+  cells << "1 0 -1 fill=1 imp:n=1\n";
+  writeCard( cells, "2 0 -11 12 -13 14 lat=1 u=1 imp:n=1 " + uniformFill( lo_i, p.n, lo_j, p.m, 2 ) );
+  writePinCells( cells, 2, 3, 20 );
+  cells << "5 0 1 imp:n=0\n";
+
+  surfaces << "1 rpp " << ( lo_i - 0.5 ) * p.pitch << " " << ( lo_i + p.n - 0.5 ) * p.pitch << " "
+           << ( lo_j - 0.5 ) * p.pitch << " " << ( lo_j + p.m - 0.5 ) * p.pitch << " "
+           << -10 * p.pitch << " " << 10 * p.pitch << "\n";
+  surfaces << "11 px " << h << "\n12 px " << -h << "\n13 py " << h << "\n14 py " << -h << "\n";
+  surfaces << "20 cz " << 0.4 * p.pitch << "\n";
+
+  out << "Generated " << p.n << "x" << p.m << " square lattice of pins\n"
+      << cells.str() << "\n" << surfaces.str() << "\n" << pin_materials;
+}
+
+static void writeHexLattice( std::ostream& out, const deck_params& p ){
+  double h = p.pitch / 2.0;
+  double root3 = std::sqrt( 3.0 );
+  int lo_i = -(p.n / 2), lo_j = -(p.m / 2);
+  std::stringstream cells, surfaces;
+
+  cells << "1 0 -1 -2 3 fill=1 imp:n=1\n";
+  writeCard( cells, "2 0 -11 12 -13 15 -14 16 lat=2 u=1 imp:n=1 " + uniformFill( lo_i, p.n, lo_j, p.m, 2 ) );
+  writePinCells( cells, 2, 3, 20 );
+  cells << "5 0 1:2:-3 imp:n=0\n";
+
+  // the container is the largest cylinder inside the lattice's fill
+  surfaces << "1 cz " << ( std::min( p.n, p.m ) / 2 ) * p.pitch * 0.8 + h << "\n";
+  surfaces << "2 pz " << 10 * p.pitch << "\n3 pz " << -10 * p.pitch << "\n";
+  surfaces << "11 px " << h << "\n12 px " << -h << "\n";
+  surfaces << "13 p 1 " << root3 << " 0 " << 2 * h << "\n";
+  surfaces << "14 p -1 " << root3 << " 0 " << 2 * h << "\n";
+  surfaces << "15 p 1 " << root3 << " 0 " << -2 * h << "\n";
+  surfaces << "16 p -1 " << root3 << " 0 " << -2 * h << "\n";
+  surfaces << "20 cz " << 0.4 * p.pitch << "\n";
+
+  out << "Generated " << p.n << "x" << p.m << " hexagonal lattice of pins\n"
+      << cells.str() << "\n" << surfaces.str() << "\n" << pin_materials;
+}
+
+static void writeNestedLattice( std::ostream& out, const deck_params& p ){
+  std::stringstream cells, surfaces;
+  int n = p.n | 1;
+  int lo = -(n / 2);
+
+  // level l is a lattice in universe l of elements filled with universe l+1; the
+  // elements of each level are the size of a whole lattice of the next
+  double pitch = p.pitch;
+  for( int l = 1; l < p.depth; ++l ) pitch *= n;
+
+  cells << "1 0 -1 fill=1 imp:n=1\n";
+  surfaces << "1 rpp";
+  for( int k = 0; k < 2; ++k ){
+    surfaces << " " << ( lo - 0.5 ) * pitch << " " << ( lo + n - 0.5 ) * pitch;
+  }
+  surfaces << " " << -p.pitch << " " << p.pitch << "\n";
+
+  for( int l = 1; l <= p.depth; ++l ){
+    int s = 10 * l;
+    std::stringstream lattice;
+    lattice << 1 + l << " 0 -" << s + 1 << " " << s + 2 << " -" << s + 3 << " " << s + 4
+            << " lat=1 u=" << l << " imp:n=1 " << uniformFill( lo, n, lo, n, l + 1 );
+    writeCard( cells, lattice.str() );
+    surfaces << s + 1 << " px " << pitch / 2 << "\n" << s + 2 << " px " << -pitch / 2 << "\n"
+             << s + 3 << " py " << pitch / 2 << "\n" << s + 4 << " py " << -pitch / 2 << "\n";
+    pitch /= n;
+  }
+
+  int pin_surface = 10 * ( p.depth + 1 );
+  writePinCells( cells, p.depth + 1, p.depth + 2, pin_surface );
+  cells << p.depth + 4 << " 0 1 imp:n=0\n";
+  surfaces << pin_surface << " cz " << 0.4 * p.pitch << "\n";
+
+  out << "Generated " << n << "x" << n << " square lattices nested " << p.depth << " deep\n"
+      << cells.str() << "\n" << surfaces.str() << "\n" << pin_materials;
+}
+
+static void writePlaneCells( std::ostream& out, const deck_params& p ){
+  std::stringstream cells, surfaces;
+  int sides = std::max( 3, p.planes - 2 );
+  double radius = p.pitch;
+  double pi = std::acos( -1.0 );
+
+  // cell k is the slab between x planes k and k+1, cut to a polygonal prism by planes
+  // tangent to a cylinder about the x axis
+  std::stringstream sides_expr;
+  for( int s = 0; s < sides; ++s ){
+    double a = 2 * pi * s / sides;
+    int ident = p.n + 2 + s;
+    surfaces << ident << " p 0 " << tidy( std::cos( a ) ) << " " << tidy( std::sin( a ) ) << " " << radius << "\n";
+    sides_expr << " -" << ident;
+  }
+  for( int k = 0; k <= p.n; ++k ){
+    surfaces << k + 1 << " px " << k * p.pitch << "\n";
+  }
+
+  std::stringstream outside;
+  outside << p.n + 1 << " 0 -1:" << p.n + 1;
+  for( int k = 0; k < p.n; ++k ){
+    std::stringstream cell;
+    cell << k + 1 << " " << k % 2 + 1 << " -1.0 " << k + 1 << " -" << k + 2 << sides_expr.str() << " imp:n=1";
+    writeCard( cells, cell.str() );
+  }
+  for( int s = 0; s < sides; ++s ){
+    outside << ":" << p.n + 2 + s;
+  }
+  writeCard( cells, outside.str() + " imp:n=0" );
+
+  out << "Generated " << p.n << " cells of " << sides + 2 << " planes each\n"
+      << cells.str() << "\n" << surfaces.str() << "\n" << pin_materials;
+}
+
+static void writeComplements( std::ostream& out, const deck_params& p ){
+  std::stringstream cells, surfaces;
+  int side = (int)std::ceil( std::sqrt( (double)p.n ) );
+
+  std::stringstream box;
+  box << p.n + 1 << " 2 -1.0 -1";
+  for( int k = 0; k < p.n; ++k ){
+    cells << k + 1 << " 1 -10.5 -" << k + 2 << " imp:n=1\n";
+    surfaces << k + 2 << " s " << ( k % side ) * p.pitch << " " << ( k / side ) * p.pitch << " 0 "
+             << 0.4 * p.pitch << "\n";
+    box << " #" << k + 1;
+  }
+  writeCard( cells, box.str() + " imp:n=1" );
+  cells << p.n + 2 << " 0 1 imp:n=0\n";
+
+  std::stringstream container;
+  container << "1 rpp " << -p.pitch << " " << side * p.pitch << " " << -p.pitch << " " << side * p.pitch
+            << " " << -p.pitch << " " << p.pitch << "\n";
+
+  out << "Generated " << p.n << " cells excluded from a box by complements\n"
+      << cells.str() << "\n" << container.str() << surfaces.str() << "\n" << pin_materials;
+}
+
+static void writeTransforms( std::ostream& out, const deck_params& p ){
+  std::stringstream cells, surfaces, transforms;
+  int side = (int)std::ceil( std::sqrt( (double)p.n ) );
+  double pi = std::acos( -1.0 );
+
+  // each can is a cylinder between two planes, all three surfaces carrying the can's own
+  // transform: a rotation about z by a different angle, moved to its place on a grid
+  std::stringstream world;
+  world << p.n + 1 << " 2 -1.0 -1";
+  for( int k = 0; k < p.n; ++k ){
+    int tr = k + 1, s = 10 * ( k + 1 );
+    double a = pi * k / p.n;
+    cells << k + 1 << " 1 -10.5 -" << s << " -" << s + 1 << " " << s + 2 << " imp:n=1\n";
+    surfaces << s << " " << tr << " cx " << 0.2 * p.pitch << "\n"
+             << s + 1 << " " << tr << " px " << 0.4 * p.pitch << "\n"
+             << s + 2 << " " << tr << " px " << -0.4 * p.pitch << "\n";
+    std::stringstream card;
+    card.precision( 17 );
+    card << "tr" << tr << " " << ( k % side ) * p.pitch << " " << ( k / side ) * p.pitch << " 0 "
+         << tidy( std::cos( a ) ) << " " << tidy( std::sin( a ) ) << " 0 " << tidy( -std::sin( a ) ) << " "
+         << tidy( std::cos( a ) ) << " 0 0 0 1";
+    writeCard( transforms, card.str() );
+    world << " #" << k + 1;
+  }
+  writeCard( cells, world.str() + " imp:n=1" );
+  cells << p.n + 2 << " 0 1 imp:n=0\n";
+
+  std::stringstream container;
+  container << "1 rpp " << -p.pitch << " " << side * p.pitch << " " << -p.pitch << " " << side * p.pitch
+            << " " << -p.pitch << " " << p.pitch << "\n";
+
+  out << "Generated " << p.n << " transformed cells\n"
+      << cells.str() << "\n" << container.str() << surfaces.str() << "\n" << transforms.str() << pin_materials;
+}
+
+static void writeDataCards( std::ostream& out, const deck_params& p ){
+  std::stringstream cells, surfaces, data;
+  int count = std::max( 1, p.n );
+
+  // one sphere per material, so every card is referenced
+  int shown = std::min( count, 10 );
+  std::stringstream world;
+  world << shown + 1 << " 0 -1";
+  for( int k = 0; k < shown; ++k ){
+    cells << k + 1 << " " << k + 1 << " -1.0 -" << k + 2 << " imp:n=1\n";
+    surfaces << k + 2 << " s " << k * p.pitch << " 0 0 " << 0.4 * p.pitch << "\n";
+    world << " " << k + 2;
+  }
+  cells << world.str() << " imp:n=1\n";
+  cells << shown + 2 << " 0 1 imp:n=0\n";
+
+  for( int k = 0; k < count; ++k ){
+    std::stringstream card;
+    card << "m" << k + 1;
+    for( int j = 0; j < p.m; ++j ){
+      int z = j % 90 + 1;
+      card << " " << 1000 * z + 2 * z + j / 90 << ".70c " << 1.0 / ( j + 1 );
+    }
+    writeCard( data, card.str() );
+  }
+  data << "sdef pos=0 0 0 erg=2\n";
+  for( int k = 0; k < count; ++k ){
+    data << "f" << 10 * k + 4 << ":n " << k % shown + 1 << "\n";
+  }
+  data << "nps 1000\n";
+
+  out << "Generated " << count << " material cards of " << p.m << " nuclides\n"
+      << cells.str() << "\n" << "1 rpp " << -p.pitch << " " << shown * p.pitch << " " << -p.pitch << " "
+      << p.pitch << " " << -p.pitch << " " << p.pitch << "\n" << surfaces.str() << "\n" << data.str();
+}
+
+int main(int argc, char* argv[]){
+
+  deck_params p;
+  p.n = 10;
+  p.m = 0;
+  p.depth = 2;
+  p.planes = 6;
+  p.pitch = 1.26;
+  std::string kind, output_file;
+
+  ProgOptions po("mcnpgen " + mcnpgen_version(false) + ": A generator of synthetic MCNP decks for benchmarks");
+  po.setVersion( mcnpgen_version() );
+
+  po.addOpt<int>(",n", "Size of the deck: lattice width, or number of cells, complements, transforms or "
+                 "material cards. Default: 10", &p.n );
+  po.addOpt<int>(",m", "Lattice height, or nuclides per material card. Default: same as -n", &p.m );
+  po.addOpt<int>("depth,d", "Nesting depth of a nested lattice. Default: 2", &p.depth );
+  po.addOpt<int>("planes,p", "Planes bounding each cell of a planes deck. Default: 6", &p.planes );
+  po.addOpt<double>("pitch", "Lattice pitch, or spacing of repeated cells. Default: 1.26", &p.pitch );
+  po.addOpt<std::string>(",o", "Write the deck to this file. Default: standard output", &output_file );
+
+  po.addRequiredArg( "kind", "One of lattice, hexlattice, nested, planes, complements, transforms, data", &kind );
+
+  po.parseCommandLine( argc, argv );
+
+  if( p.m <= 0 ) p.m = p.n;
+  if( p.n <= 0 || p.depth <= 0 || p.pitch <= 0 ){
+    std::cerr << "Error: -n, --depth and --pitch must be positive" << std::endl;
+    return 1;
+  }
+
+  std::ofstream file;
+  if( output_file.length() ){
+    file.open( output_file.c_str() );
+    if( !file.is_open() ){
+      std::cerr << "Error: couldn't open file \"" << output_file << "\"" << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = output_file.length() ? file : std::cout;
+
+  if( kind == "lattice" ) writeSquareLattice( out, p );
+  else if( kind == "hexlattice" ) writeHexLattice( out, p );
+  else if( kind == "nested" ) writeNestedLattice( out, p );
+  else if( kind == "planes" ) writePlaneCells( out, p );
+  else if( kind == "complements" ) writeComplements( out, p );
+  else if( kind == "transforms" ) writeTransforms( out, p );
+  else if( kind == "data" ) writeDataCards( out, p );
+  else{
+    std::cerr << "Error: unknown kind of deck \"" << kind << "\"" << std::endl;
+    return 1;
+  }
+
+  out.flush();
+  if( !out.good() ){
+    std::cerr << "Error: couldn't write the deck" << std::endl;
+    return 1;
+  }
+  return 0;
+
+}
@@ -0,0 +1,493 @@
+#include "mesher.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+#include "MCNPInput.hpp"
+#include "volumes.hpp"
+#include "regions.hpp"
+#include "workers.hpp"
+#include "options.hpp"
+
+// the finest grid meshRegion() will use has 2^max_mesh_depth cubes along each side
+static const int max_mesh_depth = 10;
+
+// cells per side of a cell's bounding box when no mesh size is given
+static const double default_mesh_divisions = 32;
+
+// decks with more cell instances than this get fewer divisions per instance by default,
+// down to min_mesh_divisions, so that the facets of the whole model stop growing with them
+static const double full_mesh_instances = 256;
+static const double min_mesh_divisions = 8;
+
+bool TriangleMesh::isClosed() const {
+  // each directed edge must appear once, and its reverse once; a sorted list of them
+  // is far cheaper to build than a map
+  std::vector< std::pair<int,int> > edges;
+  edges.reserve( triangles.size() );
+  for( size_t t = 0; t < triangles.size(); t += 3 ){
+    for( int e = 0; e < 3; ++e ){
+      edges.push_back( std::make_pair( triangles[t+e], triangles[t+(e+1)%3] ) );
+    }
+  }
+  std::sort( edges.begin(), edges.end() );
+  if( std::adjacent_find( edges.begin(), edges.end() ) != edges.end() ) return false;
+  for( size_t i = 0; i < edges.size(); ++i ){
+    const std::pair<int,int>& e = edges[i];
+    if( !std::binary_search( edges.begin(), edges.end(), std::make_pair( e.second, e.first ) ) ) return false;
+  }
+  return true;
+}
+
+void TriangleMesh::writeOBJ( std::ostream& out, const std::string& name, const std::string& group ) const {
+  out << "o " << name << "\n";
+  out << "g " << group << "\n";
+  for( size_t i = 0; i < vertices.size(); ++i ){
+    const Vector3d& v = vertices[i];
+    out << "v " << v.v[0] << " " << v.v[1] << " " << v.v[2] << "\n";
+  }
+  // relative indices keep the object valid wherever it ends up in the file
+  long nv = vertices.size();
+  for( size_t t = 0; t < triangles.size(); t += 3 ){
+    out << "f " << triangles[t] - nv << " " << triangles[t+1] - nv << " " << triangles[t+2] - nv << "\n";
+  }
+}
+
+/** The order in which each of a cube's six tetrahedra steps along the axes, and its orientation */
+static const int tet_axes[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+static const int tet_sign[6] = { 1, -1, -1, 1, 1, -1 };
+
+/**
+ * The state of one meshRegion() call: a grid of 2^depth cubes on a side, with the region's
+ * values at grid points and the surface's vertices on grid edges kept as they are found.
+ */
+class RegionMesher{
+
+protected:
+  const ImplicitRegion& region;
+  Vector3d origin;
+  double cell;
+  int depth;
+  long long n; // grid points per side
+
+  std::map< long long, double > values;
+  std::map< std::pair<long long,long long>, int > edge_vertices;
+  TriangleMesh& mesh;
+
+  long long key( long long i, long long j, long long k ) const { return ( i * n + j ) * n + k; }
+
+  Vector3d point( long long key ) const {
+    long long k = key % n, j = ( key / n ) % n, i = key / ( n * n );
+    return origin + Vector3d( i * cell, j * cell, k * cell );
+  }
+
+  double value( long long key ){
+    std::map< long long, double >::iterator i = values.find( key );
+    if( i != values.end() ) return (*i).second;
+    double f = region.evaluate( point( key ) );
+    values[key] = f;
+    return f;
+  }
+
+  /// the surface's vertex on the edge from an inside grid point to an outside one
+  int edgeVertex( long long in, long long out ){
+    std::pair<long long,long long> edge( std::min( in, out ), std::max( in, out ) );
+    std::map< std::pair<long long,long long>, int >::iterator i = edge_vertices.find( edge );
+    if( i != edge_vertices.end() ) return (*i).second;
+
+    // a few steps of regula falsi place the vertex closer to the true surface than
+    // linear interpolation would
+    Vector3d a = point( in ), b = point( out );
+    double fa = value( in ), fb = value( out );
+    for( int step = 0; step < 4; ++step ){
+      Vector3d m = a + ( b + -a ) * ( fa / ( fa - fb ) );
+      double fm = region.evaluate( m );
+      if( fm < 0 ){ a = m; fa = fm; }
+      else{ b = m; fb = fm; }
+    }
+
+    int v = mesh.vertices.size();
+    mesh.vertices.push_back( a + ( b + -a ) * ( fa / ( fa - fb ) ) );
+    edge_vertices[edge] = v;
+    return v;
+  }
+
+  void addTriangle( int a, int b, int c ){
+    mesh.triangles.push_back( a );
+    mesh.triangles.push_back( b );
+    mesh.triangles.push_back( c );
+  }
+
+  void meshTet( const long long v[4], const bool inside[4], int sign );
+  void meshCube( long long i, long long j, long long k );
+
+public:
+  RegionMesher( const ImplicitRegion& region_p, const Vector3d& origin_p, double cell_p, int depth_p,
+                TriangleMesh& mesh_p ) :
+    region( region_p ), origin( origin_p ), cell( cell_p ), depth( depth_p ), n( (1LL << depth_p) + 1 ), mesh( mesh_p )
+  {}
+
+  void visit( int level, long long i, long long j, long long k );
+};
+
+/**
+ * Triangulate the part of the surface within one tetrahedron.  sign is the orientation of
+ * the tetrahedron as ordered; triangles are wound from the combinatorics alone, so that
+ * a degenerate triangle still gets the same winding as its neighbours.
+ */
+void RegionMesher::meshTet( const long long v[4], const bool inside[4], int sign ){
+
+  int num_inside = inside[0] + inside[1] + inside[2] + inside[3];
+  if( num_inside == 0 || num_inside == 4 ) return;
+
+  if( num_inside == 1 || num_inside == 3 ){
+    // one vertex differs from the others; moving it to the front of the order flips
+    // the orientation once for each place it moves.  The triangle cutting it off faces
+    // away from it when the reordered tetrahedron is positive.
+    bool odd = ( num_inside == 1 );
+    int s = 0;
+    while( inside[s] != odd ) ++s;
+    int others[3], c = 0;
+    for( int i = 0; i < 4; ++i ){
+      if( i != s ) others[c++] = i;
+    }
+    int e[3];
+    for( int i = 0; i < 3; ++i ){
+      e[i] = odd ? edgeVertex( v[s], v[others[i]] ) : edgeVertex( v[others[i]], v[s] );
+    }
+    int orientation = sign * ( ( s % 2 ) ? -1 : 1 );
+    // face away from an inside vertex, toward an outside one
+    if( ( orientation > 0 ) == odd ) addTriangle( e[0], e[1], e[2] );
+    else addTriangle( e[0], e[2], e[1] );
+  }
+  else{
+    // two inside (a,b) and two outside (c,d): the quad ac,ad,bd,bc faces outward
+    // when (a,b,c,d) is positively oriented
+    int order[4], c = 0;
+    for( int i = 0; i < 4; ++i ) if( inside[i] ) order[c++] = i;
+    for( int i = 0; i < 4; ++i ) if( !inside[i] ) order[c++] = i;
+    int inversions = 0;
+    for( int i = 0; i < 4; ++i ){
+      for( int j = i+1; j < 4; ++j ){
+        if( order[i] > order[j] ) ++inversions;
+      }
+    }
+    int orientation = sign * ( ( inversions % 2 ) ? -1 : 1 );
+
+    long long a = v[order[0]], b = v[order[1]], cc = v[order[2]], d = v[order[3]];
+    int ac = edgeVertex( a, cc ), ad = edgeVertex( a, d ), bd = edgeVertex( b, d ), bc = edgeVertex( b, cc );
+    if( orientation > 0 ){
+      addTriangle( ac, ad, bd );
+      addTriangle( ac, bd, bc );
+    }
+    else{
+      addTriangle( ac, bd, ad );
+      addTriangle( ac, bc, bd );
+    }
+  }
+}
+
+void RegionMesher::meshCube( long long i, long long j, long long k ){
+
+  long long corner[8];
+  bool inside[8];
+  int num_inside = 0;
+  for( int c = 0; c < 8; ++c ){
+    corner[c] = key( i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1) );
+    inside[c] = value( corner[c] ) < 0;
+    num_inside += inside[c];
+  }
+  if( num_inside == 0 || num_inside == 8 ) return;
+
+  // the six tetrahedra around the cube's main diagonal, each stepping from corner 0 to
+  // corner 7 along the axes in a different order; every cube is split the same way, so
+  // neighbouring cubes' tetrahedra meet face to face
+  for( int t = 0; t < 6; ++t ){
+    int c1 = 1 << tet_axes[t][0];
+    int c2 = c1 | ( 1 << tet_axes[t][1] );
+    long long v[4] = { corner[0], corner[c1], corner[c2], corner[7] };
+    bool in[4] = { inside[0], inside[c1], inside[c2], inside[7] };
+    meshTet( v, in, tet_sign[t] );
+  }
+}
+
+void RegionMesher::visit( int level, long long i, long long j, long long k ){
+
+  double size = cell * (double)( 1LL << ( depth - level ) );
+  Vector3d center = origin + Vector3d( ( i + 0.5 ) * size, ( j + 0.5 ) * size, ( k + 0.5 ) * size );
+  double reach = size * sqrt( 3.0 ) / 2.0;
+
+  // the boundary cannot cross a cube whose center is further from it than its corners are
+  double f = region.evaluate( center );
+  if( std::fabs( f ) > reach * ( 1.0 + 1e-9 ) ) return;
+
+  if( level == depth ){
+    meshCube( i, j, k );
+    return;
+  }
+
+  for( int c = 0; c < 8; ++c ){
+    visit( level + 1, 2*i + (c & 1), 2*j + ((c >> 1) & 1), 2*k + ((c >> 2) & 1) );
+  }
+}
+
+void meshRegion( const ImplicitRegion& region, const Vector3d& box_min, const Vector3d& box_max,
+                 double max_cell, TriangleMesh& mesh ){
+
+  double side = 0;
+  for( int k = 0; k < 3; ++k ){
+    side = std::max( side, box_max.v[k] - box_min.v[k] );
+  }
+
+  // leave a layer of cubes around the box, so that the grid's outermost points are
+  // outside the region and the surface closes
+  int depth = 2;
+  while( depth < max_mesh_depth && side / ( (1 << depth) - 2 ) > max_cell ){
+    depth++;
+  }
+  double cell = side / ( (1 << depth) - 2 );
+  Vector3d origin = box_min + Vector3d( -cell, -cell, -cell );
+
+  RegionMesher mesher( region, origin, cell, depth, mesh );
+  mesher.visit( 0, 0, 0, 0 );
+}
+
+/** Add a box to a mesh, facing outward, or inward if requested */
+static void addBox( TriangleMesh& mesh, const Vector3d& min, const Vector3d& max, bool inward ){
+  static const int faces[6][4] = { {0,4,6,2}, {1,3,7,5}, {0,1,5,4}, {2,6,7,3}, {0,2,3,1}, {4,5,7,6} };
+
+  int base = mesh.vertices.size();
+  for( int c = 0; c < 8; ++c ){
+    mesh.vertices.push_back( Vector3d( (c & 1) ? max.v[0] : min.v[0],
+                                       (c & 2) ? max.v[1] : min.v[1],
+                                       (c & 4) ? max.v[2] : min.v[2] ) );
+  }
+  for( int f = 0; f < 6; ++f ){
+    const int* q = faces[f];
+    for( int t = 1; t < 3; ++t ){
+      mesh.triangles.push_back( base + q[0] );
+      mesh.triangles.push_back( base + ( inward ? q[t+1] : q[t] ) );
+      mesh.triangles.push_back( base + ( inward ? q[t] : q[t+1] ) );
+    }
+  }
+}
+
+static std::string materialGroup( const CellCard& cell ){
+  std::stringstream formatter;
+  if( cell.getMat() == 0 ){
+    formatter << "void";
+  }
+  else{
+    formatter << "mat_" << cell.getMat() << "_rho_" << cell.getRho();
+  }
+  return formatter.str();
+}
+
+/**
+ * The cells per side of each instance's bounding box when no mesh size is given: the
+ * work of meshing an instance grows with the square of its divisions, so beyond
+ * full_mesh_instances they fall with the square root of the number of instances.
+ */
+static double defaultMeshDivisions( size_t num_instances ){
+  double divisions = default_mesh_divisions;
+  if( num_instances > full_mesh_instances ){
+    divisions *= sqrt( full_mesh_instances / num_instances );
+  }
+  return std::max( divisions, min_mesh_divisions );
+}
+
+/**
+ * Mesh one cell instance, sized to its bounding box, with the given divisions along its
+ * longest side unless a mesh size was set.  Returns false if the instance's mesh is not
+ * closed; an empty mesh, for an instance that turns out to be empty, counts as closed.
+ */
+static bool meshInstance( const CellInstance& instance, double divisions, TriangleMesh& mesh ){
+
+  Vector3d min, max;
+  if( !instance.getBounds( min, max ) ){
+    return true;
+  }
+
+  double max_cell = Gopt.mesh_size;
+  if( max_cell <= 0 ){
+    double side = 0;
+    for( int k = 0; k < 3; ++k ){
+      side = std::max( side, max.v[k] - min.v[k] );
+    }
+    max_cell = side / divisions;
+  }
+
+  meshRegion( instance, min, max, max_cell, mesh );
+  return mesh.isClosed();
+}
+
+/**
+ * Mesh instances [begin,end) and write them to an OBJ stream; returns the number whose
+ * meshes were not closed.
+ */
+static size_t writeInstances( const std::vector<CellInstance>& instances, size_t begin, size_t end,
+                              double divisions, std::ostream& out ){
+
+  size_t open = 0;
+  for( size_t i = begin; i < end; ++i ){
+    const CellInstance& instance = instances[i];
+    int ident = instance.cell->getIdent();
+
+    TriangleMesh mesh;
+    bool closed = meshInstance( instance, divisions, mesh );
+    if( OPT_DEBUG ) std::cout << "Meshed cell " << instance.origin << ": " << mesh.numTriangles() << " triangles" << std::endl;
+
+    if( mesh.triangles.empty() ){
+      if( OPT_VERBOSE ) std::cout << "Cell " << instance.origin << " is empty; skipped." << std::endl;
+      continue;
+    }
+    if( !closed ){
+      std::cerr << "Warning: the mesh of cell " << instance.origin << " is not closed" << std::endl;
+      open++;
+    }
+
+    std::stringstream name;
+    name << "MCNP_ID_" << ident;
+    out << "# cell " << instance.origin << "\n";
+    mesh.writeOBJ( out, name.str(), materialGroup( *instance.cell ) );
+  }
+  return open;
+}
+
+// the last line of a complete fragment of the output file written by a worker process
+static const std::string fragment_end = "# end of fragment";
+
+/** A contiguous run of cell instances to be meshed in a worker process */
+class MeshJob : public WorkerJob {
+protected:
+  const std::vector<CellInstance>& instances;
+  size_t begin, end;
+  double divisions;
+  std::string filename;
+public:
+  MeshJob( const std::vector<CellInstance>& instances_p, size_t begin_p, size_t end_p, double divisions_p,
+           const std::string& filename_p ) :
+    instances(instances_p), begin(begin_p), end(end_p), divisions(divisions_p), filename(filename_p)
+  {}
+
+  /// fails if any mesh was not closed, even though the fragment is complete
+  virtual bool run(){
+    std::ofstream out( filename.c_str() );
+    out.precision( 12 );
+    size_t open = writeInstances( instances, begin, end, divisions, out );
+    out << fragment_end << std::endl;
+    return out.good() && open == 0;
+  }
+};
+
+/** Append a worker's fragment to the output; false if the fragment is incomplete */
+static bool copyFragment( const std::string& filename, std::ostream& out ){
+  std::ifstream in( filename.c_str() );
+  std::string line;
+  std::stringstream buffer;
+  bool complete = false;
+  while( std::getline( in, line ) ){
+    if( line == fragment_end ){
+      complete = true;
+      break;
+    }
+    buffer << line << "\n";
+  }
+  if( complete ){
+    out << buffer.str();
+  }
+  return complete;
+}
+
+bool writeMeshedGeometry( InputDeck& deck, const std::string& filename ){
+
+  double world_size = estimateWorldSize( deck );
+
+  AnalyticGeometry geometry( deck, world_size );
+  geometry.placeCells();
+  const std::vector<CellInstance>& instances = geometry.getInstances();
+
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  out.precision( 12 );
+  out << "# Faceted geometry of " << Gopt.input_file << ", one object per cell instance" << "\n";
+
+  size_t count = instances.size();
+  bool all_closed = true;
+
+  double divisions = defaultMeshDivisions( count );
+  if( Gopt.mesh_size <= 0 && OPT_VERBOSE ){
+    std::cout << "Meshing each cell with " << divisions << " divisions along its longest side" << std::endl;
+  }
+
+  if( Gopt.worker_processes > 1 && count > 1 ){
+
+    // several runs of instances per worker even out cells of different sizes
+    size_t num_jobs = std::min( count, (size_t)Gopt.worker_processes * 4 );
+    std::cout << "Meshing " << count << " cells in " << num_jobs << " jobs with "
+              << Gopt.worker_processes << " worker processes..." << std::endl;
+
+    std::string scratch_dir = makeScratchDirectory( "mcnp2cad-mesh" );
+    std::vector<std::string> files( num_jobs );
+    std::vector<size_t> starts( num_jobs + 1 );
+    std::vector<bool> built( num_jobs, false );
+    for( size_t j = 0; j <= num_jobs; ++j ){
+      starts[j] = count * j / num_jobs;
+    }
+
+    WorkerPool pool( Gopt.worker_processes );
+    size_t next = 0;
+    while( next < num_jobs || pool.numRunning() > 0 ){
+      while( next < num_jobs && pool.hasFreeSlot() ){
+        std::stringstream name;
+        name << scratch_dir << "/cells_" << next << ".obj";
+        files[next] = name.str();
+        MeshJob job( instances, starts[next], starts[next+1], divisions, files[next] );
+        pool.start( next, job );
+        ++next;
+      }
+      if( pool.numRunning() == 0 ) continue;
+
+      bool success;
+      int job = pool.waitAny( success );
+      built[job] = success;
+    }
+
+    for( size_t j = 0; j < num_jobs; ++j ){
+      if( !copyFragment( files[j], out ) ){
+        std::cerr << "Warning: mesh job " << j << " failed; its cells will be meshed in place." << std::endl;
+        all_closed = writeInstances( instances, starts[j], starts[j+1], divisions, out ) == 0 && all_closed;
+      }
+      else if( !built[j] ){
+        // the worker has already warned about each of its open meshes
+        all_closed = false;
+      }
+    }
+
+    removeScratchDirectory( scratch_dir );
+  }
+  else{
+    std::cout << "Meshing " << count << " cells..." << std::endl;
+    all_closed = writeInstances( instances, 0, count, divisions, out ) == 0;
+  }
+
+  if( Gopt.make_graveyard ){
+    TriangleMesh graveyard;
+    double outer_size = world_size + world_size / 50.0;
+    addBox( graveyard, Vector3d( -outer_size, -outer_size, -outer_size ), Vector3d( outer_size, outer_size, outer_size ), false );
+    addBox( graveyard, Vector3d( -world_size, -world_size, -world_size ), Vector3d( world_size, world_size, world_size ), true );
+    graveyard.writeOBJ( out, "graveyard", "graveyard" );
+  }
+
+  out.close();
+  std::cout << "Saved file \"" << filename << "\"." << std::endl;
+  return all_closed && !out.fail();
+
+}
@@ -0,0 +1,53 @@
+#ifndef MCNP2CAD_MESHER_H
+#define MCNP2CAD_MESHER_H
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+#include "geometry.hpp"
+
+class InputDeck;
+class ImplicitRegion;
+
+/**
+ * A triangulated surface.  Triangles are wound counterclockwise as seen from outside
+ * the region they bound.
+ */
+class TriangleMesh{
+
+public:
+  std::vector<Vector3d> vertices;
+  std::vector<int> triangles; // three vertex indices per triangle
+
+  size_t numTriangles() const { return triangles.size() / 3; }
+
+  /// true if every edge is used by exactly two triangles, which traverse it in opposite directions
+  bool isClosed() const;
+
+  /// write the mesh as an OBJ object, with face indices relative to the end of its own vertex list
+  void writeOBJ( std::ostream& out, const std::string& name, const std::string& group ) const;
+
+};
+
+/**
+ * Triangulate the boundary of a region within a box, by marching tetrahedra through a
+ * grid of cubes no wider than max_cell.  The grid is refined adaptively as an octree, in
+ * which only the cubes that the boundary might cross are subdivided, so the work done
+ * grows with the area of the boundary rather than the volume of the box.  Each cube is
+ * split into six tetrahedra that meet their neighbours' face to face, and vertices are
+ * shared along grid edges, so the surface of a region inside the box is closed.
+ */
+void meshRegion( const ImplicitRegion& region, const Vector3d& box_min, const Vector3d& box_max,
+                 double max_cell, TriangleMesh& mesh );
+
+/**
+ * Build a faceted model of a deck without a CAD kernel: every instance of a material cell
+ * is meshed on its own from the analytic definitions of its surfaces, in parallel worker
+ * processes if requested, and written to an OBJ file as one object per instance, grouped
+ * by material.  Neighbouring cells are not imprinted on one another, so their facets do
+ * not match where they touch.  Returns false if any cell could not be meshed or written.
+ */
+bool writeMeshedGeometry( InputDeck& deck, const std::string& filename );
+
+#endif /* MCNP2CAD_MESHER_H */
@@ -0,0 +1,587 @@
+#include "montecarlo.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "MCNPInput.hpp"
+#include "volumes.hpp"
+#include "regions.hpp"
+#include "workers.hpp"
+#include "options.hpp"
+
+// points or rays drawn from each seeded generator; fixed, so that the results do not depend on -j
+static const int chunk_samples = 65536;
+static const int chunk_rays = 16;
+
+// points checked along each ray, per length of the diagonal of the box the rays cross
+static const int ray_steps = 4000;
+
+// points closer than this to a cell's boundary, relative to the world size, are not checked
+static const double conflict_tolerance = 1e-7;
+
+/** The splitmix64 generator: small, fast, and well mixed from any seed */
+class SampleGenerator{
+protected:
+  uint64_t state;
+public:
+  SampleGenerator( uint64_t seed ) : state( seed ) {}
+
+  uint64_t next(){
+    uint64_t z = ( state += 0x9E3779B97F4A7C15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+    return z ^ ( z >> 31 );
+  }
+
+  /// uniform on [0,1)
+  double uniform(){ return ( next() >> 11 ) * ( 1.0 / 9007199254740992.0 ); }
+};
+
+/**
+ * Work divided into fixed chunks, each drawing from its own seeded generator, whose
+ * results can be written by a worker process and added up by the parent.
+ */
+class ChunkedSampling{
+public:
+  virtual ~ChunkedSampling(){}
+  virtual int numChunks() const = 0;
+  virtual void sampleChunks( int begin, int end ) = 0;
+  virtual void write( std::ostream& out ) const = 0;
+  /// add the results written by another copy; false if they could not all be read
+  virtual bool read( std::istream& in ) = 0;
+};
+
+/** The generator of a chunk, seeded from its index */
+static SampleGenerator chunkGenerator( int chunk ){
+  return SampleGenerator( SampleGenerator( chunk ).next() );
+}
+
+/**
+ * Points sampled uniformly in a box and counted by the material cell that contains them.
+ * Points in no cell at all are missed; those under an excluded cell of universe 0 are
+ * counted apart from the cells.
+ */
+class VolumeSampler : public ChunkedSampling {
+
+public:
+  AnalyticGeometry& geometry;
+  Vector3d min, max;
+  const std::set< const CellCard* >& excluded;
+  int samples;
+
+  std::map< int, long > hits;
+  long missed, outside;
+
+  VolumeSampler( AnalyticGeometry& geometry_p, const Vector3d& min_p, const Vector3d& max_p,
+                 const std::set< const CellCard* >& excluded_p, int samples_p ) :
+    geometry( geometry_p ), min( min_p ), max( max_p ), excluded( excluded_p ), samples( samples_p ),
+    missed( 0 ), outside( 0 )
+  {}
+
+  int numChunks() const { return ( samples + chunk_samples - 1 ) / chunk_samples; }
+
+  void sampleChunks( int begin, int end ){
+    for( int c = begin; c < end; ++c ){
+      SampleGenerator generator = chunkGenerator( c );
+      int count = std::min( chunk_samples, samples - c * chunk_samples );
+      for( int i = 0; i < count; ++i ){
+        Vector3d p;
+        for( int k = 0; k < 3; ++k ){
+          p.v[k] = min.v[k] + ( max.v[k] - min.v[k] ) * generator.uniform();
+        }
+        PointLocation location;
+        if( !geometry.locate( p, location ) ){
+          missed++;
+        }
+        else if( excluded.count( location.top ) ){
+          outside++;
+        }
+        else{
+          hits[ location.cell->getIdent() ]++;
+        }
+      }
+    }
+  }
+
+  void write( std::ostream& out ) const {
+    out << missed << " " << outside << "\n";
+    for( std::map< int, long >::const_iterator i = hits.begin(); i != hits.end(); ++i ){
+      out << (*i).first << " " << (*i).second << "\n";
+    }
+  }
+
+  bool read( std::istream& in ){
+    long m, o;
+    if( !( in >> m >> o ) ) return false;
+    std::map< int, long > read_hits;
+    int ident;
+    long count;
+    while( in >> ident >> count ){
+      read_hits[ ident ] += count;
+    }
+    if( !in.eof() ) return false;
+
+    missed += m;
+    outside += o;
+    for( std::map< int, long >::iterator i = read_hits.begin(); i != read_hits.end(); ++i ){
+      hits[ (*i).first ] += (*i).second;
+    }
+    return true;
+  }
+
+};
+
+/** A run of chunks to be sampled in a worker process */
+class SamplingJob : public WorkerJob {
+protected:
+  ChunkedSampling& sampling;
+  int begin, end;
+  std::string filename;
+public:
+  SamplingJob( ChunkedSampling& sampling_p, int begin_p, int end_p, const std::string& filename_p ) :
+    sampling(sampling_p), begin(begin_p), end(end_p), filename(filename_p)
+  {}
+
+  /// write the chunks' results; the sampling is the worker's own copy, and starts empty
+  virtual bool run(){
+    sampling.sampleChunks( begin, end );
+    std::ofstream out( filename.c_str() );
+    out.precision( 17 );
+    sampling.write( out );
+    out.close();
+    return !out.fail();
+  }
+};
+
+/**
+ * Run every chunk of a sampling, sharing them among worker processes if requested.  The
+ * results of the jobs are read back in order, so they are the same for any number of
+ * workers.  name describes the work in messages and scratch files.
+ */
+static void runSampling( ChunkedSampling& sampling, const std::string& name ){
+
+  int num_chunks = sampling.numChunks();
+  if( Gopt.worker_processes <= 1 || num_chunks <= 1 ){
+    sampling.sampleChunks( 0, num_chunks );
+    return;
+  }
+
+  int num_jobs = std::min( num_chunks, Gopt.worker_processes * 4 );
+  std::cout << "Sampling in " << num_jobs << " jobs with " << Gopt.worker_processes
+            << " worker processes..." << std::endl;
+
+  std::string scratch_dir = makeScratchDirectory( "mcnp2cad-" + name );
+  std::vector<std::string> files( num_jobs );
+  std::vector<int> starts( num_jobs + 1 );
+  for( int j = 0; j <= num_jobs; ++j ){
+    starts[j] = (int)( (long)num_chunks * j / num_jobs );
+  }
+
+  WorkerPool pool( Gopt.worker_processes );
+  int next = 0;
+  while( next < num_jobs || pool.numRunning() > 0 ){
+    while( next < num_jobs && pool.hasFreeSlot() ){
+      std::stringstream file;
+      file << scratch_dir << "/" << name << "_" << next << ".txt";
+      files[next] = file.str();
+      SamplingJob job( sampling, starts[next], starts[next+1], files[next] );
+      pool.start( next, job );
+      ++next;
+    }
+    if( pool.numRunning() == 0 ) continue;
+
+    bool job_success;
+    pool.waitAny( job_success );
+  }
+
+  for( int j = 0; j < num_jobs; ++j ){
+    std::ifstream in( files[j].c_str() );
+    if( !sampling.read( in ) ){
+      std::cerr << "Warning: " << name << " job " << j << " failed; its samples will be drawn in place." << std::endl;
+      sampling.sampleChunks( starts[j], starts[j+1] );
+    }
+  }
+
+  removeScratchDirectory( scratch_dir );
+}
+
+/**
+ * The union of the boxes of the cells of universe 0 that are bounded; a cell whose box
+ * reaches the edge of the world is unbounded, and is added to excluded instead.  Returns
+ * false if no cell is bounded.
+ */
+static bool findSamplingBox( InputDeck& deck, AnalyticGeometry& geometry, Vector3d& box_min, Vector3d& box_max,
+                             std::set< const CellCard* >& excluded ){
+  double world_size = geometry.getWorldSize();
+  double reach = 0.99 * world_size;
+  bool found = false;
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( 0 );
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i != cells.end(); ++i ){
+    const CellCard& cell = *(*i);
+    if( cell.isLattice() ) continue;
+
+    std::vector<PlacedRegion> bounds;
+    try{
+      bounds.push_back( PlacedRegion( &geometry.getRegion( cell ), std::vector<Transform>() ) );
+    }
+    catch( std::runtime_error& e ){
+      continue; // reported when the cells are first located
+    }
+
+    Vector3d cell_min, cell_max;
+    if( !CellInstance( &cell, "", bounds, world_size ).getBounds( cell_min, cell_max ) ) continue;
+
+    bool bounded = true;
+    for( int k = 0; k < 3; ++k ){
+      bounded = bounded && cell_min.v[k] > -reach && cell_max.v[k] < reach;
+    }
+    if( !bounded ){
+      excluded.insert( &cell );
+      continue;
+    }
+    for( int k = 0; k < 3; ++k ){
+      box_min.v[k] = found ? std::min( box_min.v[k], cell_min.v[k] ) : cell_min.v[k];
+      box_max.v[k] = found ? std::max( box_max.v[k], cell_max.v[k] ) : cell_max.v[k];
+    }
+    found = true;
+  }
+  return found;
+}
+
+bool writeCellVolumes( InputDeck& deck, int samples, const std::string& filename ){
+
+  if( samples <= 0 ){
+    std::cerr << "Error: the number of volume samples must be positive" << std::endl;
+    return false;
+  }
+
+  double world_size = estimateWorldSize( deck );
+  AnalyticGeometry geometry( deck, world_size );
+
+  // the samples span the bounded cells of universe 0
+  std::set< const CellCard* > excluded;
+  Vector3d box_min, box_max;
+  if( !findSamplingBox( deck, geometry, box_min, box_max, excluded ) ){
+    std::cerr << "Error: no bounded cells in universe 0 to estimate volumes of" << std::endl;
+    return false;
+  }
+  for( std::set< const CellCard* >::iterator i = excluded.begin(); i != excluded.end(); ++i ){
+    std::cerr << "Warning: cell " << (*i)->getIdent() << " of universe 0 is unbounded; "
+              << "it and any cells within it are left out of the volume estimates" << std::endl;
+  }
+
+  // find every universe's cells before any workers are forked, so that each need not
+  geometry.indexUniverses();
+
+  VolumeSampler sampler( geometry, box_min, box_max, excluded, samples );
+  std::cout << "Sampling " << samples << " points from " << box_min << " to " << box_max << std::endl;
+
+  runSampling( sampler, "volumes" );
+
+  double box_volume = 1.0;
+  for( int k = 0; k < 3; ++k ){
+    box_volume *= box_max.v[k] - box_min.v[k];
+  }
+  if( OPT_VERBOSE ){
+    std::cout << sampler.missed << " samples were in no cell, and " << sampler.outside
+              << " in unbounded cells" << std::endl;
+  }
+
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  out << "cell,material,volume,error,hits\n";
+  for( std::map< int, long >::iterator i = sampler.hits.begin(); i != sampler.hits.end(); ++i ){
+    double fraction = (double)(*i).second / samples;
+    double error = box_volume * std::sqrt( fraction * ( 1.0 - fraction ) / samples );
+    out << (*i).first << "," << deck.lookup_cell_card( (*i).first )->getMat() << ","
+        << box_volume * fraction << "," << error << "," << (*i).second << "\n";
+  }
+  out.close();
+
+  bool success = !out.fail();
+  if( success ){
+    std::cout << "Saved file \"" << filename << "\"." << std::endl;
+  }
+  return success;
+
+}
+
+/** A run of points along a ray where the same universe has the same conflict */
+struct ConflictSegment{
+  int ray;
+  int universe;
+  int lattice;            // the lattice cell, for points in none of its nodes; else 0
+  std::vector<int> cells; // the cells claiming the points
+  std::string origin;
+  Vector3d start, end;
+
+  bool sameConflict( const ConflictSegment& s ) const {
+    return universe == s.universe && lattice == s.lattice && cells == s.cells && origin == s.origin;
+  }
+};
+
+/**
+ * Rays cast through a box in random directions from random points, each checked with
+ * AnalyticGeometry::checkPoint() at evenly spaced points between the sides of the box.
+ * Neighboring points with the same conflict are joined into segments.
+ */
+class RayChecker : public ChunkedSampling {
+
+public:
+  AnalyticGeometry& geometry;
+  Vector3d min, max;
+  int rays;
+  double tolerance;
+
+  std::vector<ConflictSegment> segments;
+  long points;
+
+  RayChecker( AnalyticGeometry& geometry_p, const Vector3d& min_p, const Vector3d& max_p, int rays_p ) :
+    geometry( geometry_p ), min( min_p ), max( max_p ), rays( rays_p ),
+    tolerance( conflict_tolerance * geometry_p.getWorldSize() ), points( 0 )
+  {}
+
+  int numChunks() const { return ( rays + chunk_rays - 1 ) / chunk_rays; }
+
+  void castRay( int ray, SampleGenerator& generator ){
+    Vector3d origin, direction;
+    for( int k = 0; k < 3; ++k ){
+      origin.v[k] = min.v[k] + ( max.v[k] - min.v[k] ) * generator.uniform();
+    }
+    double z = 2.0 * generator.uniform() - 1.0, phi = 2.0 * M_PI * generator.uniform();
+    double r = std::sqrt( std::max( 0.0, 1.0 - z * z ) );
+    direction = Vector3d( r * std::cos( phi ), r * std::sin( phi ), z );
+
+    // the ray runs from side to side of the box, through its origin
+    double t_begin = -HUGE_VAL, t_end = HUGE_VAL;
+    for( int k = 0; k < 3; ++k ){
+      if( direction.v[k] == 0 ) continue;
+      double t0 = ( min.v[k] - origin.v[k] ) / direction.v[k], t1 = ( max.v[k] - origin.v[k] ) / direction.v[k];
+      t_begin = std::max( t_begin, std::min( t0, t1 ) );
+      t_end = std::min( t_end, std::max( t0, t1 ) );
+    }
+    double step = ( max + -min ).length() / ray_steps;
+    int count = (int)( ( t_end - t_begin ) / step ) + 1;
+
+    bool open = false;
+    ConflictSegment current;
+    for( int i = 0; i < count; ++i ){
+      Vector3d p = origin + direction * ( t_begin + i * step );
+      points++;
+      PointConflict conflict;
+      if( geometry.checkPoint( p, tolerance, conflict ) ){
+        if( open ) segments.push_back( current );
+        open = false;
+        continue;
+      }
+
+      ConflictSegment found;
+      found.ray = ray;
+      found.universe = conflict.universe;
+      found.lattice = conflict.lattice ? conflict.lattice->getIdent() : 0;
+      for( size_t c = 0; c < conflict.cells.size(); ++c ){
+        found.cells.push_back( conflict.cells[c]->getIdent() );
+      }
+      found.origin = conflict.origin;
+      if( open && current.sameConflict( found ) ){
+        current.end = p;
+        continue;
+      }
+      if( open ) segments.push_back( current );
+      current = found;
+      current.start = current.end = p;
+      open = true;
+    }
+    if( open ) segments.push_back( current );
+  }
+
+  void sampleChunks( int begin, int end ){
+    for( int c = begin; c < end; ++c ){
+      SampleGenerator generator = chunkGenerator( c );
+      int count = std::min( chunk_rays, rays - c * chunk_rays );
+      for( int i = 0; i < count; ++i ){
+        castRay( c * chunk_rays + i, generator );
+      }
+    }
+  }
+
+  void write( std::ostream& out ) const {
+    out << points << " " << segments.size() << "\n";
+    for( size_t i = 0; i < segments.size(); ++i ){
+      const ConflictSegment& s = segments[i];
+      out << s.ray << " " << s.universe << " " << s.lattice << " " << s.cells.size();
+      for( size_t c = 0; c < s.cells.size(); ++c ){
+        out << " " << s.cells[c];
+      }
+      out << " " << ( s.origin.length() ? s.origin : "-" );
+      for( int k = 0; k < 3; ++k ) out << " " << s.start.v[k];
+      for( int k = 0; k < 3; ++k ) out << " " << s.end.v[k];
+      out << "\n";
+    }
+  }
+
+  bool read( std::istream& in ){
+    long read_points;
+    size_t num_segments;
+    if( !( in >> read_points >> num_segments ) ) return false;
+    std::vector<ConflictSegment> read_segments( num_segments );
+    for( size_t i = 0; i < num_segments; ++i ){
+      ConflictSegment& s = read_segments[i];
+      size_t num_cells;
+      if( !( in >> s.ray >> s.universe >> s.lattice >> num_cells ) ) return false;
+      s.cells.resize( num_cells );
+      for( size_t c = 0; c < num_cells; ++c ){
+        in >> s.cells[c];
+      }
+      in >> s.origin;
+      if( s.origin == "-" ) s.origin = "";
+      for( int k = 0; k < 3; ++k ) in >> s.start.v[k];
+      for( int k = 0; k < 3; ++k ) in >> s.end.v[k];
+      if( !in ) return false;
+    }
+    points += read_points;
+    segments.insert( segments.end(), read_segments.begin(), read_segments.end() );
+    return true;
+  }
+
+};
+
+/** A description of a conflict, such as "cells 3 and 4 of universe 2 overlap" */
+static std::string describeConflict( const ConflictSegment& s ){
+  std::stringstream str;
+  if( s.lattice ){
+    str << "a region is in no node of lattice cell " << s.lattice;
+  }
+  else if( s.cells.empty() ){
+    str << "a region of universe " << s.universe << " is in no cell";
+  }
+  else{
+    str << "cells ";
+    for( size_t c = 0; c < s.cells.size(); ++c ){
+      if( c ) str << ( c + 1 < s.cells.size() ? ", " : " and " );
+      str << s.cells[c];
+    }
+    str << " of universe " << s.universe << " overlap";
+  }
+  return str.str();
+}
+
+bool writeGeometryConflicts( InputDeck& deck, int rays, const std::string& filename ){
+
+  if( rays <= 0 ){
+    std::cerr << "Error: the number of rays must be positive" << std::endl;
+    return false;
+  }
+
+  double world_size = estimateWorldSize( deck );
+  AnalyticGeometry geometry( deck, world_size );
+
+  // the rays cross the bounded cells of universe 0 and some of what surrounds them
+  std::set< const CellCard* > unbounded;
+  Vector3d box_min, box_max;
+  if( !findSamplingBox( deck, geometry, box_min, box_max, unbounded ) ){
+    std::cerr << "Error: no bounded cells in universe 0 to cast rays through" << std::endl;
+    return false;
+  }
+  Vector3d margin = ( box_max + -box_min ) * 0.05;
+  box_min = box_min + -margin;
+  box_max = box_max + margin;
+
+  geometry.indexUniverses();
+
+  RayChecker checker( geometry, box_min, box_max, rays );
+  std::cout << "Casting " << rays << " rays from " << box_min << " to " << box_max << std::endl;
+  runSampling( checker, "rays" );
+
+  // the same conflict is usually crossed by many rays; each is described once, with its
+  // longest segment as an example
+  std::map< std::string, size_t > longest;
+  std::map< std::string, int > counts;
+  std::vector< std::string > order;
+  for( size_t i = 0; i < checker.segments.size(); ++i ){
+    const ConflictSegment& s = checker.segments[i];
+    std::string description = describeConflict( s );
+    if( !counts.count( description ) ){
+      order.push_back( description );
+      longest[ description ] = i;
+    }
+    counts[ description ]++;
+    const ConflictSegment& l = checker.segments[ longest[ description ] ];
+    if( ( s.end + -s.start ).length() > ( l.end + -l.start ).length() ){
+      longest[ description ] = i;
+    }
+  }
+
+  std::cout << "Checked " << checker.points << " points: found " << checker.segments.size()
+            << " segments claimed by no cell or by several" << std::endl;
+  for( size_t i = 0; i < order.size(); ++i ){
+    const ConflictSegment& l = checker.segments[ longest[ order[i] ] ];
+    std::cout << "Warning: " << order[i] << " (" << counts[ order[i] ] << " segments), e.g. from "
+              << l.start << " to " << l.end;
+    if( l.origin.length() ) std::cout << " by way of " << l.origin;
+    std::cout << std::endl;
+  }
+
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  out << "ray,kind,universe,cells,x0,y0,z0,x1,y1,z1,path\n";
+  for( size_t i = 0; i < checker.segments.size(); ++i ){
+    const ConflictSegment& s = checker.segments[i];
+    out << s.ray << "," << ( s.cells.size() ? "overlap" : "gap" ) << "," << s.universe << ",";
+    if( s.lattice ) out << s.lattice;
+    for( size_t c = 0; c < s.cells.size(); ++c ){
+      out << ( c ? " " : "" ) << s.cells[c];
+    }
+    out << "," << s.start.v[0] << "," << s.start.v[1] << "," << s.start.v[2]
+        << "," << s.end.v[0] << "," << s.end.v[1] << "," << s.end.v[2] << "," << s.origin << "\n";
+  }
+  out.close();
+  if( out.fail() ){
+    return false;
+  }
+  std::cout << "Saved file \"" << filename << "\"." << std::endl;
+  return checker.segments.empty();
+
+}
+
+bool printPointLocation( InputDeck& deck, const std::string& point ){
+
+  std::string coords( point );
+  std::replace( coords.begin(), coords.end(), ',', ' ' );
+  std::stringstream str( coords );
+  Vector3d p;
+  if( !( str >> p.v[0] >> p.v[1] >> p.v[2] ) ){
+    std::cerr << "Error: a point to locate must be given as X,Y,Z" << std::endl;
+    return false;
+  }
+
+  AnalyticGeometry geometry( deck, estimateWorldSize( deck ) );
+  PointLocation location;
+  if( geometry.locate( p, location, true ) ){
+    std::cout << "Point " << p << " is in cell " << location.cell->getIdent()
+              << " (material " << location.cell->getMat() << ")";
+    if( location.top != location.cell ){
+      std::cout << " by way of " << location.origin;
+    }
+    std::cout << std::endl;
+  }
+  else{
+    std::cout << "Point " << p << " is in no cell" << std::endl;
+  }
+  return true;
+
+}
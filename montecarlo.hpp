@@ -0,0 +1,51 @@
+#ifndef MCNP2CAD_MONTECARLO_H
+#define MCNP2CAD_MONTECARLO_H
+
+#include <string>
+
+class InputDeck;
+
+/**
+ * Estimate the volume of every material cell of a deck by sampling random points, without
+ * a CAD kernel, for checking the volumes of a converted model.  The points are spread
+ * uniformly over the box bounding the cells of universe 0, and each is located with
+ * AnalyticGeometry::locate().  Cells of universe 0 that reach the edge of the world, such
+ * as the outside of the model, are left out of the box, along with everything in them.
+ *
+ * The points are drawn in fixed chunks, each from a generator seeded by its index, so the
+ * estimates depend only on the number of samples and not on how many worker processes
+ * share the chunks.  The CSV file written has one line per cell:
+ *
+ *   cell,material,volume,error,hits
+ *
+ * where volume is the total over every instance of the cell and error is one standard
+ * deviation of the estimate.  Returns false if the volumes could not be estimated or
+ * written.
+ */
+bool writeCellVolumes( InputDeck& deck, int samples, const std::string& filename );
+
+/**
+ * Look for overlapping cells and undefined regions before converting a deck, by casting
+ * random rays through the box bounding the cells of universe 0 and checking points along
+ * each with AnalyticGeometry::checkPoint(): a point must be claimed by exactly one cell of
+ * every universe it passes through, from universe 0 down through fills and lattices.
+ * Runs of points along a ray with the same problem are reported as segments, each
+ * distinct problem is printed once, and every segment is written to a CSV file:
+ *
+ *   ray,kind,universe,cells,x0,y0,z0,x1,y1,z1,path
+ *
+ * where kind is gap or overlap, cells are the overlapping cells (or, for a gap in a
+ * lattice, the lattice cell) separated by spaces, and path leads to the universe.  Rays
+ * are seeded as the samples of writeCellVolumes() are, so the same segments are found
+ * with any number of worker processes.  Returns false if any segments were found or the
+ * check could not be made.
+ */
+bool writeGeometryConflicts( InputDeck& deck, int rays, const std::string& filename );
+
+/**
+ * Print the cell containing a point, given as "x,y,z", and the chain of fills and lattice
+ * nodes that lead to it.  Returns false if the point could not be read.
+ */
+bool printPointLocation( InputDeck& deck, const std::string& point );
+
+#endif /* MCNP2CAD_MONTECARLO_H */
@@ -2,6 +2,7 @@
 #define MCNP2CAD_OPTIONS_H
 
 #include <string>
+#include <vector>
 
 struct program_option_struct{
   bool verbose;
@@ -18,11 +19,34 @@ struct program_option_struct{
   
   std::string output_file;
   std::string input_file;
+  std::string retag_file;
   
   std::string igeom_init_options;
 
   bool override_tolerance;
   double specific_tolerance;
+  int imprint_batch_size;
+  int imprint_shards;
+
+  int worker_processes;
+  int shards;
+  std::string checkpoint_dir;
+  double checkpoint_interval;
+  std::string cache_dir;
+  double cell_timeout;
+
+  bool native_mesh;
+  double mesh_size;
+  std::vector<int> voxel_dims;
+  int volume_samples;
+  int check_rays;
+  std::string locate_point;
+
+  std::string profile_file;
+  std::string trace_file;
+  std::string cost_file;
+  bool census;
+  std::string census_file;
 };
 
 extern struct program_option_struct Gopt;
@@ -31,5 +55,9 @@ extern struct program_option_struct Gopt;
 #define OPT_DEBUG   (Gopt.debug)
 
 #define OPT_DEFAULT_OUTPUT_FILENAME "out.sat"
+#define OPT_DEFAULT_MESH_FILENAME "out.obj"
+#define OPT_DEFAULT_VOXEL_FILENAME "out.vox"
+#define OPT_DEFAULT_VOLUME_FILENAME "volumes.csv"
+#define OPT_DEFAULT_CONFLICT_FILENAME "conflicts.csv"
 
 #endif /* MCNP2CAD_OPTIONS_H */
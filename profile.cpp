@@ -0,0 +1,399 @@
+#include "profile.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+struct OpStats{
+  long count;
+  double total, max;
+  int slowest_scope; // scope of the longest call
+
+  OpStats() : count(0), total(0), max(0), slowest_scope(0) {}
+};
+
+/** The totals of every occurrence of one scope */
+struct ScopeStats{
+  std::string kind, label;
+  long entries;
+  double time, self_time;        // wall time, including and excluding nested scopes
+  long ops, self_ops;            // kernel operations
+  double kernel_time;            // time in kernel operations, including nested scopes
+  long bodies;
+
+  ScopeStats( const std::string& kind_p, const std::string& label_p ) :
+    kind(kind_p), label(label_p), entries(0), time(0), self_time(0), ops(0), self_ops(0),
+    kernel_time(0), bodies(0)
+  {}
+
+  std::string name() const { return label.empty() ? kind : kind + " " + label; }
+};
+
+/** An open scope */
+struct Frame{
+  int scope;
+  int detail;
+  double start;
+  double nested_time, kernel_time;
+  long ops, nested_ops;
+};
+
+/** One kernel operation, or one scope if op is NULL */
+struct TraceEvent{
+  const char* op;
+  int scope;
+  int detail; // index into Profile::details, or -1
+  double start, duration;
+};
+
+struct Profile{
+  bool enabled, trace;
+  std::string summary_file, trace_file, cost_file;
+  pid_t pid;
+  double start;
+
+  std::map< std::string, OpStats > ops;
+  std::vector< ScopeStats > scopes;        // scope 0 is the top level
+  std::map< std::string, int > scope_index;
+  std::vector< Frame > stack;              // open scopes, innermost last
+  std::vector< TraceEvent > events;
+  std::vector< std::string > details;
+
+  Profile() : enabled(false), trace(false), pid(0), start(0) {
+    scopes.push_back( ScopeStats( "top level", "" ) );
+  }
+
+  int currentScope() const { return stack.empty() ? 0 : stack.back().scope; }
+
+  int intern( const std::string& kind, const std::string& label ){
+    std::string key = kind + " " + label;
+    std::map< std::string, int >::iterator i = scope_index.find( key );
+    if( i != scope_index.end() ) return (*i).second;
+    int index = scopes.size();
+    scopes.push_back( ScopeStats( kind, label ) );
+    scope_index[key] = index;
+    return index;
+  }
+
+  void addEvent( const char* op, int scope, int detail, double begin, double duration ){
+    TraceEvent e;
+    e.op = op;
+    e.scope = scope;
+    e.detail = detail;
+    e.start = begin - start;
+    e.duration = duration;
+    events.push_back( e );
+  }
+};
+
+Profile profile;
+
+std::string jsonString( const std::string& s ){
+  std::string ret = "\"";
+  for( size_t i = 0; i < s.length(); ++i ){
+    if( s[i] == '"' || s[i] == '\\' ) ret += '\\';
+    ret += s[i];
+  }
+  return ret + "\"";
+}
+
+bool byTotal( const std::pair<std::string,OpStats>& a, const std::pair<std::string,OpStats>& b ){
+  return a.second.total > b.second.total;
+}
+
+bool byTime( const ScopeStats* a, const ScopeStats* b ){
+  return a->time > b->time;
+}
+
+/** The scopes of one kind, or of every kind but one, most expensive first */
+std::vector< const ScopeStats* > sortedScopes( const std::string& kind, bool exclude ){
+  std::vector< const ScopeStats* > ret;
+  for( size_t i = 1; i < profile.scopes.size(); ++i ){
+    const ScopeStats& s = profile.scopes[i];
+    if( ( s.kind == kind ) != exclude && s.entries > 0 ) ret.push_back( &s );
+  }
+  std::stable_sort( ret.begin(), ret.end(), byTime );
+  return ret;
+}
+
+/** A file name for this process: worker processes append their process ID */
+std::string processFileName( const std::string& name ){
+  if( getpid() == profile.pid ) return name;
+  std::stringstream str;
+  str << name << "." << getpid();
+  return str.str();
+}
+
+bool writeSummary( const std::string& filename ){
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open profile file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+
+  std::vector< std::pair<std::string,OpStats> > ops( profile.ops.begin(), profile.ops.end() );
+  std::stable_sort( ops.begin(), ops.end(), byTotal );
+  double kernel_time = 0;
+  for( size_t i = 0; i < ops.size(); ++i ){
+    kernel_time += ops[i].second.total;
+  }
+
+  out << "{\n";
+  out << "  \"wall_seconds\": " << wallTime() - profile.start << ",\n";
+  out << "  \"kernel_seconds\": " << kernel_time << ",\n";
+  out << "  \"phases\": [";
+  std::vector< const ScopeStats* > phases = sortedScopes( "phase", false );
+  for( size_t i = 0; i < phases.size(); ++i ){
+    out << ( i ? "," : "" ) << "\n    { \"phase\": " << jsonString( phases[i]->label )
+        << ", \"seconds\": " << phases[i]->time << ", \"ops\": " << phases[i]->ops << " }";
+  }
+  out << "\n  ],\n";
+  out << "  \"operations\": [";
+  for( size_t i = 0; i < ops.size(); ++i ){
+    const OpStats& s = ops[i].second;
+    out << ( i ? "," : "" ) << "\n    { \"op\": " << jsonString( ops[i].first )
+        << ", \"count\": " << s.count
+        << ", \"total_seconds\": " << s.total
+        << ", \"max_seconds\": " << s.max
+        << ", \"slowest_in\": " << jsonString( profile.scopes[ s.slowest_scope ].name() ) << " }";
+  }
+  out << "\n  ]\n}\n";
+  out.close();
+  return !out.fail();
+}
+
+bool writeTrace( const std::string& filename ){
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open trace file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+
+  // times in the trace event format are in microseconds
+  out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for( size_t i = 0; i < profile.events.size(); ++i ){
+    const TraceEvent& e = profile.events[i];
+    std::string scope = profile.scopes[ e.scope ].name();
+    if( e.detail >= 0 ) scope += " " + profile.details[ e.detail ];
+    out << ( i ? "," : "" ) << "\n  { \"name\": " << jsonString( e.op ? e.op : scope )
+        << ", \"cat\": \"" << ( e.op ? "iGeom" : profile.scopes[ e.scope ].kind ) << "\", \"ph\": \"X\""
+        << ", \"ts\": " << (long long)( e.start * 1e6 )
+        << ", \"dur\": " << (long long)( e.duration * 1e6 )
+        << ", \"pid\": " << getpid() << ", \"tid\": 0";
+    if( e.op ){
+      out << ", \"args\": { \"scope\": " << jsonString( scope ) << " }";
+    }
+    out << " }";
+  }
+  out << "\n] }\n";
+  out.close();
+  return !out.fail();
+}
+
+bool writeCosts( const std::string& filename ){
+  std::ofstream out( filename.c_str() );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open cost report file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+
+  out << "kind,id,entries,seconds,self_seconds,kernel_seconds,ops,self_ops,bodies\n";
+  std::vector< const ScopeStats* > phases = sortedScopes( "phase", false );
+  std::vector< const ScopeStats* > scopes = sortedScopes( "phase", true );
+  scopes.insert( scopes.begin(), phases.begin(), phases.end() );
+  for( size_t i = 0; i < scopes.size(); ++i ){
+    const ScopeStats& s = *scopes[i];
+    out << s.kind << "," << s.label << "," << s.entries << "," << s.time << "," << s.self_time << ","
+        << s.kernel_time << "," << s.ops << "," << s.self_ops << "," << s.bodies << "\n";
+  }
+  out.close();
+  return !out.fail();
+}
+
+} // namespace
+
+double wallTime(){
+  struct timeval tv;
+  gettimeofday( &tv, NULL );
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+void startProfiling( const std::string& summary_file, const std::string& trace_file,
+                     const std::string& cost_file ){
+  profile.enabled = true;
+  profile.trace = !trace_file.empty();
+  profile.summary_file = summary_file;
+  profile.trace_file = trace_file;
+  profile.cost_file = cost_file;
+  profile.pid = getpid();
+  profile.start = wallTime();
+  profile.ops.clear();
+  profile.events.clear();
+  profile.details.clear();
+  profile.scopes.erase( profile.scopes.begin() + 1, profile.scopes.end() );
+  profile.scopes[0] = ScopeStats( "top level", "" );
+  profile.scope_index.clear();
+}
+
+bool profilingEnabled(){
+  return profile.enabled;
+}
+
+void startWorkerProfile(){
+  if( !profile.enabled ) return;
+  profile.ops.clear();
+  profile.events.clear();
+  profile.details.clear();
+  for( size_t i = 0; i < profile.scopes.size(); ++i ){
+    profile.scopes[i] = ScopeStats( profile.scopes[i].kind, profile.scopes[i].label );
+  }
+  // the scopes the worker was started in are still open, but their costs so far are the parent's
+  double now = wallTime();
+  for( size_t i = 0; i < profile.stack.size(); ++i ){
+    Frame& f = profile.stack[i];
+    f.start = now;
+    f.nested_time = f.kernel_time = 0;
+    f.ops = f.nested_ops = 0;
+  }
+}
+
+bool writeProfile(){
+  if( !profile.enabled ) return true;
+  bool success = true;
+  if( !profile.summary_file.empty() ){
+    success = writeSummary( processFileName( profile.summary_file ) ) && success;
+  }
+  if( profile.trace ){
+    success = writeTrace( processFileName( profile.trace_file ) ) && success;
+  }
+  if( !profile.cost_file.empty() ){
+    success = writeCosts( processFileName( profile.cost_file ) ) && success;
+  }
+  return success;
+}
+
+void printCostReport( std::ostream& out, size_t top ){
+  if( !profile.enabled ) return;
+
+  std::vector< const ScopeStats* > phases = sortedScopes( "phase", false );
+  if( phases.size() ){
+    out << "Time by phase:" << std::endl;
+    for( size_t i = 0; i < phases.size(); ++i ){
+      out << "  " << std::setw(14) << std::left << phases[i]->label << std::right
+          << std::setw(12) << std::fixed << std::setprecision(3) << phases[i]->time << " s"
+          << std::setw(12) << phases[i]->ops << " ops" << std::endl;
+    }
+  }
+
+  std::vector< const ScopeStats* > scopes = sortedScopes( "phase", true );
+  if( scopes.size() ){
+    out << "Most expensive parts of the model, including what they contain:" << std::endl;
+    out << "  " << std::setw(20) << std::left << "scope" << std::right << std::setw(9) << "entries"
+        << std::setw(12) << "seconds" << std::setw(12) << "self" << std::setw(10) << "ops"
+        << std::setw(10) << "bodies" << std::endl;
+    for( size_t i = 0; i < scopes.size() && i < top; ++i ){
+      const ScopeStats& s = *scopes[i];
+      out << "  " << std::setw(20) << std::left << s.name() << std::right << std::setw(9) << s.entries
+          << std::setw(12) << std::fixed << std::setprecision(3) << s.time
+          << std::setw(12) << s.self_time << std::setw(10) << s.ops << std::setw(10) << s.bodies << std::endl;
+    }
+  }
+  out.unsetf( std::ios::floatfield );
+  out << std::setprecision(6);
+}
+
+KernelOpTimer::KernelOpTimer( const char* op_p ) :
+  op( op_p ), start( profile.enabled ? wallTime() : 0 )
+{}
+
+KernelOpTimer::~KernelOpTimer(){
+  if( !profile.enabled ) return;
+  double elapsed = wallTime() - start;
+  int scope = profile.currentScope();
+
+  OpStats& s = profile.ops[op];
+  s.count++;
+  s.total += elapsed;
+  if( s.count == 1 || elapsed > s.max ){
+    s.max = elapsed;
+    s.slowest_scope = scope;
+  }
+  if( profile.stack.size() ){
+    Frame& f = profile.stack.back();
+    f.ops++;
+    f.kernel_time += elapsed;
+  }
+  if( profile.trace ){
+    int detail = profile.stack.size() ? profile.stack.back().detail : -1;
+    profile.addEvent( op, scope, detail, start, elapsed );
+  }
+}
+
+void ProfileScope::open( const std::string& kind, const std::string& label, const std::string& detail ){
+  Frame f;
+  f.scope = profile.intern( kind, label );
+  f.detail = -1;
+  if( profile.trace && !detail.empty() ){
+    f.detail = profile.details.size();
+    profile.details.push_back( detail );
+  }
+  f.start = wallTime();
+  f.nested_time = f.kernel_time = 0;
+  f.ops = f.nested_ops = 0;
+  profile.stack.push_back( f );
+}
+
+ProfileScope::ProfileScope( const char* kind, int ident, const std::string& detail ) :
+  active( profile.enabled )
+{
+  if( !active ) return;
+  std::stringstream label;
+  label << ident;
+  open( kind, label.str(), detail );
+}
+
+ProfileScope::ProfileScope( const char* kind, const char* label ) :
+  active( profile.enabled )
+{
+  if( !active ) return;
+  open( kind, label, "" );
+}
+
+ProfileScope::~ProfileScope(){
+  if( !active ) return;
+  Frame f = profile.stack.back();
+  profile.stack.pop_back();
+
+  double elapsed = wallTime() - f.start;
+  ScopeStats& s = profile.scopes[ f.scope ];
+  s.entries++;
+  s.time += elapsed;
+  s.self_time += elapsed - f.nested_time;
+  s.ops += f.ops + f.nested_ops;
+  s.self_ops += f.ops;
+  s.kernel_time += f.kernel_time;
+
+  if( profile.stack.size() ){
+    Frame& parent = profile.stack.back();
+    parent.nested_time += elapsed;
+    parent.nested_ops += f.ops + f.nested_ops;
+    parent.kernel_time += f.kernel_time;
+  }
+  if( profile.trace ){
+    profile.addEvent( NULL, f.scope, f.detail, f.start, elapsed );
+  }
+}
+
+void ProfileScope::addBodies( size_t count ){
+  if( !active ) return;
+  profile.scopes[ profile.stack.back().scope ].bodies += count;
+}
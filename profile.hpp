@@ -0,0 +1,77 @@
+#ifndef MCNP2CAD_PROFILE_H
+#define MCNP2CAD_PROFILE_H
+
+#include <string>
+#include <iosfwd>
+
+/**
+ * Optional profiling of the work that mcnp2cad does.  When profiling is on, every iGeom
+ * call made through PROFILE_IGEOM() is timed and attributed to the part of the model
+ * being built at the time, as named by the innermost ProfileScope.  Scopes also collect
+ * their own wall time, the kernel operations made in them and the bodies they produce,
+ * both on their own and including the scopes nested in them, such as the universes
+ * that fill a cell.  Scopes of the kind "phase" time the steps of a whole conversion.
+ *
+ * The totals are written as a JSON summary and a CSV cost report.  Each call and scope
+ * may also be written as an event in the Chrome trace event format, which
+ * chrome://tracing and similar viewers show as a flame graph.
+ *
+ * Worker processes keep their own profiles, written to the same file names with the
+ * worker's process ID appended.
+ */
+
+/// wall clock time in seconds
+double wallTime();
+
+/**
+ * Turn profiling on, to be written to the given files when writeProfile() is called;
+ * any of the names may be empty to skip that file.  A trace of every call and scope is
+ * kept only if trace_file is not empty.  Anything recorded by an earlier call is
+ * forgotten, so each deck of a batch is profiled on its own.
+ */
+void startProfiling( const std::string& summary_file, const std::string& trace_file,
+                     const std::string& cost_file );
+
+bool profilingEnabled();
+
+/// in a newly forked worker process, forget what the parent process recorded
+void startWorkerProfile();
+
+/// write the summary, trace and cost report; returns false if a file could not be written
+bool writeProfile();
+
+/// print the time of each phase, and the top scopes by their time including nested scopes
+void printCostReport( std::ostream& out, size_t top );
+
+/** Times one kernel operation, from construction to destruction */
+class KernelOpTimer{
+  const char* op;
+  double start;
+public:
+  KernelOpTimer( const char* op_p );
+  ~KernelOpTimer();
+};
+
+/**
+ * Names the part of the model being built, such as a cell or universe, or the phase of
+ * the conversion, for as long as it exists.  Scopes nest, and kernel operations are
+ * attributed to the innermost one.  Scopes with the same kind and label are counted
+ * together; a detail, if given, names this one occurrence in the trace.
+ */
+class ProfileScope{
+  bool active;
+  void open( const std::string& kind, const std::string& label, const std::string& detail );
+public:
+  ProfileScope( const char* kind, int ident, const std::string& detail = "" );
+  ProfileScope( const char* kind, const char* label );
+  ~ProfileScope();
+
+  /// count bodies produced in this scope
+  void addBodies( size_t count );
+};
+
+/** Make an iGeom call, timing it as the named operation if profiling is on */
+#define PROFILE_IGEOM( op, call ) \
+  do{ KernelOpTimer profile_op_timer( op ); call; } while(0)
+
+#endif /* MCNP2CAD_PROFILE_H */
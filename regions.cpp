@@ -0,0 +1,660 @@
+#include "regions.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#include "MCNPInput.hpp"
+#include "volumes.hpp"
+#include "options.hpp"
+
+// octree depths used to bound a lattice's container and its origin element
+static const int container_bound_depth = 5;
+static const int element_bound_depth = 6;
+
+// octree depth of each pass that narrows down a cell instance's bounding box
+static const int instance_bound_depth = 6;
+
+// universes nested deeper than this are taken to contain themselves, and are not searched
+static const int max_locate_depth = 1000;
+
+void CellRegion::compile( const CellCard& cell, InputDeck& deck, AnalyticGeometry& geometry ){
+
+  const CellCard::geom_list_t geom = cell.getGeom();
+
+  program.clear();
+  size_t depth = 0, max_depth = 0;
+  for( CellCard::geom_list_t::const_iterator i = geom.begin(); i != geom.end(); ++i ){
+
+    const CellCard::geom_list_entry_t& token = (*i);
+    Op op;
+    op.surface = NULL;
+    op.positive = false;
+    op.cell = NULL;
+
+    switch( token.first ){
+    case CellCard::CELLNUM:
+      op.op = CELL;
+      op.cell = &geometry.getRegion( *(deck.lookup_cell_card( token.second )) );
+      depth++;
+      break;
+    case CellCard::SURFNUM:
+      op.op = SURFACE;
+      op.positive = token.second > 0;
+      op.surface = &makeSurface( deck.lookup_surface_card( std::abs( token.second ) ) );
+      depth++;
+      break;
+    case CellCard::MBODYFACET:
+      throw std::runtime_error( "Macrobody facets are not yet supported by mcnp2cad." );
+    case CellCard::INTERSECT:
+    case CellCard::UNION:
+      if( depth < 2 ) throw std::runtime_error( "Malformed cell geometry" );
+      op.op = ( token.first == CellCard::INTERSECT ) ? INTERSECT : UNION;
+      depth--;
+      break;
+    case CellCard::COMPLEMENT:
+      if( depth < 1 ) throw std::runtime_error( "Malformed cell geometry" );
+      op.op = COMPLEMENT;
+      break;
+    default:
+      throw std::runtime_error( "Unexpected token while evaluating cell geometry" );
+    }
+
+    program.push_back( op );
+    max_depth = std::max( max_depth, depth );
+  }
+
+  if( depth != 1 ) throw std::runtime_error( "Malformed cell geometry" );
+
+  stack.resize( max_depth );
+  trcl = cell.getTrcl().hasData() ? &(cell.getTrcl().getData()) : NULL;
+
+}
+
+double CellRegion::evaluate( const Vector3d& p_world ) const {
+
+  Vector3d p = trcl ? trcl->applyInverse( p_world ) : p_world;
+
+  size_t n = 0;
+  for( size_t i = 0; i < program.size(); ++i ){
+    const Op& op = program[i];
+    switch( op.op ){
+    case SURFACE:
+      {
+        double f = op.surface->evaluate( p );
+        stack[n++] = op.positive ? -f : f;
+      }
+      break;
+    case CELL:
+      stack[n++] = op.cell->evaluate( p );
+      break;
+    case INTERSECT:
+      --n;
+      stack[n-1] = std::max( stack[n-1], stack[n] );
+      break;
+    case UNION:
+      --n;
+      stack[n-1] = std::min( stack[n-1], stack[n] );
+      break;
+    case COMPLEMENT:
+      stack[n-1] = -stack[n-1];
+      break;
+    }
+  }
+
+  return stack[0];
+}
+
+double PlacedRegion::evaluate( const Vector3d& p ) const {
+  Vector3d q = p;
+  for( size_t i = 0; i < frame.size(); ++i ){
+    q = frame[i].applyInverse( q );
+  }
+  return region->evaluate( q );
+}
+
+double CellInstance::evaluate( const Vector3d& p ) const {
+  double ret = -world_size;
+  for( int k = 0; k < 3; ++k ){
+    ret = std::max( ret, std::fabs( p.v[k] ) - world_size );
+  }
+  for( size_t i = 0; i < bounds.size(); ++i ){
+    ret = std::max( ret, bounds[i].evaluate( p ) );
+  }
+  return ret;
+}
+
+static bool boxWithin( const Vector3d& min, const Vector3d& max, const Vector3d& bound_min, const Vector3d& bound_max ){
+  bool ret = true;
+  for( int k = 0; k < 3 && ret; ++k ){
+    ret = bound_min.v[k] <= min.v[k] && max.v[k] <= bound_max.v[k];
+  }
+  return ret;
+}
+
+static void boundBox( const ImplicitRegion& region, const Vector3d& min, const Vector3d& max, int depth,
+                      bool& found, Vector3d& region_min, Vector3d& region_max ){
+
+  if( found && boxWithin( min, max, region_min, region_max ) ) return;
+
+  Vector3d half = ( max + -min ) * 0.5;
+  double radius = half.length();
+  double f = region.evaluate( min + half );
+
+  // the region does not reach this box
+  if( f > radius * ( 1.0 + 1e-9 ) ) return;
+
+  if( f < -radius || depth == 0 ){
+    if( !found ){
+      region_min = min;
+      region_max = max;
+      found = true;
+    }
+    for( int k = 0; k < 3; ++k ){
+      region_min.v[k] = std::min( region_min.v[k], min.v[k] );
+      region_max.v[k] = std::max( region_max.v[k], max.v[k] );
+    }
+    return;
+  }
+
+  for( int c = 0; c < 8; ++c ){
+    Vector3d child_min = min, child_max = min + half;
+    for( int k = 0; k < 3; ++k ){
+      if( c & (1 << k) ){
+        child_min.v[k] += half.v[k];
+        child_max.v[k] = max.v[k];
+      }
+    }
+    boundBox( region, child_min, child_max, depth - 1, found, region_min, region_max );
+  }
+}
+
+bool CellInstance::getBounds( Vector3d& min, Vector3d& max ) const {
+  min = Vector3d( -world_size, -world_size, -world_size );
+  max = Vector3d( world_size, world_size, world_size );
+  for( int pass = 0; pass < 4; ++pass ){
+    Vector3d region_min, region_max;
+    if( !boundRegion( *this, min, max, instance_bound_depth, region_min, region_max ) ){
+      return false;
+    }
+    double shrink = ( region_max + -region_min ).length() / ( max + -min ).length();
+    min = region_min;
+    max = region_max;
+    if( shrink > 0.9 ) break;
+  }
+  return true;
+}
+
+bool boundRegion( const ImplicitRegion& region, const Vector3d& box_min, const Vector3d& box_max, int depth,
+                  Vector3d& region_min, Vector3d& region_max ){
+  bool found = false;
+  boundBox( region, box_min, box_max, depth, found, region_min, region_max );
+  return found;
+}
+
+/** The box bounding the image of a box, mapped into a frame by the inverses of its transforms */
+static void boxIntoFrame( const std::vector<Transform>& frame, const Vector3d& min, const Vector3d& max,
+                          Vector3d& frame_min, Vector3d& frame_max ){
+  for( int c = 0; c < 8; ++c ){
+    Vector3d p;
+    for( int k = 0; k < 3; ++k ){
+      p.v[k] = ( c & (1 << k) ) ? max.v[k] : min.v[k];
+    }
+    for( size_t i = 0; i < frame.size(); ++i ){
+      p = frame[i].applyInverse( p );
+    }
+    for( int k = 0; k < 3; ++k ){
+      if( c == 0 || p.v[k] < frame_min.v[k] ) frame_min.v[k] = p.v[k];
+      if( c == 0 || p.v[k] > frame_max.v[k] ) frame_max.v[k] = p.v[k];
+    }
+  }
+}
+
+AnalyticGeometry::AnalyticGeometry( InputDeck& deck_p, double world_size_p ) :
+  deck( deck_p ), world_size( world_size_p )
+{}
+
+AnalyticGeometry::~AnalyticGeometry(){
+  for( std::map< const CellCard*, CellRegion* >::iterator i = regions.begin(); i != regions.end(); ++i ){
+    delete (*i).second;
+  }
+}
+
+const CellRegion& AnalyticGeometry::getRegion( const CellCard& cell ){
+  std::map< const CellCard*, CellRegion* >::iterator i = regions.find( &cell );
+  if( i != regions.end() ){
+    return *(*i).second;
+  }
+
+  // a region that fails to compile is not kept, so that asking again fails again
+  CellRegion* region = new CellRegion();
+  regions[ &cell ] = region;
+  try{
+    region->compile( cell, deck, *this );
+  }
+  catch( std::runtime_error& e ){
+    regions.erase( &cell );
+    delete region;
+    throw;
+  }
+  return *region;
+}
+
+void AnalyticGeometry::placeCells(){
+  instances.clear();
+  placeUniverse( 0, std::vector<Transform>(), std::vector<PlacedRegion>(), "" );
+  if( OPT_VERBOSE ) std::cout << "Found " << instances.size() << " cell instances" << std::endl;
+}
+
+void AnalyticGeometry::placeUniverse( int universe, const std::vector<Transform>& frame,
+                                      const std::vector<PlacedRegion>& bounds, const std::string& origin ){
+
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  if( cells.size() == 1 && cells[0]->isLattice() ){
+    placeLattice( *cells[0], frame, bounds, origin );
+    return;
+  }
+
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i != cells.end(); ++i ){
+    const CellCard& cell = *(*i);
+
+    if( cell.isLattice() ){
+      std::cerr << "Warning: lattice cell " << cell.getIdent() << " is not alone in universe "
+                << universe << ", skipping it" << std::endl;
+      continue;
+    }
+
+    const CellRegion* region;
+    try{
+      region = &getRegion( cell );
+    }
+    catch( std::runtime_error& e ){
+      std::cerr << "Error: cell " << cell.getIdent() << ": " << e.what() << std::endl;
+      continue;
+    }
+
+    std::stringstream cell_name;
+    cell_name << origin << "/" << cell.getIdent();
+
+    std::vector<PlacedRegion> cell_bounds( bounds );
+    cell_bounds.push_back( PlacedRegion( region, frame ) );
+
+    if( cell.hasFill() ){
+      // as in GeometryContext::populateCell(), the contained universe is transformed by
+      // the FillNode's transform, if any, or else by the cell's TRCL value, if any.
+      const FillNode& n = cell.getFill().getOriginNode();
+      std::vector<Transform> fill_frame( frame );
+      if( n.hasTransform() ){
+        fill_frame.push_back( n.getTransform() );
+      }
+      else if( cell.getTrcl().hasData() ){
+        fill_frame.push_back( cell.getTrcl().getData() );
+      }
+      placeUniverse( n.getFillingUniverse(), fill_frame, cell_bounds, cell_name.str() );
+    }
+    else{
+      instances.push_back( CellInstance( &cell, cell_name.str(), cell_bounds, world_size ) );
+    }
+  }
+}
+
+bool AnalyticGeometry::findLatticeNodes( const CellCard& cell, const std::vector<Transform>& frame,
+                                         const std::vector<PlacedRegion>& bounds, LatticeNodeTable& nodes ){
+
+  const CellRegion* element;
+  try{
+    element = &getRegion( cell );
+  }
+  catch( std::runtime_error& e ){
+    std::cerr << "Error: lattice cell " << cell.getIdent() << ": " << e.what() << std::endl;
+    return false;
+  }
+
+  // the box of the lattice's container, carried into the lattice's frame
+  Vector3d world_min( -world_size, -world_size, -world_size ), world_max( world_size, world_size, world_size );
+  Vector3d container_min, container_max, lattice_min, lattice_max;
+  CellInstance container( NULL, "", bounds, world_size );
+  if( !boundRegion( container, world_min, world_max, container_bound_depth, container_min, container_max ) ){
+    return false;
+  }
+  boxIntoFrame( frame, container_min, container_max, lattice_min, lattice_max );
+
+  // the box of the origin element, which may be unbounded in some directions; frames are
+  // never moved further than world_size from the world's center
+  Vector3d shell_min, shell_max;
+  if( !boundRegion( *element, world_min * 2.0, world_max * 2.0, element_bound_depth, shell_min, shell_max ) ){
+    return false;
+  }
+
+  const Lattice& lattice = cell.getLattice();
+  nodes.clear();
+  if( lattice.isFixedSize() ){
+    lattice.addNodes( nodes, 0, lattice.numNodes() );
+  }
+  else{
+    // every node that can reach the container is within a shell of the container's corners
+    int radius = 0;
+    for( int c = 0; c < 8; ++c ){
+      Vector3d p;
+      for( int k = 0; k < 3; ++k ){
+        p.v[k] = ( c & (1 << k) ) ? lattice_max.v[k] : lattice_min.v[k];
+      }
+      radius = std::max( radius, lattice.getRadiusOfPoint( p ) );
+    }
+    radius += 1;
+
+    int dims = lattice.numFiniteDirections();
+    int rx = radius, ry = ( dims >= 2 ) ? radius : 0, rz = ( dims >= 3 ) ? radius : 0;
+    for( int x = -rx; x <= rx; ++x ){
+      for( int y = -ry; y <= ry; ++y ){
+        for( int z = -rz; z <= rz; ++z ){
+          nodes.addNode( x, y, z );
+        }
+      }
+    }
+  }
+  lattice.computeNodeTable( nodes, shell_min, shell_max, lattice_min, lattice_max );
+  return true;
+}
+
+void AnalyticGeometry::placeLattice( const CellCard& cell, const std::vector<Transform>& frame,
+                                     const std::vector<PlacedRegion>& bounds, const std::string& origin ){
+
+  LatticeNodeTable nodes;
+  if( !findLatticeNodes( cell, frame, bounds, nodes ) ){
+    return;
+  }
+  const CellRegion* element = &getRegion( cell );
+
+  std::stringstream cell_name;
+  cell_name << origin << "/" << cell.getIdent();
+
+  int lattice_universe = cell.getUniverse();
+  for( size_t n = 0; n < nodes.size(); ++n ){
+    if( !nodes.in_bounds[n] || nodes.universe[n] == 0 ) continue;
+
+    std::stringstream node_name;
+    node_name << cell_name.str() << "[" << nodes.x[n] << "," << nodes.y[n] << "," << nodes.z[n] << "]";
+
+    std::vector<Transform> node_frame( frame );
+    node_frame.push_back( nodes.getTx( n ) );
+    std::vector<PlacedRegion> node_bounds( bounds );
+    node_bounds.push_back( PlacedRegion( element, node_frame ) );
+
+    if( nodes.universe[n] == lattice_universe ){
+      // this node is just a translated copy of the origin element
+      instances.push_back( CellInstance( &cell, node_name.str(), node_bounds, world_size ) );
+    }
+    else{
+      const FillNode* fn = nodes.fill[n];
+      if( fn->hasTransform() ){
+        node_frame.push_back( fn->getTransform() );
+      }
+      placeUniverse( nodes.universe[n], node_frame, node_bounds, node_name.str() );
+    }
+  }
+
+}
+
+const AnalyticGeometry::UniverseCells& AnalyticGeometry::getUniverseCells( int universe ){
+
+  std::map< int, UniverseCells >::iterator known = universe_cells.find( universe );
+  if( known != universe_cells.end() ) return (*known).second;
+
+  UniverseCells& u = universe_cells[ universe ];
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  if( cells.size() == 1 && cells[0]->isLattice() ){
+    try{
+      u.regions.push_back( &getRegion( *cells[0] ) );
+      u.lattice = cells[0];
+    }
+    catch( std::runtime_error& e ){
+      std::cerr << "Error: lattice cell " << cells[0]->getIdent() << ": " << e.what() << std::endl;
+    }
+    return u;
+  }
+
+  // universe 0 lies within the world's box; other universes' frames are never moved
+  // further than world_size from the world's center
+  double extent = ( universe == 0 ) ? world_size : 2.0 * world_size;
+  Vector3d world_min( -extent, -extent, -extent ), world_max( extent, extent, extent );
+
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i != cells.end(); ++i ){
+    const CellCard& cell = *(*i);
+    if( cell.isLattice() ) continue; // placeUniverse() warns of these
+
+    const CellRegion* region;
+    try{
+      region = &getRegion( cell );
+    }
+    catch( std::runtime_error& e ){
+      std::cerr << "Error: cell " << cell.getIdent() << ": " << e.what() << std::endl;
+      continue;
+    }
+
+    Vector3d box_min, box_max;
+    if( !boundRegion( *region, world_min, world_max, element_bound_depth, box_min, box_max ) ){
+      continue;
+    }
+    u.cells.push_back( &cell );
+    u.regions.push_back( region );
+    u.box_min.push_back( box_min );
+    u.box_max.push_back( box_max );
+  }
+  return u;
+}
+
+void AnalyticGeometry::indexUniverses(){
+  InputDeck::cell_card_list cells = deck.getCells();
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i != cells.end(); ++i ){
+    getUniverseCells( (*i)->getUniverse() );
+  }
+}
+
+static bool inBox( const Vector3d& p, const Vector3d& min, const Vector3d& max ){
+  return min.v[0] <= p.v[0] && p.v[0] <= max.v[0] && min.v[1] <= p.v[1] && p.v[1] <= max.v[1] &&
+         min.v[2] <= p.v[2] && p.v[2] <= max.v[2];
+}
+
+/** Whether a lattice has a node at x,y,z whose element contains q; node_q is q in the node's frame */
+static bool inLatticeNode( const Lattice& lattice, const CellRegion& element, const Vector3d& q,
+                           int x, int y, int z, Vector3d& node_q ){
+  if( !lattice.hasNode( x, y, z ) ) return false;
+  node_q = lattice.getTxForNode( x, y, z ).applyInverse( q );
+  return element.evaluate( node_q ) < 0;
+}
+
+bool AnalyticGeometry::locate( const Vector3d& p, PointLocation& location, bool with_origin ){
+
+  location = PointLocation();
+  Vector3d world_min( -world_size, -world_size, -world_size ), world_max( world_size, world_size, world_size );
+  if( !inBox( p, world_min, world_max ) ) return false;
+
+  std::stringstream origin;
+  Vector3d q = p;
+  int universe = 0;
+
+  for( int level = 0; level < max_locate_depth; ++level ){
+    const UniverseCells& u = getUniverseCells( universe );
+
+    if( u.lattice ){
+      const CellCard& cell = *u.lattice;
+      const Lattice& lattice = cell.getLattice();
+      if( u.regions.empty() ) return false;
+
+      // the point lies in the node nearest to it in lattice coordinates or, for elements
+      // that are not parallelepipeds, in one of that node's neighbors; the elements do not
+      // overlap, so the first node found to contain it is taken
+      int nx, ny, nz;
+      lattice.getNearestNode( q, nx, ny, nz );
+      int dims = lattice.numFiniteDirections();
+      int rx = 1, ry = ( dims >= 2 ) ? 1 : 0, rz = ( dims >= 3 ) ? 1 : 0;
+      int bx = nx, by = ny, bz = nz;
+      Vector3d node_q;
+      bool found = inLatticeNode( lattice, *u.regions[0], q, bx, by, bz, node_q );
+      for( int x = nx - rx; x <= nx + rx && !found; ++x ){
+        for( int y = ny - ry; y <= ny + ry && !found; ++y ){
+          for( int z = nz - rz; z <= nz + rz && !found; ++z ){
+            if( x == nx && y == ny && z == nz ) continue;
+            bx = x; by = y; bz = z;
+            found = inLatticeNode( lattice, *u.regions[0], q, bx, by, bz, node_q );
+          }
+        }
+      }
+      if( !found ) return false;
+
+      if( universe == 0 ) location.top = &cell;
+      if( with_origin ){
+        origin << "/" << cell.getIdent() << "[" << bx << "," << by << "," << bz << "]";
+      }
+      const FillNode& node = lattice.getFillForNode( bx, by, bz );
+      int filling = node.getFillingUniverse();
+      if( filling == 0 ) return false;
+      if( filling == universe ){
+        // this node is just a translated copy of the origin element
+        location.cell = &cell;
+        break;
+      }
+      q = node.hasTransform() ? node.getTransform().applyInverse( node_q ) : node_q;
+      universe = filling;
+      continue;
+    }
+
+    size_t i = 0;
+    while( i < u.cells.size() && !( inBox( q, u.box_min[i], u.box_max[i] ) && u.regions[i]->evaluate( q ) < 0 ) ){
+      ++i;
+    }
+    if( i == u.cells.size() ) return false;
+
+    const CellCard& cell = *u.cells[i];
+    if( universe == 0 ) location.top = &cell;
+    if( with_origin ) origin << "/" << cell.getIdent();
+    if( !cell.hasFill() ){
+      location.cell = &cell;
+      break;
+    }
+
+    // as in placeUniverse(), the fill's transform, if any, or else the cell's TRCL
+    const FillNode& n = cell.getFill().getOriginNode();
+    if( n.hasTransform() ){
+      q = n.getTransform().applyInverse( q );
+    }
+    else if( cell.getTrcl().hasData() ){
+      q = cell.getTrcl().getData().applyInverse( q );
+    }
+    universe = n.getFillingUniverse();
+  }
+
+  if( !location.cell ) return false;
+  location.origin = origin.str();
+  return true;
+}
+
+/** A step down the universes at a point: a cell, or a node of a lattice cell */
+struct PathStep{
+  int cell;
+  bool node;
+  int x, y, z;
+};
+
+/** A path of steps, named as in CellInstance::origin */
+static std::string formatPath( const std::vector<PathStep>& path ){
+  std::stringstream str;
+  for( size_t i = 0; i < path.size(); ++i ){
+    str << "/" << path[i].cell;
+    if( path[i].node ) str << "[" << path[i].x << "," << path[i].y << "," << path[i].z << "]";
+  }
+  return str.str();
+}
+
+bool AnalyticGeometry::checkPoint( const Vector3d& p, double tolerance, PointConflict& conflict ){
+
+  conflict = PointConflict();
+  Vector3d world_min( -world_size, -world_size, -world_size ), world_max( world_size, world_size, world_size );
+  if( !inBox( p, world_min, world_max ) ) return true;
+
+  std::vector<PathStep> path;
+  std::vector< const CellCard* > claims;
+  Vector3d q = p;
+  int universe = 0;
+
+  for( int level = 0; level < max_locate_depth; ++level ){
+    const UniverseCells& u = getUniverseCells( universe );
+
+    if( u.lattice ){
+      const CellCard& cell = *u.lattice;
+      const Lattice& lattice = cell.getLattice();
+      if( u.regions.empty() ) return true;
+
+      // lattice elements cannot overlap, but a point may be in none of them
+      int nx, ny, nz;
+      lattice.getNearestNode( q, nx, ny, nz );
+      int dims = lattice.numFiniteDirections();
+      int rx = 1, ry = ( dims >= 2 ) ? 1 : 0, rz = ( dims >= 3 ) ? 1 : 0;
+      bool found = false;
+      PathStep step = { cell.getIdent(), true, 0, 0, 0 };
+      Vector3d node_q;
+      for( int x = nx - rx; x <= nx + rx; ++x ){
+        for( int y = ny - ry; y <= ny + ry; ++y ){
+          for( int z = nz - rz; z <= nz + rz; ++z ){
+            if( !lattice.hasNode( x, y, z ) ) continue;
+            Vector3d candidate_q = lattice.getTxForNode( x, y, z ).applyInverse( q );
+            double f = u.regions[0]->evaluate( candidate_q );
+            if( std::fabs( f ) <= tolerance ) return true;
+            if( f < 0 && !found ){
+              found = true;
+              step.x = x; step.y = y; step.z = z;
+              node_q = candidate_q;
+            }
+          }
+        }
+      }
+      if( !found ){
+        conflict.universe = universe;
+        conflict.lattice = &cell;
+        conflict.origin = formatPath( path );
+        return false;
+      }
+
+      path.push_back( step );
+      const FillNode& node = lattice.getFillForNode( step.x, step.y, step.z );
+      int filling = node.getFillingUniverse();
+      if( filling == 0 || filling == universe ) return true;
+      q = node.hasTransform() ? node.getTransform().applyInverse( node_q ) : node_q;
+      universe = filling;
+      continue;
+    }
+
+    claims.clear();
+    for( size_t i = 0; i < u.cells.size(); ++i ){
+      if( !inBox( q, u.box_min[i], u.box_max[i] ) ) continue;
+      double f = u.regions[i]->evaluate( q );
+      if( std::fabs( f ) <= tolerance ) return true;
+      if( f < 0 ) claims.push_back( u.cells[i] );
+    }
+    if( claims.size() != 1 ){
+      conflict.universe = universe;
+      conflict.cells = claims;
+      conflict.origin = formatPath( path );
+      return false;
+    }
+
+    const CellCard& cell = *claims[0];
+    if( !cell.hasFill() ) return true;
+    PathStep step = { cell.getIdent(), false, 0, 0, 0 };
+    path.push_back( step );
+
+    const FillNode& n = cell.getFill().getOriginNode();
+    if( n.hasTransform() ){
+      q = n.getTransform().applyInverse( q );
+    }
+    else if( cell.getTrcl().hasData() ){
+      q = cell.getTrcl().getData().applyInverse( q );
+    }
+    universe = n.getFillingUniverse();
+  }
+  return true;
+}
@@ -0,0 +1,211 @@
+#ifndef MCNP2CAD_REGIONS_H
+#define MCNP2CAD_REGIONS_H
+
+#include <vector>
+#include <map>
+#include <string>
+
+#include "geometry.hpp"
+
+class InputDeck;
+class CellCard;
+class SurfaceVolume;
+class AnalyticGeometry;
+
+/**
+ * A region of space given by an implicit function, negative inside the region and
+ * positive outside it.  The functions used here never change faster than the distance
+ * to the region's boundary does, so |evaluate(p)| is at most the distance from p to the
+ * boundary: a ball of radius |evaluate(p)| about p lies entirely inside or outside.
+ */
+class ImplicitRegion{
+public:
+  virtual ~ImplicitRegion(){}
+  virtual double evaluate( const Vector3d& p ) const = 0;
+};
+
+/**
+ * The region of a cell card, evaluated directly from the implicit functions of its
+ * surfaces rather than built in a CAD kernel.  The cell's geometry list is compiled once
+ * into a program for a stack of function values: intersection takes the larger of two
+ * values, union the smaller, and complement negates, all of which keep the distance
+ * bound of the surfaces' functions.  The region is in the coordinates of the cell's
+ * universe, with the cell's TRCL transform, if any, applied.
+ */
+class CellRegion : public ImplicitRegion{
+
+protected:
+  enum op_t { SURFACE, CELL, INTERSECT, UNION, COMPLEMENT };
+
+  struct Op{
+    op_t op;
+    const SurfaceVolume* surface; // for SURFACE
+    bool positive;                // for SURFACE
+    const CellRegion* cell;       // for CELL, a #-complemented cell
+  };
+
+  std::vector<Op> program;
+  const Transform* trcl;
+  mutable std::vector<double> stack;
+
+public:
+  CellRegion() : trcl(NULL) {}
+
+  /// compile the geometry of a cell, using regions for any complemented cells it names
+  void compile( const CellCard& cell, InputDeck& deck, AnalyticGeometry& geometry );
+
+  virtual double evaluate( const Vector3d& p ) const;
+};
+
+/** A region placed through a chain of transforms, outermost first */
+struct PlacedRegion{
+  const ImplicitRegion* region;
+  std::vector<Transform> frame;
+
+  PlacedRegion( const ImplicitRegion* region_p, const std::vector<Transform>& frame_p ) :
+    region( region_p ), frame( frame_p )
+  {}
+
+  double evaluate( const Vector3d& p ) const;
+};
+
+/**
+ * One occurrence of a material cell in the model: a cell of some universe, placed by
+ * the fills and lattices above it and bounded by every cell that contains it, within
+ * the box [-world_size,world_size] on each axis.  cell is NULL for a region that only
+ * bounds others, such as the container of a lattice.
+ */
+class CellInstance : public ImplicitRegion{
+
+public:
+  const CellCard* cell;
+  std::string origin; // the chain of cells and lattice nodes leading to this instance
+  std::vector<PlacedRegion> bounds;
+  double world_size;
+
+  CellInstance( const CellCard* cell_p, const std::string& origin_p, const std::vector<PlacedRegion>& bounds_p,
+                double world_size_p ) :
+    cell( cell_p ), origin( origin_p ), bounds( bounds_p ), world_size( world_size_p )
+  {}
+
+  virtual double evaluate( const Vector3d& p ) const;
+
+  /**
+   * Find a box enclosing this instance by narrowing in on it from the world's box.
+   * Returns false if the instance turns out to be empty.
+   */
+  bool getBounds( Vector3d& min, Vector3d& max ) const;
+};
+
+/**
+ * Find a box enclosing a region within the box [box_min,box_max], by refining an octree
+ * of that box depth times, skipping cubes the region cannot reach.  The result may be
+ * larger than the region by up to the size of the finest cubes.  Returns false if the
+ * region does not meet the box at all.
+ */
+bool boundRegion( const ImplicitRegion& region, const Vector3d& box_min, const Vector3d& box_max, int depth,
+                  Vector3d& region_min, Vector3d& region_max );
+
+/**
+ * The cell found at a point of the model: the material cell (or lattice cell, for a node
+ * that repeats the lattice's own element), the cell of universe 0 that contains it, and
+ * the chain of cells and lattice nodes between them, named as in CellInstance::origin.
+ */
+struct PointLocation{
+  const CellCard* cell;
+  const CellCard* top;
+  std::string origin;
+
+  PointLocation() : cell( NULL ), top( NULL ) {}
+};
+
+/**
+ * A point of the model claimed by no cell, or by more than one, of some universe: the
+ * claiming cells, if any, and the chain of cells and lattice nodes leading to the
+ * universe.  For a point in no node of a lattice, lattice is that lattice's cell.
+ */
+struct PointConflict{
+  int universe;
+  const CellCard* lattice;
+  std::vector< const CellCard* > cells;
+  std::string origin;
+
+  PointConflict() : universe( 0 ), lattice( NULL ) {}
+};
+
+/**
+ * The cells of a deck as analytic regions, and every instance of a material cell in the
+ * model, found by expanding universe 0 through its fills and lattices the same way
+ * that GeometryContext does when building the model in a CAD kernel.
+ */
+class AnalyticGeometry{
+
+protected:
+  InputDeck& deck;
+  double world_size;
+  std::map< const CellCard*, CellRegion* > regions;
+  std::vector< CellInstance > instances;
+
+  /// the cells of a universe as searched by locate(), with boxes about their regions
+  struct UniverseCells{
+    const CellCard* lattice; // the universe's lattice cell, if it is a lattice
+    std::vector< const CellCard* > cells;
+    std::vector< const CellRegion* > regions;
+    std::vector< Vector3d > box_min, box_max;
+    UniverseCells() : lattice( NULL ) {}
+  };
+  std::map< int, UniverseCells > universe_cells;
+
+  const UniverseCells& getUniverseCells( int universe );
+
+  void placeUniverse( int universe, const std::vector<Transform>& frame, const std::vector<PlacedRegion>& bounds,
+                      const std::string& origin );
+  void placeLattice( const CellCard& cell, const std::vector<Transform>& frame, const std::vector<PlacedRegion>& bounds,
+                     const std::string& origin );
+
+public:
+  AnalyticGeometry( InputDeck& deck_p, double world_size_p );
+  ~AnalyticGeometry();
+
+  /// the compiled region of a cell card; throws std::runtime_error for unsupported geometry
+  const CellRegion& getRegion( const CellCard& cell );
+
+  /**
+   * Find the nodes of a lattice cell, placed through frame, that can reach the container
+   * given by bounds: the table's in_bounds entries are cleared for the others.  Returns
+   * false, with nothing in the table, if the container or the lattice's element is empty
+   * or the element's geometry is unsupported.
+   */
+  bool findLatticeNodes( const CellCard& cell, const std::vector<Transform>& frame,
+                         const std::vector<PlacedRegion>& bounds, LatticeNodeTable& nodes );
+
+  /// find the instances of every material cell in universe 0
+  void placeCells();
+
+  /**
+   * Find the material cell at a point of the model by descending from universe 0 through
+   * the fills and lattice nodes that contain it, without building any instances.  Within
+   * each universe, the first cell found to contain the point is taken.  The origin path
+   * is only filled in if with_origin is set.  Returns false if the point is in no cell,
+   * in an empty lattice node, or outside the world's box.
+   */
+  bool locate( const Vector3d& p, PointLocation& location, bool with_origin = false );
+
+  /**
+   * Check that a point of the model is claimed by exactly one cell of each universe that
+   * locate() would pass through on its way down from universe 0.  Points closer than
+   * tolerance to the boundary of any cell or lattice element involved are not checked.
+   * Returns false, describing the first universe where the point is claimed by no cell
+   * or by several, if there is one.
+   */
+  bool checkPoint( const Vector3d& p, double tolerance, PointConflict& conflict );
+
+  /// find the cells of every universe for locate() ahead of time, e.g. before forking workers
+  void indexUniverses();
+
+  const std::vector< CellInstance >& getInstances() const { return instances; }
+  double getWorldSize() const { return world_size; }
+
+};
+
+#endif /* MCNP2CAD_REGIONS_H */
@@ -0,0 +1,9 @@
+#ifndef IBASE_H
+#define IBASE_H
+/* The parts of the ITAPS iBase interface used by mcnp2cad, for the stub iGeom in iGeom_stub.cpp */
+typedef struct iBase_EntityHandle_Private* iBase_EntityHandle;
+typedef struct iBase_EntitySetHandle_Private* iBase_EntitySetHandle;
+typedef struct iBase_TagHandle_Private* iBase_TagHandle;
+enum iBase_EntityType { iBase_VERTEX = 0, iBase_EDGE, iBase_FACE, iBase_REGION, iBase_ALL_TYPES };
+enum iBase_ErrorType { iBase_SUCCESS = 0, iBase_FAILURE = 1 };
+#endif
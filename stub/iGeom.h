@@ -0,0 +1,54 @@
+#ifndef IGEOM_H
+#define IGEOM_H
+/* The subset of the iGeom interface that mcnp2cad uses, as implemented by iGeom_stub.cpp */
+#include "iBase.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef struct iGeom_Instance_Private* iGeom_Instance;
+void iGeom_getDescription(iGeom_Instance, char*, int);
+void iGeom_newGeom(const char*, iGeom_Instance*, int*, int);
+void iGeom_dtor(iGeom_Instance, int*);
+void iGeom_load(iGeom_Instance, const char*, const char*, int*, int, int);
+void iGeom_save(iGeom_Instance, const char*, const char*, int*, int, int);
+void iGeom_getRootSet(iGeom_Instance, iBase_EntitySetHandle*, int*);
+void iGeom_getEntities(iGeom_Instance, iBase_EntitySetHandle, int, iBase_EntityHandle**, int*, int*, int*);
+void iGeom_getNumOfType(iGeom_Instance, iBase_EntitySetHandle, int, int*, int*);
+void iGeom_getEntBoundBox(iGeom_Instance, iBase_EntityHandle, double*, double*, double*, double*, double*, double*, int*);
+void iGeom_getTagHandle(iGeom_Instance, const char*, iBase_TagHandle*, int*, int);
+void iGeom_getTagSizeBytes(iGeom_Instance, iBase_TagHandle, int*, int*);
+void iGeom_setData(iGeom_Instance, iBase_EntityHandle, iBase_TagHandle, const void*, int, int*);
+void iGeom_getData(iGeom_Instance, iBase_EntityHandle, iBase_TagHandle, void*, int*, int*, int*);
+void iGeom_rmvTag(iGeom_Instance, iBase_EntityHandle, iBase_TagHandle, int*);
+void iGeom_setArrData(iGeom_Instance, const iBase_EntityHandle*, int, iBase_TagHandle, const void*, int, int*);
+void iGeom_setEntSetData(iGeom_Instance, iBase_EntitySetHandle, iBase_TagHandle, const void*, int, int*);
+void iGeom_getEntSetData(iGeom_Instance, iBase_EntitySetHandle, iBase_TagHandle, void*, int*, int*, int*);
+void iGeom_createEntSet(iGeom_Instance, int, iBase_EntitySetHandle*, int*);
+void iGeom_destroyEntSet(iGeom_Instance, iBase_EntitySetHandle, int*);
+void iGeom_getEntSets(iGeom_Instance, iBase_EntitySetHandle, int, iBase_EntitySetHandle**, int*, int*, int*);
+void iGeom_addEntToSet(iGeom_Instance, iBase_EntityHandle, iBase_EntitySetHandle, int*);
+void iGeom_addEntArrToSet(iGeom_Instance, const iBase_EntityHandle*, int, iBase_EntitySetHandle, int*);
+void iGeom_copyEnt(iGeom_Instance, iBase_EntityHandle, iBase_EntityHandle*, int*);
+void iGeom_moveEnt(iGeom_Instance, iBase_EntityHandle, double, double, double, int*);
+void iGeom_rotateEnt(iGeom_Instance, iBase_EntityHandle, double, double, double, double, int*);
+void iGeom_reflectEnt(iGeom_Instance, iBase_EntityHandle, double, double, double, double, double, double, int*);
+void iGeom_scaleEnt(iGeom_Instance, iBase_EntityHandle, double, double, double, double, double, double, int*);
+void iGeom_createSphere(iGeom_Instance, double, iBase_EntityHandle*, int*);
+void iGeom_createBrick(iGeom_Instance, double, double, double, iBase_EntityHandle*, int*);
+void iGeom_createCylinder(iGeom_Instance, double, double, double, iBase_EntityHandle*, int*);
+void iGeom_createCone(iGeom_Instance, double, double, double, double, iBase_EntityHandle*, int*);
+void iGeom_createTorus(iGeom_Instance, double, double, iBase_EntityHandle*, int*);
+void iGeom_uniteEnts(iGeom_Instance, const iBase_EntityHandle*, int, iBase_EntityHandle*, int*);
+void iGeom_subtractEnts(iGeom_Instance, iBase_EntityHandle, iBase_EntityHandle, iBase_EntityHandle*, int*);
+void iGeom_intersectEnts(iGeom_Instance, iBase_EntityHandle, iBase_EntityHandle, iBase_EntityHandle*, int*);
+void iGeom_sectionEnt(iGeom_Instance, iBase_EntityHandle, double, double, double, double, int, iBase_EntityHandle*, int*);
+void iGeom_imprintEnts(iGeom_Instance, const iBase_EntityHandle*, int, int*);
+void iGeom_mergeEnts(iGeom_Instance, const iBase_EntityHandle*, int, double, int*);
+void iGeom_deleteEnt(iGeom_Instance, iBase_EntityHandle, int*);
+void iGeom_deleteAll(iGeom_Instance, int*);
+void iGeom_getEntAdj(iGeom_Instance, iBase_EntityHandle, int, iBase_EntityHandle**, int*, int*, int*);
+void iGeom_getEntClosestPt(iGeom_Instance, iBase_EntityHandle, double, double, double, double*, double*, double*, int*);
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,599 @@
+/* A stand-in implementation of the subset of the iGeom interface that mcnp2cad uses.
+ *
+ * No geometry is actually created: each body is a synthetic handle carrying an axis-aligned
+ * bounding box that is kept up to date through transforms and booleans by the functions of
+ * boxkernel.hpp, which --analyze uses as well.  Every call is counted, so the front end of
+ * mcnp2cad (parsing, universe traversal, lattice loops, metadata bookkeeping, tagging) can
+ * be run and profiled without a CAD kernel.
+ *
+ * Set the environment variable IGEOM_STUB_COUNTS to a file name (or "-" for stdout) to
+ * have the per-function call counts written out when the program exits; forked worker
+ * processes append their process IDs to the name.  IGEOM_STUB_BOOL_USEC and
+ * IGEOM_STUB_IMPRINT_USEC add a simulated kernel latency, in microseconds, to each
+ * boolean and to each body imprinted or merged.
+ *
+ * Build with "make mcnp2cad-stub".
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+
+#include "iGeom.h"
+#include "../boxkernel.hpp"
+
+namespace {
+
+struct StubBody : public BoundBox {
+  std::string name;
+};
+
+struct StubSet {
+  std::vector<iBase_EntityHandle> members;
+  std::string name;
+};
+
+class StubGeom {
+public:
+  typedef std::map< iBase_EntityHandle, StubBody > body_map_t;
+
+  body_map_t bodies;
+  std::map< iBase_EntitySetHandle, StubSet > sets;
+  std::map< std::string, long > counts;
+  size_t next_id;
+  std::string last_error;
+
+  StubGeom() : next_id(1) {}
+
+  iBase_EntityHandle make( const double min[3], const double max[3] ){
+    iBase_EntityHandle h = reinterpret_cast<iBase_EntityHandle>( next_id++ );
+    StubBody& b = bodies[h];
+    for( int i = 0; i < 3; ++i ){ b.min[i] = min[i]; b.max[i] = max[i]; }
+    return h;
+  }
+
+  iBase_EntityHandle make( const BoundBox& box ){
+    return make( box.min, box.max );
+  }
+
+  StubBody* find( iBase_EntityHandle h ){
+    body_map_t::iterator i = bodies.find( h );
+    return ( i == bodies.end() ) ? NULL : &((*i).second);
+  }
+
+  bool fail( int* err, const std::string& msg ){
+    last_error = msg;
+    *err = iBase_FAILURE;
+    return false;
+  }
+
+};
+
+std::vector< StubGeom* > instances;
+std::string counts_file;
+
+StubGeom* geom( iGeom_Instance igm ){
+  return reinterpret_cast<StubGeom*>( igm );
+}
+
+pid_t original_pid = 0;
+
+void writeCounts(){
+  if( counts_file.empty() ) return;
+
+  std::map< std::string, long > total;
+  for( std::vector<StubGeom*>::iterator i = instances.begin(); i != instances.end(); ++i ){
+    for( std::map<std::string,long>::iterator j = (*i)->counts.begin(); j != (*i)->counts.end(); ++j ){
+      total[ (*j).first ] += (*j).second;
+    }
+  }
+
+  std::ofstream file;
+  std::ostream* out = &std::cout;
+  if( counts_file != "-" ){
+    std::string name = counts_file;
+    if( getpid() != original_pid ){
+      // forked worker processes write their own files
+      std::stringstream pid; pid << "." << getpid();
+      name += pid.str();
+    }
+    file.open( name.c_str() );
+    out = &file;
+  }
+  for( std::map<std::string,long>::iterator i = total.begin(); i != total.end(); ++i ){
+    *out << (*i).first << " " << (*i).second << std::endl;
+  }
+}
+
+} // namespace
+
+#define STUB_COUNT( igm, name ) (geom(igm)->counts[ name ]++)
+
+// simulated kernel latency for booleans, from IGEOM_STUB_BOOL_USEC
+static void boolDelay(){
+  static long usec = -1;
+  if( usec < 0 ){
+    const char* env = getenv( "IGEOM_STUB_BOOL_USEC" );
+    usec = env ? atol( env ) : 0;
+  }
+  if( usec > 0 ) usleep( usec );
+}
+
+// simulated kernel time per body for imprint and merge, from IGEOM_STUB_IMPRINT_USEC
+static void imprintDelay( int count ){
+  static long usec = -1;
+  if( usec < 0 ){
+    const char* env = getenv( "IGEOM_STUB_IMPRINT_USEC" );
+    usec = env ? atol( env ) : 0;
+  }
+  if( usec > 0 ) usleep( usec * count );
+}
+
+extern "C" {
+
+void iGeom_getDescription( iGeom_Instance igm, char* descr, int descr_len ){
+  strncpy( descr, geom(igm)->last_error.c_str(), descr_len );
+  if( descr_len > 0 ) descr[ descr_len-1 ] = '\0';
+}
+
+void iGeom_newGeom( const char*, iGeom_Instance* instance_out, int* err, int ){
+  if( instances.empty() ){
+    const char* env = getenv( "IGEOM_STUB_COUNTS" );
+    if( env ){
+      counts_file = env;
+      original_pid = getpid();
+      atexit( writeCounts );
+    }
+  }
+  StubGeom* g = new StubGeom();
+  instances.push_back( g );
+  *instance_out = reinterpret_cast<iGeom_Instance>( g );
+  STUB_COUNT( *instance_out, "newGeom" );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_dtor( iGeom_Instance igm, int* err ){
+  STUB_COUNT( igm, "dtor" );
+  geom(igm)->bodies.clear();
+  geom(igm)->sets.clear();
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_save( iGeom_Instance igm, const char* name, const char*, int* err, int name_len, int ){
+  STUB_COUNT( igm, "save" );
+  if( original_pid && getpid() != original_pid ) writeCounts();
+  std::string filename( name, name_len );
+  std::ofstream out( filename.c_str() );
+  if( !out ){ geom(igm)->fail( err, "cannot open " + filename ); return; }
+  out.precision( 17 );
+  out << "mcnp2cad-igeom-stub 1" << std::endl;
+  StubGeom::body_map_t& bodies = geom(igm)->bodies;
+  std::map< iBase_EntityHandle, size_t > index;
+  size_t k = 0;
+  for( StubGeom::body_map_t::iterator i = bodies.begin(); i != bodies.end(); ++i, ++k ){
+    const StubBody& b = (*i).second;
+    out << b.min[0] << " " << b.min[1] << " " << b.min[2] << " "
+        << b.max[0] << " " << b.max[1] << " " << b.max[2] << " " << b.name << std::endl;
+    index[ (*i).first ] = k;
+  }
+  // named sets follow the bodies, as "set NAME" and the indices of their live members
+  std::map< iBase_EntitySetHandle, StubSet >& sets = geom(igm)->sets;
+  for( std::map< iBase_EntitySetHandle, StubSet >::iterator i = sets.begin(); i != sets.end(); ++i ){
+    if( (*i).second.name.empty() ) continue;
+    out << "set " << (*i).second.name;
+    const std::vector<iBase_EntityHandle>& members = (*i).second.members;
+    for( size_t j = 0; j < members.size(); ++j ){
+      if( index.count( members[j] ) ) out << " " << index[ members[j] ];
+    }
+    out << std::endl;
+  }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_load( iGeom_Instance igm, const char* name, const char*, int* err, int name_len, int ){
+  STUB_COUNT( igm, "load" );
+  std::string filename( name, name_len );
+  std::ifstream in( filename.c_str() );
+  std::string header;
+  if( !in || !std::getline( in, header ) || header != "mcnp2cad-igeom-stub 1" ){
+    geom(igm)->fail( err, "cannot load " + filename );
+    return;
+  }
+  std::string line;
+  std::vector< iBase_EntityHandle > loaded;
+  while( std::getline( in, line ) ){
+    std::stringstream str( line );
+    if( line.compare( 0, 4, "set " ) == 0 ){
+      std::string word;
+      iBase_EntitySetHandle set = reinterpret_cast<iBase_EntitySetHandle>( geom(igm)->next_id++ );
+      StubSet& s = geom(igm)->sets[set];
+      str >> word >> s.name;
+      size_t member;
+      while( str >> member ){
+        if( member < loaded.size() ) s.members.push_back( loaded[member] );
+      }
+      continue;
+    }
+    double min[3], max[3];
+    str >> min[0] >> min[1] >> min[2] >> max[0] >> max[1] >> max[2];
+    if( !str ) continue;
+    iBase_EntityHandle h = geom(igm)->make( min, max );
+    str >> geom(igm)->bodies[h].name;
+    loaded.push_back( h );
+  }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getRootSet( iGeom_Instance igm, iBase_EntitySetHandle* root_set, int* err ){
+  STUB_COUNT( igm, "getRootSet" );
+  *root_set = NULL;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getNumOfType( iGeom_Instance igm, iBase_EntitySetHandle, int type, int* num_out, int* err ){
+  STUB_COUNT( igm, "getNumOfType" );
+  *num_out = ( type == iBase_REGION ) ? static_cast<int>( geom(igm)->bodies.size() ) : 0;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getEntities( iGeom_Instance igm, iBase_EntitySetHandle, int type,
+                        iBase_EntityHandle** handles, int* allocated, int* size, int* err ){
+  STUB_COUNT( igm, "getEntities" );
+  StubGeom::body_map_t& bodies = geom(igm)->bodies;
+  int count = ( type == iBase_REGION ) ? static_cast<int>( bodies.size() ) : 0;
+  if( *allocated < count ){
+    *handles = static_cast<iBase_EntityHandle*>( malloc( count * sizeof(iBase_EntityHandle) ) );
+    *allocated = count;
+  }
+  *size = 0;
+  if( type == iBase_REGION ){
+    for( StubGeom::body_map_t::iterator i = bodies.begin(); i != bodies.end(); ++i ){
+      (*handles)[ (*size)++ ] = (*i).first;
+    }
+  }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getEntBoundBox( iGeom_Instance igm, iBase_EntityHandle h, double* min_x, double* min_y, double* min_z,
+                           double* max_x, double* max_y, double* max_z, int* err ){
+  STUB_COUNT( igm, "getEntBoundBox" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "getEntBoundBox: bad handle" ); return; }
+  *min_x = b->min[0]; *min_y = b->min[1]; *min_z = b->min[2];
+  *max_x = b->max[0]; *max_y = b->max[1]; *max_z = b->max[2];
+  *err = iBase_SUCCESS;
+}
+
+static iBase_TagHandle stub_name_tag = reinterpret_cast<iBase_TagHandle>( 1 );
+static const int stub_name_tag_size = 64;
+
+void iGeom_getTagHandle( iGeom_Instance igm, const char* tag_name, iBase_TagHandle* tag, int* err, int tag_name_len ){
+  STUB_COUNT( igm, "getTagHandle" );
+  if( std::string( tag_name, tag_name_len ) != "NAME" ){
+    geom(igm)->fail( err, "getTagHandle: no such tag" );
+    return;
+  }
+  *tag = stub_name_tag;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getTagSizeBytes( iGeom_Instance igm, iBase_TagHandle, int* tag_size, int* err ){
+  STUB_COUNT( igm, "getTagSizeBytes" );
+  *tag_size = stub_name_tag_size;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_setData( iGeom_Instance igm, iBase_EntityHandle h, iBase_TagHandle, const void* value, int value_size, int* err ){
+  STUB_COUNT( igm, "setData" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "setData: bad handle" ); return; }
+  b->name = std::string( static_cast<const char*>(value), strnlen( static_cast<const char*>(value), value_size ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getData( iGeom_Instance igm, iBase_EntityHandle h, iBase_TagHandle, void* value, int* allocated, int* size, int* err ){
+  STUB_COUNT( igm, "getData" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b || b->name.empty() ){ geom(igm)->fail( err, "getData: no tag value" ); return; }
+  // as in the ITAPS interface, value is really a pointer to the caller's array pointer
+  char** out = static_cast<char**>( value );
+  int n = static_cast<int>( b->name.length() );
+  if( *allocated < n ){
+    *out = static_cast<char*>( malloc( n ) );
+    *allocated = n;
+  }
+  memcpy( *out, b->name.c_str(), n );
+  *size = n;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_rmvTag( iGeom_Instance igm, iBase_EntityHandle h, iBase_TagHandle, int* err ){
+  STUB_COUNT( igm, "rmvTag" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "rmvTag: bad handle" ); return; }
+  b->name.clear();
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_setArrData( iGeom_Instance igm, const iBase_EntityHandle* handles, int handles_size, iBase_TagHandle,
+                       const void* values, int values_size, int* err ){
+  STUB_COUNT( igm, "setArrData" );
+  if( handles_size == 0 ){ *err = iBase_SUCCESS; return; }
+  int stride = values_size / handles_size;
+  const char* data = static_cast<const char*>( values );
+  for( int i = 0; i < handles_size; ++i ){
+    StubBody* b = geom(igm)->find( handles[i] );
+    if( !b ){ geom(igm)->fail( err, "setArrData: bad handle" ); return; }
+    b->name = std::string( data + i*stride, strnlen( data + i*stride, stride ) );
+  }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_setEntSetData( iGeom_Instance igm, iBase_EntitySetHandle set, iBase_TagHandle, const void* value, int value_size, int* err ){
+  STUB_COUNT( igm, "setEntSetData" );
+  geom(igm)->sets[set].name = std::string( static_cast<const char*>(value), value_size );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getEntSetData( iGeom_Instance igm, iBase_EntitySetHandle set, iBase_TagHandle, void* value,
+                          int* allocated, int* size, int* err ){
+  STUB_COUNT( igm, "getEntSetData" );
+  std::map< iBase_EntitySetHandle, StubSet >::iterator s = geom(igm)->sets.find( set );
+  if( s == geom(igm)->sets.end() || (*s).second.name.empty() ){
+    geom(igm)->fail( err, "getEntSetData: no tag value" );
+    return;
+  }
+  char** out = static_cast<char**>( value );
+  int n = static_cast<int>( (*s).second.name.length() );
+  if( *allocated < n ){
+    *out = static_cast<char*>( malloc( n ) );
+    *allocated = n;
+  }
+  memcpy( *out, (*s).second.name.c_str(), n );
+  *size = n;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createEntSet( iGeom_Instance igm, int, iBase_EntitySetHandle* set, int* err ){
+  STUB_COUNT( igm, "createEntSet" );
+  *set = reinterpret_cast<iBase_EntitySetHandle>( geom(igm)->next_id++ );
+  geom(igm)->sets[*set];
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_destroyEntSet( iGeom_Instance igm, iBase_EntitySetHandle set, int* err ){
+  STUB_COUNT( igm, "destroyEntSet" );
+  if( !geom(igm)->sets.erase( set ) ){ geom(igm)->fail( err, "destroyEntSet: bad handle" ); return; }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getEntSets( iGeom_Instance igm, iBase_EntitySetHandle, int, iBase_EntitySetHandle** handles,
+                       int* allocated, int* size, int* err ){
+  STUB_COUNT( igm, "getEntSets" );
+  std::map< iBase_EntitySetHandle, StubSet >& sets = geom(igm)->sets;
+  int count = static_cast<int>( sets.size() );
+  if( *allocated < count ){
+    *handles = static_cast<iBase_EntitySetHandle*>( malloc( count * sizeof(iBase_EntitySetHandle) ) );
+    *allocated = count;
+  }
+  *size = 0;
+  for( std::map< iBase_EntitySetHandle, StubSet >::iterator i = sets.begin(); i != sets.end(); ++i ){
+    (*handles)[ (*size)++ ] = (*i).first;
+  }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_addEntToSet( iGeom_Instance igm, iBase_EntityHandle h, iBase_EntitySetHandle set, int* err ){
+  STUB_COUNT( igm, "addEntToSet" );
+  geom(igm)->sets[set].members.push_back( h );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_addEntArrToSet( iGeom_Instance igm, const iBase_EntityHandle* handles, int handles_size, iBase_EntitySetHandle set, int* err ){
+  STUB_COUNT( igm, "addEntArrToSet" );
+  geom(igm)->sets[set].members.insert( geom(igm)->sets[set].members.end(), handles, handles + handles_size );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_copyEnt( iGeom_Instance igm, iBase_EntityHandle source, iBase_EntityHandle* copy, int* err ){
+  STUB_COUNT( igm, "copyEnt" );
+  StubBody* b = geom(igm)->find( source );
+  if( !b ){ geom(igm)->fail( err, "copyEnt: bad handle" ); return; }
+  StubBody original = *b;
+  *copy = geom(igm)->make( original.min, original.max );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_moveEnt( iGeom_Instance igm, iBase_EntityHandle h, double x, double y, double z, int* err ){
+  STUB_COUNT( igm, "moveEnt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "moveEnt: bad handle" ); return; }
+  moveBox( *b, x, y, z );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_rotateEnt( iGeom_Instance igm, iBase_EntityHandle h, double angle, double ax, double ay, double az, int* err ){
+  STUB_COUNT( igm, "rotateEnt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "rotateEnt: bad handle" ); return; }
+  rotateBox( *b, angle, ax, ay, az );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_reflectEnt( iGeom_Instance igm, iBase_EntityHandle h, double px, double py, double pz,
+                       double nx, double ny, double nz, int* err ){
+  STUB_COUNT( igm, "reflectEnt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "reflectEnt: bad handle" ); return; }
+  reflectBox( *b, px, py, pz, nx, ny, nz );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_scaleEnt( iGeom_Instance igm, iBase_EntityHandle h, double px, double py, double pz,
+                     double sx, double sy, double sz, int* err ){
+  STUB_COUNT( igm, "scaleEnt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "scaleEnt: bad handle" ); return; }
+  scaleBox( *b, px, py, pz, sx, sy, sz );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createSphere( iGeom_Instance igm, double radius, iBase_EntityHandle* h, int* err ){
+  STUB_COUNT( igm, "createSphere" );
+  *h = geom(igm)->make( sphereBox( radius ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createBrick( iGeom_Instance igm, double x, double y, double z, iBase_EntityHandle* h, int* err ){
+  STUB_COUNT( igm, "createBrick" );
+  *h = geom(igm)->make( centeredBox( x, y, z ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createCylinder( iGeom_Instance igm, double height, double major_rad, double minor_rad, iBase_EntityHandle* h, int* err ){
+  STUB_COUNT( igm, "createCylinder" );
+  *h = geom(igm)->make( cylinderBox( height, major_rad, minor_rad ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createCone( iGeom_Instance igm, double height, double major_rad_base, double minor_rad_base, double rad_top,
+                       iBase_EntityHandle* h, int* err ){
+  STUB_COUNT( igm, "createCone" );
+  *h = geom(igm)->make( coneBox( height, major_rad_base, minor_rad_base, rad_top ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_createTorus( iGeom_Instance igm, double major_rad, double minor_rad, iBase_EntityHandle* h, int* err ){
+  STUB_COUNT( igm, "createTorus" );
+  *h = geom(igm)->make( torusBox( major_rad, minor_rad ) );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_uniteEnts( iGeom_Instance igm, const iBase_EntityHandle* handles, int handles_size, iBase_EntityHandle* result, int* err ){
+  STUB_COUNT( igm, "uniteEnts" );
+  boolDelay();
+  BoundBox united = emptyBox();
+  for( int i = 0; i < handles_size; ++i ){
+    StubBody* b = geom(igm)->find( handles[i] );
+    if( !b ){ geom(igm)->fail( err, "uniteEnts: bad handle" ); return; }
+    growBox( united, *b );
+  }
+  for( int i = 0; i < handles_size; ++i ){ geom(igm)->bodies.erase( handles[i] ); }
+  *result = geom(igm)->make( united );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_subtractEnts( iGeom_Instance igm, iBase_EntityHandle blank, iBase_EntityHandle tool, iBase_EntityHandle* result, int* err ){
+  STUB_COUNT( igm, "subtractEnts" );
+  boolDelay();
+  StubBody* b = geom(igm)->find( blank );
+  if( !b || !geom(igm)->find( tool ) ){ geom(igm)->fail( err, "subtractEnts: bad handle" ); return; }
+  BoundBox kept = *b;
+  geom(igm)->bodies.erase( blank );
+  geom(igm)->bodies.erase( tool );
+  *result = geom(igm)->make( kept );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_intersectEnts( iGeom_Instance igm, iBase_EntityHandle h1, iBase_EntityHandle h2, iBase_EntityHandle* result, int* err ){
+  STUB_COUNT( igm, "intersectEnts" );
+  boolDelay();
+  StubBody* b1 = geom(igm)->find( h1 );
+  StubBody* b2 = geom(igm)->find( h2 );
+  if( !b1 || !b2 ){ geom(igm)->fail( err, "intersectEnts: bad handle" ); return; }
+  BoundBox overlap;
+  if( !intersectBoxes( *b1, *b2, overlap ) ){
+    // like a real kernel, fail on an empty intersection and leave the operands alone
+    geom(igm)->fail( err, "intersectEnts: empty intersection" );
+    return;
+  }
+  geom(igm)->bodies.erase( h1 );
+  geom(igm)->bodies.erase( h2 );
+  *result = geom(igm)->make( overlap );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_sectionEnt( iGeom_Instance igm, iBase_EntityHandle h, double nx, double ny, double nz, double offset,
+                       int reverse, iBase_EntityHandle* result, int* err ){
+  STUB_COUNT( igm, "sectionEnt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "sectionEnt: bad handle" ); return; }
+  BoundBox kept = *b;
+  sectionBox( kept, nx, ny, nz, offset, reverse );
+  geom(igm)->bodies.erase( h );
+  *result = geom(igm)->make( kept );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_imprintEnts( iGeom_Instance igm, const iBase_EntityHandle*, int count, int* err ){
+  STUB_COUNT( igm, "imprintEnts" );
+  imprintDelay( count );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_mergeEnts( iGeom_Instance igm, const iBase_EntityHandle*, int count, double, int* err ){
+  STUB_COUNT( igm, "mergeEnts" );
+  imprintDelay( count );
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_deleteEnt( iGeom_Instance igm, iBase_EntityHandle h, int* err ){
+  STUB_COUNT( igm, "deleteEnt" );
+  if( geom(igm)->bodies.erase( h ) == 0 ){ geom(igm)->fail( err, "deleteEnt: bad handle" ); return; }
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_deleteAll( iGeom_Instance igm, int* err ){
+  STUB_COUNT( igm, "deleteAll" );
+  geom(igm)->bodies.clear();
+  geom(igm)->sets.clear();
+  *err = iBase_SUCCESS;
+}
+
+// bodies have a single face: the surface of their box, represented by the body's own handle
+void iGeom_getEntAdj( iGeom_Instance igm, iBase_EntityHandle h, int, iBase_EntityHandle** adj, int* allocated, int* size, int* err ){
+  STUB_COUNT( igm, "getEntAdj" );
+  if( !geom(igm)->find( h ) ){ geom(igm)->fail( err, "getEntAdj: bad handle" ); return; }
+  if( *allocated < 1 ){
+    *adj = static_cast<iBase_EntityHandle*>( malloc( sizeof(iBase_EntityHandle) ) );
+    *allocated = 1;
+  }
+  (*adj)[0] = h;
+  *size = 1;
+  *err = iBase_SUCCESS;
+}
+
+void iGeom_getEntClosestPt( iGeom_Instance igm, iBase_EntityHandle h, double x, double y, double z,
+                            double* on_x, double* on_y, double* on_z, int* err ){
+  STUB_COUNT( igm, "getEntClosestPt" );
+  StubBody* b = geom(igm)->find( h );
+  if( !b ){ geom(igm)->fail( err, "getEntClosestPt: bad handle" ); return; }
+  double p[3] = { x, y, z }, q[3];
+  bool inside = true;
+  for( int k = 0; k < 3; ++k ){
+    q[k] = std::max( b->min[k], std::min( b->max[k], p[k] ) );
+    inside = inside && q[k] == p[k];
+  }
+  if( inside ){
+    // project onto the nearest side of the box
+    int best = 0; double best_d = 1e300, best_v = 0;
+    for( int k = 0; k < 3; ++k ){
+      if( p[k] - b->min[k] < best_d ){ best_d = p[k] - b->min[k]; best = k; best_v = b->min[k]; }
+      if( b->max[k] - p[k] < best_d ){ best_d = b->max[k] - p[k]; best = k; best_v = b->max[k]; }
+    }
+    q[best] = best_v;
+  }
+  *on_x = q[0]; *on_y = q[1]; *on_z = q[2];
+  *err = iBase_SUCCESS;
+}
+
+} // extern "C"
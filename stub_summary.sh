@@ -0,0 +1,24 @@
+#!/bin/sh
+#
+# Summarize an output file of mcnp2cad-stub as one line per body: its name, or "-" if it
+# has none, followed by the names of the groups it belongs to.  The lines are sorted, so
+# two conversions that build the same bodies into the same groups have the same summary
+# whatever order they created the bodies in.  Coordinates are left out, since they are
+# rounded when bodies are saved and loaded again.
+#
+# Usage: stub_summary.sh FILE
+
+awk 'NR == 1 { if( $0 != "mcnp2cad-igeom-stub 1" ){ print "not a stub output: " FILENAME; bad = 1; exit }
+               next }
+     $1 == "set" { for( i = 3; i <= NF; ++i ) groups[$i] = groups[$i] " " $2; next }
+     { name[nbodies++] = ( NF > 6 ? $7 : "-" ) }
+     END { if( bad ) exit 1
+           for( k = 0; k < nbodies; ++k ){
+             n = split( groups[k], list, " " )
+             # sort the group names of the body, which are few
+             for( i = 2; i <= n; ++i )
+               for( j = i; j > 1 && list[j - 1] > list[j]; --j ){ t = list[j]; list[j] = list[j - 1]; list[j - 1] = t }
+             line = name[k]
+             for( i = 1; i <= n; ++i ) line = line " " list[i]
+             print line
+           } }' "$1" | LC_ALL=C sort
@@ -0,0 +1,165 @@
+#include "universes.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+
+#include "MCNPInput.hpp"
+#include "geometry.hpp"
+#include "options.hpp"
+
+/** Ordering for buildable universes: most expensive first, ties broken by universe number */
+class CostOrder{
+  std::map<int,double>& costs;
+public:
+  CostOrder( std::map<int,double>& costs_p ) : costs(costs_p) {}
+  bool operator()( int a, int b ) const {
+    if( costs[a] != costs[b] ) return costs[a] > costs[b];
+    return a < b;
+  }
+};
+
+UniverseGraph::UniverseGraph( InputDeck& deck_p ) :
+  deck( deck_p )
+{
+
+  // find every universe reachable from universe 0
+  std::vector<int> queue( 1, 0 );
+  std::set<int> reached;
+  reached.insert( 0 );
+  for( size_t i = 0; i < queue.size(); ++i ){
+    int u = queue[i];
+    findUses( u );
+    std::map<int,double>& u_uses = uses[u];
+    for( std::map<int,double>::iterator j = u_uses.begin(); j != u_uses.end(); ++j ){
+      if( reached.insert( (*j).first ).second ){
+        queue.push_back( (*j).first );
+      }
+    }
+  }
+
+  std::set<int> in_progress;
+  computeCost( 0, in_progress );
+
+  for( size_t i = 0; i < queue.size(); ++i ){
+    int u = queue[i];
+    std::set<int> seen;
+    expandDependencies( u, dependencies[u], seen );
+
+    if( u != 0 && !isLatticeUniverse( u ) && own_cells[u] > 0 ){
+      buildable.push_back( u );
+    }
+  }
+
+  // only buildable universes can be waited upon
+  std::set<int> buildable_set( buildable.begin(), buildable.end() );
+  for( std::map< int, std::set<int> >::iterator i = dependencies.begin(); i != dependencies.end(); ++i ){
+    std::set<int> deps;
+    std::set_intersection( (*i).second.begin(), (*i).second.end(), buildable_set.begin(), buildable_set.end(),
+                           std::inserter( deps, deps.begin() ) );
+    (*i).second.swap( deps );
+  }
+
+  std::sort( buildable.begin(), buildable.end(), CostOrder( costs ) );
+
+  if( OPT_DEBUG ){
+    for( size_t i = 0; i < buildable.size(); ++i ){
+      int u = buildable[i];
+      std::cout << "Universe " << u << ": estimated cost " << costs[u] << ", depends on";
+      for( std::set<int>::iterator j = dependencies[u].begin(); j != dependencies[u].end(); ++j ){
+        std::cout << " " << *j;
+      }
+      std::cout << std::endl;
+    }
+  }
+}
+
+bool UniverseGraph::isLatticeUniverse( int universe ){
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  return cells.size() == 1 && cells[0]->isLattice();
+}
+
+/** Count the cells of a universe, and the universes filling them */
+void UniverseGraph::findUses( int universe ){
+
+  InputDeck::cell_card_list cells = deck.getCellsOfUniverse( universe );
+  double& count = own_cells[universe];
+  std::map<int,double>& u_uses = uses[universe];
+
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i != cells.end(); ++i ){
+    CellCard* cell = *i;
+
+    if( cell->isLattice() ){
+      const Lattice& lattice = cell->getLattice();
+      int self = std::abs( cell->getUniverse() );
+
+      if( lattice.isFixedSize() ){
+        irange xr = lattice.getXRange(), yr = lattice.getYRange(), zr = lattice.getZRange();
+        for( int x = xr.first; x <= xr.second; ++x ){
+          for( int y = yr.first; y <= yr.second; ++y ){
+            for( int z = zr.first; z <= zr.second; ++z ){
+              int v = std::abs( lattice.getFillForNode( x, y, z ).getFillingUniverse() );
+              if( v == self ) count += 1;
+              else if( v != 0 ) u_uses[v] += 1;
+            }
+          }
+        }
+      }
+      else{
+        // the extent of an infinite lattice is not known until it is built,
+        // so it is counted as a single node
+        int v = std::abs( lattice.getFillForNode( 0, 0, 0 ).getFillingUniverse() );
+        if( v == self ) count += 1;
+        else if( v != 0 ) u_uses[v] += 1;
+      }
+    }
+    else{
+      count += 1;
+      if( cell->hasFill() ){
+        int v = std::abs( cell->getFill().getOriginNode().getFillingUniverse() );
+        if( v != 0 && v != universe ) u_uses[v] += 1;
+      }
+    }
+  }
+}
+
+/** Collect the buildable universes used by a universe, looking through any lattices */
+void UniverseGraph::expandDependencies( int universe, std::set<int>& deps, std::set<int>& seen ){
+
+  std::map<int,double>& u_uses = uses[universe];
+  for( std::map<int,double>::iterator i = u_uses.begin(); i != u_uses.end(); ++i ){
+    int v = (*i).first;
+    if( !seen.insert( v ).second ) continue;
+
+    if( isLatticeUniverse( v ) ){
+      expandDependencies( v, deps, seen );
+    }
+    else{
+      deps.insert( v );
+    }
+  }
+}
+
+double UniverseGraph::computeCost( int universe, std::set<int>& in_progress ){
+
+  std::map<int,double>::iterator memo = costs.find( universe );
+  if( memo != costs.end() ){
+    return (*memo).second;
+  }
+
+  if( !in_progress.insert( universe ).second ){
+    std::cerr << "Warning: universe " << universe << " appears to contain itself" << std::endl;
+    return 0;
+  }
+
+  double cost = own_cells[universe];
+  std::map<int,double>& u_uses = uses[universe];
+  for( std::map<int,double>::iterator i = u_uses.begin(); i != u_uses.end(); ++i ){
+    cost += (*i).second * computeCost( (*i).first, in_progress );
+  }
+
+  in_progress.erase( universe );
+  costs[universe] = cost;
+  return cost;
+}
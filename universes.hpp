@@ -0,0 +1,57 @@
+#ifndef MCNP2CAD_UNIVERSES_H
+#define MCNP2CAD_UNIVERSES_H
+
+#include <vector>
+#include <set>
+#include <map>
+
+class InputDeck;
+
+/**
+ * The dependency graph of the universes in an input deck.
+ *
+ * A universe depends on each universe that fills one of its cells.  A lattice universe
+ * can only be built inside the particular container it fills, so lattice universes are
+ * not buildable nodes of the graph: a universe filled by a lattice depends instead on
+ * the universes that fill the lattice's nodes.  Universe 0 is the root of the graph.
+ */
+class UniverseGraph{
+
+protected:
+  InputDeck& deck;
+
+  // for each universe: the number of cells it defines directly, and how many times each
+  // universe that fills one of its cells is instantiated within it
+  std::map< int, double > own_cells;
+  std::map< int, std::map<int,double> > uses;
+
+  std::map< int, std::set<int> > dependencies; // buildable universes each universe needs first
+  std::map< int, double > costs;
+  std::vector<int> buildable;
+
+  void findUses( int universe );
+  void expandDependencies( int universe, std::set<int>& deps, std::set<int>& seen );
+  double computeCost( int universe, std::set<int>& in_progress );
+
+public:
+  UniverseGraph( InputDeck& deck_p );
+
+  /// true if the universe consists of a single lattice cell
+  bool isLatticeUniverse( int universe );
+
+  /**
+   * Universes, other than 0, that are used by the geometry and can be built on their own,
+   * independently of the cells they fill.  Listed in order of decreasing estimated cost.
+   */
+  const std::vector<int>& getBuildableUniverses() const { return buildable; }
+
+  /// buildable universes that must be available before the given universe is built
+  const std::set<int>& getDependencies( int universe ) { return dependencies[universe]; }
+
+  /// rough estimate of the relative expense of building a universe, counting every cell
+  /// that will be created within it
+  double getCost( int universe ) { return costs[universe]; }
+
+};
+
+#endif /* MCNP2CAD_UNIVERSES_H */
@@ -3,23 +3,47 @@
 #include <cfloat>
 
 #include <cassert>
+#include <algorithm>
 
 #include "MCNPInput.hpp"
 #include "volumes.hpp"
 #include "geometry.hpp"
 #include "options.hpp"
+#include "profile.hpp"
 
 
 static Vector3d origin(0,0,0);
 
 
+double SurfaceVolume::evaluate( const Vector3d& p ) const {
+  if( transform ){
+    return evaluateLocal( transform->applyInverse( p ) );
+  }
+  return evaluateLocal( p );
+}
+
+/** Distance from p to an axis through center, and p's coordinate along that axis */
+static void axialCoordinates( const Vector3d& p, const Vector3d& center, int axis, double& rho, double& u ){
+  Vector3d d = p.add( -center );
+  u = d.v[axis];
+  d.v[axis] = 0;
+  rho = d.length();
+}
+
+/** Implicit function of the slab 0 <= u <= length, negative inside */
+static double slab( double u, double length ){
+  return std::max( -u, u - length );
+}
+
+#ifndef MCNP2CAD_NO_IGEOM
+
 iBase_EntityHandle makeWorldSphere( iGeom_Instance& igm, double world_size ){
   iBase_EntityHandle world_sphere;
   int igm_result;
   // Note: I tried using createBrick instead of createSphere to bound the universe with a box
   // instead of a sphere.  This worked but led to a substantial increase in run times and
   // memory usage, so should be avoided.
-  iGeom_createSphere( igm, world_size, &world_sphere, &igm_result);
+  PROFILE_IGEOM( "createSphere", iGeom_createSphere( igm, world_size, &world_sphere, &igm_result) );
   CHECK_IGEOM( igm_result, "making world sphere" );
   return world_sphere;
 }
@@ -43,11 +67,11 @@ static iBase_EntityHandle embedWithinWorld( bool positive, iGeom_Instance& igm,
     iBase_EntityHandle world_sphere = makeWorldSphere( igm, world_size );    
     
     if( positive ){
-      iGeom_subtractEnts( igm, world_sphere, body, &final_body, &igm_result);
+      PROFILE_IGEOM( "subtractEnts", iGeom_subtractEnts( igm, world_sphere, body, &final_body, &igm_result) );
       CHECK_IGEOM( igm_result, "making positive body" );
     }
     else{ // !positive && bound_with_world
-      iGeom_intersectEnts( igm, world_sphere, body, &final_body, &igm_result);
+      PROFILE_IGEOM( "intersectEnts", iGeom_intersectEnts( igm, world_sphere, body, &final_body, &igm_result) );
       CHECK_IGEOM( igm_result, "making negative body" );
     }
   }
@@ -61,7 +85,7 @@ iBase_EntityHandle applyTransform( const Transform& t, iGeom_Instance& igm, iBas
   int igm_result;
   if( t.hasRot()  ){
     const Vector3d& axis = t.getAxis();
-    iGeom_rotateEnt( igm, e, t.getTheta(), axis.v[0], axis.v[1], axis.v[2], &igm_result );
+    PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, e, t.getTheta(), axis.v[0], axis.v[1], axis.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "applying rotation" );
   }
   
@@ -70,9 +94,9 @@ iBase_EntityHandle applyTransform( const Transform& t, iGeom_Instance& igm, iBas
       //iGeom_rotateEnt( igm, e, 180, 0, 0, 0, &igm_result );
 
     //if( !t.hasRot() ){
-      iGeom_reflectEnt( igm, e, 0, 0, 0, 0, 0, 1, &igm_result );
-      iGeom_reflectEnt( igm, e, 0, 0, 0, 0, 1, 0, &igm_result );
-      iGeom_reflectEnt( igm, e, 0, 0, 0, 1, 0, 0, &igm_result );
+      PROFILE_IGEOM( "reflectEnt", iGeom_reflectEnt( igm, e, 0, 0, 0, 0, 0, 1, &igm_result ) );
+      PROFILE_IGEOM( "reflectEnt", iGeom_reflectEnt( igm, e, 0, 0, 0, 0, 1, 0, &igm_result ) );
+      PROFILE_IGEOM( "reflectEnt", iGeom_reflectEnt( igm, e, 0, 0, 0, 1, 0, 0, &igm_result ) );
       //}
       //else{
       //   const Vector3d& axis = t.getAxis();
@@ -84,7 +108,7 @@ iBase_EntityHandle applyTransform( const Transform& t, iGeom_Instance& igm, iBas
 
 
   const Vector3d& translation = t.getTranslation();
-  iGeom_moveEnt( igm, e, translation.v[0], translation.v[1], translation.v[2], &igm_result);
+  PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, e, translation.v[0], translation.v[1], translation.v[2], &igm_result) );
   CHECK_IGEOM( igm_result, "applying translation" );
   
   return e;
@@ -96,17 +120,17 @@ iBase_EntityHandle applyReverseTransform( const Transform& tx, iGeom_Instance& i
   Transform rev_t = tx.reverse();
 
   const Vector3d& translation = rev_t.getTranslation();
-  iGeom_moveEnt( igm, e, translation.v[0], translation.v[1], translation.v[2], &igm_result);
+  PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, e, translation.v[0], translation.v[1], translation.v[2], &igm_result) );
   CHECK_IGEOM( igm_result, "applying reverse translation" );
 
   if( rev_t.hasInversion() ){
-    iGeom_rotateEnt( igm, e, 180, 0, 0, 0, &igm_result );
+    PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, e, 180, 0, 0, 0, &igm_result ) );
     CHECK_IGEOM( igm_result, "inverting for reverse transformation" );
   }
 
   if( rev_t.hasRot() ){
     const Vector3d& axis = rev_t.getAxis();
-    iGeom_rotateEnt( igm, e, rev_t.getTheta(), axis.v[0], axis.v[1], axis.v[2], &igm_result );
+    PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, e, rev_t.getTheta(), axis.v[0], axis.v[1], axis.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "applying rotation" );
   }
   
@@ -123,6 +147,67 @@ iBase_EntityHandle SurfaceVolume::define( bool positive, iGeom_Instance& igm, do
   return handle;
 }
 
+/*
+ * The functions above, replayed on a kernel of bounding boxes for --analyze.  They must
+ * make the same calls with the same arguments as the originals, so a change to one of
+ * them, or to any getHandle(), needs the same change to its twin below.
+ */
+
+BoundBox makeWorldSphere( BoxKernel& k, double world_size ){
+  return k.createSphere( world_size );
+}
+
+static BoundBox embedWithinWorld( bool positive, BoxKernel& k, double world_size,
+                                  const BoundBox& body, bool bound_with_world )
+{
+  if( !positive && !bound_with_world ){
+    return body;
+  }
+  BoundBox world_sphere = makeWorldSphere( k, world_size );
+  if( positive ){
+    return k.subtractEnts( world_sphere, body );
+  }
+  BoundBox final_body = body;
+  k.intersectEnts( world_sphere, body, final_body );
+  return final_body;
+}
+
+void applyTransform( const Transform& t, BoxKernel& k, BoundBox& b ){
+  if( t.hasRot() ){
+    const Vector3d& axis = t.getAxis();
+    k.rotateEnt( b, t.getTheta(), axis.v[0], axis.v[1], axis.v[2] );
+  }
+  if( t.hasInversion() ){
+    k.reflectEnt( b, 0, 0, 0, 0, 0, 1 );
+    k.reflectEnt( b, 0, 0, 0, 0, 1, 0 );
+    k.reflectEnt( b, 0, 0, 0, 1, 0, 0 );
+  }
+  const Vector3d& translation = t.getTranslation();
+  k.moveEnt( b, translation.v[0], translation.v[1], translation.v[2] );
+}
+
+void applyReverseTransform( const Transform& tx, BoxKernel& k, BoundBox& b ){
+  Transform rev_t = tx.reverse();
+  const Vector3d& translation = rev_t.getTranslation();
+  k.moveEnt( b, translation.v[0], translation.v[1], translation.v[2] );
+  if( rev_t.hasInversion() ){
+    k.rotateEnt( b, 180, 0, 0, 0 );
+  }
+  if( rev_t.hasRot() ){
+    const Vector3d& axis = rev_t.getAxis();
+    k.rotateEnt( b, rev_t.getTheta(), axis.v[0], axis.v[1], axis.v[2] );
+  }
+}
+
+BoundBox SurfaceVolume::define( bool positive, BoxKernel& k, double world_size ) const {
+  BoundBox box = this->getBox( positive, k, world_size );
+  if( transform ){
+    applyTransform( *transform, k, box );
+  }
+  return box;
+}
+
+#endif /* !MCNP2CAD_NO_IGEOM */
 
 
 class PlaneSurface : public SurfaceVolume { 
@@ -144,20 +229,32 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    return normal.dot( p ) / normal.length() - offset;
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size){
 
     int igm_result;
     iBase_EntityHandle world_sphere = makeWorldSphere(igm, world_size);
     iBase_EntityHandle hemisphere;
     // note the reversal of sense in this call; mcnp and igeom define it differently.
-    iGeom_sectionEnt( igm, world_sphere, 
-                      normal.v[0], normal.v[1], normal.v[2], offset, !positive, &hemisphere, &igm_result);
+    PROFILE_IGEOM( "sectionEnt", iGeom_sectionEnt( igm, world_sphere,
+                                                   normal.v[0], normal.v[1], normal.v[2], offset, !positive,
+                                                   &hemisphere, &igm_result) );
     CHECK_IGEOM( igm_result, "Sectioning world for a plane" );
     return hemisphere;
 
 
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox world_sphere = makeWorldSphere( k, world_size );
+    return k.sectionEnt( world_sphere, normal.v[0], normal.v[1], normal.v[2], offset, !positive );
+  }
+#endif
+
 };
 
 
@@ -192,25 +289,32 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    double rho, u;
+    axialCoordinates( p, center, axis, rho, u );
+    return rho - radius;
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
     int igm_result;
 
     iBase_EntityHandle cylinder;
-    iGeom_createCylinder( igm, 2.0 * world_size, radius, 0, &cylinder, &igm_result);
+    PROFILE_IGEOM( "createCylinder", iGeom_createCylinder( igm, 2.0 * world_size, radius, 0, &cylinder, &igm_result) );
     CHECK_IGEOM( igm_result, "making cylinder" );
 
     
     if( axis == X ){
-      iGeom_rotateEnt( igm, cylinder, 90, 0, 1, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, cylinder, 90, 0, 1, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating cylinder (X)" );
     }
     else if( axis == Y ){
-      iGeom_rotateEnt( igm, cylinder, 90, 1, 0, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, cylinder, 90, 1, 0, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating cylinder (Y)" );
     }
 
     if( onaxis == false ){
-      iGeom_moveEnt( igm, cylinder, center.v[0], center.v[1], center.v[2], &igm_result);
+      PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, cylinder, center.v[0], center.v[1], center.v[2], &igm_result) );
       CHECK_IGEOM( igm_result, "moving cylinder" );
     }
 
@@ -219,6 +323,21 @@ protected:
     return final_cylinder;
   };
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox cylinder = k.createCylinder( 2.0 * world_size, radius, 0 );
+    if( axis == X ){
+      k.rotateEnt( cylinder, 90, 0, 1, 0 );
+    }
+    else if( axis == Y ){
+      k.rotateEnt( cylinder, 90, 1, 0, 0 );
+    }
+    if( onaxis == false ){
+      k.moveEnt( cylinder, center.v[0], center.v[1], center.v[2] );
+    }
+    return embedWithinWorld( positive, k, world_size, cylinder, true );
+  }
+#endif
+
 };
 
 #ifdef HAVE_IGEOM_CONE
@@ -264,6 +383,17 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    // distance from the cone's surface, near it, taken along its slant; a single
+    // nappe excludes the half space behind its apex
+    double rho, u;
+    axialCoordinates( p, center, axis, rho, u );
+    if( nappe == BOTH ){ u = std::fabs( u ); }
+    else if( nappe == LEFT ){ u = -u; }
+    return rho * cos( theta ) - u * sin( theta );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
     double height = (center.length() + world_size);
@@ -280,18 +410,18 @@ protected:
     iBase_EntityHandle cone; 
     
     if( nappe != LEFT){
-      iGeom_createCone( igm, height, base_radius, 0, 0, &right_nappe, &igm_result);
+      PROFILE_IGEOM( "createCone", iGeom_createCone( igm, height, base_radius, 0, 0, &right_nappe, &igm_result) );
       CHECK_IGEOM( igm_result, "making cone (right nappe)" );
-      iGeom_rotateEnt( igm, right_nappe, 180, 1, 0, 0, &igm_result);
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, right_nappe, 180, 1, 0, 0, &igm_result) );
       CHECK_IGEOM( igm_result, "Rotating cone (right nappe)");
-      iGeom_moveEnt( igm, right_nappe, 0, 0, height/2.0, &igm_result );
+      PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, right_nappe, 0, 0, height/2.0, &igm_result ) );
       CHECK_IGEOM( igm_result, "Moving cone (right nappe)");      
       cone = right_nappe;
     }
     if( nappe != RIGHT ){
-      iGeom_createCone( igm, height, base_radius, 0, 0, &left_nappe, &igm_result );
+      PROFILE_IGEOM( "createCone", iGeom_createCone( igm, height, base_radius, 0, 0, &left_nappe, &igm_result ) );
       CHECK_IGEOM( igm_result, "making cone (left nappe)" );
-      iGeom_moveEnt( igm, left_nappe, 0, 0, -height/2.0, &igm_result );
+      PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, left_nappe, 0, 0, -height/2.0, &igm_result ) );
       CHECK_IGEOM( igm_result, "Moving cone (left nappe)" );
       cone = left_nappe;
     }
@@ -299,20 +429,20 @@ protected:
     
     if( right_nappe && left_nappe ){
       iBase_EntityHandle nappes[2] = {right_nappe, left_nappe};
-      iGeom_uniteEnts( igm, nappes, 2, &cone, &igm_result );
+      PROFILE_IGEOM( "uniteEnts", iGeom_uniteEnts( igm, nappes, 2, &cone, &igm_result ) );
       CHECK_IGEOM( igm_result, "Unioning cone nappes" );
     }
 
     if( axis == X ){
-      iGeom_rotateEnt( igm, cone, 90, 0, 1, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, cone, 90, 0, 1, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating cone (X)" );
     }
     else if( axis == Y ){
-      iGeom_rotateEnt( igm, cone, -90, 1, 0, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, cone, -90, 1, 0, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating cone (Y)" );
     }
 
-    iGeom_moveEnt( igm, cone, center.v[0], center.v[1], center.v[2], &igm_result);
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, cone, center.v[0], center.v[1], center.v[2], &igm_result) );
     CHECK_IGEOM( igm_result, "moving cone to its apex" );
 
     iBase_EntityHandle final_cone = embedWithinWorld( positive, igm, world_size, cone, true );
@@ -321,6 +451,37 @@ protected:
 
     }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    double height = (center.length() + world_size);
+    double base_radius = height * tan( theta );
+
+    BoundBox right_nappe, left_nappe, cone;
+    if( nappe != LEFT ){
+      right_nappe = k.createCone( height, base_radius, 0, 0 );
+      k.rotateEnt( right_nappe, 180, 1, 0, 0 );
+      k.moveEnt( right_nappe, 0, 0, height/2.0 );
+      cone = right_nappe;
+    }
+    if( nappe != RIGHT ){
+      left_nappe = k.createCone( height, base_radius, 0, 0 );
+      k.moveEnt( left_nappe, 0, 0, -height/2.0 );
+      cone = left_nappe;
+    }
+    if( nappe == BOTH ){
+      cone = k.uniteEnts( right_nappe, left_nappe );
+    }
+
+    if( axis == X ){
+      k.rotateEnt( cone, 90, 0, 1, 0 );
+    }
+    else if( axis == Y ){
+      k.rotateEnt( cone, -90, 1, 0, 0 );
+    }
+    k.moveEnt( cone, center.v[0], center.v[1], center.v[2] );
+    return embedWithinWorld( positive, k, world_size, cone, true );
+  }
+#endif
+
 };
 
 #endif /* HAVE_IGEOM_CONE */
@@ -344,31 +505,41 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    // the elliptical cross section is measured in units of its smaller radius
+    double rho, u;
+    axialCoordinates( p, center, axis, rho, u );
+    double a = ( rho - radius ) / ellipse_perp_rad;
+    double b = u / ellipse_axis_rad;
+    return std::min( ellipse_axis_rad, ellipse_perp_rad ) * ( sqrt( a*a + b*b ) - 1.0 );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
     int igm_result;
 
     iBase_EntityHandle torus;
 
-    iGeom_createTorus( igm, radius, ellipse_perp_rad, &torus, &igm_result );
+    PROFILE_IGEOM( "createTorus", iGeom_createTorus( igm, radius, ellipse_perp_rad, &torus, &igm_result ) );
     CHECK_IGEOM( igm_result, "Creating initial torus");
 
     if( ellipse_axis_rad != ellipse_perp_rad ){
       double scalef = ellipse_axis_rad / ellipse_perp_rad;
-      iGeom_scaleEnt( igm, torus, 0, 0, 0, 1.0, 1.0, scalef, &igm_result );
+      PROFILE_IGEOM( "scaleEnt", iGeom_scaleEnt( igm, torus, 0, 0, 0, 1.0, 1.0, scalef, &igm_result ) );
       CHECK_IGEOM( igm_result, "Scaling torus" );
     }
     
     if( axis == X ){
-      iGeom_rotateEnt( igm, torus, 90, 0, 1, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, torus, 90, 0, 1, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating torus (X)" );
     }
     else if( axis == Y ){
-      iGeom_rotateEnt( igm, torus, -90, 1, 0, 0, &igm_result );
+      PROFILE_IGEOM( "rotateEnt", iGeom_rotateEnt( igm, torus, -90, 1, 0, 0, &igm_result ) );
       CHECK_IGEOM( igm_result, "rotating torus (Y)" );
     }
 
-    iGeom_moveEnt( igm, torus, center.v[0], center.v[1], center.v[2], &igm_result);
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, torus, center.v[0], center.v[1], center.v[2], &igm_result) );
     CHECK_IGEOM( igm_result, "moving torus to its center point" );
     
     
@@ -378,6 +549,23 @@ protected:
 
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox torus = k.createTorus( radius, ellipse_perp_rad );
+    if( ellipse_axis_rad != ellipse_perp_rad ){
+      double scalef = ellipse_axis_rad / ellipse_perp_rad;
+      k.scaleEnt( torus, 0, 0, 0, 1.0, 1.0, scalef );
+    }
+    if( axis == X ){
+      k.rotateEnt( torus, 90, 0, 1, 0 );
+    }
+    else if( axis == Y ){
+      k.rotateEnt( torus, -90, 1, 0, 0 );
+    }
+    k.moveEnt( torus, center.v[0], center.v[1], center.v[2] );
+    return embedWithinWorld( positive, k, world_size, torus, false );
+  }
+#endif
+
 };
 
 class SphereSurface : public SurfaceVolume {
@@ -398,15 +586,20 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    return p.add( -center ).length() - radius;
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
     int igm_result;
     iBase_EntityHandle sphere;
 
-    iGeom_createSphere( igm, radius, &sphere, &igm_result);
+    PROFILE_IGEOM( "createSphere", iGeom_createSphere( igm, radius, &sphere, &igm_result) );
     CHECK_IGEOM( igm_result, "making sphere" );
 
-    iGeom_moveEnt( igm, sphere, center.v[0], center.v[1], center.v[2], &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, sphere, center.v[0], center.v[1], center.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "moving sphere" );
 
 
@@ -415,6 +608,13 @@ protected:
     return final_sphere; 
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox sphere = k.createSphere( radius );
+    k.moveEnt( sphere, center.v[0], center.v[1], center.v[2] );
+    return embedWithinWorld( positive, k, world_size, sphere, false );
+  }
+#endif
+
 };
 
 class EllipsoidSurface : public SurfaceVolume {
@@ -435,19 +635,29 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d d = p.add( -center );
+    double r = 0, min_axis_sq = 1.0 / std::max( axes.v[0], std::max( axes.v[1], axes.v[2] ) );
+    for( int i = 0; i < 3; ++i ){
+      r += axes.v[i] * d.v[i] * d.v[i];
+    }
+    return sqrt( min_axis_sq ) * ( sqrt( r ) - 1.0 );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
     int igm_result;
     iBase_EntityHandle sphere;
     double radius = 1;
 
-    iGeom_createSphere( igm, radius, &sphere, &igm_result);
+    PROFILE_IGEOM( "createSphere", iGeom_createSphere( igm, radius, &sphere, &igm_result) );
     CHECK_IGEOM( igm_result, "making sphere" );
 
-    iGeom_scaleEnt( igm, sphere, 0, 0, 0, sqrt(1/axes.v[0]), sqrt(1/axes.v[1]), sqrt(1/axes.v[2]), &igm_result);
+    PROFILE_IGEOM( "scaleEnt", iGeom_scaleEnt( igm, sphere, 0, 0, 0, sqrt(1/axes.v[0]), sqrt(1/axes.v[1]), sqrt(1/axes.v[2]), &igm_result) );
     CHECK_IGEOM( igm_result, "scaling sphere to ellipsoid" );
 
-    iGeom_moveEnt( igm, sphere, center.v[0], center.v[1], center.v[2], &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, sphere, center.v[0], center.v[1], center.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "moving sphere" );
 
 
@@ -456,6 +666,15 @@ protected:
     return final_sphere; 
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    double radius = 1;
+    BoundBox sphere = k.createSphere( radius );
+    k.scaleEnt( sphere, 0, 0, 0, sqrt(1/axes.v[0]), sqrt(1/axes.v[1]), sqrt(1/axes.v[2]) );
+    k.moveEnt( sphere, center.v[0], center.v[1], center.v[2] );
+    return embedWithinWorld( positive, k, world_size, sphere, false );
+  }
+#endif
+
 };
 
 
@@ -513,17 +732,24 @@ public:
   }
   
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = transform.applyInverse( p );
+    return std::max( slab( q.v[0], dimensions.v[0] ), 
+                     std::max( slab( q.v[1], dimensions.v[1] ), slab( q.v[2], dimensions.v[2] ) ) );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
 
     int igm_result;
     iBase_EntityHandle box;
 
-    iGeom_createBrick( igm, dimensions.v[0], dimensions.v[1], dimensions.v[2], &box, &igm_result );
+    PROFILE_IGEOM( "createBrick", iGeom_createBrick( igm, dimensions.v[0], dimensions.v[1], dimensions.v[2], &box, &igm_result ) );
     CHECK_IGEOM( igm_result, "making box" );
 
     Vector3d halfdim = dimensions.scale( 1.0 / 2.0 );
-    iGeom_moveEnt( igm, box, halfdim.v[0], halfdim.v[1], halfdim.v[2], &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, box, halfdim.v[0], halfdim.v[1], halfdim.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "moving box (halfdim)" );
 
     box = applyTransform( transform, igm, box );
@@ -532,6 +758,15 @@ protected:
     return final_box;
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox box = k.createBrick( dimensions.v[0], dimensions.v[1], dimensions.v[2] );
+    Vector3d halfdim = dimensions.scale( 1.0 / 2.0 );
+    k.moveEnt( box, halfdim.v[0], halfdim.v[1], halfdim.v[2] );
+    applyTransform( transform, k, box );
+    return embedWithinWorld( positive, k, world_size, box, false );
+  }
+#endif
+
 };
 
 
@@ -555,21 +790,35 @@ public:
   }
   
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = p.add( -center_offset ) + dimensions.scale( 0.5 );
+    return std::max( slab( q.v[0], dimensions.v[0] ), 
+                     std::max( slab( q.v[1], dimensions.v[1] ), slab( q.v[2], dimensions.v[2] ) ) );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
 
     int igm_result;
     iBase_EntityHandle rpp;
 
-    iGeom_createBrick( igm, dimensions.v[0], dimensions.v[1], dimensions.v[2], &rpp, &igm_result );
+    PROFILE_IGEOM( "createBrick", iGeom_createBrick( igm, dimensions.v[0], dimensions.v[1], dimensions.v[2], &rpp, &igm_result ) );
     CHECK_IGEOM( igm_result, "making rpp" );
 
-    iGeom_moveEnt( igm, rpp, center_offset.v[0], center_offset.v[1], center_offset.v[2], &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, rpp, center_offset.v[0], center_offset.v[1], center_offset.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "moving rpp" );
 
     iBase_EntityHandle final_rpp = embedWithinWorld( positive, igm, world_size, rpp, false );
     return final_rpp;
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox rpp = k.createBrick( dimensions.v[0], dimensions.v[1], dimensions.v[2] );
+    k.moveEnt( rpp, center_offset.v[0], center_offset.v[1], center_offset.v[2] );
+    return embedWithinWorld( positive, k, world_size, rpp, false );
+  }
+#endif
+
 };
 
 
@@ -596,22 +845,39 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = transform.applyInverse( p );
+    double a = q.v[0] / radius1, b = q.v[1] / radius2;
+    double side = std::min( radius1, radius2 ) * ( sqrt( a*a + b*b ) - 1.0 );
+    return std::max( side, slab( q.v[2], length ) );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
     int igm_result;
     iBase_EntityHandle rec;
     
-    iGeom_createCylinder( igm, length, radius1, radius2, &rec, &igm_result );
+    PROFILE_IGEOM( "createCylinder", iGeom_createCylinder( igm, length, radius1, radius2, &rec, &igm_result ) );
     CHECK_IGEOM( igm_result, "creating rec" );
     
 
     double movement_factor = length / 2.0;
-    iGeom_moveEnt( igm, rec, 0, 0, movement_factor, &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, rec, 0, 0, movement_factor, &igm_result ) );
     CHECK_IGEOM( igm_result, "moving rec" );
     
     rec = applyTransform( transform, igm, rec );
     iBase_EntityHandle final_rec = embedWithinWorld( positive, igm, world_size, rec, false );
     return final_rec;
   }
+
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox rec = k.createCylinder( length, radius1, radius2 );
+    double movement_factor = length / 2.0;
+    k.moveEnt( rec, 0, 0, movement_factor );
+    applyTransform( transform, k, rec );
+    return embedWithinWorld( positive, k, world_size, rec, false );
+  }
+#endif
 };
 
 
@@ -632,15 +898,22 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = transform.applyInverse( p );
+    double side = sqrt( q.v[0]*q.v[0] + q.v[1]*q.v[1] ) - radius;
+    return std::max( side, slab( q.v[2], length ) );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
     int igm_result;
     iBase_EntityHandle rcc;
 
-    iGeom_createCylinder( igm, length, radius, 0, &rcc, &igm_result );
+    PROFILE_IGEOM( "createCylinder", iGeom_createCylinder( igm, length, radius, 0, &rcc, &igm_result ) );
     CHECK_IGEOM( igm_result, "creating rcc" );
     
     double movement_factor = length / 2.0;
-    iGeom_moveEnt( igm, rcc, 0, 0, movement_factor, &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, rcc, 0, 0, movement_factor, &igm_result ) );
     CHECK_IGEOM( igm_result, "moving rcc" );
 
     rcc = applyTransform( transform, igm, rcc );
@@ -648,6 +921,15 @@ protected:
     return final_rcc;
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox rcc = k.createCylinder( length, radius, 0 );
+    double movement_factor = length / 2.0;
+    k.moveEnt( rcc, 0, 0, movement_factor );
+    applyTransform( transform, k, rcc );
+    return embedWithinWorld( positive, k, world_size, rcc, false );
+  }
+#endif
+
 };
 
 
@@ -670,14 +952,22 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = transform.applyInverse( p );
+    double slope = ( radius2 - radius1 ) / length;
+    double side = ( sqrt( q.v[0]*q.v[0] + q.v[1]*q.v[1] ) - radius1 - slope * q.v[2] ) / sqrt( 1.0 + slope*slope );
+    return std::max( side, slab( q.v[2], length ) );
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
     int igm_result;
     iBase_EntityHandle trc;
 
-    iGeom_createCone( igm, length, radius1, 0, radius2, &trc, &igm_result );
+    PROFILE_IGEOM( "createCone", iGeom_createCone( igm, length, radius1, 0, radius2, &trc, &igm_result ) );
     CHECK_IGEOM( igm_result, "creating trc" );
     
-    iGeom_moveEnt( igm, trc, 0, 0, length / 2.0, &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, trc, 0, 0, length / 2.0, &igm_result ) );
     CHECK_IGEOM( igm_result, "moving trc" );
 
     trc = applyTransform( transform, igm, trc );
@@ -685,6 +975,14 @@ protected:
     return final_trc;
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox trc = k.createCone( length, radius1, 0, radius2 );
+    k.moveEnt( trc, 0, 0, length / 2.0 );
+    applyTransform( transform, k, trc );
+    return embedWithinWorld( positive, k, world_size, trc, false );
+  }
+#endif
+
 };
 #endif
 
@@ -716,6 +1014,18 @@ public:
   }
 
 protected:
+  virtual double evaluateLocal( const Vector3d& p ) const {
+    Vector3d q = p.add( -base_center );
+    double ret = slab( heightV.normalize().dot( q ), heightV.length() );
+    const Vector3d* vec[3] = {&RV, &SV, &TV};
+    for( int i = 0; i < 3; ++i ){
+      double length = vec[i]->length();
+      ret = std::max( ret, std::fabs( vec[i]->dot( q ) ) / length - length );
+    }
+    return ret;
+  }
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ){
     int igm_result;
     iBase_EntityHandle hex;
@@ -723,11 +1033,11 @@ protected:
     hex = makeWorldSphere( igm, world_size );
 
     Vector3d b = - heightV.normalize();
-    iGeom_sectionEnt( igm, hex, b.v[0], b.v[1], b.v[2], 0, true, &hex, &igm_result );
+    PROFILE_IGEOM( "sectionEnt", iGeom_sectionEnt( igm, hex, b.v[0], b.v[1], b.v[2], 0, true, &hex, &igm_result ) );
     CHECK_IGEOM( igm_result, "Sectioning world for a hex (1)" );
 
     b = -b;
-    iGeom_sectionEnt( igm, hex, b.v[0], b.v[1], b.v[2], heightV.length(), true, &hex, &igm_result );
+    PROFILE_IGEOM( "sectionEnt", iGeom_sectionEnt( igm, hex, b.v[0], b.v[1], b.v[2], heightV.length(), true, &hex, &igm_result ) );
     CHECK_IGEOM( igm_result, "Sectioning world for a hex (2)" );
 
 
@@ -738,17 +1048,17 @@ protected:
       double length = v.length(); 
       v = v.normalize();
       
-      iGeom_sectionEnt( igm, hex, v.v[0], v.v[1], v.v[2], length, true, &hex, &igm_result );
+      PROFILE_IGEOM( "sectionEnt", iGeom_sectionEnt( igm, hex, v.v[0], v.v[1], v.v[2], length, true, &hex, &igm_result ) );
       CHECK_IGEOM( igm_result, "Sectioning world for a hex (3)" );
       
       v = -v;
-      iGeom_sectionEnt( igm, hex, v.v[0], v.v[1], v.v[2], length, true, &hex, &igm_result );
+      PROFILE_IGEOM( "sectionEnt", iGeom_sectionEnt( igm, hex, v.v[0], v.v[1], v.v[2], length, true, &hex, &igm_result ) );
       CHECK_IGEOM( igm_result, "Sectioning world for a hex (4)" );
       
 
     }
 
-    iGeom_moveEnt( igm, hex, base_center.v[0], base_center.v[1], base_center.v[2], &igm_result );
+    PROFILE_IGEOM( "moveEnt", iGeom_moveEnt( igm, hex, base_center.v[0], base_center.v[1], base_center.v[2], &igm_result ) );
     CHECK_IGEOM( igm_result, "Moving hex" );
 
     iBase_EntityHandle final_hex = embedWithinWorld( positive, igm, world_size, hex, false );
@@ -756,28 +1066,106 @@ protected:
 
   }
 
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const {
+    BoundBox hex = makeWorldSphere( k, world_size );
+
+    Vector3d b = - heightV.normalize();
+    hex = k.sectionEnt( hex, b.v[0], b.v[1], b.v[2], 0, true );
+    b = -b;
+    hex = k.sectionEnt( hex, b.v[0], b.v[1], b.v[2], heightV.length(), true );
+
+    const Vector3d* vec[3] = {&RV, &SV, &TV};
+    for( int i = 0; i < 3; ++i ){
+      Vector3d v = *(vec[i]);
+      double length = v.length();
+      v = v.normalize();
+      hex = k.sectionEnt( hex, v.v[0], v.v[1], v.v[2], length, true );
+      v = -v;
+      hex = k.sectionEnt( hex, v.v[0], v.v[1], v.v[2], length, true );
+    }
+
+    k.moveEnt( hex, base_center.v[0], base_center.v[1], base_center.v[2] );
+    return embedWithinWorld( positive, k, world_size, hex, false );
+  }
+#endif
+
 };
 
 
+/**
+ * SurfaceVolumes are kept by the content of their cards, not by the cards themselves, so
+ * that they outlive the deck they were made for: a later deck of a batch with the same
+ * surface reuses the same object.  Each cached surface has its own copy of its transform.
+ * Building the key of a card is not free, so the cards of the current deck are also
+ * indexed directly, until forgetCards() is called.
+ */
 class VolumeCache{
 
 protected:
-  std::map<const SurfaceCard*,SurfaceVolume*> mapping;
+  std::map<std::string,SurfaceVolume*> mapping;
+  std::map<const SurfaceCard*,SurfaceVolume*> cards;
+  std::vector<Transform*> transforms;
+
+  static void append( std::string& k, double d ){
+    k.append( reinterpret_cast<const char*>( &d ), sizeof(d) );
+  }
+  static void append( std::string& k, const Vector3d& v ){
+    append( k, v.v[0] ); append( k, v.v[1] ); append( k, v.v[2] );
+  }
 
 public:
   VolumeCache(){}
-  
-  bool contains( const SurfaceCard* c ) const {
-    return ( mapping.find(c) != mapping.end() );
+
+  /// the mnemonic of a card followed by the bytes of its numbers and its transform's
+  static std::string key( const SurfaceCard* c ){
+    std::string k = c->getMnemonic();
+    const std::vector<double>& args = c->getArgs();
+    k.reserve( k.length() + ( args.size() + 9 ) * sizeof(double) );
+    for( size_t i = 0; i < args.size(); ++i ){
+      append( k, args[i] );
+    }
+    if( c->getTransform().hasData() ){
+      const Transform& t = c->getTransform().getData();
+      k += t.hasInversion() ? 'I' : 'T';
+      append( k, t.getTranslation() );
+      if( t.hasRot() ){
+        append( k, t.getTheta() );
+        append( k, t.getAxis() );
+      }
+    }
+    return k;
+  }
+
+  bool contains( const std::string& k ) const {
+    return ( mapping.find(k) != mapping.end() );
+  }
+
+  SurfaceVolume* get( const std::string& k ) {
+    assert( contains( k ) );
+    return (*(mapping.find(k))).second;
+  }
+
+  void insert( const std::string& k, SurfaceVolume* s ){
+    mapping[k] = s;
   }
 
-  SurfaceVolume* get( const SurfaceCard* c ) {
-    assert( contains( c ) );
-    return (*(mapping.find(c))).second;
+  /// the volume made for a card of the current deck, or NULL
+  SurfaceVolume* find( const SurfaceCard* c ) const {
+    std::map<const SurfaceCard*,SurfaceVolume*>::const_iterator i = cards.find( c );
+    return i == cards.end() ? NULL : (*i).second;
   }
 
   void insert( const SurfaceCard* c, SurfaceVolume* s ){
-    mapping[c] = s;
+    cards[c] = s;
+  }
+
+  void forgetCards(){
+    cards.clear();
+  }
+
+  const Transform* keep( const Transform& t ){
+    transforms.push_back( new Transform( t ) );
+    return transforms.back();
   }
 
 };
@@ -807,8 +1195,15 @@ SurfaceVolume& makeSurface( const SurfaceCard* card, VolumeCache* v){
   }
 
   
-  if( cache.contains( card ) ){
-    return *cache.get( card );
+  SurfaceVolume* known = cache.find( card );
+  if( known ){
+    return *known;
+  }
+
+  std::string key = VolumeCache::key( card );
+  if( cache.contains( key ) ){
+    cache.insert( card, cache.get( key ) );
+    return *cache.get( key );
   }
   else{ 
     // SurfaceCard variables:  mnemonic, args, coord_xform  
@@ -1041,10 +1436,10 @@ SurfaceVolume& makeSurface( const SurfaceCard* card, VolumeCache* v){
     }
     
     if( card->getTransform().hasData() ){
-      const Transform& transform = card->getTransform().getData();
-      surface->setTransform( &transform );
+      surface->setTransform( cache.keep( card->getTransform().getData() ) );
     }
     
+    cache.insert( key, surface );
     cache.insert( card, surface );
     return *surface;
     
@@ -1053,4 +1448,57 @@ SurfaceVolume& makeSurface( const SurfaceCard* card, VolumeCache* v){
   
 }
 
+void forgetSurfaceCards(){
+  default_volume_cache.forgetCards();
+}
+
+double estimateWorldSize( InputDeck& deck ){
 
+  double world_size = 0.0;
+
+  InputDeck::cell_card_list    cells     = deck.getCells();
+  InputDeck::surface_card_list surfaces  = deck.getSurfaces();
+  InputDeck::data_card_list    datacards = deck.getDataCards();
+
+  // estimate how large the geometry will need to be to accomodate all the surfaces
+  for( InputDeck::surface_card_list::iterator i = surfaces.begin(); i!=surfaces.end(); ++i){
+    // catch all exceptions from makeSurface at this time; if they exist, they will
+    // more properly be displayed to the user at a later time.  Right now we just want
+    // to estimate a size and failures can be ignored.
+    try{
+      world_size = std::max( world_size, makeSurface( *i ).getFarthestExtentFromOrigin() );
+    } catch(std::runtime_error& e){}
+  }
+
+  // translations can extend the size of the world
+  double translation_addition = 0;
+  for( InputDeck::data_card_list::iterator i = datacards.begin(); i!=datacards.end(); ++i){
+    DataCard* c = *i;
+    if( c->getKind() == DataCard::TR ){
+      double tform_len = dynamic_cast<DataRef<Transform>*>(c)->getData().getTranslation().length();
+      translation_addition = std::max (translation_addition, tform_len );
+    }
+  }
+
+  for( InputDeck::cell_card_list::iterator i = cells.begin(); i!=cells.end(); ++i){
+    CellCard* c = *i;
+      // translations can come from TRCL data
+    if( c->getTrcl().hasData() ){
+      double tform_len = c->getTrcl().getData().getTranslation().length();
+      translation_addition = std::max( translation_addition, tform_len );
+    }
+    // translations can also come from fill nodes.  This implementation does *not* take
+    // lattices into account, as they are assumed to be contained within other volumes.
+    if( c->hasFill() && c->getFill().getOriginNode().hasTransform() ){
+      double tform_len = c->getFill().getOriginNode().getTransform().getTranslation().length();
+      translation_addition = std::max( translation_addition, tform_len );
+    }
+  }
+
+  world_size += translation_addition;
+  world_size *= 1.2;
+
+  std::cout << "World size: " << world_size << " (trs added " << translation_addition << ")" << std::endl;
+  return world_size;
+
+}
@@ -2,11 +2,18 @@
 #define MCNP2CAD_VOLUMES_H
 
 #include <cstdlib>
-#include "iGeom.h"
 
+// Building with MCNP2CAD_NO_IGEOM leaves out everything that needs the iGeom library,
+// keeping only what the native mesher (see mesher.hpp) uses.
+#ifndef MCNP2CAD_NO_IGEOM
+#include "iGeom.h"
+#include "boxkernel.hpp"
+#endif
 
+class Vector3d;
 class Transform;
 class SurfaceCard;
+class InputDeck;
 
 class SurfaceVolume{
 
@@ -22,10 +29,33 @@ public:
   void setTransform( const Transform* transform_p ){ transform = transform_p; }
   
   virtual double getFarthestExtentFromOrigin( ) const = 0;
+
+  /**
+   * Evaluate the implicit function of this surface at a point: negative on the surface's
+   * negative side and positive on its positive side.  The function changes no faster
+   * than the distance to the surface does, so |evaluate(p)| never exceeds that distance.
+   */
+  double evaluate( const Vector3d& p ) const;
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle define( bool positive, iGeom_Instance& igm, double world_size );
 
+  /**
+   * Make the same calls as define() on a kernel of bounding boxes, returning the box
+   * of the body that define() would make
+   */
+  BoundBox define( bool positive, BoxKernel& k, double world_size ) const;
+#endif
+
 protected:
+  /// evaluate() in the surface's own coordinates, before any transform
+  virtual double evaluateLocal( const Vector3d& p ) const = 0;
+
+#ifndef MCNP2CAD_NO_IGEOM
   virtual iBase_EntityHandle getHandle( bool positive, iGeom_Instance& igm, double world_size ) = 0;
+  /// getHandle() on a kernel of bounding boxes
+  virtual BoundBox getBox( bool positive, BoxKernel& k, double world_size ) const = 0;
+#endif
 };
 
 class VolumeCache;
@@ -33,14 +63,28 @@ class VolumeCache;
 /** 
  * Function to create an SurfaceVolume object from a SurfaceCard.
  * Created volumes are kept in a cache.  If the v parameter is null,
- * a default cache (static within volumes.cpp) will be used.  If multiple
- * MCNPInput instances are used in the course of a single program, then
- * there will need to be a way to get multiple VolumeCache objects;
- * that's not an issue right now, so I haven't coded it.
+ * a default cache (static within volumes.cpp) will be used.  Volumes are
+ * cached by the content of their cards, so one made for a deck may be
+ * returned for an identical surface of any deck read later.
  */
 extern 
 SurfaceVolume& makeSurface( const SurfaceCard* card, VolumeCache* v = NULL );
 
+/**
+ * Forget the cards that the default cache's volumes were made for, before the deck that
+ * holds them is deleted.  The volumes stay cached for any later deck with the same surfaces.
+ */
+extern
+void forgetSurfaceCards();
+
+/**
+ * Estimate the half-width of a world large enough to hold every surface in the deck,
+ * allowing for the translations of its transforms.
+ */
+extern
+double estimateWorldSize( InputDeck& deck );
+
+#ifndef MCNP2CAD_NO_IGEOM
 extern 
 iBase_EntityHandle makeWorldSphere( iGeom_Instance& igm, double world_size ); 
 
@@ -50,6 +94,16 @@ iBase_EntityHandle applyTransform( const Transform& t, iGeom_Instance& igm, iBas
 extern
 iBase_EntityHandle applyReverseTransform( const Transform& tx, iGeom_Instance& igm, iBase_EntityHandle& e ) ;
 
+/* the same, on a kernel of bounding boxes */
+extern
+BoundBox makeWorldSphere( BoxKernel& k, double world_size );
+
+extern
+void applyTransform( const Transform& t, BoxKernel& k, BoundBox& b );
+
+extern
+void applyReverseTransform( const Transform& tx, BoxKernel& k, BoundBox& b );
+
 
 
 
@@ -57,13 +111,15 @@ iBase_EntityHandle applyReverseTransform( const Transform& tx, iGeom_Instance& i
 
 // TODO: clean this igeom check function up
 #define CHECK_BUF_SIZE 512
-static char m_buf[CHECK_BUF_SIZE];
 
 #define CHECK_IGEOM(err, msg) \
   do{/*std::cout << msg << std::endl;*/ if((err) != iBase_SUCCESS){     \
     std::cerr << "iGeom error (" << err << "): " << msg << std::endl;   \
+    char m_buf[CHECK_BUF_SIZE];                                         \
     iGeom_getDescription( igm, m_buf, CHECK_BUF_SIZE);                  \
     std::cerr << " * " << m_buf << std::endl;                           \
      } } while(0) 
 
+#endif /* !MCNP2CAD_NO_IGEOM */
+
 #endif /* MCNP2CAD_VOLUMES_H */
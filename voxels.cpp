@@ -0,0 +1,272 @@
+#include "voxels.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#include "MCNPInput.hpp"
+#include "volumes.hpp"
+#include "regions.hpp"
+#include "workers.hpp"
+#include "options.hpp"
+
+static const char voxel_magic[8] = { 'M', 'C', 'N', 'P', 'V', 'O', 'X', '1' };
+
+/** The voxels whose centers lie in an instance's bounding box, as inclusive index ranges */
+struct VoxelRange{
+  int lo[3], hi[3];
+  bool empty;
+};
+
+/**
+ * A grid of voxels and the cell and material found at the center of each.  Instances are
+ * classified one at a time over the voxels of their bounding boxes; a voxel keeps the
+ * first instance found to contain it.
+ */
+class VoxelGrid{
+
+public:
+  int dims[3];
+  Vector3d min, max, size;
+  std::vector<int32_t> cells;
+  std::vector<int32_t> materials;
+  size_t overlaps; // voxels found in more than one instance
+
+  VoxelGrid( const int dims_p[3], const Vector3d& min_p, const Vector3d& max_p ) :
+    min( min_p ), max( max_p ), overlaps( 0 )
+  {
+    for( int k = 0; k < 3; ++k ){
+      dims[k] = dims_p[k];
+      size.v[k] = ( max.v[k] - min.v[k] ) / dims[k];
+    }
+    size_t count = (size_t)dims[0] * dims[1] * dims[2];
+    cells.assign( count, 0 );
+    materials.assign( count, 0 );
+  }
+
+  size_t sliceSize() const { return (size_t)dims[0] * dims[1]; }
+
+  VoxelRange rangeOf( const Vector3d& box_min, const Vector3d& box_max ) const {
+    VoxelRange r;
+    r.empty = false;
+    for( int k = 0; k < 3; ++k ){
+      r.lo[k] = std::max( 0, (int)std::ceil( ( box_min.v[k] - min.v[k] ) / size.v[k] - 0.5 ) );
+      r.hi[k] = std::min( dims[k] - 1, (int)std::floor( ( box_max.v[k] - min.v[k] ) / size.v[k] - 0.5 ) );
+      r.empty = r.empty || r.lo[k] > r.hi[k];
+    }
+    return r;
+  }
+
+  /**
+   * Classify the voxels of one instance within slices [z_begin,z_end).  Rows are walked
+   * along x using the distance bound of the instance's function: every voxel center
+   * closer to a sample than |f| lies on the same side of the boundary, so a whole run of
+   * voxels is settled by one evaluation.
+   */
+  void classify( const CellInstance& instance, const VoxelRange& r, int z_begin, int z_end ){
+    int32_t ident = instance.cell->getIdent();
+    int32_t mat = instance.cell->getMat();
+    z_begin = std::max( z_begin, r.lo[2] );
+    z_end = std::min( z_end, r.hi[2] + 1 );
+
+    for( int z = z_begin; z < z_end; ++z ){
+      for( int y = r.lo[1]; y <= r.hi[1]; ++y ){
+        size_t row = ( (size_t)z * dims[1] + y ) * dims[0];
+        Vector3d p( 0, min.v[1] + ( y + 0.5 ) * size.v[1], min.v[2] + ( z + 0.5 ) * size.v[2] );
+
+        int x = r.lo[0];
+        while( x <= r.hi[0] ){
+          p.v[0] = min.v[0] + ( x + 0.5 ) * size.v[0];
+          double f = instance.evaluate( p );
+          int run = std::max( 1, (int)std::ceil( std::fabs( f ) * ( 1.0 - 1e-9 ) / size.v[0] ) );
+          run = std::min( run, r.hi[0] - x + 1 );
+
+          if( f < 0 ){
+            for( int i = x; i < x + run; ++i ){
+              if( cells[ row + i ] != 0 ){
+                overlaps++;
+                continue;
+              }
+              cells[ row + i ] = ident;
+              materials[ row + i ] = mat;
+            }
+          }
+          x += run;
+        }
+      }
+    }
+  }
+
+  void classifyAll( const std::vector<CellInstance>& instances, const std::vector<VoxelRange>& ranges,
+                    int z_begin, int z_end ){
+    for( size_t i = 0; i < instances.size(); ++i ){
+      if( ranges[i].empty || ranges[i].hi[2] < z_begin || ranges[i].lo[2] >= z_end ) continue;
+      classify( instances[i], ranges[i], z_begin, z_end );
+    }
+  }
+
+};
+
+/** A run of z slices of the grid to be classified in a worker process */
+class VoxelJob : public WorkerJob {
+protected:
+  VoxelGrid& grid;
+  const std::vector<CellInstance>& instances;
+  const std::vector<VoxelRange>& ranges;
+  int z_begin, z_end;
+  std::string filename;
+public:
+  VoxelJob( VoxelGrid& grid_p, const std::vector<CellInstance>& instances_p, const std::vector<VoxelRange>& ranges_p,
+            int z_begin_p, int z_end_p, const std::string& filename_p ) :
+    grid(grid_p), instances(instances_p), ranges(ranges_p), z_begin(z_begin_p), z_end(z_end_p), filename(filename_p)
+  {}
+
+  /// write the slices' cells, materials and overlap count; the grid is the worker's own copy
+  virtual bool run(){
+    grid.classifyAll( instances, ranges, z_begin, z_end );
+    size_t begin = grid.sliceSize() * z_begin, count = grid.sliceSize() * ( z_end - z_begin );
+    std::ofstream out( filename.c_str(), std::ios::binary );
+    out.write( reinterpret_cast<const char*>( &grid.cells[begin] ), count * sizeof(int32_t) );
+    out.write( reinterpret_cast<const char*>( &grid.materials[begin] ), count * sizeof(int32_t) );
+    out.write( reinterpret_cast<const char*>( &grid.overlaps ), sizeof(size_t) );
+    out.close();
+    return !out.fail();
+  }
+};
+
+/** Read a worker's slices back into the grid; false if the file is incomplete */
+static bool readSlices( const std::string& filename, VoxelGrid& grid, int z_begin, int z_end ){
+  size_t begin = grid.sliceSize() * z_begin, count = grid.sliceSize() * ( z_end - z_begin );
+  size_t overlaps = 0;
+  std::ifstream in( filename.c_str(), std::ios::binary );
+  in.read( reinterpret_cast<char*>( &grid.cells[begin] ), count * sizeof(int32_t) );
+  in.read( reinterpret_cast<char*>( &grid.materials[begin] ), count * sizeof(int32_t) );
+  in.read( reinterpret_cast<char*>( &overlaps ), sizeof(size_t) );
+  if( !in.good() ) return false;
+  grid.overlaps += overlaps;
+  return true;
+}
+
+bool writeVoxelMap( InputDeck& deck, const std::vector<int>& dims, const std::string& filename ){
+
+  if( dims.size() != 3 || dims[0] <= 0 || dims[1] <= 0 || dims[2] <= 0 ){
+    std::cerr << "Error: voxel grid dimensions must be three positive numbers, NX,NY,NZ" << std::endl;
+    return false;
+  }
+
+  double world_size = estimateWorldSize( deck );
+  AnalyticGeometry geometry( deck, world_size );
+  geometry.placeCells();
+  const std::vector<CellInstance>& instances = geometry.getInstances();
+
+  // the grid spans the union of the instances' bounding boxes
+  std::vector<Vector3d> box_min( instances.size() ), box_max( instances.size() );
+  std::vector<bool> has_box( instances.size(), false );
+  Vector3d grid_min, grid_max;
+  bool found = false;
+  for( size_t i = 0; i < instances.size(); ++i ){
+    has_box[i] = instances[i].getBounds( box_min[i], box_max[i] );
+    if( !has_box[i] ) continue;
+    for( int k = 0; k < 3; ++k ){
+      grid_min.v[k] = found ? std::min( grid_min.v[k], box_min[i].v[k] ) : box_min[i].v[k];
+      grid_max.v[k] = found ? std::max( grid_max.v[k], box_max[i].v[k] ) : box_max[i].v[k];
+    }
+    found = true;
+  }
+  if( !found ){
+    std::cerr << "Error: no material cells to voxelize" << std::endl;
+    return false;
+  }
+
+  int grid_dims[3] = { dims[0], dims[1], dims[2] };
+  VoxelGrid grid( grid_dims, grid_min, grid_max );
+  std::cout << "Voxel grid: " << dims[0] << "x" << dims[1] << "x" << dims[2] << " from " << grid_min
+            << " to " << grid_max << std::endl;
+
+  std::vector<VoxelRange> ranges( instances.size() );
+  for( size_t i = 0; i < instances.size(); ++i ){
+    if( has_box[i] ){
+      ranges[i] = grid.rangeOf( box_min[i], box_max[i] );
+    }
+    else{
+      ranges[i].empty = true;
+    }
+  }
+
+  int nz = grid_dims[2];
+  if( Gopt.worker_processes > 1 && nz > 1 ){
+
+    int num_jobs = std::min( nz, Gopt.worker_processes * 4 );
+    std::cout << "Classifying " << instances.size() << " cells in " << num_jobs << " jobs with "
+              << Gopt.worker_processes << " worker processes..." << std::endl;
+
+    std::string scratch_dir = makeScratchDirectory( "mcnp2cad-voxels" );
+    std::vector<std::string> files( num_jobs );
+    std::vector<int> starts( num_jobs + 1 );
+    for( int j = 0; j <= num_jobs; ++j ){
+      starts[j] = (int)( (long)nz * j / num_jobs );
+    }
+
+    WorkerPool pool( Gopt.worker_processes );
+    int next = 0;
+    while( next < num_jobs || pool.numRunning() > 0 ){
+      while( next < num_jobs && pool.hasFreeSlot() ){
+        std::stringstream name;
+        name << scratch_dir << "/slices_" << next << ".bin";
+        files[next] = name.str();
+        VoxelJob job( grid, instances, ranges, starts[next], starts[next+1], files[next] );
+        pool.start( next, job );
+        ++next;
+      }
+      if( pool.numRunning() == 0 ) continue;
+
+      bool job_success;
+      pool.waitAny( job_success );
+    }
+
+    for( int j = 0; j < num_jobs; ++j ){
+      if( !readSlices( files[j], grid, starts[j], starts[j+1] ) ){
+        std::cerr << "Warning: voxel job " << j << " failed; its slices will be classified in place." << std::endl;
+        grid.classifyAll( instances, ranges, starts[j], starts[j+1] );
+      }
+    }
+
+    removeScratchDirectory( scratch_dir );
+  }
+  else{
+    std::cout << "Classifying " << instances.size() << " cells..." << std::endl;
+    grid.classifyAll( instances, ranges, 0, nz );
+  }
+
+  size_t filled = grid.cells.size() - std::count( grid.cells.begin(), grid.cells.end(), 0 );
+  if( OPT_VERBOSE ){
+    std::cout << filled << " of " << grid.cells.size() << " voxels are in cells" << std::endl;
+  }
+  if( grid.overlaps ){
+    std::cerr << "Warning: " << grid.overlaps << " voxels are in more than one cell" << std::endl;
+  }
+
+  std::ofstream out( filename.c_str(), std::ios::binary );
+  if( !out.is_open() ){
+    std::cerr << "Error: couldn't open file \"" << filename << "\"" << std::endl;
+    return false;
+  }
+  int32_t header_dims[3] = { dims[0], dims[1], dims[2] };
+  out.write( voxel_magic, sizeof(voxel_magic) );
+  out.write( reinterpret_cast<const char*>( header_dims ), sizeof(header_dims) );
+  out.write( reinterpret_cast<const char*>( grid.min.v ), 3 * sizeof(double) );
+  out.write( reinterpret_cast<const char*>( grid.max.v ), 3 * sizeof(double) );
+  out.write( reinterpret_cast<const char*>( &grid.cells[0] ), grid.cells.size() * sizeof(int32_t) );
+  out.write( reinterpret_cast<const char*>( &grid.materials[0] ), grid.materials.size() * sizeof(int32_t) );
+  out.close();
+
+  bool success = !out.fail();
+  if( success ){
+    std::cout << "Saved file \"" << filename << "\"." << std::endl;
+  }
+  return success;
+
+}
@@ -0,0 +1,27 @@
+#ifndef MCNP2CAD_VOXELS_H
+#define MCNP2CAD_VOXELS_H
+
+#include <vector>
+#include <string>
+
+class InputDeck;
+
+/**
+ * Write a material map of a deck on a regular grid of nx*ny*nz voxels spanning the
+ * bounding box of every material cell, without a CAD kernel.  Each voxel takes the cell
+ * and material of the cell instance containing its center, found from the analytic
+ * definitions of the surfaces; z slabs of the grid are classified in parallel worker
+ * processes if requested.  The file is binary, in the machine's byte order:
+ *
+ *   char    magic[8]       "MCNPVOX1"
+ *   int32   nx, ny, nz
+ *   double  min[3], max[3] corners of the grid
+ *   int32   cell[nx*ny*nz]      cell number, or 0 for a voxel outside every cell
+ *   int32   material[nx*ny*nz]  material number, 0 for void or outside every cell
+ *
+ * with x varying fastest in both arrays.  Returns false if the map could not be built
+ * or written.
+ */
+bool writeVoxelMap( InputDeck& deck, const std::vector<int>& dims, const std::string& filename );
+
+#endif /* MCNP2CAD_VOXELS_H */
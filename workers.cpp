@@ -0,0 +1,217 @@
+#include "workers.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#include "options.hpp"
+#include "profile.hpp"
+
+// a byte is written to this pipe whenever a child exits during WorkerPool::waitAny()
+static int child_pipe[2] = { -1, -1 };
+
+static void noteChildExit( int ){
+  int saved_errno = errno;
+  ssize_t written = write( child_pipe[1], "", 1 );
+  (void)written;
+  errno = saved_errno;
+}
+
+/**
+ * While in scope, wake wait() whenever a child process exits.  The handler is installed
+ * before the caller first looks for exited workers, so an exit between that look and
+ * the wait is not missed.
+ */
+class ChildExitWatch{
+
+protected:
+  struct sigaction saved;
+
+public:
+  ChildExitWatch(){
+    if( child_pipe[0] < 0 ){
+      if( pipe( child_pipe ) != 0 ){
+        throw std::runtime_error( std::string("Error creating a pipe to wait for workers: ") + strerror(errno) );
+      }
+      for( int i = 0; i < 2; ++i ){
+        fcntl( child_pipe[i], F_SETFL, fcntl( child_pipe[i], F_GETFL ) | O_NONBLOCK );
+        fcntl( child_pipe[i], F_SETFD, FD_CLOEXEC );
+      }
+    }
+    struct sigaction action;
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = noteChildExit;
+    sigemptyset( &action.sa_mask );
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction( SIGCHLD, &action, &saved );
+  }
+
+  ~ChildExitWatch(){
+    sigaction( SIGCHLD, &saved, NULL );
+  }
+
+  /// sleep until a child may have exited, or for at most timeout seconds if it is positive
+  void wait( double timeout ){
+    fd_set readable;
+    FD_ZERO( &readable );
+    FD_SET( child_pipe[0], &readable );
+    struct timeval limit;
+    limit.tv_sec = (long)timeout;
+    limit.tv_usec = (long)( ( timeout - limit.tv_sec ) * 1e6 );
+    select( child_pipe[0] + 1, &readable, NULL, NULL, timeout > 0 ? &limit : NULL );
+
+    char buffer[64];
+    while( read( child_pipe[0], buffer, sizeof(buffer) ) > 0 );
+  }
+
+};
+
+bool WorkerPool::start( int job_id, WorkerJob& job, double time_limit ){
+
+  // anything still buffered would otherwise be written twice, once by each process
+  std::cout << std::flush;
+  std::cerr << std::flush;
+
+  pid_t pid = fork();
+  if( pid < 0 ){
+    std::cerr << "Warning: could not fork a worker process: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  if( pid == 0 ){
+    // child process: run the job and exit without running the parent's atexit handlers
+    // or static destructors, which belong to the parent.
+    bool success = false;
+    startWorkerProfile();
+    try{
+      success = job.run();
+    }
+    catch( std::exception& e ){
+      std::cerr << "Error in worker process: " << e.what() << std::endl;
+    }
+    writeProfile();
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    _exit( success ? 0 : 1 );
+  }
+
+  if( OPT_DEBUG ) std::cout << "Started worker " << pid << " for job " << job_id << std::endl;
+  running[pid] = job_id;
+  if( time_limit > 0 ){
+    deadlines[pid] = wallTime() + time_limit;
+  }
+  return true;
+}
+
+pid_t WorkerPool::reapExited( int& status ){
+  for( std::map< pid_t, int >::iterator i = running.begin(); i != running.end(); ++i ){
+    pid_t pid;
+    while( ( pid = waitpid( (*i).first, &status, WNOHANG ) ) < 0 && errno == EINTR );
+    if( pid < 0 ){
+      throw std::runtime_error( std::string("Error waiting for worker processes: ") + strerror(errno) );
+    }
+    if( pid > 0 ) return pid;
+  }
+  return 0;
+}
+
+int WorkerPool::waitAny( bool& success, bool& timed_out ){
+
+  success = timed_out = false;
+  if( running.empty() ) return -1;
+
+  ChildExitWatch watch;
+  while( true ){
+
+    int status;
+    pid_t pid = reapExited( status );
+
+    if( pid == 0 ){
+      // every worker is still running; kill the first one found to be over its time
+      double now = wallTime(), next_deadline = 0;
+      for( std::map< pid_t, double >::iterator i = deadlines.begin(); i != deadlines.end(); ++i ){
+        if( now < (*i).second ){
+          if( next_deadline == 0 || (*i).second < next_deadline ) next_deadline = (*i).second;
+          continue;
+        }
+        pid = (*i).first;
+        kill( pid, SIGKILL );
+        while( waitpid( pid, &status, 0 ) < 0 && errno == EINTR );
+        timed_out = true;
+        break;
+      }
+      if( pid == 0 ){
+        // sleep until a worker exits or the next time limit is reached
+        watch.wait( next_deadline > 0 ? next_deadline - now : 0 );
+        continue;
+      }
+    }
+
+    std::map< pid_t, int >::iterator i = running.find( pid );
+    int job_id = (*i).second;
+    running.erase( i );
+    deadlines.erase( pid );
+    success = !timed_out && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+    if( OPT_DEBUG ) std::cout << "Worker " << pid << " for job " << job_id
+                              << ( timed_out ? " timed out" : success ? " finished" : " failed" ) << std::endl;
+    return job_id;
+  }
+}
+
+std::string makeScratchDirectory( const std::string& prefix ){
+
+  const char* tmpdir = getenv( "TMPDIR" );
+  std::string path = std::string( tmpdir ? tmpdir : "/tmp" ) + "/" + prefix + "XXXXXX";
+
+  std::vector<char> buf( path.begin(), path.end() );
+  buf.push_back( '\0' );
+  if( mkdtemp( &(buf[0]) ) == NULL ){
+    throw std::runtime_error( "Could not create a temporary directory " + path + ": " + strerror(errno) );
+  }
+  return std::string( &(buf[0]) );
+}
+
+void removeScratchDirectory( const std::string& path ){
+
+  DIR* dir = opendir( path.c_str() );
+  if( !dir ) return;
+
+  struct dirent* entry;
+  while( (entry = readdir( dir )) != NULL ){
+    std::string name = entry->d_name;
+    if( name == "." || name == ".." ) continue;
+    std::string file = path + "/" + name;
+    if( unlink( file.c_str() ) != 0 ){
+      std::cerr << "Warning: could not remove temporary file " << file << std::endl;
+    }
+  }
+  closedir( dir );
+
+  if( rmdir( path.c_str() ) != 0 ){
+    std::cerr << "Warning: could not remove temporary directory " << path << std::endl;
+  }
+}
+
+bool prepareDirectory( const std::string& path, const std::string& purpose ){
+  if( mkdir( path.c_str(), 0777 ) != 0 && errno != EEXIST ){
+    std::cerr << "Error: could not create " << purpose << " directory " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  if( access( path.c_str(), W_OK ) != 0 ){
+    std::cerr << "Error: cannot write to " << purpose << " directory " << path << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef MCNP2CAD_WORKERS_H
+#define MCNP2CAD_WORKERS_H
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * A unit of work to be run in a forked worker process.  run() is called in the child
+ * process only, and its return value becomes the child's exit status.
+ */
+class WorkerJob{
+public:
+  virtual ~WorkerJob(){}
+  virtual bool run() = 0;
+};
+
+/**
+ * A bounded pool of forked worker processes.  Each worker runs a single job and exits;
+ * results are passed back to the parent through files, so the only thing the pool
+ * reports is whether each job succeeded.  A job may be given a time limit, after which
+ * its worker is killed.
+ */
+class WorkerPool{
+
+protected:
+  int max_workers;
+  std::map< pid_t, int > running; // pid -> job id
+  std::map< pid_t, double > deadlines; // pid -> wallTime() by which it must finish
+
+  /// reap one of this pool's workers that has exited; returns its pid, or 0 if none has
+  pid_t reapExited( int& status );
+
+public:
+  WorkerPool( int max_workers_p ) :
+    max_workers( max_workers_p < 1 ? 1 : max_workers_p )
+  {}
+
+  bool hasFreeSlot() const { return running.size() < (size_t)max_workers; }
+  size_t numRunning() const { return running.size(); }
+
+  /**
+   * fork a worker to run the job; returns false if the fork failed.  If time_limit is
+   * positive, the worker is killed once it has run for that many seconds.
+   */
+  bool start( int job_id, WorkerJob& job, double time_limit = 0 );
+
+  /**
+   * wait for any running worker to exit; returns its job id, or -1 if none are running.
+   * Only the pool's own workers are reaped, so other children of the process keep
+   * their exit statuses for whoever started them.
+   */
+  int waitAny( bool& success ){
+    bool timed_out;
+    return waitAny( success, timed_out );
+  }
+
+  /// as above, also reporting whether the worker was killed for exceeding its time limit
+  int waitAny( bool& success, bool& timed_out );
+
+};
+
+/// create a new, uniquely named directory for temporary files; returns its path
+std::string makeScratchDirectory( const std::string& prefix );
+
+/// remove a directory created by makeScratchDirectory, along with all the files in it
+void removeScratchDirectory( const std::string& path );
+
+/**
+ * Create a directory that is kept between runs, such as the checkpoint directory, if it
+ * does not exist.  Returns false, having printed an error naming its purpose, if it
+ * cannot be created or written to.
+ */
+bool prepareDirectory( const std::string& path, const std::string& purpose );
+
+#endif /* MCNP2CAD_WORKERS_H */